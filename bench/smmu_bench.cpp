@@ -0,0 +1,661 @@
+// SMMU 微基準測試程序
+// 使用 Google Benchmark 測量 TLB 命中、頁表遍歷、嵌套轉換、無效化、混合頁面大小、順序掃描預取、連續頁面合併、TLB 分區、遍歷器內存讀取路徑、插樁開銷、頁表構建、描述符批量解碼、批量遍歷和快照預熱的性能
+//
+// 運行：make bench
+// 機器可讀輸出：./bin/smmu_bench --benchmark_format=json
+//            或 --benchmark_out=results.json --benchmark_out_format=json
+
+#include "smmu.h"
+#include "page_table_builder.h"
+#include "allocation_counter.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace smmu;
+
+namespace {
+
+// ============================================================================
+// 頁表寫入輔助
+// 4KB 粒度、4 級頁表，按需分配中間級別的表；逐個寫入描述符，可以指定葉子級別和附加屬性
+// ============================================================================
+
+constexpr uint64_t ADDR_MASK = 0x0000FFFFFFFFF000ULL;
+constexpr uint64_t NORMAL_RW_AF = 0x400 | (0x4 << 2);  // AF=1，Normal WB，讀寫
+
+class PageTableWriter {
+public:
+    explicit PageTableWriter(SimpleMemoryModel& memory)
+        : memory_(memory), root_(memory.allocate_page()), tables_{root_} {}
+
+    PhysicalAddress root() const { return root_; }
+
+    // 已分配的所有表頁面（包括根表）
+    const std::vector<PhysicalAddress>& tables() const { return tables_; }
+
+    // 映射一個葉子：level 3 = 4KB 頁，level 2 = 2MB 塊，level 1 = 1GB 塊
+    // extra_attrs 附加到葉子描述符（例如連續位）
+    void map(VirtualAddress va, PhysicalAddress pa, uint8_t leaf_level = 3,
+             uint64_t extra_attrs = 0) {
+        PhysicalAddress table = root_;
+        for (uint8_t level = 0; level < leaf_level; level++) {
+            PhysicalAddress entry = table + index(va, level) * 8;
+            uint64_t desc = 0;
+            memory_.read(entry, &desc, 8);
+            if ((desc & 1) == 0) {
+                tables_.push_back(memory_.allocate_page());
+                desc = tables_.back() | 0x3;
+                memory_.write_pte(entry, desc);
+            }
+            table = desc & ADDR_MASK;
+        }
+        uint64_t type_bits = (leaf_level == 3) ? 0x3 : 0x1;  // 頁描述符 / 塊描述符
+        memory_.write_pte(table + index(va, leaf_level) * 8,
+                          (pa & ADDR_MASK) | NORMAL_RW_AF | type_bits | extra_attrs);
+    }
+
+private:
+    static uint64_t index(VirtualAddress va, uint8_t level) {
+        return (va >> (12 + (3 - level) * 9)) & 0x1FF;
+    }
+
+    SimpleMemoryModel& memory_;
+    PhysicalAddress root_;
+    std::vector<PhysicalAddress> tables_;
+};
+
+// ============================================================================
+// 基準測試環境
+// 一個流（StreamID 0，ASID 1）映射 pages 個 4KB 頁面
+// ============================================================================
+
+constexpr VirtualAddress VA_BASE = 0x10000000;
+constexpr PhysicalAddress PA_BASE = 0x80000000;
+
+struct Fixture {
+    std::shared_ptr<SimpleMemoryModel> memory;
+    std::unique_ptr<SMMU> smmu;
+    std::unique_ptr<PageTableWriter> s1;
+
+    explicit Fixture(const SMMUConfig& config) {
+        memory = std::make_shared<SimpleMemoryModel>();
+        smmu = std::make_unique<SMMU>(config);
+        smmu->set_memory_model(memory);
+        s1 = std::make_unique<PageTableWriter>(*memory);
+    }
+
+    // 配置階段1（以及可選的階段2）並啟用 SMMU
+    void enable(const PageTableWriter* s2 = nullptr) {
+        StreamTableEntry ste;
+        ste.valid = true;
+        ste.s1_enabled = true;
+        if (s2) {
+            ste.s2_enabled = true;
+            ste.s2_translation_table_base = s2->root();
+            ste.s2_granule = 12;
+            ste.vmid = 1;
+        }
+        smmu->configure_stream_table_entry(0, ste);
+
+        ContextDescriptor cd;
+        cd.valid = true;
+        cd.translation_table_base = s1->root();
+        cd.translation_granule = 12;
+        cd.ips = 48;
+        cd.asid = 1;
+        smmu->configure_context_descriptor(0, 1, cd);
+        smmu->enable();
+    }
+
+    void map_pages(size_t pages, uint64_t extra_attrs = 0) {
+        for (size_t i = 0; i < pages; i++) {
+            s1->map(VA_BASE + i * 0x1000, PA_BASE + i * 0x1000, 3, extra_attrs);
+        }
+    }
+};
+
+SMMUConfig make_config(size_t tlb_size, size_t walk_cache_size = 16) {
+    SMMUConfig config;
+    config.tlb_size = tlb_size;
+    config.walk_cache_size = walk_cache_size;
+    return config;
+}
+
+// 固定種子的隨機訪問序列（頁內偏移按 64 字節對齊）
+std::vector<VirtualAddress> random_addresses(size_t pages, size_t count, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<VirtualAddress> vas(count);
+    for (auto& va : vas) {
+        va = VA_BASE + (rng() % pages) * 0x1000 + (rng() % 64) * 64;
+    }
+    return vas;
+}
+
+// 記錄命中率和每次轉換的描述符讀取數
+void report(benchmark::State& state, const SMMU& smmu) {
+    auto stats = smmu.get_statistics();
+    uint64_t lookups = stats.tlb_hits + stats.tlb_misses;
+    state.counters["tlb_hit_rate"] = lookups ? static_cast<double>(stats.tlb_hits) / lookups : 0.0;
+    state.counters["desc_reads_per_op"] =
+        lookups ? static_cast<double>(stats.descriptor_reads) / lookups : 0.0;
+    state.SetItemsProcessed(state.iterations());
+}
+
+// ============================================================================
+// TLB 命中：工作集不超過 TLB 容量，預熱後全部命中；allocs_per_op 為每次轉換的堆分配次數
+// 參數：TLB 大小，工作集頁數
+// ============================================================================
+
+void BM_TLBHit(benchmark::State& state) {
+    size_t tlb_size = static_cast<size_t>(state.range(0));
+    size_t pages = static_cast<size_t>(state.range(1));
+
+    Fixture f(make_config(tlb_size));
+    f.map_pages(pages);
+    f.enable();
+
+    auto vas = random_addresses(pages, 4096, 1);
+    for (size_t i = 0; i < pages; i++) f.smmu->translate(VA_BASE + i * 0x1000, 0, 1, 0);
+    f.smmu->reset_statistics();
+
+    size_t i = 0;
+    size_t allocations = allocation_count();
+    for (auto _ : state) {
+        auto result = f.smmu->translate(vas[i++ & 4095], 0, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+    }
+    allocations = allocation_count() - allocations;
+    report(state, *f.smmu);
+    state.counters["allocs_per_op"] =
+        static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_TLBHit)
+    ->ArgNames({"tlb", "pages"})
+    ->Args({64, 16})->Args({64, 64})
+    ->Args({512, 64})->Args({512, 512})
+    ->Args({4096, 512})->Args({4096, 4096});
+
+// ============================================================================
+// TLB 未命中 + 4 級頁表遍歷：循環訪問遠大於 TLB 的工作集，LRU 下每次都未命中
+// 參數：工作集頁數，頁表遍歷緩存每級表項數（0 = 禁用）
+// ============================================================================
+
+void BM_TLBMissWalk(benchmark::State& state) {
+    size_t pages = static_cast<size_t>(state.range(0));
+    size_t walk_cache = static_cast<size_t>(state.range(1));
+
+    Fixture f(make_config(16, walk_cache));
+    f.map_pages(pages);
+    f.enable();
+
+    size_t i = 0;
+    for (auto _ : state) {
+        VirtualAddress va = VA_BASE + (i++ % pages) * 0x1000;
+        auto result = f.smmu->translate(va, 0, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+    }
+    report(state, *f.smmu);
+}
+BENCHMARK(BM_TLBMissWalk)
+    ->ArgNames({"pages", "walk_cache"})
+    ->Args({1024, 0})->Args({1024, 16})
+    ->Args({65536, 0})->Args({65536, 16});
+
+// ============================================================================
+// 階段1+2 嵌套轉換（TLB 未命中）：階段1各級表地址和輸出的 IPA 都經過階段2
+// 參數：工作集頁數，階段2 TLB 大小（0 = 禁用）
+// ============================================================================
+
+void BM_NestedWalk(benchmark::State& state) {
+    size_t pages = static_cast<size_t>(state.range(0));
+
+    SMMUConfig config = make_config(16);
+    config.s2_tlb_size = static_cast<size_t>(state.range(1));
+    Fixture f(config);
+    PageTableWriter s2(*f.memory);
+    constexpr PhysicalAddress IPA_BASE = 0x40000000;
+    for (size_t p = 0; p < pages; p++) {
+        f.s1->map(VA_BASE + p * 0x1000, IPA_BASE + p * 0x1000);
+        s2.map(IPA_BASE + p * 0x1000, PA_BASE + p * 0x1000);
+    }
+    // 階段1表位於 IPA 空間：表頁面在階段2中恆等映射
+    for (PhysicalAddress table : f.s1->tables()) s2.map(table, table);
+    f.enable(&s2);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        VirtualAddress va = VA_BASE + (i++ % pages) * 0x1000;
+        auto result = f.smmu->translate(va, 0, 1, 1);
+        benchmark::DoNotOptimize(result.physical_addr);
+    }
+    report(state, *f.smmu);
+    auto stats = f.smmu->get_statistics();
+    uint64_t s2_lookups = stats.s2_tlb_hits + stats.s2_tlb_misses;
+    state.counters["s2_tlb_hit_rate"] =
+        s2_lookups ? static_cast<double>(stats.s2_tlb_hits) / s2_lookups : 0.0;
+}
+BENCHMARK(BM_NestedWalk)->ArgNames({"pages", "s2_tlb"})
+    ->Args({1024, 0})->Args({1024, 64})
+    ->Args({65536, 0})->Args({65536, 64});
+
+// ============================================================================
+// 按 ASID 無效化：TLB 已滿，表項平均分佈在若干 ASID 中，
+// 每次無效化其中一個 ASID 後（不計時）重新填回
+// 參數：TLB 大小，組織方式（0 = 全相聯，1 = 8 路組相聯），ASID 數量
+// ============================================================================
+
+void BM_InvalidateByASID(benchmark::State& state) {
+    size_t tlb_size = static_cast<size_t>(state.range(0));
+    bool set_assoc = state.range(1) != 0;
+    const ASID NUM_ASIDS = static_cast<ASID>(state.range(2));
+
+    std::unique_ptr<TLBInterface> tlb;
+    if (set_assoc) {
+        tlb = std::make_unique<SetAssociativeTLB>(tlb_size, 8);
+    } else {
+        tlb = std::make_unique<TLB>(tlb_size);
+    }
+
+    std::vector<TLBEntry> entries(tlb->capacity());
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].va = VA_BASE + i * 0x1000;
+        entries[i].pa = PA_BASE + i * 0x1000;
+        entries[i].asid = static_cast<ASID>(i % NUM_ASIDS);
+        entries[i].permission = AccessPermission::READ_WRITE;
+        tlb->insert(entries[i]);
+    }
+
+    ASID asid = 0;
+    for (auto _ : state) {
+        tlb->invalidate_by_asid(asid);
+
+        state.PauseTiming();
+        for (size_t i = asid; i < entries.size(); i += NUM_ASIDS) tlb->insert(entries[i]);
+        asid = static_cast<ASID>((asid + 1) % NUM_ASIDS);
+        state.ResumeTiming();
+    }
+    state.counters["entries"] = static_cast<double>(tlb->size());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InvalidateByASID)
+    ->ArgNames({"tlb", "set_assoc", "asids"})
+    ->Args({512, 0, 8})->Args({512, 1, 8})
+    ->Args({4096, 0, 8})->Args({4096, 1, 8})
+    ->Args({4096, 0, 256})->Args({4096, 1, 256});
+
+// ============================================================================
+// 多流未命中：大量 StreamID（如 SR-IOV 虛擬功能）共用一套頁表，
+// 輪流訪問使每次都 TLB 未命中，測量配置查找在未命中路徑上的開銷
+// 參數：流數量，是否為並發模式（配置表以快照發佈）
+// ============================================================================
+
+void BM_ManyStreamsMiss(benchmark::State& state) {
+    const StreamID streams = static_cast<StreamID>(state.range(0));
+    SMMUConfig config = make_config(16);
+    config.thread_safe = state.range(1) != 0;
+
+    Fixture f(config);
+    f.map_pages(16);
+    f.enable();
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    ContextDescriptor cd = f.smmu->get_context_descriptor(0, 1);
+    for (StreamID sid = 1; sid < streams; sid++) {
+        f.smmu->configure_stream_table_entry(sid, ste);
+        f.smmu->configure_context_descriptor(sid, 1, cd);
+    }
+
+    // 步長與流數量互質，訪問順序分散在整個流表中
+    StreamID sid = 0;
+    size_t i = 0;
+    for (auto _ : state) {
+        sid = (sid + 97) % streams;
+        auto result = f.smmu->translate(VA_BASE + (i++ & 15) * 0x1000, sid, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+    }
+    report(state, *f.smmu);
+}
+BENCHMARK(BM_ManyStreamsMiss)
+    ->ArgNames({"streams", "thread_safe"})
+    ->Args({256, 0})->Args({4096, 0})->Args({65536, 0})
+    ->Args({4096, 1});
+
+// ============================================================================
+// 4KB / 2MB / 1GB 混合：1GB 塊、若干 2MB 塊和 4KB 頁面，隨機訪問
+// 參數：TLB 大小
+// ============================================================================
+
+void BM_PageSizeMix(benchmark::State& state) {
+    size_t tlb_size = static_cast<size_t>(state.range(0));
+
+    Fixture f(make_config(tlb_size));
+    constexpr VirtualAddress VA_1G = 0x40000000;    // 1 個 1GB 塊
+    constexpr VirtualAddress VA_2M = 0x80000000;    // 64 個 2MB 塊
+    constexpr VirtualAddress VA_4K = 0xC0000000;    // 1024 個 4KB 頁面
+    f.s1->map(VA_1G, 0x100000000ULL, 1);
+    for (size_t i = 0; i < 64; i++) {
+        f.s1->map(VA_2M + i * 0x200000, 0x200000000ULL + i * 0x200000, 2);
+    }
+    for (size_t i = 0; i < 1024; i++) {
+        f.s1->map(VA_4K + i * 0x1000, 0x300000000ULL + i * 0x1000, 3);
+    }
+    f.enable();
+
+    // 三種大小各佔三分之一的訪問
+    std::mt19937_64 rng(7);
+    std::vector<VirtualAddress> vas(4096);
+    for (auto& va : vas) {
+        switch (rng() % 3) {
+            case 0: va = VA_1G + (rng() % 0x40000000); break;
+            case 1: va = VA_2M + (rng() % (64 * 0x200000)); break;
+            default: va = VA_4K + (rng() % (1024 * 0x1000)); break;
+        }
+        va &= ~0x3FULL;
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        auto result = f.smmu->translate(vas[i++ & 4095], 0, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+    }
+    report(state, *f.smmu);
+}
+BENCHMARK(BM_PageSizeMix)->ArgName("tlb")->Arg(64)->Arg(512)->Arg(4096);
+
+// ============================================================================
+// 順序 DMA 掃描：按 256 字節步進線性掃過遠大於 TLB 的緩衝區
+// 參數：預取深度（0 = 禁用），是否用葉子緩存行填充相鄰表項
+// ============================================================================
+
+void BM_StreamingSweep(benchmark::State& state) {
+    constexpr size_t PAGES = 16384;
+    SMMUConfig config = make_config(64);
+    config.prefetch_depth = static_cast<size_t>(state.range(0));
+    config.fill_leaf_neighbours = state.range(1) != 0;
+    Fixture f(config);
+    f.map_pages(PAGES);
+    f.enable();
+
+    // 需求訪問自身等待的描述符讀取（預取遍歷不在關鍵路徑上）
+    uint64_t offset = 0;
+    uint64_t critical_reads = 0;
+    for (auto _ : state) {
+        auto result = f.smmu->translate(VA_BASE + offset, 0, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+        critical_reads += result.descriptor_reads;
+        offset = (offset + 256) % (PAGES * 0x1000);
+    }
+    report(state, *f.smmu);
+    state.counters["critical_reads_per_op"] =
+        static_cast<double>(critical_reads) / static_cast<double>(state.iterations());
+    auto stats = f.smmu->get_statistics();
+    state.counters["prefetch_coverage"] =
+        stats.tlb_misses ? static_cast<double>(stats.prefetch_hits) / stats.tlb_misses : 0.0;
+    state.counters["prefetch_accuracy"] =
+        stats.prefetches_issued ? static_cast<double>(stats.prefetch_hits) / stats.prefetches_issued : 0.0;
+}
+BENCHMARK(BM_StreamingSweep)->ArgNames({"depth", "neighbours"})
+    ->Args({0, 0})->Args({4, 0})->Args({16, 0})->Args({0, 1})->Args({4, 1});
+
+// ============================================================================
+// TLB 覆蓋範圍：64 項 TLB 隨機訪問 1024 個頁面
+// mode 0：每頁一個表項；1：描述符設置連續位（16 頁一個表項）；
+// 2：軟件合併葉子緩存行中的連續頁面（8 頁一個表項）
+// ============================================================================
+
+void BM_TLBReach(benchmark::State& state) {
+    constexpr size_t PAGES = 1024;
+    const int64_t mode = state.range(0);
+    SMMUConfig config = make_config(64);
+    config.use_contiguous_hint = (mode == 1);
+    config.coalesce_leaf_pages = (mode == 2);
+    Fixture f(config);
+    f.map_pages(PAGES, mode == 1 ? (1ULL << 52) : 0);
+    f.enable();
+
+    auto vas = random_addresses(PAGES, 4096, 13);
+    size_t i = 0;
+    for (auto _ : state) {
+        auto result = f.smmu->translate(vas[i], 0, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+        i = (i + 1) % vas.size();
+    }
+    report(state, *f.smmu);
+}
+BENCHMARK(BM_TLBReach)->ArgName("mode")->Arg(0)->Arg(1)->Arg(2);
+
+// ============================================================================
+// 吵鬧鄰居：流 0 反覆訪問 32 個熱頁面，流 1 每訪問一次熱頁面就掃描 4 個新頁面
+// 參數：流 0 的保留表項數（0 = 無配額），TLB 組織（0 全相聯，1 組相聯）
+// 計數器 hot_hit_rate 為流 0 的命中率
+// ============================================================================
+
+void BM_NoisyNeighbour(benchmark::State& state) {
+    constexpr size_t HOT_PAGES = 32;
+    constexpr size_t SWEEP_PAGES = 8192;
+    SMMUConfig config = make_config(128);
+    if (state.range(1)) config.tlb_organization = TLBOrganization::SET_ASSOCIATIVE;
+    Fixture f(config);
+    f.map_pages(SWEEP_PAGES);
+    f.enable();
+    StreamTableEntry ste = f.smmu->get_stream_table_entry(0);
+    ste.tlb_reserved = static_cast<uint32_t>(state.range(0));
+    f.smmu->configure_stream_table_entry(0, ste);
+    ste.tlb_reserved = 0;
+    f.smmu->configure_stream_table_entry(1, ste);
+    f.smmu->configure_context_descriptor(1, 1, f.smmu->get_context_descriptor(0, 1));
+
+    size_t hot = 0;
+    size_t sweep = 0;
+    for (auto _ : state) {
+        auto result = f.smmu->translate(VA_BASE + (hot++ % HOT_PAGES) * 0x1000, 0, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+        for (int i = 0; i < 4; i++) {
+            result = f.smmu->translate(VA_BASE + (sweep++ % SWEEP_PAGES) * 0x1000, 1, 1, 0);
+            benchmark::DoNotOptimize(result.physical_addr);
+        }
+    }
+    report(state, *f.smmu);
+    TLBStreamStats stats = f.smmu->get_stream_tlb_statistics(0);
+    state.counters["hot_hit_rate"] = static_cast<double>(stats.hits) /
+                                     static_cast<double>(stats.hits + stats.misses);
+}
+BENCHMARK(BM_NoisyNeighbour)->ArgNames({"reserved", "set_assoc"})
+    ->Args({0, 0})->Args({32, 0})->Args({0, 1})->Args({32, 1});
+
+// ============================================================================
+// 頁表遍歷器的內存讀取路徑：不經過 SMMU 和 TLB，每次完整遍歷 4 級
+// direct 0：std::function 回調；1：直接讀取 SimpleMemoryModel（內聯）
+// ============================================================================
+
+void BM_WalkerMemoryPath(benchmark::State& state) {
+    constexpr size_t PAGES = 4096;
+    SimpleMemoryModel memory;
+    PageTableWriter builder(memory);
+    for (size_t i = 0; i < PAGES; i++) {
+        builder.map(VA_BASE + i * 0x1000, PA_BASE + i * 0x1000);
+    }
+    PageTableWalker walker([&memory](PhysicalAddress addr, uint64_t& data, size_t size) {
+        return memory.read(addr, &data, size);
+    });
+    if (state.range(0)) walker.set_direct_memory(&memory);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        auto result = walker.translate(VA_BASE + (i++ % PAGES) * 0x1000, builder.root(),
+                                       12, 48, TranslationStage::STAGE1);
+        benchmark::DoNotOptimize(result.physical_addr);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WalkerMemoryPath)->ArgName("direct")->Arg(0)->Arg(1);
+
+// ============================================================================
+// 插樁開銷：TLB 命中路徑（64 個頁面、512 項 TLB）
+// instrumented 0：關閉（只多一次空指針判斷）；1：記錄上下文計數、直方圖和主機耗時
+// ============================================================================
+
+void BM_InstrumentationOverhead(benchmark::State& state) {
+    constexpr size_t PAGES = 64;
+    SMMUConfig config = make_config(512);
+    config.instrumentation = state.range(0) != 0;
+
+    Fixture f(config);
+    f.map_pages(PAGES);
+    f.enable();
+
+    auto vas = random_addresses(PAGES, 4096, 1);
+    for (size_t i = 0; i < PAGES; i++) f.smmu->translate(VA_BASE + i * 0x1000, 0, 1, 0);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        auto result = f.smmu->translate(vas[i++ & 4095], 0, 1, 0);
+        benchmark::DoNotOptimize(result.physical_addr);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InstrumentationOverhead)->ArgName("instrumented")->Arg(0)->Arg(1);
+
+// ============================================================================
+// 頁表構建：映射 64MB 的 4KB 頁面（輸出地址不按 2MB 對齊，不能使用塊）
+// mode 0：逐頁從根表遍歷並寫入描述符；1：PageTableBuilder::map 逐頁；
+//      2：PageTableBuilder::map_range 一次映射
+// ============================================================================
+
+void BM_PageTableBuild(benchmark::State& state) {
+    constexpr size_t PAGES = 16384;
+    const int mode = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        SimpleMemoryModel memory;
+        if (mode == 0) {
+            PageTableWriter writer(memory);
+            for (size_t i = 0; i < PAGES; i++) {
+                writer.map(VA_BASE + i * 0x1000, PA_BASE + 0x1000 + i * 0x1000);
+            }
+            benchmark::DoNotOptimize(writer.root());
+        } else {
+            smmu::PageTableBuilder builder(memory);
+            if (mode == 1) {
+                for (size_t i = 0; i < PAGES; i++) {
+                    builder.map(VA_BASE + i * 0x1000, PA_BASE + 0x1000 + i * 0x1000);
+                }
+            } else {
+                builder.map_range(VA_BASE, PA_BASE + 0x1000, PAGES * 0x1000);
+            }
+            benchmark::DoNotOptimize(builder.root());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * PAGES);
+}
+BENCHMARK(BM_PageTableBuild)->ArgName("mode")->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+// ============================================================================
+// 葉子緩存行解碼：8 個描述符
+// mode 0：逐個 parse_descriptor；1：標量位平面解碼；2：decode_descriptors（向量內核）
+// ============================================================================
+
+void BM_DescriptorDecode(benchmark::State& state) {
+    constexpr size_t LINES = 256;
+    const int mode = static_cast<int>(state.range(0));
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> raw(LINES * DescriptorBatch::WIDTH);
+    for (uint64_t& desc : raw) desc = (rng() & ~ADDR_MASK & ~0x7FCULL) | (rng() & ADDR_MASK) | 0x703;
+    PageTableWalker parser([](PhysicalAddress, uint64_t& data, size_t) { data = 0; return true; });
+
+    size_t line = 0;
+    for (auto _ : state) {
+        const uint64_t* descs = &raw[(line++ % LINES) * DescriptorBatch::WIDTH];
+        if (mode == 0) {
+            PageTableDescriptor parsed[DescriptorBatch::WIDTH];
+            for (size_t i = 0; i < DescriptorBatch::WIDTH; i++) {
+                parsed[i] = parser.parse_descriptor(descs[i], 3, 12);
+            }
+            benchmark::DoNotOptimize(parsed);
+        } else {
+            DescriptorBatch batch;
+            if (mode == 1) {
+                decode_descriptors_scalar(descs, 3, batch);
+            } else {
+                decode_descriptors(descs, 3, batch);
+            }
+            benchmark::DoNotOptimize(batch);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * DescriptorBatch::WIDTH);
+    state.SetLabel(mode == 2 ? descriptor_kernel_name() : "");
+}
+BENCHMARK(BM_DescriptorDecode)->ArgName("mode")->Arg(0)->Arg(1)->Arg(2);
+
+// ============================================================================
+// 批量遍歷：4096 個連續頁面（不經過 SMMU 和 TLB，直接讀取內存模型）
+// batch 0：逐個 translate；1：translate_batch（批量提取索引，共享上層表）
+// ============================================================================
+
+void BM_WalkerBatch(benchmark::State& state) {
+    constexpr size_t PAGES = 4096;
+    SimpleMemoryModel memory;
+    PageTableBuilder builder(memory);
+    builder.map_range(VA_BASE, PA_BASE + 0x1000, PAGES * 0x1000);
+    PageTableWalker walker([&memory](PhysicalAddress addr, uint64_t& data, size_t size) {
+        return memory.read(addr, &data, size);
+    });
+    walker.set_direct_memory(&memory);
+
+    std::vector<VirtualAddress> vas(PAGES);
+    for (size_t i = 0; i < PAGES; i++) vas[i] = VA_BASE + i * 0x1000;
+    std::vector<TranslationResult> results(PAGES);
+    for (auto _ : state) {
+        if (state.range(0)) {
+            walker.translate_batch(vas.data(), PAGES, builder.root(), 12, 48,
+                                   TranslationStage::STAGE1, results.data());
+        } else {
+            for (size_t i = 0; i < PAGES; i++) {
+                results[i] = walker.translate(vas[i], builder.root(), 12, 48,
+                                              TranslationStage::STAGE1);
+            }
+        }
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * PAGES);
+}
+BENCHMARK(BM_WalkerBatch)->ArgName("batch")->Arg(0)->Arg(1);
+
+// ============================================================================
+// 預熱：4096 項 TLB，16384 個頁面經過遍歷填充
+// snapshot 0：寫入頁表並逐頁轉換；1：從快照文件加載同一狀態（頁表、流表和 TLB）
+// ============================================================================
+
+void BM_WarmStart(benchmark::State& state) {
+    constexpr size_t PAGES = 16384;
+    const char* path = "smmu_bench_snapshot.bin";
+    auto warm_up = [](Fixture& fx) {
+        fx.map_pages(PAGES);
+        fx.enable();
+        for (size_t i = 0; i < PAGES; i++) fx.smmu->translate(VA_BASE + i * 0x1000, 0, 1);
+    };
+    if (state.range(0)) {
+        Fixture fx(make_config(4096));
+        warm_up(fx);
+        fx.smmu->save_snapshot(path);
+    }
+    for (auto _ : state) {
+        Fixture fx(make_config(4096));
+        if (state.range(0)) {
+            fx.smmu->load_snapshot(path);
+        } else {
+            warm_up(fx);
+        }
+        benchmark::DoNotOptimize(fx.smmu->get_statistics().tlb_misses);
+    }
+    if (state.range(0)) std::remove(path);
+    state.SetItemsProcessed(state.iterations() * PAGES);
+}
+BENCHMARK(BM_WarmStart)->ArgName("snapshot")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
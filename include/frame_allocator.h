@@ -0,0 +1,130 @@
+// 頁表幀分配器（Frame Allocator）頭文件
+// 在 SimpleMemoryModel 的物理地址空間上按 4KB / 16KB / 64KB 分配頁表幀，
+// 支持釋放和重用、按所有者（通常為 ASID）整體釋放，並顯式報告失敗原因
+
+#ifndef SMMU_FRAME_ALLOCATOR_H
+#define SMMU_FRAME_ALLOCATOR_H
+
+#include "smmu_types.h"
+#include "page_table.h"
+#include <unordered_map>
+#include <vector>
+
+namespace smmu {
+
+// ============================================================================
+// 分配錯誤類型
+// ============================================================================
+
+enum class FrameAllocError {
+    NONE,             // 無錯誤
+    INVALID_SIZE,     // 大小不是 4KB / 16KB / 64KB
+    OUT_OF_MEMORY,    // 達到分配器上限或物理地址空間耗盡
+    NOT_ALLOCATED     // 釋放的地址不是已分配幀的起始地址（含重複釋放）
+};
+
+// 錯誤類型名稱（靜態字符串，不分配內存）
+inline const char* frame_alloc_error_to_string(FrameAllocError error) {
+    switch (error) {
+        case FrameAllocError::NONE: return "NONE";
+        case FrameAllocError::INVALID_SIZE: return "INVALID_SIZE";
+        case FrameAllocError::OUT_OF_MEMORY: return "OUT_OF_MEMORY";
+        case FrameAllocError::NOT_ALLOCATED: return "NOT_ALLOCATED";
+    }
+    return "UNKNOWN";
+}
+
+// 分配結果：成功時 pa 為按大小對齊的幀地址，失敗時 pa 為 0
+struct FrameAllocation {
+    bool success;
+    PhysicalAddress pa;
+    FrameAllocError error;
+
+    FrameAllocation() : success(false), pa(0), error(FrameAllocError::NONE) {}
+};
+
+// ============================================================================
+// 頁表幀分配器類
+// 從內存模型按區域（arena）預留物理地址，區域再切分成 64KB 的板（slab），
+// 每塊板只存放同一大小的幀，使同類頁表在物理地址上保持緊湊
+// 釋放的幀進入對應大小的空閒鏈表（後進先出），其內容被丟棄，重新分配時讀為 0
+// limit_bytes 限制從內存模型預留的總字節數（0 表示只受物理地址空間限制）
+// 非線程安全：與 SimpleMemoryModel 的寫入一樣需要由調用者串行化
+// ============================================================================
+
+class FrameAllocator {
+public:
+    using Owner = uint32_t;
+    static constexpr Owner NO_OWNER = 0xFFFFFFFF;          // 不屬於任何所有者
+    static constexpr size_t NUM_SIZE_CLASSES = 3;          // 4KB / 16KB / 64KB
+    static constexpr uint64_t SLAB_BYTES = 64 * 1024;
+    static constexpr uint64_t DEFAULT_ARENA_BYTES = 2 * 1024 * 1024;
+
+    struct Stats {
+        uint64_t reserved_bytes = 0;    // 從內存模型預留的字節數
+        uint64_t allocated_bytes = 0;   // 當前已分配的字節數
+        uint64_t allocations = 0;       // 成功分配次數
+        uint64_t recycled = 0;          // 其中來自空閒鏈表的次數
+        uint64_t frees = 0;             // 釋放的幀數（含按所有者釋放）
+        uint64_t failures = 0;          // 失敗的分配和釋放次數
+    };
+
+    // arena_bytes 向上取整為 SLAB_BYTES 的倍數
+    explicit FrameAllocator(SimpleMemoryModel& memory, uint64_t limit_bytes = 0,
+                            uint64_t arena_bytes = DEFAULT_ARENA_BYTES);
+
+    SimpleMemoryModel& memory() { return memory_; }
+
+    // 分配一個 size 字節的幀（4096 / 16384 / 65536），可選地記錄所有者
+    FrameAllocation allocate(uint64_t size = 4096, Owner owner = NO_OWNER);
+
+    // 釋放 allocate 返回的幀
+    FrameAllocError free_page(PhysicalAddress pa);
+
+    // 釋放所有者的全部幀（例如銷毀一個地址空間的頁表），返回釋放的幀數
+    size_t release_owner(Owner owner);
+
+    // 所有者當前持有的幀數
+    size_t owned_frames(Owner owner) const;
+
+    // 幀的大小（未分配時返回 0）
+    uint64_t frame_size(PhysicalAddress pa) const;
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct FrameRecord {
+        uint8_t size_class;
+        Owner owner;
+        uint32_t owner_index;   // 在 owners_[owner] 中的位置
+    };
+
+    struct SizeClass {
+        std::vector<PhysicalAddress> free_list;
+        PhysicalAddress slab_next = 0;   // 當前板中下一個未用的幀
+        PhysicalAddress slab_end = 0;
+    };
+
+    static int size_class_of(uint64_t size);
+    static uint64_t class_bytes(int size_class) { return 4096ULL << (2 * size_class); }
+
+    // 從區域中取一塊板（必要時預留新區域），失敗時返回 0
+    PhysicalAddress take_slab();
+
+    // 把幀放回空閒鏈表（不處理所有者記錄）
+    void recycle(PhysicalAddress pa, uint8_t size_class);
+
+    SimpleMemoryModel& memory_;
+    uint64_t limit_bytes_;
+    uint64_t arena_bytes_;
+    PhysicalAddress arena_next_;
+    PhysicalAddress arena_end_;
+    SizeClass classes_[NUM_SIZE_CLASSES];
+    std::unordered_map<PhysicalAddress, FrameRecord> frames_;
+    std::unordered_map<Owner, std::vector<PhysicalAddress>> owners_;
+    Stats stats_;
+};
+
+} // namespace smmu
+
+#endif // SMMU_FRAME_ALLOCATOR_H
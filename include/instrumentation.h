@@ -0,0 +1,192 @@
+// 轉換路徑插樁（Instrumentation）頭文件
+// 按 (StreamID, ASID) 統計命中/未命中/遍歷次數，記錄遍歷深度分佈、
+// 轉換延遲直方圖（模型週期和主機納秒）以及各類無效化次數，並導出為 JSON / Prometheus 文本
+
+#ifndef SMMU_INSTRUMENTATION_H
+#define SMMU_INSTRUMENTATION_H
+
+#include "smmu_types.h"
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace smmu {
+
+// ============================================================================
+// 延遲直方圖
+// 對數分桶：小於 8 的值每個值一個桶，之後每個 2 的冪區間分為 8 個子桶，
+// 百分位的相對誤差不超過 12.5%；計數使用 relaxed 原子操作，
+// concurrent 為 true 時可以從多個線程同時記錄，否則使用不帶讀改寫的累加
+// ============================================================================
+
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 3;
+    static constexpr size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    // 直方圖快照（普通值，可以合併）
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        std::vector<uint64_t> buckets;   // 為空表示沒有記錄
+
+        double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+
+        // 第 q 分位（0 < q <= 1）所在桶的上界，不超過 max；沒有記錄時返回 0
+        uint64_t percentile(double q) const;
+
+        // 累加另一個快照
+        void merge(const Snapshot& other);
+
+        // {"count":..,"mean":..,"p50":..,"p99":..,"p999":..,"max":..}
+        void write_json(std::ostream& os) const;
+    };
+
+    explicit LatencyHistogram(bool concurrent = true);
+
+    void record(uint64_t value);
+    Snapshot snapshot() const;
+    void reset();
+
+    // 值所在的桶，以及桶覆蓋的最大值
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_upper(size_t index);
+
+private:
+    bool concurrent_;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+// ============================================================================
+// 插樁快照
+// ============================================================================
+
+// 無效化類型（順序與 TranslationInvalidation::Scope 的前五項相同）
+enum class InvalidationType : uint8_t {
+    ALL,
+    ASID,
+    VMID,
+    STREAM,
+    VA_RANGE,
+    COUNT
+};
+
+const char* invalidation_type_to_string(InvalidationType type);
+
+// 單個 (StreamID, ASID) 的計數
+struct ContextCounters {
+    StreamID stream_id = 0;
+    ASID asid = 0;
+    uint64_t translations = 0;       // 轉換次數
+    uint64_t tlb_hits = 0;           // TLB 命中次數
+    uint64_t tlb_misses = 0;         // TLB 未命中次數
+    uint64_t page_walks = 0;         // 讀取了描述符的未命中次數
+    uint64_t descriptor_reads = 0;   // 描述符讀取次數
+    uint64_t faults = 0;             // 失敗的轉換次數
+};
+
+struct InstrumentationSnapshot {
+    static constexpr size_t MAX_WALK_DEPTH = 24;  // 嵌套 4 級 + 4 級的最大描述符讀取數
+
+    bool enabled = false;
+    std::vector<ContextCounters> contexts;     // 按 TLB 未命中次數從多到少排序
+    ContextCounters overflow;                  // 上下文表已滿後的其他上下文（stream_id/asid 無意義）
+    std::vector<uint64_t> walk_depth;          // [n]：讀取 n 個描述符的未命中次數（最後一項含更多）
+    LatencyHistogram::Snapshot latency_cycles; // 模型延遲（週期）
+    LatencyHistogram::Snapshot latency_host_ns;// 主機耗時（納秒）
+    uint64_t invalidations[static_cast<size_t>(InvalidationType::COUNT)] = {};
+
+    // 累加另一個快照（例如多個 SMMU 實例的插樁）；other.enabled 為 false 時不變
+    void merge(const InstrumentationSnapshot& other);
+
+    // 導出為一個 JSON 對象
+    void write_json(std::ostream& os) const;
+
+    // 導出為 Prometheus 文本格式，指標名以 prefix 開頭
+    void write_prometheus(std::ostream& os, const std::string& prefix = "smmu") const;
+};
+
+// ============================================================================
+// 插樁計數器
+// 上下文表為固定容量的開放尋址表，表項的鍵用 CAS 佔用後不再釋放（重置只清零計數），
+// 因此記錄路徑無鎖、不分配內存；表滿後的上下文計入 overflow
+// 模型延遲 = hit_cycles + 描述符讀取數 × descriptor_read_cycles
+// 主機耗時每 time_sampling 次轉換（每個線程）測量一次，讀取時鐘的開銷遠大於計數
+// ============================================================================
+
+class Instrumentation {
+public:
+    // concurrent: 是否可能從多個線程同時記錄
+    // time_sampling: 主機耗時的採樣間隔（向上取整為 2 的冪，0 表示不測量）
+    Instrumentation(size_t max_contexts, uint32_t hit_cycles, uint32_t descriptor_read_cycles,
+                    uint32_t time_sampling = 1, bool concurrent = true);
+
+    // 當前線程的這次轉換是否需要測量主機耗時
+    bool sample_host_time() {
+        static thread_local uint32_t tick = 0;
+        return timing_enabled_ && (tick++ & time_sampling_mask_) == 0;
+    }
+
+    // 記錄一次轉換
+    // tlb_hit: 主 TLB（或批量轉換的同頁復用）命中
+    void record_translation(StreamID stream_id, ASID asid, bool tlb_hit,
+                            const TranslationResult& result);
+
+    // 記錄一次採樣的主機耗時
+    void record_host_time(uint64_t host_ns) { latency_host_ns_.record(host_ns); }
+
+    void record_invalidation(InvalidationType type) {
+        add(invalidations_[static_cast<size_t>(type)]);
+    }
+
+    InstrumentationSnapshot snapshot() const;
+    void reset();
+
+private:
+    struct alignas(64) ContextSlot {
+        std::atomic<uint64_t> key{0};   // (stream_id << 16 | asid) + 1，0 表示空閒
+        std::atomic<uint64_t> translations{0};
+        std::atomic<uint64_t> tlb_hits{0};
+        std::atomic<uint64_t> tlb_misses{0};
+        std::atomic<uint64_t> page_walks{0};
+        std::atomic<uint64_t> descriptor_reads{0};
+        std::atomic<uint64_t> faults{0};
+    };
+
+    void add(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+        if (concurrent_) {
+            counter.fetch_add(n, std::memory_order_relaxed);
+        } else {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    }
+
+    // 查找或佔用上下文的表項（表滿時返回 overflow_）
+    ContextSlot& context_slot(StreamID stream_id, ASID asid);
+
+    static void read_slot(const ContextSlot& slot, ContextCounters& counters);
+    static void clear_slot(ContextSlot& slot);
+
+    size_t mask_;                                    // 容量 - 1（容量為 2 的冪）
+    std::unique_ptr<ContextSlot[]> contexts_;
+    ContextSlot overflow_;
+    uint32_t hit_cycles_;
+    uint32_t descriptor_read_cycles_;
+    bool timing_enabled_;
+    uint32_t time_sampling_mask_;
+    bool concurrent_;
+    std::atomic<uint64_t> walk_depth_[InstrumentationSnapshot::MAX_WALK_DEPTH + 1];
+    std::atomic<uint64_t> invalidations_[static_cast<size_t>(InvalidationType::COUNT)];
+    LatencyHistogram latency_cycles_;
+    LatencyHistogram latency_host_ns_;
+};
+
+} // namespace smmu
+
+#endif // SMMU_INSTRUMENTATION_H
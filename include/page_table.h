@@ -5,9 +5,11 @@
 #define SMMU_PAGE_TABLE_H
 
 #include "smmu_types.h"
+#include "page_walk_cache.h"
 #include <memory>
 #include <vector>
 #include <functional>
+#include <cstring>
 
 namespace smmu {
 
@@ -39,6 +41,81 @@ struct PageTableDescriptor {
           execute_never(false) {}
 };
 
+// ============================================================================
+// 批量解碼的描述符（結構數組形式）
+// 一次解碼 WIDTH 個相鄰描述符：輸出地址存為數組，各標誌存為位平面
+// （第 i 位對應第 i 個描述符），比較一組描述符的屬性只需要位運算
+// 無效描述符的地址和所有標誌位為 0，與 parse_descriptor 的結果一致
+// ============================================================================
+
+struct DescriptorBatch {
+    static constexpr size_t WIDTH = 8;
+    
+    uint64_t address[WIDTH];   // 輸出地址 [47:12]
+    uint8_t valid;             // bit 0
+    uint8_t table;             // 表描述符（L0-L2 的 bit 1；L3 恆為 0）
+    uint8_t access_flag;       // AF (bit 10)
+    uint8_t read_only;         // AP[2] (bit 7)
+    uint8_t shareable;         // SH (bits [9:8]) 非 0
+    uint8_t contiguous;        // bit 52
+    uint8_t dirty;             // DBM (bit 51)
+    uint8_t pxn;               // bit 53
+    uint8_t xn;                // bit 54
+    uint8_t attr_index[3];     // AttrIndx (bits [4:2]) 的三個位平面
+    
+    // 有效的塊/頁描述符
+    uint8_t leaf() const { return static_cast<uint8_t>(valid & ~table); }
+    
+    // mask 選中的描述符是否全部具有相同的權限和內存屬性（可以合併到一個 TLB 表項）
+    bool same_attributes(uint8_t mask) const {
+        auto uniform = [mask](uint8_t plane) {
+            uint8_t bits = plane & mask;
+            return bits == 0 || bits == mask;
+        };
+        return uniform(read_only) && uniform(shareable) && uniform(pxn) && uniform(xn) &&
+               uniform(attr_index[0]) && uniform(attr_index[1]) && uniform(attr_index[2]);
+    }
+    
+    AccessPermission permission(size_t i) const {
+        return (read_only >> i) & 1 ? AccessPermission::READ_ONLY : AccessPermission::READ_WRITE;
+    }
+    
+    bool is_shareable(size_t i) const { return (shareable >> i) & 1; }
+    
+    MemoryType memory_type(size_t i) const;
+    
+    // 展開為 PageTableDescriptor（與 parse_descriptor 的結果相同）
+    PageTableDescriptor descriptor(size_t i) const;
+};
+
+// 解碼 raw 中的 WIDTH 個描述符（level 決定 bit 1 表示表還是頁）
+// 支持時使用 AVX2（運行時檢測）或 NEON 內核，否則使用標量實現
+void decode_descriptors(const uint64_t* raw, uint8_t level, DescriptorBatch& out);
+
+// 標量實現（用於對照和測試）
+void decode_descriptors_scalar(const uint64_t* raw, uint8_t level, DescriptorBatch& out);
+
+// ============================================================================
+// 批量索引提取
+// 一次計算多個 VA 在 L0-L3 各級頁表中的索引，與遍歷器逐級計算的索引相同；
+// 低於起始級別的項（64KB 粒度的 L0）為 0
+// ============================================================================
+
+struct LevelIndices {
+    uint16_t index[4];   // [level]
+};
+
+// granule_size 必須為 12、14 或 16
+void extract_indices(const VirtualAddress* vas, size_t count, uint8_t granule_size,
+                     LevelIndices* out);
+
+// 標量實現（用於對照和測試）
+void extract_indices_scalar(const VirtualAddress* vas, size_t count, uint8_t granule_size,
+                            LevelIndices* out);
+
+// 當前使用的內核："avx2"、"neon" 或 "scalar"
+const char* descriptor_kernel_name();
+
 // ============================================================================
 // 內存讀取回調函數類型
 // 用於從物理內存讀取數據（頁表項）
@@ -48,9 +125,50 @@ using MemoryReadCallback = std::function<bool(PhysicalAddress addr,
                                                uint64_t& data, 
                                                size_t size)>;
 
+// 按塊讀取回調（用於一次讀取整個緩存行的描述符）
+using MemoryBlockReadCallback = std::function<bool(PhysicalAddress addr,
+                                                    void* data,
+                                                    size_t size)>;
+
+// ============================================================================
+// 葉子緩存行
+// 在最後一級頁表中，遍歷器一次讀取描述符所在的整個 64 字節緩存行（8 個相鄰描述符），
+// 相鄰描述符對應一段按 8 頁對齊的連續 VA，可以直接用於填充 TLB
+// ============================================================================
+
+struct LeafLine {
+    static constexpr size_t LINE_SIZE = 64;                // 緩存行大小（字節）
+    static constexpr size_t ENTRIES = LINE_SIZE / 8;       // 每行描述符數量
+    
+    VirtualAddress va_base;                     // 第 0 個描述符對應的 VA
+    PageSize page_size;                         // 每個描述符映射的頁面大小
+    uint8_t level;                              // 頁表級別
+    uint8_t count;                              // 已讀取的描述符數量（0 表示未讀取緩存行）
+    uint8_t index;                              // 本次遍歷的描述符在行內的位置
+    DescriptorBatch decoded;                    // 解碼後的描述符
+    
+    static_assert(ENTRIES == DescriptorBatch::WIDTH, "a leaf line is decoded as one batch");
+    
+    PageTableDescriptor descriptor(size_t i) const { return decoded.descriptor(i); }
+    
+    LeafLine() : va_base(0), page_size(PageSize::SIZE_4KB), level(3), count(0), index(0) {}
+};
+
+// ============================================================================
+// 階段2轉換回調函數類型
+// 嵌套遍歷時階段1頁表位於中間物理地址空間，每一級表地址在讀取前
+// 都通過該回調轉換為物理地址
+// ============================================================================
+
+using Stage2TranslateCallback = std::function<TranslationResult(PhysicalAddress ipa)>;
+
+class SimpleMemoryModel;
+
 // ============================================================================
 // 頁表遍歷器類
 // 實現多級頁表的遍歷和地址轉換
+// 遍歷循環按內存後端實例化為模板：設置了直接內存時描述符讀取內聯到循環中，
+// 否則經過 MemoryReadCallback / MemoryBlockReadCallback（通用路徑）
 // ============================================================================
 
 class PageTableWalker {
@@ -58,17 +176,57 @@ public:
     // 構造函數：需要提供內存讀取回調函數
     PageTableWalker(MemoryReadCallback memory_read);
     
+    // 設置頁表遍歷緩存（nullptr 表示不使用緩存）
+    void set_walk_cache(PageWalkCache* walk_cache) { walk_cache_ = walk_cache; }
+    
+    // 是否按連續位擴大葉子映射（默認啟用）
+    void set_contiguous_hint(bool enabled) { contiguous_hint_ = enabled; }
+    
+    // 替換單個描述符讀取回調
+    void set_memory_read(MemoryReadCallback memory_read) { memory_read_ = std::move(memory_read); }
+    
+    // 設置按塊讀取回調；未設置時讀取葉子緩存行退化為逐個描述符讀取
+    void set_block_read(MemoryBlockReadCallback block_read) { block_read_ = std::move(block_read); }
+    
+    // 設置直接讀取的內存模型（不擁有）
+    // 非 nullptr 時遍歷直接讀取該模型，不經過回調；nullptr 恢復回調路徑
+    void set_direct_memory(const SimpleMemoryModel* memory) { direct_memory_ = memory; }
+    
     // 執行地址轉換
     // va: 虛擬地址
     // ttb: 轉換表基地址（Translation Table Base）
     // granule_size: 頁面粒度大小（12=4KB, 14=16KB, 16=64KB）
     // ips_bits: 中間物理地址大小（位數）
     // stage: 轉換階段
+    // asid/vmid: 用於標記頁表遍歷緩存表項
+    // stage2: 非 nullptr 時為嵌套遍歷，ttb 和各級表地址都是 IPA，讀取前經其轉換；
+    //         階段2遍歷讀取的描述符計入結果的 descriptor_reads
+    // line: 非 nullptr 時在最後一級讀取整個緩存行並把解析結果寫入其中
+    //       （一次緩存行讀取計為一次描述符讀取）
     TranslationResult translate(VirtualAddress va,
                                 PhysicalAddress ttb,
                                 uint8_t granule_size,
                                 uint8_t ips_bits,
-                                TranslationStage stage);
+                                TranslationStage stage,
+                                ASID asid = 0,
+                                VMID vmid = 0,
+                                const Stage2TranslateCallback* stage2 = nullptr,
+                                LeafLine* line = nullptr);
+    
+    // 批量遍歷（單階段，不讀取葉子緩存行）
+    // results[i] 與 translate(vas[i], ttb, ...) 的結果相同；各級索引一次提取，
+    // 與前一個地址的上層索引相同時從前一次遍歷到達的最深公共表繼續，
+    // 跳過的級別不讀取描述符（descriptor_reads 只計實際讀取）
+    // 要求批次內頁表不被修改
+    void translate_batch(const VirtualAddress* vas,
+                         size_t count,
+                         PhysicalAddress ttb,
+                         uint8_t granule_size,
+                         uint8_t ips_bits,
+                         TranslationStage stage,
+                         TranslationResult* results,
+                         ASID asid = 0,
+                         VMID vmid = 0);
     
     // 從內存中解析描述符
     // desc: 64位描述符值
@@ -78,8 +236,20 @@ public:
                                          uint8_t level,
                                          uint8_t granule_size);
     
-    // 獲取指定級別的頁面大小
-    PageSize get_page_size(uint8_t level, uint8_t granule_size) const;
+    // 獲取指定級別的頁面大小（該級別的葉子描述符映射的大小）
+    static PageSize get_page_size(uint8_t level, uint8_t granule_size);
+    
+    // 指定級別是否允許葉子（塊/頁）描述符
+    // 4KB 粒度：L1（1GB）、L2（2MB）、L3（4KB）
+    // 16KB 粒度：L2（32MB）、L3（16KB）
+    // 64KB 粒度：L2（512MB）、L3（64KB）
+    static bool is_leaf_allowed(uint8_t level, uint8_t granule_size);
+    
+    // 連續位覆蓋的描述符數量（該級別不支持連續位時返回 1）
+    // 4KB 粒度：L1/L2/L3 各 16 項
+    // 16KB 粒度：L2 32 項，L3 128 項
+    // 64KB 粒度：L2/L3 各 32 項
+    static uint64_t contiguous_entries(uint8_t level, uint8_t granule_size);
     
 private:
     // ========================================================================
@@ -87,62 +257,200 @@ private:
     // 存儲頁表遍歷過程中需要的所有信息
     // ========================================================================
     
+    // 一次遍歷經過的各級表（批量遍歷用於從公共表繼續）
+    // 遍歷緩存命中時淺於 begin 的級別沒有被讀取
+    struct TableTrace {
+        PhysicalAddress table[4] = {};   // [level]：該級別讀取的表
+        uint8_t begin = 0;               // 已記錄的最淺級別
+        uint8_t end = 0;                 // 已記錄的最深級別 + 1（0 表示沒有記錄）
+    };
+    
     struct WalkContext {
         VirtualAddress va;           // 要轉換的虛擬地址
+        LevelIndices indices;        // 各級索引
         PhysicalAddress ttb;         // 轉換表基地址
         uint8_t granule_size;        // 頁面粒度大小
         uint8_t ips_bits;            // 中間物理地址大小
         uint8_t start_level;         // 起始級別
         uint8_t max_level;           // 最大級別
         TranslationStage stage;      // 轉換階段
+        ASID asid;                   // 地址空間ID（用於遍歷緩存）
+        VMID vmid;                   // 虛擬機ID（用於遍歷緩存）
+        const Stage2TranslateCallback* stage2;  // 表地址的階段2轉換（nullptr 表示表地址即 PA）
+        LeafLine* line;              // 最後一級的緩存行（nullptr 表示只讀取單個描述符）
+        uint8_t resume_level = 0;    // 大於 start_level 時從該級別的 resume_table 開始
+        PhysicalAddress resume_table = 0;
+        TableTrace* trace = nullptr; // 非 nullptr 時記錄經過的表
     };
     
-    // 執行頁表遍歷
-    TranslationResult walk_table(const WalkContext& ctx);
+    // 按粒度設置起始和最大級別（粒度無效時返回 false）
+    static bool set_levels(WalkContext& ctx);
     
-    // 從虛擬地址中提取指定級別的索引位
-    uint64_t get_index_bits(VirtualAddress va, uint8_t level, 
-                           uint8_t granule_size) const;
+    // 按內存後端執行遍歷
+    TranslationResult run_walk(const WalkContext& ctx);
+    
+    // 內存後端：提供 read_descriptor(addr, desc) 和 read_block(addr, data, size)
+    struct CallbackMemory;   // 經過回調函數
+    struct DirectMemory;     // 直接讀取 SimpleMemoryModel
+    
+    // 執行頁表遍歷
+    template <typename Memory>
+    TranslationResult walk_table(const WalkContext& ctx, Memory& memory);
     
     // 計算描述符在頁表中的地址
     uint64_t get_descriptor_address(PhysicalAddress table_base,
                                    uint64_t index,
                                    uint8_t granule_size) const;
     
-    // 從物理內存讀取描述符
-    bool read_descriptor(PhysicalAddress addr, uint64_t& desc);
+    // 讀取 addr 所在的緩存行並解析到 line，desc 返回 addr 處的描述符值
+    template <typename Memory>
+    bool read_leaf_line(const WalkContext& ctx, Memory& memory,
+                        PhysicalAddress addr, uint64_t& desc);
     
     // 內存讀取回調函數
     MemoryReadCallback memory_read_;
+    MemoryBlockReadCallback block_read_;
+    
+    // 直接讀取的內存模型（不擁有，nullptr 表示使用回調）
+    const SimpleMemoryModel* direct_memory_;
+    
+    // 頁表遍歷緩存（不擁有）
+    PageWalkCache* walk_cache_;
+    
+    // 是否按連續位擴大葉子映射
+    bool contiguous_hint_;
 };
 
 // ============================================================================
 // 簡單內存模型類
 // 用於測試的簡化物理內存模擬器
+// 使用三級基數樹按 4KB 幀稀疏存儲，首次寫入時才分配，支持完整的48位物理地址
 // ============================================================================
 
 class SimpleMemoryModel {
 public:
+    static constexpr unsigned PA_BITS = 48;                        // 物理地址位數
+    static constexpr PhysicalAddress PA_LIMIT = 1ULL << PA_BITS;   // 物理地址上限
+    static constexpr unsigned FRAME_SHIFT = 12;                    // 幀大小（log2）
+    static constexpr size_t FRAME_SIZE = 1ULL << FRAME_SHIFT;      // 4KB 幀
+    
     SimpleMemoryModel();
     
-    // 向物理內存寫入數據
+    // 向物理內存寫入數據（按需分配幀）
     void write(PhysicalAddress addr, const void* data, size_t size);
     
-    // 從物理內存讀取數據
-    bool read(PhysicalAddress addr, void* data, size_t size);
+    // 從物理內存讀取數據（未寫入過的區域讀為0）
+    // 返回：地址超出48位物理地址範圍時返回 false
+    bool read(PhysicalAddress addr, void* data, size_t size) const;
+    
+    // 與 read 相同；不跨幀的讀取（描述符、緩存行）在調用處內聯完成
+    bool read_direct(PhysicalAddress addr, void* data, size_t size) const {
+        size_t offset = addr & (FRAME_SIZE - 1);
+        if (addr >= PA_LIMIT || size > FRAME_SIZE - offset) {
+            return read(addr, data, size);
+        }
+        const Frame* frame = find_frame(addr);
+        if (frame) {
+            std::memcpy(data, &frame->bytes[offset], size);
+        } else {
+            std::memset(data, 0, size);
+        }
+        return true;
+    }
+    
+    // addr 所在 4KB 幀的數據指針（按需分配），用於 DMI 等直接訪問
+    // 指針在模型銷毀前保持有效；地址超出物理地址範圍時返回 nullptr
+    uint8_t* frame_data(PhysicalAddress addr);
     
     // 寫入頁表項（Page Table Entry）
     void write_pte(PhysicalAddress addr, uint64_t pte);
     
+    // 丟棄 [addr, addr + size) 的內容：完整覆蓋的幀被釋放（之前 frame_data 返回的指針失效），
+    // 部分覆蓋的幀清零；之後讀為 0
+    void discard(PhysicalAddress addr, size_t size);
+    
     // 分配物理頁面
     // size: 頁面大小（默認4096字節）
-    // 返回：分配的物理地址
+    // 返回：分配的物理地址；物理地址空間耗盡時返回 0（低 4KB 保留，0 不會是有效分配）
+    // 順序分配、不支持釋放；需要重用頁表幀時使用 FrameAllocator
     PhysicalAddress allocate_page(size_t size = 4096);
     
+    // 已分配（被寫入過）的幀數量，用於觀察實際內存佔用
+    size_t resident_frames() const { return resident_frames_; }
+    
+    // 下一次 allocate_page 的起始地址
+    PhysicalAddress next_allocation() const { return next_alloc_; }
+    
+    // 之後的 allocate_page 不返回 addr 以下的地址（恢復快照時保留已恢復內容的地址範圍）
+    void reserve_below(PhysicalAddress addr) {
+        if (addr > PA_LIMIT) addr = PA_LIMIT;
+        if (addr > next_alloc_) next_alloc_ = addr;
+    }
+    
+    // 與 other 交換全部內容（幀、分配位置）；之前 frame_data 返回的指針隨幀一起轉移
+    void swap(SimpleMemoryModel& other) noexcept {
+        root_.swap(other.root_);
+        std::swap(resident_frames_, other.resident_frames_);
+        std::swap(next_alloc_, other.next_alloc_);
+    }
+    
+    // 按地址升序對每個已分配的幀調用 fn(幀地址, 幀數據)
+    template <typename Fn>
+    void for_each_frame(Fn fn) const {
+        for (size_t m = 0; m < RADIX_FANOUT; m++) {
+            const MidNode* mid = root_[m].get();
+            if (!mid) continue;
+            for (size_t l = 0; l < RADIX_FANOUT; l++) {
+                const LeafNode* leaf = mid->leaves[l].get();
+                if (!leaf) continue;
+                for (size_t f = 0; f < RADIX_FANOUT; f++) {
+                    const Frame* frame = leaf->frames[f].get();
+                    if (!frame) continue;
+                    PhysicalAddress addr = (static_cast<PhysicalAddress>(m) << 36) |
+                                           (static_cast<PhysicalAddress>(l) << 24) |
+                                           (static_cast<PhysicalAddress>(f) << FRAME_SHIFT);
+                    fn(addr, static_cast<const uint8_t*>(frame->bytes));
+                }
+            }
+        }
+    }
+    
 private:
-    std::vector<uint8_t> memory_;           // 內存數組
-    PhysicalAddress next_alloc_;            // 下一個分配地址
-    static constexpr size_t MEMORY_SIZE = 256 * 1024 * 1024; // 256MB
+    // ========================================================================
+    // 基數樹結構
+    // PA[47:36] -> 中間節點，PA[35:24] -> 葉節點，PA[23:12] -> 4KB 幀
+    // ========================================================================
+    
+    static constexpr unsigned RADIX_BITS = 12;
+    static constexpr size_t RADIX_FANOUT = 1ULL << RADIX_BITS;
+    
+    struct Frame {
+        uint8_t bytes[FRAME_SIZE];
+    };
+    
+    struct LeafNode {
+        std::unique_ptr<Frame> frames[RADIX_FANOUT];
+    };
+    
+    struct MidNode {
+        std::unique_ptr<LeafNode> leaves[RADIX_FANOUT];
+    };
+    
+    // 查找幀（不存在時返回 nullptr）
+    const Frame* find_frame(PhysicalAddress addr) const {
+        const MidNode* mid = root_[(addr >> 36) & (RADIX_FANOUT - 1)].get();
+        if (!mid) return nullptr;
+        const LeafNode* leaf = mid->leaves[(addr >> 24) & (RADIX_FANOUT - 1)].get();
+        if (!leaf) return nullptr;
+        return leaf->frames[(addr >> FRAME_SHIFT) & (RADIX_FANOUT - 1)].get();
+    }
+    
+    // 查找幀，不存在時分配並清零
+    Frame* get_or_create_frame(PhysicalAddress addr);
+    
+    std::vector<std::unique_ptr<MidNode>> root_;  // 基數樹根（RADIX_FANOUT 項）
+    size_t resident_frames_;                      // 已分配幀數量
+    PhysicalAddress next_alloc_;                  // 下一個分配地址
 };
 
 } // namespace smmu
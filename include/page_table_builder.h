@@ -0,0 +1,142 @@
+// 頁表構建器（Page Table Builder）頭文件
+// 在 SimpleMemoryModel 中按範圍建立頁表：對齊允許時使用塊描述符，
+// 支持 4KB / 16KB / 64KB 粒度，描述符格式與 PageTableWalker::parse_descriptor 一致
+
+#ifndef SMMU_PAGE_TABLE_BUILDER_H
+#define SMMU_PAGE_TABLE_BUILDER_H
+
+#include "smmu_types.h"
+#include "page_table.h"
+#include "frame_allocator.h"
+#include <vector>
+
+namespace smmu {
+
+// ============================================================================
+// 映射屬性
+// ============================================================================
+
+struct MappingAttributes {
+    AccessPermission permission;     // READ_ONLY 為只讀，其餘為讀寫
+    MemoryType memory_type;          // 編碼為 AttrIndx（DEVICE_nGRE / DEVICE_GRE 按 DEVICE_nGnRE 編碼）
+    bool shareable;                  // 內部共享（SH = 11）
+    bool execute_never;              // XN
+    bool privileged_execute_never;   // PXN
+    bool contiguous;                 // 完整且對齊的一組葉子描述符設置連續位
+
+    MappingAttributes()
+        : permission(AccessPermission::READ_WRITE),
+          memory_type(MemoryType::NORMAL_WB),
+          shareable(false), execute_never(false),
+          privileged_execute_never(false), contiguous(false) {}
+};
+
+// ============================================================================
+// 頁表構建器類
+// map_range 自頂向下按級別處理整個範圍：對齊且完整覆蓋一個表項的部分直接寫入
+// 塊描述符，其餘部分進入下一級表；同一張表中連續的葉子描述符一次寫入
+// 頁表成批從內存模型分配（每批最多 TABLES_PER_CHUNK 張），並按表大小對齊
+// 每一級最近使用的下一級表被緩存，逐頁調用 map 時不必每次從根表重新讀取
+// 構建器假設自己是這些頁表唯一的寫入者；修改已生效的映射後需要按常規方式無效化 TLB
+// ============================================================================
+
+class PageTableBuilder {
+public:
+    static constexpr size_t TABLES_PER_CHUNK = 64;
+
+    struct Stats {
+        uint64_t tables = 0;   // 分配的頁表數（含根表）
+        uint64_t blocks = 0;   // 寫入的塊描述符數
+        uint64_t pages = 0;    // 寫入的頁描述符數
+        uint64_t splits = 0;   // 為更細的映射拆分的塊數
+    };
+
+    // 分配新的根表
+    // granule_size: 12=4KB, 14=16KB, 16=64KB（其他值時 map_range 總是失敗）
+    explicit PageTableBuilder(SimpleMemoryModel& memory, uint8_t granule_size = 12);
+
+    // 在已有的根表上繼續構建
+    PageTableBuilder(SimpleMemoryModel& memory, uint8_t granule_size, PhysicalAddress root);
+
+    // 頁表（含根表）從 frames 按表大小逐張分配並記錄為 owner 所有，
+    // frames.release_owner(owner) 釋放整個地址空間的頁表；根表分配失敗時 root() 為 0
+    PageTableBuilder(FrameAllocator& frames, FrameAllocator::Owner owner,
+                     uint8_t granule_size = 12);
+
+    PhysicalAddress root() const { return root_; }
+    uint8_t granule_size() const { return granule_size_; }
+    uint64_t granule_bytes() const { return 1ULL << granule_size_; }
+
+    // 與 PageTableWalker 相同：4KB / 16KB 從 L0 開始，64KB 從 L1 開始
+    uint8_t start_level() const { return start_level_; }
+
+    // 映射 [va, va + size) 到 [pa, pa + size)
+    // va、pa、size 必須按粒度對齊且在 48 位地址範圍內，否則返回 false 且不修改頁表；
+    // 內存不足時返回 false（已寫入的部分保留）
+    // 已有映射被覆蓋：需要更細映射的塊先拆分為下一級表，塊的其餘部分保持原映射；
+    // 被塊描述符覆蓋的舊表不再被引用（內存模型不支持釋放）
+    bool map_range(VirtualAddress va, PhysicalAddress pa, uint64_t size,
+                   const MappingAttributes& attrs = MappingAttributes());
+
+    // 映射一個粒度大小的頁面
+    bool map(VirtualAddress va, PhysicalAddress pa,
+             const MappingAttributes& attrs = MappingAttributes()) {
+        return map_range(va, pa, granule_bytes(), attrs);
+    }
+
+    // 葉子描述符編碼（L3 為頁描述符，其餘級別為塊描述符）
+    static uint64_t encode_leaf(PhysicalAddress pa, uint8_t level, const MappingAttributes& attrs);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    // 最近使用的下一級表：prefix 為上一級表項覆蓋的 VA 前綴
+    struct TableCache {
+        bool valid = false;
+        uint64_t prefix = 0;
+        PhysicalAddress table = 0;
+    };
+
+    // 表項覆蓋的地址位數
+    uint8_t entry_shift(uint8_t level) const {
+        return static_cast<uint8_t>(granule_size_ + (3 - level) * (granule_size_ - 3));
+    }
+
+    uint64_t table_bytes() const { return granule_bytes(); }
+
+    // 在 table（級別 level）中映射一段不跨越該表覆蓋範圍的區間
+    bool map_level(PhysicalAddress table, uint8_t level, VirtualAddress va,
+                   PhysicalAddress pa, uint64_t size, const MappingAttributes& attrs);
+
+    // 表項 index 指向的下一級表：不存在時分配，是塊時拆分
+    PhysicalAddress next_table(PhysicalAddress table, uint8_t level, uint64_t index,
+                               VirtualAddress va);
+
+    // 寫入 run 中從 first_index 開始的連續葉子描述符，並維護連續位
+    void write_leaves(PhysicalAddress table, uint8_t level, uint64_t first_index,
+                      const MappingAttributes& attrs);
+
+    // 清除只被部分覆寫的連續組中其他描述符的連續位
+    void clear_contiguous_group(PhysicalAddress table, uint8_t level, uint64_t index);
+
+    // 從幀分配器或批量分配的表池中取一張表（內存不足時返回 0）
+    PhysicalAddress allocate_table();
+
+    SimpleMemoryModel& memory_;
+    FrameAllocator* frames_;                 // 非 nullptr 時頁表從幀分配器分配
+    FrameAllocator::Owner owner_;
+    uint8_t granule_size_;
+    uint8_t start_level_;
+    bool valid_granule_;
+    PhysicalAddress root_;
+    PhysicalAddress pool_next_;              // 表池中下一張表
+    PhysicalAddress pool_end_;
+    size_t chunk_tables_;                    // 下一批分配的表數
+    TableCache cache_[4];                    // [level]：級別 level 的表
+    std::vector<uint64_t> run_;              // 等待寫入的葉子描述符
+    Stats stats_;
+};
+
+} // namespace smmu
+
+#endif // SMMU_PAGE_TABLE_BUILDER_H
@@ -0,0 +1,149 @@
+// 頁表遍歷緩存（Page Walk Cache）頭文件
+// 緩存中間級別的表描述符，使頁表遍歷可以從最深的已緩存級別開始
+
+#ifndef SMMU_PAGE_WALK_CACHE_H
+#define SMMU_PAGE_WALK_CACHE_H
+
+#include "smmu_types.h"
+#include <unordered_map>
+#include <list>
+#include <array>
+#include <mutex>
+
+namespace smmu {
+
+// ============================================================================
+// 頁表遍歷緩存類
+// 每個表級別（L1-L3）一個帶 LRU 淘汰的全相聯緩存
+// 鍵：(TTB, 級別, VA 前綴, 粒度, 階段, ASID, VMID)
+// 值：該 VA 前綴在該級別使用的頁表基地址
+// thread_safe 為 true 時所有操作由內部互斥鎖保護，可被多個遍歷線程共享
+// ============================================================================
+
+class PageWalkCache {
+public:
+    static constexpr uint8_t NUM_LEVELS = 4;  // 頁表級別 L0-L3
+
+    // 構造函數
+    // entries_per_level: 每個級別可緩存的表項數量
+    // thread_safe: 是否允許多個線程同時訪問
+    explicit PageWalkCache(size_t entries_per_level = 16, bool thread_safe = false);
+
+    // 查找某級別的頁表基地址
+    // 命中時寫入 table_base 並返回 true
+    bool lookup(PhysicalAddress ttb, uint8_t level, VirtualAddress va,
+                uint8_t granule_size, TranslationStage stage,
+                ASID asid, VMID vmid, PhysicalAddress& table_base);
+
+    // 插入某級別的頁表基地址（由上一級的表描述符得到）
+    void insert(PhysicalAddress ttb, uint8_t level, VirtualAddress va,
+                uint8_t granule_size, TranslationStage stage,
+                ASID asid, VMID vmid, PhysicalAddress table_base);
+
+    // ========================================================================
+    // 無效化操作
+    // ========================================================================
+
+    void invalidate_all();                               // 使所有表項無效
+    void invalidate_by_asid(ASID asid);                  // 按 ASID 使階段1表項無效
+    void invalidate_by_vmid(VMID vmid);                  // 按 VMID 使表項無效
+    void invalidate_by_va(VirtualAddress va, ASID asid); // 使覆蓋該地址的階段1表項無效
+    void invalidate_by_va_range(VirtualAddress start, uint64_t size, ASID asid); // 使與該範圍重疊的階段1表項無效
+
+    // ========================================================================
+    // 統計信息查詢
+    // ========================================================================
+
+    size_t size() const;                                  // 當前表項總數
+    size_t entries_per_level() const { return capacity_; }
+    uint64_t hit_count(uint8_t level) const;              // 按級別的命中次數
+    uint64_t miss_count() const;                          // 所有級別都未命中的遍歷次數
+    void record_miss();
+    void reset_statistics();
+
+    // 計算 VA 在指定級別的前綴（選擇該級別頁表所用的所有高位）
+    static VirtualAddress va_prefix(VirtualAddress va, uint8_t level, uint8_t granule_size) {
+        uint64_t shift = prefix_shift(level, granule_size);
+        return shift >= 64 ? 0 : (va >> shift);
+    }
+    
+    // 前綴的起始位：級別 L 的索引位從 granule + (3-L)*bits 開始，前綴是其上的所有位
+    static uint64_t prefix_shift(uint8_t level, uint8_t granule_size) {
+        uint8_t bits_per_level = granule_size - 3;
+        return granule_size + (4 - level) * bits_per_level;
+    }
+
+private:
+    // ========================================================================
+    // 緩存鍵和哈希
+    // ========================================================================
+
+    struct Key {
+        PhysicalAddress ttb;     // 轉換表基地址
+        VirtualAddress prefix;   // VA 前綴
+        ASID asid;               // 地址空間ID（階段2為0）
+        VMID vmid;               // 虛擬機ID
+        uint8_t granule_size;    // 粒度
+        TranslationStage stage;  // 轉換階段
+
+        bool operator==(const Key& other) const {
+            return ttb == other.ttb && prefix == other.prefix &&
+                   asid == other.asid && vmid == other.vmid &&
+                   granule_size == other.granule_size && stage == other.stage;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<uint64_t>()(key.ttb) ^
+                   (std::hash<uint64_t>()(key.prefix) << 1) ^
+                   (std::hash<uint16_t>()(key.asid) << 2) ^
+                   (std::hash<uint16_t>()(key.vmid) << 3) ^
+                   (static_cast<size_t>(key.granule_size) << 5) ^
+                   (static_cast<size_t>(key.stage) << 7);
+        }
+    };
+
+    // 緩存節點：表項值與其 LRU 位置
+    struct Node {
+        PhysicalAddress table_base;
+        std::list<Key>::iterator lru_pos;
+    };
+
+    // 單個級別的緩存
+    struct LevelCache {
+        std::unordered_map<Key, Node, KeyHash> entries;
+        std::list<Key> lru_list;  // 最近使用的在前面
+    };
+
+    // 線程安全模式下鎖定內部互斥鎖，否則返回空鎖
+    std::unique_lock<std::mutex> lock() const {
+        return thread_safe_ ? std::unique_lock<std::mutex>(mutex_)
+                            : std::unique_lock<std::mutex>();
+    }
+    
+    // 按條件刪除某級別中的表項
+    template <typename Pred>
+    void erase_if(LevelCache& cache, Pred pred) {
+        auto it = cache.entries.begin();
+        while (it != cache.entries.end()) {
+            if (pred(it->first)) {
+                cache.lru_list.erase(it->second.lru_pos);
+                it = cache.entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    size_t capacity_;                                 // 每個級別的容量
+    std::array<LevelCache, NUM_LEVELS> levels_;       // 按級別的緩存
+    std::array<uint64_t, NUM_LEVELS> hit_count_;      // 按級別的命中計數
+    uint64_t miss_count_;                             // 未命中計數
+    bool thread_safe_;                                // 是否啟用內部鎖
+    mutable std::mutex mutex_;                        // 保護以上所有狀態
+};
+
+} // namespace smmu
+
+#endif // SMMU_PAGE_WALK_CACHE_H
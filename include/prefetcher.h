@@ -0,0 +1,127 @@
+// 轉換預取器（Translation Prefetcher）頭文件
+// 檢測每個流的順序/固定步長訪問，提前遍歷後續頁面並放入預取緩衝區
+
+#ifndef SMMU_PREFETCHER_H
+#define SMMU_PREFETCHER_H
+
+#include "smmu_types.h"
+#include "tlb.h"
+#include <vector>
+#include <optional>
+#include <mutex>
+
+namespace smmu {
+
+// ============================================================================
+// 轉換預取器類
+// 步長檢測：每個 (StreamID, ASID, VMID) 記錄上一次未命中的頁號和步長，
+//   連續兩次相同的非零步長後開始預取，之後保持領先 depth 個步長
+// 預取緩衝區：預取得到的表項先放在這裏（FIFO 替換），不佔用 TLB；
+//   TLB 未命中時先查緩衝區，命中的表項移入 TLB
+// 統計：issued（放入緩衝區的表項）、hits（被需求訪問使用的表項）、
+//   unused（未被使用就被替換或無效化的表項）
+// thread_safe 為 true 時所有操作由內部互斥鎖保護
+// ============================================================================
+
+class TranslationPrefetcher {
+public:
+    // 預取計劃：從 start 開始每隔 stride 字節一個頁面，共 count 個
+    struct Plan {
+        VirtualAddress start;
+        int64_t stride;
+        uint32_t count;
+    };
+
+    // 構造函數
+    // depth: 領先需求訪問的頁面數
+    // buffer_entries: 預取緩衝區表項數
+    // stream_entries: 步長檢測表項數（按 StreamID 直接映射）
+    TranslationPrefetcher(size_t depth, size_t buffer_entries,
+                          size_t stream_entries, bool thread_safe = false);
+
+    // 在預取緩衝區中查找，命中時取出該表項（從緩衝區刪除）
+    std::optional<TLBEntry> take(VirtualAddress va, StreamID stream_id,
+                                 ASID asid, VMID vmid);
+
+    // 記錄一次 TLB 未命中並返回需要預取的頁面
+    // page_size: 本次轉換得到的頁面大小，步長以該大小為單位
+    Plan observe(VirtualAddress va, StreamID stream_id, ASID asid, VMID vmid,
+                 PageSize page_size);
+
+    // 放入一個預取得到的表項
+    void fill(const TLBEntry& entry);
+
+    // ========================================================================
+    // 無效化操作（與 TLBInterface 的語義相同，同時重置步長檢測狀態）
+    // ========================================================================
+
+    void invalidate_all();
+    void invalidate_by_asid(ASID asid);
+    void invalidate_by_vmid(VMID vmid);
+    void invalidate_by_va(VirtualAddress va, ASID asid);
+    void invalidate_by_va_range(VirtualAddress start, uint64_t size, ASID asid);
+    void invalidate_by_stream(StreamID stream_id);
+
+    // ========================================================================
+    // 統計信息查詢
+    // ========================================================================
+
+    size_t depth() const { return depth_; }
+    size_t size() const;                   // 緩衝區中的表項數
+    uint64_t issued_count() const;         // 放入緩衝區的表項數
+    uint64_t hit_count() const;            // 被使用的表項數
+    uint64_t unused_count() const;         // 未使用就被丟棄的表項數
+    void reset_statistics();
+
+private:
+    // 單個流的步長檢測狀態
+    struct StreamState {
+        bool valid = false;
+        StreamID stream_id = 0;
+        ASID asid = 0;
+        VMID vmid = 0;
+        uint8_t page_shift = 0;   // 步長單位（log2 頁面大小）
+        uint64_t last_page = 0;   // 上一次未命中的頁號
+        int64_t stride = 0;       // 步長（頁數）
+        uint8_t confidence = 0;   // 連續相同步長的次數
+        uint32_t ahead = 0;       // 已預取到 last_page 之後的步長數
+    };
+
+    // 緩衝區表項
+    struct Slot {
+        bool valid = false;
+        TLBEntry entry;
+    };
+
+    // 線程安全模式下鎖定內部互斥鎖，否則返回空鎖
+    std::unique_lock<std::mutex> lock() const {
+        return thread_safe_ ? std::unique_lock<std::mutex>(mutex_)
+                            : std::unique_lock<std::mutex>();
+    }
+
+    // 刪除滿足條件的緩衝區表項，並重置步長檢測狀態
+    template <typename Pred>
+    void discard_if(Pred pred) {
+        for (auto& slot : buffer_) {
+            if (slot.valid && pred(slot.entry)) {
+                slot.valid = false;
+                unused_count_++;
+            }
+        }
+        for (auto& state : streams_) state.valid = false;
+    }
+
+    size_t depth_;                        // 預取深度
+    std::vector<Slot> buffer_;            // 預取緩衝區
+    size_t next_slot_;                    // FIFO 替換位置
+    std::vector<StreamState> streams_;    // 步長檢測表
+    uint64_t issued_count_;
+    uint64_t hit_count_;
+    uint64_t unused_count_;
+    bool thread_safe_;                    // 是否啟用內部鎖
+    mutable std::mutex mutex_;            // 保護以上所有狀態
+};
+
+} // namespace smmu
+
+#endif // SMMU_PREFETCHER_H
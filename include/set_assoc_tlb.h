@@ -0,0 +1,166 @@
+// 組相聯 TLB 頭文件
+// 使用扁平數組存儲表項，支持可配置的組數/路數和可插拔的替換策略
+
+#ifndef SMMU_SET_ASSOC_TLB_H
+#define SMMU_SET_ASSOC_TLB_H
+
+#include "tlb.h"
+#include <vector>
+#include <memory>
+#include <array>
+
+namespace smmu {
+
+// ============================================================================
+// 替換策略狀態接口
+// 每種替換策略維護自己的每組元數據
+// ============================================================================
+
+class ReplacementState {
+public:
+    virtual ~ReplacementState() = default;
+
+    // 某一路被命中時調用
+    virtual void on_hit(size_t set, size_t way) = 0;
+
+    // 某一路被填入新表項時調用
+    virtual void on_fill(size_t set, size_t way) = 0;
+
+    // 某一路被無效化時調用（默認不需要處理）
+    virtual void on_invalidate(size_t set, size_t way) { (void)set; (void)way; }
+
+    // 選擇要淘汰的路（僅在組內所有路都有效時調用）
+    virtual size_t victim(size_t set) = 0;
+};
+
+// 根據策略創建替換狀態
+// sets: 組數, ways: 每組路數
+std::unique_ptr<ReplacementState> make_replacement_state(ReplacementPolicy policy,
+                                                         size_t sets,
+                                                         size_t ways);
+
+// ============================================================================
+// 組相聯 TLB 類
+// 所有頁面大小共用一個數組，每個表項帶頁面大小標籤；
+// 每種頁面大小使用自己的 VPN 位選擇組，查找時只探測當前駐留的頁面大小
+// 流配額限制組內犧牲路的選擇（上限和保留額度按整個 TLB 的表項數計算）
+// ============================================================================
+
+class SetAssociativeTLB : public TLBInterface {
+public:
+    // 構造函數
+    // capacity: 總表項數量
+    // ways: 每組路數（0 表示全相聯，即單組）
+    // policy: 替換策略
+    // 組數會向下取整到2的冪
+    SetAssociativeTLB(size_t capacity, size_t ways,
+                      ReplacementPolicy policy = ReplacementPolicy::LRU);
+
+    std::optional<TLBEntry> lookup(VirtualAddress va, StreamID stream_id,
+                                   ASID asid, VMID vmid) override;
+
+    void insert(const TLBEntry& entry) override;
+
+    // ========================================================================
+    // TLB 無效化操作
+    // ========================================================================
+
+    void invalidate_all() override;
+    void invalidate_by_asid(ASID asid) override;
+    void invalidate_by_vmid(VMID vmid) override;
+    void invalidate_by_va(VirtualAddress va, ASID asid) override;
+    void invalidate_by_stream(StreamID stream_id) override;
+    void invalidate_by_va_range(VirtualAddress start, uint64_t size,
+                                ASID asid, uint8_t ttl_level = 0) override;
+
+    // ========================================================================
+    // 統計信息查詢
+    // ========================================================================
+
+    size_t size() const override { return valid_count_; }
+    size_t capacity() const override { return sets_ * ways_; }
+    uint64_t hit_count() const override { return hit_count_; }
+    uint64_t miss_count() const override { return miss_count_; }
+
+    void set_stream_quota(StreamID stream_id, size_t reserved, size_t limit) override {
+        partitions_.set_quota(stream_id, reserved, limit);
+    }
+    TLBStreamStats stream_stats(StreamID stream_id) const override {
+        const TLBStreamStats* partition = partitions_.find(stream_id);
+        return partition ? *partition : TLBStreamStats();
+    }
+    void reset_stream_stats() override { partitions_.reset_statistics(); }
+
+    // 按填入順序導出；替換策略的訪問歷史不導出，重新插入後按填入順序重建
+    void export_entries(std::vector<TLBEntry>& out) const override;
+
+    size_t num_sets() const { return sets_; }    // 組數
+    size_t num_ways() const { return ways_; }    // 每組路數
+    ReplacementPolicy policy() const { return policy_; }
+
+private:
+    // ========================================================================
+    // 標籤結構
+    // 查找時只掃描標籤數組，命中後才訪問表項數據
+    // ========================================================================
+
+    struct Tag {
+        VirtualAddress va_base;  // 頁面基地址
+        StreamID stream_id;      // 流ID
+        ASID asid;               // 地址空間ID
+        VMID vmid;               // 虛擬機ID
+        uint8_t page_shift;      // 頁面大小（log2）
+        bool valid;              // 是否有效
+    };
+
+    // 計算某頁面大小下虛擬地址對應的組索引
+    size_t set_index(VirtualAddress va, uint8_t page_shift) const {
+        return static_cast<size_t>(va >> page_shift) & set_mask_;
+    }
+
+    // 在指定頁面大小下查找匹配的路，返回數組下標（未找到返回 npos）
+    size_t find(VirtualAddress va, uint8_t page_shift, StreamID stream_id,
+                ASID asid, VMID vmid) const;
+
+    // 使指定位置的表項無效
+    void invalidate_slot(size_t slot);
+
+    // 為 owner 在組 set 中選擇一路（必要時淘汰該路的表項）
+    // owner 達到上限時替換它在本組中最早插入的表項，本組沒有時返回 npos（旁路）；
+    // 否則優先空閒路，再由替換策略選擇，犧牲路屬於某個流的保留額度時
+    // 改選組內最早插入的、不受保護的一路
+    size_t choose_slot(size_t set, TLBStreamStats& owner);
+
+    // 淘汰指定位置的表項（計入所屬流的淘汰數）
+    void evict_slot(size_t slot);
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // ========================================================================
+    // 私有成員變量
+    // ========================================================================
+
+    size_t sets_;                 // 組數
+    size_t ways_;                 // 每組路數
+    size_t set_mask_;             // 組索引掩碼
+    ReplacementPolicy policy_;    // 替換策略
+
+    std::vector<Tag> tags_;       // 標籤數組（sets_ * ways_，按組連續存放）
+    std::vector<TLBEntry> data_;  // 表項數據（與標籤一一對應）
+    std::vector<TLBStreamStats*> owners_;  // 表項所屬流的分區（與標籤一一對應）
+    TLBPartitions partitions_;    // 按流分區
+    std::unique_ptr<ReplacementState> replacement_;
+
+    size_t valid_count_;          // 有效表項數量
+    uint64_t timestamp_counter_;  // 時間戳計數器
+    uint64_t hit_count_;          // 命中計數
+    uint64_t miss_count_;         // 未命中計數
+
+    // 每種頁面大小（按 log2 索引）的駐留表項數，以及駐留大小的位圖
+    std::array<uint32_t, 64> size_counts_;
+    uint64_t resident_shifts_;
+};
+
+} // namespace smmu
+
+#endif // SMMU_SET_ASSOC_TLB_H
@@ -6,76 +6,35 @@
 
 #include "smmu_types.h"
 #include "tlb.h"
+#include "set_assoc_tlb.h"
 #include "page_table.h"
+#include "prefetcher.h"
+#include "instrumentation.h"
+#include "smmu_queue.h"
+#include "smmu_registers.h"
+#include "smmu_snapshot.h"
 #include <memory>
-#include <unordered_map>
+#include <functional>
 #include <vector>
 #include <queue>
 #include <cstring>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
 
 namespace smmu {
 
 // ============================================================================
-// 命令隊列表項
-// 用於配置和控制 SMMU 的命令
+// 批量轉換請求
+// 用於 translate_batch 一次提交多個地址轉換
 // ============================================================================
 
-struct Command {
-    CommandType type;  // 命令類型
-    
-    // 命令數據（使用聯合體節省空間）
-    union {
-        // 使流表項緩存無效
-        struct {
-            StreamID stream_id;
-        } cfgi_ste;
-        
-        // 使上下文描述符緩存無效
-        struct {
-            StreamID stream_id;
-            ASID asid;
-        } cfgi_cd;
-        
-        // 按 ASID 使 TLB 無效
-        struct {
-            ASID asid;
-        } tlbi_asid;
-        
-        // 按虛擬地址使 TLB 無效
-        struct {
-            VirtualAddress va;
-            ASID asid;
-        } tlbi_va;
-        
-        // 按 VMID 使所有 TLB 無效
-        struct {
-            VMID vmid;
-        } tlbi_vmall;
-    } data;
-    
-    // 默認構造函數：初始化為同步命令
-    Command() : type(CommandType::CMD_SYNC) {
-        std::memset(&data, 0, sizeof(data));
-    }
-};
-
-// ============================================================================
-// 事件隊列表項
-// 記錄 SMMU 產生的錯誤和事件
-// ============================================================================
-
-struct Event {
-    FaultType fault_type;        // 錯誤類型
-    StreamID stream_id;          // 相關的流ID
-    ASID asid;                   // 相關的地址空間ID
-    VMID vmid;                   // 相關的虛擬機ID
-    VirtualAddress va;           // 相關的虛擬地址
-    std::string description;     // 錯誤描述
-    uint64_t timestamp;          // 時間戳
-    
-    // 默認構造函數
-    Event() : fault_type(FaultType::NONE), stream_id(0), 
-              asid(0), vmid(0), va(0), timestamp(0) {}
+struct TranslationRequest {
+    VirtualAddress va;    // 虛擬地址
+    StreamID stream_id;   // 流ID
+    ASID asid;            // 地址空間ID
+    VMID vmid;            // 虛擬機ID
 };
 
 // ============================================================================
@@ -85,22 +44,103 @@ struct Event {
 
 struct SMMUConfig {
     size_t tlb_size;              // TLB 大小（表項數量）
-    size_t stream_table_size;     // 流表大小
+    size_t stream_table_size;     // 流表大小（預先分配的 StreamID 範圍，更大的 StreamID 按需擴展）
     size_t command_queue_size;    // 命令隊列深度
     size_t event_queue_size;      // 事件隊列深度
     bool stage1_enabled;          // 是否啟用階段1轉換
     bool stage2_enabled;          // 是否啟用階段2轉換
     
+    // TLB 結構配置
+    TLBOrganization tlb_organization;  // TLB 組織方式（全相聯/組相聯）
+    size_t tlb_ways;                   // 組相聯時的路數（組數 = tlb_size / tlb_ways）
+    ReplacementPolicy tlb_replacement; // 組相聯時的替換策略
+    
+    size_t walk_cache_size;            // 頁表遍歷緩存每級表項數（0 表示禁用）
+    size_t s2_tlb_size;                // 階段2 TLB（IPA -> PA）表項數（0 表示禁用，默認禁用：
+                                       // 階段2遍歷已經使用頁表遍歷緩存，全相聯 TLB 的查找開銷大於節省）
+    bool fill_leaf_neighbours;         // 遍歷讀取的葉子緩存行中的相鄰頁面也填入 TLB（僅階段1）
+    bool use_contiguous_hint;          // 按描述符連續位把一組頁面緩存為一個 TLB 表項
+    bool coalesce_leaf_pages;          // 軟件合併：葉子緩存行中 VA/PA 連續、屬性相同的頁面合併為一個表項（僅階段1）
+    
+    // 順序訪問預取配置
+    size_t prefetch_depth;             // 檢測到固定步長後領先的頁面數（0 表示禁用）
+    size_t prefetch_buffer_size;       // 預取緩衝區表項數
+    size_t prefetch_streams;           // 步長檢測表項數（按 StreamID 直接映射）
+    
+    // 並發模式配置
+    bool thread_safe;                  // 是否允許多個線程同時調用 SMMU 接口
+    size_t tlb_shards;                 // 並發模式下按 StreamID 劃分的 TLB 分片數（每片 tlb_size / tlb_shards 項）
+    
+    // 插樁配置（見 instrumentation.h；關閉時轉換路徑只多一次空指針判斷）
+    bool instrumentation;                   // 是否記錄按上下文的計數、遍歷深度分佈和延遲直方圖
+    size_t instrumentation_contexts;        // 上下文計數表容量（超出的上下文合併計數）
+    uint32_t model_hit_cycles;              // 模型延遲：TLB 命中的週期數
+    uint32_t model_descriptor_read_cycles;  // 模型延遲：每次描述符讀取的週期數
+    uint32_t instrumentation_time_sampling; // 每個線程每隔多少次轉換測量一次主機耗時（0 不測量）
+    
     // 默認配置
     SMMUConfig() 
         : tlb_size(128), stream_table_size(256),
           command_queue_size(64), event_queue_size(64),
-          stage1_enabled(true), stage2_enabled(false) {}
+          stage1_enabled(true), stage2_enabled(false),
+          tlb_organization(TLBOrganization::FULLY_ASSOCIATIVE),
+          tlb_ways(8), tlb_replacement(ReplacementPolicy::LRU),
+          walk_cache_size(16), s2_tlb_size(0), fill_leaf_neighbours(false),
+          use_contiguous_hint(true), coalesce_leaf_pages(false),
+          prefetch_depth(0), prefetch_buffer_size(32), prefetch_streams(16),
+          thread_safe(false), tlb_shards(16),
+          instrumentation(false), instrumentation_contexts(256),
+          model_hit_cycles(10), model_descriptor_read_cycles(50),
+          instrumentation_time_sampling(16) {}
+};
+
+// ============================================================================
+// 轉換失效通知
+// 已緩存的轉換因無效化（直接調用或 TLBI/CFGI 命令）、TLB 容量淘汰或
+// SMMU 啟用狀態改變而不再有效時發出，用於撤銷外部基於這些轉換的緩存
+// （例如 SystemC 封裝授予的 DMI 區域）
+// ============================================================================
+
+struct TranslationInvalidation {
+    enum class Scope {
+        ALL,        // 所有轉換
+        ASID,       // asid 相同的轉換
+        VMID,       // vmid 相同的轉換
+        STREAM,     // stream_id 相同的轉換
+        VA_RANGE,   // asid 相同、且與 [va, va + size) 重疊的轉換
+        ENTRY       // 被淘汰的單個表項：stream_id、asid、vmid 相同且與 [va, va + size) 重疊
+    };
+    
+    Scope scope;
+    StreamID stream_id;
+    ASID asid;
+    VMID vmid;
+    VirtualAddress va;
+    uint64_t size;
+    
+    TranslationInvalidation()
+        : scope(Scope::ALL), stream_id(0), asid(0), vmid(0), va(0), size(0) {}
 };
 
+using InvalidationCallback = std::function<void(const TranslationInvalidation&)>;
+
 // ============================================================================
 // SMMU 主類
 // 協調所有組件，提供完整的 SMMU 功能
+//
+// 並發模式（SMMUConfig::thread_safe）：
+//   - TLB 按 StreamID 分片，每個分片有自己的鎖，不同流的命中互不競爭
+//   - 統計信息按線程分槽累加，讀取時匯總
+//   - 流表和上下文描述符以不可變快照發佈（寫時複製），轉換只讀取快照
+//   - 無效化等待進行中的頁表遍歷完成，不會有過期表項在無效化之後被填入
+//   - 頁表內存的修改需要調用者在發出無效化命令之前完成
+//
+// 嵌套轉換（流表項同時啟用階段1和階段2）：
+//   - 階段1頁表位於 IPA 空間，遍歷時每一級表地址和最終輸出都經過階段2轉換
+//   - 階段2 TLB 緩存 IPA -> PA 映射（按 VMID 標記），供階段1遍歷中的表地址和輸出共用
+//   - 主 TLB 緩存組合的 VA -> PA 表項（stage 為 STAGE1_AND_STAGE2），
+//     按調用者傳入的 VMID 標記；嵌套流的調用者應傳入流表項中的 VMID，
+//     使 CMD_TLBI_S12_VMALL 能同時清除組合表項和階段2 TLB
 // ============================================================================
 
 class SMMU {
@@ -115,11 +155,18 @@ public:
     // 設置內存模型（用於訪問頁表）
     void set_memory_model(std::shared_ptr<SimpleMemoryModel> memory);
     
+    // 設置頁表遍歷使用的內存讀取回調（例如經過互連模型的 PTW 端口）
+    // 設置後遍歷器（包括預取和鄰近表項填充）只通過回調讀取描述符，不再直接讀取內存模型；
+    // block_read 為空時葉子緩存行按描述符逐個讀取。必須在 set_memory_model 之後調用，
+    // 再次調用 set_memory_model 會恢復直接讀取。並發模式下回調需要自行保證線程安全
+    void set_walk_memory(MemoryReadCallback read, MemoryBlockReadCallback block_read = nullptr);
+    
     // ========================================================================
     // 流表配置
     // ========================================================================
     
     // 配置流表項（每個設備一個表項）
+    // 同時把 tlb_reserved / tlb_limit 設置為該流在主 TLB 中的配額
     void configure_stream_table_entry(StreamID stream_id, 
                                      const StreamTableEntry& ste);
     
@@ -153,18 +200,49 @@ public:
                                ASID asid = 0,
                                VMID vmid = 0);
     
+    // 批量地址轉換
+    // requests/results: 長度為 count 的請求和結果數組
+    // 同一 StreamID/ASID 的請求共用配置查找，同一頁面的連續請求復用轉換結果；
+    // 只啟用階段1時同一上下文的未命中成組遍歷，共享上層表
+    void translate_batch(const TranslationRequest* requests,
+                         TranslationResult* results,
+                         size_t count);
+    
+    // 批量地址轉換（vector 版本）
+    std::vector<TranslationResult> translate_batch(
+        const std::vector<TranslationRequest>& requests);
+    
+    // ========================================================================
+    // 寄存器接口
+    // CR0.CMDQEN / CR0.EVENTQEN 置位後，命令隊列和事件隊列是內存模型中的環形隊列
+    // （基地址和深度來自 CMDQ_BASE / EVENTQ_BASE，格式見 smmu_queue.h）：
+    //   - 寫 CMDQ_PROD 是門鈴：批量讀取 [CONS, PROD) 之間的命令並執行，更新 CMDQ_CONS
+    //   - 非法命令使處理暫停，CMDQ_CONS.ERR 記錄原因並翻轉 GERROR.CMDQ_ERR，
+    //     軟件寫 GERRORN 確認後從 CMDQ_CONS 繼續
+    //   - 事件寫到 EVENTQ_PROD 處；隊列已滿時丟棄並翻轉 EVENTQ_PROD.OVFLG
+    // 隊列所在的內存需要在啟用前寫入過（與頁表相同，SMMU 不負責分配）
+    // ========================================================================
+    
+    uint32_t read_register(RegisterOffset offset) const;
+    void write_register(RegisterOffset offset, uint32_t value);
+    uint64_t read_register_64(RegisterOffset offset) const;
+    void write_register_64(RegisterOffset offset, uint64_t value);
+    
     // ========================================================================
     // 命令隊列操作
     // ========================================================================
     
     // 提交命令到命令隊列
-    void submit_command(const Command& cmd);
+    // 內存隊列模式下寫入 PROD 處的表項並敲門鈴
+    // 返回：隊列已滿、命令被丟棄時返回 false
+    bool submit_command(const Command& cmd);
     
     // 處理所有待處理的命令
     void process_commands();
     
     // ========================================================================
     // 事件隊列操作
+    // 內存隊列模式下從 EVENTQ_CONS 處讀取並前進 EVENTQ_CONS（同時確認溢出）
     // ========================================================================
     
     // 檢查是否有待處理的事件
@@ -181,8 +259,15 @@ public:
     void invalidate_tlb_by_asid(ASID asid);                 // 按 ASID 無效化
     void invalidate_tlb_by_vmid(VMID vmid);                 // 按 VMID 無效化
     void invalidate_tlb_by_va(VirtualAddress va, ASID asid); // 按虛擬地址無效化
+    void invalidate_tlb_by_va_range(VirtualAddress start, uint64_t size,
+                                    ASID asid, uint8_t ttl_level = 0); // 按虛擬地址範圍無效化
     void invalidate_tlb_by_stream(StreamID stream_id);      // 按流ID無效化
     
+    // 設置轉換失效回調（nullptr 取消）
+    // 回調在無效化完成後、淘汰時在持有 TLB 鎖時調用，不能在回調中調用 SMMU 接口；
+    // 並發模式下可能從多個線程調用。應在開始轉換之前設置
+    void set_invalidation_callback(InvalidationCallback callback);
+    
     // ========================================================================
     // 統計信息
     // ========================================================================
@@ -196,35 +281,196 @@ public:
         uint64_t permission_faults;     // 權限錯誤次數
         uint64_t commands_processed;    // 已處理命令數
         uint64_t events_generated;      // 已生成事件數
+        uint64_t events_dropped;        // 事件隊列已滿而丟棄的事件數
+        uint64_t command_errors;        // 非法或無法讀取的命令數
+        uint64_t descriptor_reads;      // 頁表描述符讀取次數
+        uint64_t walk_cache_hits[PageWalkCache::NUM_LEVELS]; // 頁表遍歷緩存命中（按起始級別）
+        uint64_t walk_cache_misses;     // 頁表遍歷緩存未命中（從頂層開始遍歷）
+        uint64_t s2_tlb_hits;           // 階段2 TLB 命中次數
+        uint64_t s2_tlb_misses;         // 階段2 TLB 未命中次數（需要階段2遍歷）
+        uint64_t prefetches_issued;     // 預取並放入預取緩衝區的表項數
+        uint64_t prefetch_hits;         // 由預取緩衝區滿足的 TLB 未命中次數
+        uint64_t prefetches_unused;     // 未被使用就被替換或無效化的預取表項數
+        uint64_t neighbour_fills;       // 由葉子緩存行填入 TLB 的相鄰表項數
+        uint64_t contiguous_fills;      // 按連續位覆蓋整個連續範圍的 TLB 填充數
+        uint64_t coalesced_fills;       // 由軟件合併覆蓋多個頁面的 TLB 填充數
+        uint64_t batch_reuses;          // 批量轉換中與上一個請求同頁、直接復用結果（不查找 TLB）的次數
     };
     
     // 獲取統計信息
-    Statistics get_statistics() const { return stats_; }
+    Statistics get_statistics() const;
     
-    // 重置統計信息
+    // 重置統計信息（包括每個流的 TLB 計數器）
     void reset_statistics();
     
+    // 流在主 TLB 中的配額、表項數和命中/未命中/淘汰計數
+    TLBStreamStats get_stream_tlb_statistics(StreamID stream_id) const;
+    
+    // 插樁快照（SMMUConfig::instrumentation 為 false 時 enabled 為 false、其餘為空）
+    // 由 reset_statistics 一併清零
+    InstrumentationSnapshot get_instrumentation() const;
+    
     // ========================================================================
     // 啟用/禁用控制
     // ========================================================================
     
-    void enable();                      // 啟用 SMMU
-    void disable();                     // 禁用 SMMU
-    bool is_enabled() const { return enabled_; }  // 檢查是否已啟用
+    void enable();                      // 啟用 SMMU（同時更新 CR0.SMMUEN）
+    void disable();                     // 禁用 SMMU（同時更新 CR0.SMMUEN）
+    bool is_enabled() const { return enabled_.load(std::memory_order_acquire); }  // 檢查是否已啟用
+    
+    // ========================================================================
+    // 狀態快照（格式見 smmu_snapshot.h）
+    // 保存流表、上下文描述符、主 TLB 和階段2 TLB 的表項（按淘汰順序）、統計計數器、
+    // 啟用狀態，以及內存模型中已分配的幀；之後的任務加載快照即從預熱的狀態開始
+    // 不保存寄存器、命令/事件隊列、頁表遍歷緩存、預取器和插樁計數（恢復後為空）
+    // 保存和加載期間不能有其他線程調用 SMMU 接口或寫入內存模型
+    // ========================================================================
+    
+    // 寫入快照文件，info 非 nullptr 時返回保存的數量
+    SnapshotError save_snapshot(const std::string& path, SnapshotInfo* info = nullptr) const;
+    
+    // 加載快照：替換流表和上下文描述符，清空並重新填充 TLB，恢復統計計數器和啟用狀態；
+    // 當前內存模型（未設置時創建一個）的內容被替換為快照中的幀，快照之外的幀被丟棄
+    // TLB 配置可以與保存時不同：表項按從舊到新的順序重新插入，容量較小時保留最新的表項
+    // 文件在修改任何狀態之前完整校驗；幀先讀入臨時的內存模型，全部讀取成功後才交換，
+    // 任何錯誤返回時 SMMU 和內存模型都不變
+    SnapshotError load_snapshot(const std::string& path, SnapshotInfo* info = nullptr);
     
 private:
     // ========================================================================
     // 內部轉換函數
     // ========================================================================
     
+    // TLB 命中時根據表項構造轉換結果
+    TranslationResult make_result_from_tlb(const TLBEntry& entry,
+                                           VirtualAddress va) const;
+    
+    // translate 的實現；tlb_hit 返回是否命中主 TLB（用於插樁）
+    TranslationResult translate_lookup(VirtualAddress va,
+                                       StreamID stream_id,
+                                       ASID asid,
+                                       VMID vmid,
+                                       bool& tlb_hit);
+    
+    // TLB 未命中處理：頁表遍歷並填充 TLB（ste/cd 為 nullptr 表示不存在）
+    // 並發模式下持有 walk_mutex_ 的共享鎖，與無效化互斥
+    TranslationResult translate_miss(VirtualAddress va,
+                                     StreamID stream_id,
+                                     ASID asid,
+                                     VMID vmid,
+                                     const StreamTableEntry* ste,
+                                     const ContextDescriptor* cd);
+    
+    // 批量轉換中從未命中的 requests[first] 開始成組遍歷同一上下文的後續請求
+    // （只啟用階段1時），返回組後第一個未處理的請求下標
+    static constexpr size_t WALK_GROUP_SIZE = 64;
+    size_t translate_walk_group(const TranslationRequest* requests,
+                                TranslationResult* results,
+                                size_t first,
+                                size_t count,
+                                const StreamTableEntry& ste,
+                                const ContextDescriptor& cd);
+    
+    // 兩個請求是否屬於同一轉換上下文
+    static bool same_context(const TranslationRequest& a, const TranslationRequest& b) {
+        return a.stream_id == b.stream_id && a.asid == b.asid && a.vmid == b.vmid;
+    }
+    
+    // 按流表項配置執行階段1/階段2轉換（不查 TLB，不填充）
+    // report_faults 為 false 時失敗不生成事件（用於預取）
+    // line 非 nullptr 且只啟用階段1時，讀取葉子緩存行
+    TranslationResult walk_stages(VirtualAddress va,
+                                  StreamID stream_id,
+                                  ASID asid,
+                                  VMID vmid,
+                                  const StreamTableEntry& ste,
+                                  const ContextDescriptor* cd,
+                                  bool report_faults,
+                                  LeafLine* line = nullptr);
+    
+    // 由成功的轉換結果構造 TLB 表項，並插入該流所在的分片
+    TLBEntry make_tlb_entry(const TranslationResult& result,
+                            VirtualAddress va,
+                            StreamID stream_id,
+                            ASID asid,
+                            VMID vmid,
+                            const StreamTableEntry& ste) const;
+    void insert_tlb_entry(const TLBEntry& entry);
+    
+    // 把葉子緩存行中 [skip_first, skip_first + skip_count) 以外的有效頁描述符填入 TLB
+    void fill_neighbours(const LeafLine& line,
+                         uint8_t skip_first,
+                         uint8_t skip_count,
+                         StreamID stream_id,
+                         ASID asid,
+                         VMID vmid,
+                         const StreamTableEntry& ste);
+    
+    // 記錄一次未命中，檢測到固定步長時遍歷後續頁面並放入預取緩衝區
+    void prefetch_ahead(VirtualAddress va,
+                        StreamID stream_id,
+                        ASID asid,
+                        VMID vmid,
+                        const StreamTableEntry& ste,
+                        const ContextDescriptor* cd,
+                        PageSize page_size);
+    
+    // ========================================================================
+    // 配置表快照
+    // 二級線性流表（與 SMMUv3 STRTAB_BASE_CFG 的 2-level 格式相同的劃分）：
+    //   StreamID[23:8] 選擇一級表項，StreamID[7:0] 選擇二級表中的流
+    // 二級表按需分配；每個流的上下文描述符存放在該流的表項中，按 ASID 線性查找
+    // 寫入時只複製一級表和被修改的二級表，其餘二級表在新舊快照之間共享，
+    // 讀者持有的快照在其生命週期內保持不變
+    // ========================================================================
+    
+    static constexpr unsigned STRTAB_SPLIT = 8;     // 二級表覆蓋的 StreamID 位數
+    static constexpr unsigned STREAM_ID_BITS = 24;  // 支持的 StreamID 位數（IDR1.SIDSIZE）
+    
+    struct StreamSlot {
+        bool present = false;                      // 是否配置了流表項
+        StreamTableEntry ste;                      // 流表項
+        std::vector<std::pair<ASID, ContextDescriptor>> context_descriptors; // 該流的上下文描述符
+    };
+    
+    struct StreamTableSpan {
+        StreamSlot slots[1U << STRTAB_SPLIT];
+    };
+    
+    struct ConfigTables {
+        std::vector<std::shared_ptr<StreamTableSpan>> spans;  // 一級表（nullptr 表示未分配）
+    };
+    
+    // 獲取當前配置表快照
+    std::shared_ptr<const ConfigTables> load_config_tables() const;
+    
+    // 修改某個流的表項（並發模式下寫時複製後發佈）
+    // StreamID 超出 STREAM_ID_BITS 時忽略
+    template <typename Mutator>
+    void update_stream_slot(StreamID stream_id, Mutator mutate);
+    
+    // 在快照中查找（不複製），不存在時返回 nullptr
+    static const StreamSlot* find_stream_slot(const ConfigTables& tables, StreamID stream_id);
+    static const StreamTableEntry* find_stream_table_entry(const StreamSlot* slot);
+    static const ContextDescriptor* find_context_descriptor(const StreamSlot* slot, ASID asid);
+    
     // 階段1轉換（虛擬地址 -> 中間物理地址）
+    // 流表項啟用階段2時為嵌套遍歷，各級表地址經 translate_ipa 轉換
     TranslationResult translate_stage1(VirtualAddress va,
                                       const StreamTableEntry& ste,
-                                      const ContextDescriptor& cd);
+                                      const ContextDescriptor& cd,
+                                      bool report_faults = true,
+                                      LeafLine* line = nullptr);
     
     // 階段2轉換（中間物理地址 -> 物理地址）
     TranslationResult translate_stage2(PhysicalAddress ipa,
-                                      const StreamTableEntry& ste);
+                                      const StreamTableEntry& ste,
+                                      bool report_faults = true);
+    
+    // IPA -> PA：先查階段2 TLB，未命中時遍歷階段2頁表並填充
+    // 不生成事件，不計入 descriptor_reads（由調用者按結果累加）
+    TranslationResult translate_ipa(PhysicalAddress ipa,
+                                    const StreamTableEntry& ste);
     
     // ========================================================================
     // 事件生成
@@ -233,7 +479,7 @@ private:
     // 生成並添加事件到事件隊列
     void generate_event(FaultType fault_type, StreamID stream_id,
                        ASID asid, VMID vmid, VirtualAddress va,
-                       const std::string& description);
+                       const char* description);
     
     // ========================================================================
     // 命令處理
@@ -242,39 +488,132 @@ private:
     // 處理單個命令
     void process_command(const Command& cmd);
     
+    // 內存隊列是否啟用（CR0.CMDQEN / CR0.EVENTQEN）
+    bool cmdq_in_memory() const;
+    bool eventq_in_memory() const;
+    
+    // 門鈴處理：消費內存命令隊列直到 CONS 追上 PROD 或遇到錯誤
+    // 並發模式下同一時刻只有一個線程消費，其他線程的門鈴由它代為處理
+    void consume_command_queue();
+    
+    // 把事件寫入內存事件隊列（需持有 register_mutex_），隊列已滿時返回 false
+    bool write_event_to_queue(const Event& event);
+    
     // ========================================================================
     // 私有成員變量
     // ========================================================================
     
-    SMMUConfig config_;  // SMMU 配置
-    bool enabled_;       // 是否已啟用
+    SMMUConfig config_;          // SMMU 配置
+    std::atomic<bool> enabled_;  // 是否已啟用
+    bool concurrent_;            // 是否為並發模式（config_.thread_safe）
+    
+    // ========================================================================
+    // TLB 分片
+    // 非並發模式下只有一個分片，容量為 tlb_size
+    // ========================================================================
+    
+    struct alignas(64) TLBShard {
+        std::mutex mutex;                  // 保護分片內的 TLB（包括 LRU 狀態）
+        std::unique_ptr<TLBInterface> tlb; // 分片 TLB
+    };
+    
+    TLBShard& tlb_shard(StreamID stream_id) const {
+        return tlb_shards_[num_tlb_shards_ == 1 ? 0 : stream_id % num_tlb_shards_];
+    }
+    
+    // 對分片執行操作（並發模式下持有分片鎖）
+    template <typename Fn>
+    void for_each_tlb_shard(Fn fn);
+    
+    // 對階段2 TLB 執行無效化（未啟用時不做任何事）
+    template <typename Fn>
+    void invalidate_s2_tlb(Fn fn);
+    
+    // 發出轉換失效通知（沒有回調時不做任何事）
+    void notify_invalidation(TranslationInvalidation::Scope scope, StreamID stream_id = 0,
+                             ASID asid = 0, VMID vmid = 0, VirtualAddress va = 0,
+                             uint64_t size = 0) const;
+    
+    InvalidationCallback invalidation_callback_;            // 轉換失效回調
     
     // 核心組件
-    std::unique_ptr<TLB> tlb_;                              // TLB 緩存
+    std::unique_ptr<TLBShard[]> tlb_shards_;                // TLB 分片
+    size_t num_tlb_shards_;                                 // 分片數量
     std::unique_ptr<PageTableWalker> page_table_walker_;    // 頁表遍歷器
+    std::unique_ptr<PageWalkCache> walk_cache_;             // 頁表遍歷緩存（可選）
+    std::unique_ptr<TLB> s2_tlb_;                           // 階段2 TLB（可選）
+    mutable std::mutex s2_tlb_mutex_;                       // 保護階段2 TLB
+    std::unique_ptr<TranslationPrefetcher> prefetcher_;     // 順序訪問預取器（可選）
+    std::unique_ptr<Instrumentation> instrumentation_;      // 插樁計數器（可選）
     std::shared_ptr<SimpleMemoryModel> memory_;             // 內存模型
     
-    // 配置表
-    std::unordered_map<StreamID, StreamTableEntry> stream_table_;        // 流表
-    std::unordered_map<uint64_t, ContextDescriptor> context_descriptors_; // 上下文描述符表
+    // 配置表（通過 std::atomic_load / std::atomic_store 訪問）
+    std::shared_ptr<ConfigTables> config_tables_;
+    std::mutex config_write_mutex_;      // 串行化配置寫入
+    
+    // 進行中的頁表遍歷持有共享鎖，無效化持有獨佔鎖
+    std::shared_mutex walk_mutex_;
     
-    // 命令和事件隊列
+    // 命令和事件隊列（未啟用內存隊列時使用）
     std::queue<Command> command_queue_;  // 命令隊列
     std::queue<Event> event_queue_;      // 事件隊列
+    std::mutex command_mutex_;           // 保護命令隊列
+    mutable std::mutex event_mutex_;     // 保護事件隊列和時間戳
     
-    // 統計信息
-    Statistics stats_;           // 性能統計
-    uint64_t timestamp_counter_; // 時間戳計數器
+    // 寄存器和內存隊列
+    RegisterInterface registers_;          // 寄存器文件
+    mutable std::mutex register_mutex_;    // 保護寄存器和內存隊列表項
+    std::mutex cmdq_consumer_mutex_;       // 持有者負責消費內存命令隊列
     
     // ========================================================================
-    // 輔助函數
+    // 統計信息
+    // 每個線程累加到自己的計數槽（按緩存行對齊避免偽共享），讀取時匯總
     // ========================================================================
     
-    // 創建上下文描述符鍵（用於哈希表）
-    // 將 stream_id 和 asid 組合成唯一的64位鍵
-    uint64_t make_cd_key(StreamID stream_id, ASID asid) const {
-        return (static_cast<uint64_t>(stream_id) << 16) | asid;
+    static constexpr size_t STAT_SLOTS = 64;
+    
+    struct alignas(64) StatCounters {
+        std::atomic<uint64_t> total_translations{0};
+        std::atomic<uint64_t> tlb_hits{0};
+        std::atomic<uint64_t> tlb_misses{0};
+        std::atomic<uint64_t> page_table_walks{0};
+        std::atomic<uint64_t> translation_faults{0};
+        std::atomic<uint64_t> permission_faults{0};
+        std::atomic<uint64_t> commands_processed{0};
+        std::atomic<uint64_t> events_generated{0};
+        std::atomic<uint64_t> events_dropped{0};
+        std::atomic<uint64_t> command_errors{0};
+        std::atomic<uint64_t> descriptor_reads{0};
+        std::atomic<uint64_t> s2_tlb_hits{0};
+        std::atomic<uint64_t> s2_tlb_misses{0};
+        std::atomic<uint64_t> neighbour_fills{0};
+        std::atomic<uint64_t> contiguous_fills{0};
+        std::atomic<uint64_t> coalesced_fills{0};
+        std::atomic<uint64_t> batch_reuses{0};
+    };
+    
+    // 當前線程的計數槽
+    StatCounters& local_stats();
+    
+    // 增加計數（非並發模式下不使用原子讀改寫）
+    void bump(std::atomic<uint64_t>& counter, uint64_t n = 1) const {
+        if (concurrent_) {
+            counter.fetch_add(n, std::memory_order_relaxed);
+        } else {
+            counter.store(counter.load(std::memory_order_relaxed) + n,
+                          std::memory_order_relaxed);
+        }
+    }
+    
+    // 並發模式下鎖定互斥鎖，否則返回空鎖
+    template <typename Mutex>
+    std::unique_lock<Mutex> maybe_lock(Mutex& mutex) const {
+        return concurrent_ ? std::unique_lock<Mutex>(mutex) : std::unique_lock<Mutex>();
     }
+    
+    std::unique_ptr<StatCounters[]> stat_slots_;  // 統計計數槽
+    size_t num_stat_slots_;                       // 計數槽數量
+    uint64_t timestamp_counter_;                  // 時間戳計數器
 };
 
 } // namespace smmu
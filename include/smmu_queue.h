@@ -0,0 +1,210 @@
+// SMMU 命令隊列和事件隊列頭文件
+// 定義命令和事件表項，以及它們在內存環形隊列中的二進制格式
+
+#ifndef SMMU_QUEUE_H
+#define SMMU_QUEUE_H
+
+#include "smmu_types.h"
+#include <vector>
+#include <cstring>
+
+namespace smmu {
+
+// ============================================================================
+// 命令隊列表項
+// 用於配置和控制 SMMU 的命令
+// ============================================================================
+
+struct Command {
+    CommandType type;  // 命令類型
+
+    // 命令數據（使用聯合體節省空間）
+    union {
+        // 使流表項緩存無效
+        struct {
+            StreamID stream_id;
+        } cfgi_ste;
+
+        // 使上下文描述符緩存無效
+        struct {
+            StreamID stream_id;
+            ASID asid;
+        } cfgi_cd;
+
+        // 按 ASID 使 TLB 無效
+        struct {
+            ASID asid;
+        } tlbi_asid;
+
+        // 按虛擬地址使 TLB 無效
+        // tg 為 0 時只無效化 va 所在的頁面；
+        // tg 非 0 時為 SMMUv3.2 範圍無效化：從 va 開始的
+        // (num + 1) * 2^(5 * scale + 1) 個粒度為 2^tg 的頁面
+        struct {
+            VirtualAddress va;
+            ASID asid;
+            uint8_t tg;      // 範圍粒度（12/14/16，0 = 單地址）
+            uint8_t scale;   // 範圍指數（0-3）
+            uint8_t num;     // 範圍係數（0-31）
+            uint8_t ttl;     // 葉子級別提示（1-3，0 = 不限）
+        } tlbi_va;
+
+        // 按 VMID 使所有 TLB 無效
+        struct {
+            VMID vmid;
+        } tlbi_vmall;
+
+        // 同步命令：之前的命令全部完成後發出完成信號
+        // cs 為 SYNC_CS_IRQ 且 msi_address 非 0 時，向 msi_address 寫入 32 位 msi_data
+        struct {
+            PhysicalAddress msi_address;
+            uint32_t msi_data;
+            uint8_t cs;      // 完成信號方式（SYNC_CS_*）
+        } sync;
+    } data;
+
+    // 默認構造函數：初始化為同步命令
+    Command() : type(CommandType::CMD_SYNC) {
+        std::memset(&data, 0, sizeof(data));
+    }
+};
+
+// CMD_SYNC 完成信號方式
+constexpr uint8_t SYNC_CS_NONE = 0;  // 不發信號（軟件輪詢 CMDQ_CONS）
+constexpr uint8_t SYNC_CS_IRQ = 1;   // 寫 MSI
+constexpr uint8_t SYNC_CS_SEV = 2;   // 發送事件（本模型中等同於不發信號）
+
+// 範圍無效化命令覆蓋的字節數（tg 為 0 時返回 0）
+inline uint64_t tlbi_range_size(const Command& cmd) {
+    const auto& r = cmd.data.tlbi_va;
+    if (r.tg == 0) return 0;
+    return (static_cast<uint64_t>(r.num) + 1) << (5 * r.scale + 1 + r.tg);
+}
+
+// 把 [va, va + pages * 2^granule) 的無效化編碼為盡量少的範圍 TLBI 命令
+// va 需按粒度對齊；每條命令覆蓋 (num + 1) * 2^(5 * scale + 1) 個頁面，
+// 剩餘的奇數頁面用單地址命令補齊
+std::vector<Command> make_tlbi_range_commands(VirtualAddress va, uint64_t pages,
+                                              ASID asid, uint8_t granule = 12,
+                                              uint8_t ttl = 0);
+
+// ============================================================================
+// 事件隊列表項
+// 記錄 SMMU 產生的錯誤和事件
+// ============================================================================
+
+struct Event {
+    FaultType fault_type;        // 錯誤類型
+    StreamID stream_id;          // 相關的流ID
+    ASID asid;                   // 相關的地址空間ID
+    VMID vmid;                   // 相關的虛擬機ID
+    VirtualAddress va;           // 相關的虛擬地址
+    const char* description;     // 錯誤描述（靜態字符串）
+    uint64_t timestamp;          // 時間戳
+
+    // 默認構造函數
+    Event() : fault_type(FaultType::NONE), stream_id(0),
+              asid(0), vmid(0), va(0), description(""), timestamp(0) {}
+};
+
+// ============================================================================
+// 內存環形隊列格式
+// 操作碼與 SMMUv3 一致；字段位置按本模型支持的字段簡化
+//
+// 命令（16 字節，兩個 64 位字）：
+//   word0[7:0]   操作碼
+//   CFGI_STE / CFGI_CD:  word0[63:32] StreamID，word1[15:0] ASID（CFGI_CD）
+//   TLBI_NH_ASID:        word0[63:48] ASID
+//   TLBI_NH_VA:          word0[63:48] ASID，word0[16:12] NUM，word0[21:20] SCALE，
+//                        word1[9:8] TTL，word1[11:10] TG（0 單地址，1/2/3 = 4K/16K/64K），
+//                        word1[63:12] 地址
+//   TLBI_S12_VMALL:      word0[47:32] VMID
+//   SYNC:                word0[13:12] CS，word0[63:32] MSI 數據，word1[51:2] MSI 地址
+//
+// 事件（32 字節，四個 64 位字）：
+//   word0[7:0] 事件類型，word0[63:32] StreamID
+//   word1[15:0] ASID，word1[31:16] VMID
+//   word2 輸入地址，word3 時間戳
+//
+// 隊列索引（PROD/CONS）：低 log2size 位為表項索引，第 log2size 位為回繞標誌
+// ============================================================================
+
+namespace queue {
+
+constexpr size_t COMMAND_ENTRY_SIZE = 16;  // 命令表項大小（字節）
+constexpr size_t EVENT_ENTRY_SIZE = 32;    // 事件表項大小（字節）
+constexpr uint8_t MAX_LOG2SIZE = 19;       // 隊列最大深度（log2）
+
+// 命令操作碼
+namespace Opcode {
+    constexpr uint8_t PREFETCH_CONFIG = 0x01;
+    constexpr uint8_t PREFETCH_ADDR = 0x02;
+    constexpr uint8_t CFGI_STE = 0x03;
+    constexpr uint8_t CFGI_ALL = 0x04;
+    constexpr uint8_t CFGI_CD = 0x05;
+    constexpr uint8_t TLBI_NH_ALL = 0x10;
+    constexpr uint8_t TLBI_NH_ASID = 0x11;
+    constexpr uint8_t TLBI_NH_VA = 0x12;
+    constexpr uint8_t TLBI_S12_VMALL = 0x28;
+    constexpr uint8_t SYNC = 0x46;
+}
+
+// 事件類型
+namespace EventType {
+    constexpr uint8_t F_UUT = 0x01;          // 不支持的上游事務
+    constexpr uint8_t F_TRANSLATION = 0x10;  // 轉換錯誤
+    constexpr uint8_t F_ADDR_SIZE = 0x11;    // 地址大小錯誤
+    constexpr uint8_t F_ACCESS = 0x12;       // 訪問標誌錯誤
+    constexpr uint8_t F_PERMISSION = 0x13;   // 權限錯誤
+    constexpr uint8_t F_TLB_CONFLICT = 0x20; // TLB 衝突
+}
+
+// 命令編碼和解碼
+// decode_command 遇到未知操作碼時返回 false
+void encode_command(const Command& cmd, uint64_t raw[2]);
+bool decode_command(const uint64_t raw[2], Command& cmd);
+
+// 事件編碼和解碼（解碼後的描述為錯誤類型名稱）
+void encode_event(const Event& event, uint64_t raw[4]);
+Event decode_event(const uint64_t raw[4]);
+
+// ============================================================================
+// 隊列索引運算
+// ============================================================================
+
+inline uint32_t index_mask(uint8_t log2size) { return (1U << log2size) - 1; }
+inline uint32_t wrap_bit(uint8_t log2size) { return 1U << log2size; }
+
+// 表項索引（不含回繞標誌）
+inline uint32_t slot(uint32_t pointer, uint8_t log2size) {
+    return pointer & index_mask(log2size);
+}
+
+// 索引相同、回繞標誌相同表示為空；回繞標誌不同表示已滿
+inline bool is_empty(uint32_t prod, uint32_t cons, uint8_t log2size) {
+    uint32_t mask = index_mask(log2size) | wrap_bit(log2size);
+    return (prod & mask) == (cons & mask);
+}
+
+inline bool is_full(uint32_t prod, uint32_t cons, uint8_t log2size) {
+    uint32_t mask = index_mask(log2size) | wrap_bit(log2size);
+    return ((prod ^ cons) & mask) == wrap_bit(log2size);
+}
+
+// 隊列中的表項數量
+inline uint32_t occupancy(uint32_t prod, uint32_t cons, uint8_t log2size) {
+    uint32_t mask = index_mask(log2size) | wrap_bit(log2size);
+    return (prod - cons) & mask;
+}
+
+// 前進 n 個表項（保留回繞標誌以外的高位不變）
+inline uint32_t advance(uint32_t pointer, uint32_t n, uint8_t log2size) {
+    uint32_t mask = index_mask(log2size) | wrap_bit(log2size);
+    return (pointer & ~mask) | ((pointer + n) & mask);
+}
+
+} // namespace queue
+
+} // namespace smmu
+
+#endif // SMMU_QUEUE_H
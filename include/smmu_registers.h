@@ -34,6 +34,10 @@ enum class RegisterOffset : uint32_t {
     IRQ_CTRL = 0x0050,     // 中斷控制
     IRQ_CTRLACK = 0x0054,  // 中斷控制確認
     
+    // 全局錯誤寄存器
+    GERROR = 0x0060,   // 全局錯誤（SMMU 翻轉錯誤位）
+    GERRORN = 0x0064,  // 全局錯誤確認（軟件翻轉相同的位）
+    
     // 命令隊列寄存器
     CMDQ_BASE = 0x0090,  // 命令隊列基地址
     CMDQ_PROD = 0x0098,  // 命令隊列生產者索引
@@ -70,6 +74,47 @@ namespace CR1 {
     constexpr uint32_t TABLE_SH = (3U << 10);  // 表共享性
 }
 
+// ============================================================================
+// 隊列寄存器位定義
+// *_BASE：ADDR[51:5] 為隊列基地址，LOG2SIZE[4:0] 為隊列深度（log2）
+// *_PROD / *_CONS：低 LOG2SIZE 位為索引，第 LOG2SIZE 位為回繞標誌
+// ============================================================================
+
+namespace Q_BASE {
+    constexpr uint64_t ADDR_MASK = 0x000FFFFFFFFFFFE0ULL;  // 基地址
+    constexpr uint64_t LOG2SIZE_MASK = 0x1FULL;            // 隊列深度（log2）
+}
+
+namespace CMDQ_CONS {
+    constexpr uint32_t ERR_SHIFT = 24;             // 命令錯誤原因
+    constexpr uint32_t ERR_MASK = (0x7FU << 24);
+    constexpr uint32_t CERROR_NONE = 0x00;         // 無錯誤
+    constexpr uint32_t CERROR_ILL = 0x01;          // 非法命令
+    constexpr uint32_t CERROR_ABT = 0x02;          // 讀取命令時發生外部中止
+}
+
+namespace EVENTQ_PROD {
+    constexpr uint32_t OVFLG = (1U << 31);  // 溢出標誌（每次溢出時翻轉）
+}
+
+namespace EVENTQ_CONS {
+    constexpr uint32_t OVACKFLG = (1U << 31);  // 溢出確認標誌（軟件複製 OVFLG）
+}
+
+namespace GERROR {
+    constexpr uint32_t CMDQ_ERR = (1U << 0);  // 命令隊列錯誤，處理暫停直到確認
+}
+
+// ============================================================================
+// IDR1（識別寄存器1）位定義
+// ============================================================================
+
+namespace IDR1 {
+    constexpr uint32_t SIDSIZE_SHIFT = 0;   // StreamID 位數
+    constexpr uint32_t EVENTQS_SHIFT = 16;  // 事件隊列最大深度（log2）
+    constexpr uint32_t CMDQS_SHIFT = 21;    // 命令隊列最大深度（log2）
+}
+
 // ============================================================================
 // IDR0（識別寄存器0）位定義
 // 指示 SMMU 支持的功能
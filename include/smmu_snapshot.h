@@ -0,0 +1,136 @@
+// SMMU 狀態快照（Snapshot）文件格式頭文件
+// 由 SMMU::save_snapshot / SMMU::load_snapshot 讀寫：流表、上下文描述符、
+// TLB 內容（按淘汰順序）、統計計數器和內存模型中已分配的幀
+
+#ifndef SMMU_SNAPSHOT_H
+#define SMMU_SNAPSHOT_H
+
+#include "smmu_types.h"
+#include "tlb.h"
+#include <cstdint>
+#include <type_traits>
+
+namespace smmu {
+
+// ============================================================================
+// 快照錯誤類型
+// ============================================================================
+
+enum class SnapshotError {
+    NONE,               // 無錯誤
+    IO_ERROR,           // 文件無法打開、讀取或寫入
+    BAD_FORMAT,         // 不是快照文件，或段表與文件大小不符（截斷）
+    VERSION_MISMATCH,   // 格式版本或字節序不同
+    LAYOUT_MISMATCH     // 記錄大小不同（由不兼容的構建寫入）
+};
+
+// 錯誤類型名稱（靜態字符串，不分配內存）
+inline const char* snapshot_error_to_string(SnapshotError error) {
+    switch (error) {
+        case SnapshotError::NONE: return "NONE";
+        case SnapshotError::IO_ERROR: return "IO_ERROR";
+        case SnapshotError::BAD_FORMAT: return "BAD_FORMAT";
+        case SnapshotError::VERSION_MISMATCH: return "VERSION_MISMATCH";
+        case SnapshotError::LAYOUT_MISMATCH: return "LAYOUT_MISMATCH";
+    }
+    return "UNKNOWN";
+}
+
+// 保存或恢復的內容數量
+struct SnapshotInfo {
+    uint64_t streams = 0;               // 流表項數
+    uint64_t context_descriptors = 0;   // 上下文描述符數
+    uint64_t tlb_entries = 0;           // 主 TLB 表項數（所有分片）
+    uint64_t s2_tlb_entries = 0;        // 階段2 TLB 表項數
+    uint64_t frames = 0;                // 內存幀數
+    uint64_t file_bytes = 0;            // 文件大小
+};
+
+// ============================================================================
+// 文件格式（主機字節序）
+//   FileHeader | SectionHeader[section_count] | 各段數據
+// 每段是定長記錄的數組，段的起始偏移按 8 字節對齊；幀數據段按 4KB 對齊，
+// 其中第 i 幀對應幀索引段的第 i 個地址，可以直接 mmap 後按幀使用
+// 記錄直接保存結構體的內存表示；段表記錄每種記錄的大小，與當前構建不同時拒絕加載
+// ============================================================================
+
+namespace snapshot_format {
+
+constexpr char MAGIC[8] = {'S', 'M', 'M', 'U', 'S', 'N', 'A', 'P'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t ENDIAN_TAG = 0x01020304;   // 按主機字節序寫入，讀回不同時為另一種字節序
+constexpr uint64_t FRAME_ALIGNMENT = 4096;
+
+enum SectionKind : uint32_t {
+    STREAMS = 1,        // StreamRecord：流表項，按 StreamID 升序
+    CONTEXTS = 2,       // ContextRecord：各流的上下文描述符，按 STREAMS 的順序連續存放
+    TLB_ENTRIES = 3,    // TLBEntry：主 TLB 表項，逐個分片從最舊到最新
+    S2_TLB_ENTRIES = 4, // TLBEntry：階段2 TLB 表項，從最舊到最新
+    STATISTICS = 5,     // StatisticsRecord：一項
+    FRAME_INDEX = 6,    // uint64_t：幀地址，升序
+    FRAME_DATA = 7      // 4KB 幀數據
+};
+
+constexpr uint32_t FLAG_ENABLED = 1U << 0;    // 保存時 SMMU 已啟用
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t section_count;
+    uint32_t flags;
+    uint64_t next_allocation;   // 內存模型的下一個分配地址（沒有內存模型時為 0）
+    uint64_t file_bytes;
+};
+
+struct SectionHeader {
+    uint32_t kind;           // SectionKind
+    uint32_t record_bytes;   // 每條記錄的字節數
+    uint64_t offset;         // 相對文件開頭的偏移
+    uint64_t count;          // 記錄數
+};
+
+struct StreamRecord {
+    StreamID stream_id;
+    uint32_t present;        // 是否配置了流表項（只配置了上下文描述符的流為 0）
+    uint32_t context_count;  // 該流在 CONTEXTS 段中的記錄數
+    StreamTableEntry ste;
+};
+
+struct ContextRecord {
+    ASID asid;
+    ContextDescriptor cd;
+};
+
+// SMMU::Statistics 中由計數槽維護的字段
+// 頁表遍歷緩存和預取器的計數隨它們的內容一起從零開始，不保存
+struct StatisticsRecord {
+    uint64_t total_translations;
+    uint64_t tlb_hits;
+    uint64_t tlb_misses;
+    uint64_t page_table_walks;
+    uint64_t translation_faults;
+    uint64_t permission_faults;
+    uint64_t commands_processed;
+    uint64_t events_generated;
+    uint64_t events_dropped;
+    uint64_t command_errors;
+    uint64_t descriptor_reads;
+    uint64_t s2_tlb_hits;
+    uint64_t s2_tlb_misses;
+    uint64_t neighbour_fills;
+    uint64_t contiguous_fills;
+    uint64_t coalesced_fills;
+    uint64_t batch_reuses;
+};
+
+static_assert(std::is_trivially_copyable<StreamTableEntry>::value &&
+              std::is_trivially_copyable<ContextDescriptor>::value &&
+              std::is_trivially_copyable<TLBEntry>::value,
+              "snapshot records are stored as their in-memory representation");
+
+} // namespace snapshot_format
+
+} // namespace smmu
+
+#endif // SMMU_SNAPSHOT_H
@@ -5,7 +5,7 @@
 #define SMMU_TYPES_H
 
 #include <cstdint>
-#include <string>
+#include <cstddef>
 
 namespace smmu {
 
@@ -31,7 +31,8 @@ enum class PageSize : uint64_t {
     SIZE_2MB = 0x200000,      // 2MB 大頁面
     SIZE_32MB = 0x2000000,    // 32MB 大頁面
     SIZE_512MB = 0x20000000,  // 512MB 大頁面
-    SIZE_1GB = 0x40000000     // 1GB 大頁面
+    SIZE_1GB = 0x40000000,    // 1GB 大頁面
+    SIZE_16GB = 0x400000000   // 16GB（4KB 粒度 L1 / 64KB 粒度 L2 的連續塊）
 };
 
 // ============================================================================
@@ -69,8 +70,37 @@ enum class AccessPermission {
     READ_WRITE   // 讀寫
 };
 
+// ============================================================================
+// 錯誤類型
+// ============================================================================
+
+enum class FaultType {
+    NONE,                                // 無錯誤
+    TRANSLATION_FAULT,                   // 轉換錯誤（頁表項無效）
+    PERMISSION_FAULT,                    // 權限錯誤
+    ACCESS_FAULT,                        // 訪問錯誤
+    ADDRESS_SIZE_FAULT,                  // 地址大小錯誤
+    TLB_CONFLICT_FAULT,                  // TLB 衝突錯誤
+    UNSUPPORTED_UPSTREAM_TRANSACTION     // 不支持的上游事務
+};
+
+// 錯誤類型名稱（靜態字符串，不分配內存）
+inline const char* fault_type_to_string(FaultType type) {
+    switch (type) {
+        case FaultType::NONE: return "NONE";
+        case FaultType::TRANSLATION_FAULT: return "TRANSLATION_FAULT";
+        case FaultType::PERMISSION_FAULT: return "PERMISSION_FAULT";
+        case FaultType::ACCESS_FAULT: return "ACCESS_FAULT";
+        case FaultType::ADDRESS_SIZE_FAULT: return "ADDRESS_SIZE_FAULT";
+        case FaultType::TLB_CONFLICT_FAULT: return "TLB_CONFLICT_FAULT";
+        case FaultType::UNSUPPORTED_UPSTREAM_TRANSACTION: return "UNSUPPORTED_UPSTREAM_TRANSACTION";
+    }
+    return "UNKNOWN";
+}
+
 // ============================================================================
 // 地址轉換結果結構
+// 不含堆分配的成員，可以按值高效複製
 // ============================================================================
 
 struct TranslationResult {
@@ -80,28 +110,21 @@ struct TranslationResult {
     AccessPermission permission;     // 訪問權限
     bool cacheable;                  // 是否可緩存
     bool shareable;                  // 是否可共享
-    std::string fault_reason;        // 失敗原因（如果轉換失敗）
+    PageSize page_size;              // 葉子映射的頁面/塊大小（連續提示時為整個連續範圍）
+    uint8_t level;                   // 找到葉子描述符的頁表級別
+    uint8_t descriptor_reads;        // 本次轉換讀取的描述符數量（TLB 命中為0）
+    bool contiguous;                 // page_size 是否覆蓋多個描述符（連續位或 TLB 中的合併表項）
+    FaultType fault_type;            // 錯誤類型（成功時為 NONE）
+    const char* fault_reason;        // 失敗原因（靜態字符串，成功時為空字符串）
     
     // 默認構造函數：初始化為失敗狀態
     TranslationResult() 
         : success(false), physical_addr(0), 
           memory_type(MemoryType::NORMAL_WB),
           permission(AccessPermission::NONE),
-          cacheable(true), shareable(false) {}
-};
-
-// ============================================================================
-// 錯誤類型
-// ============================================================================
-
-enum class FaultType {
-    NONE,                                // 無錯誤
-    TRANSLATION_FAULT,                   // 轉換錯誤（頁表項無效）
-    PERMISSION_FAULT,                    // 權限錯誤
-    ACCESS_FAULT,                        // 訪問錯誤
-    ADDRESS_SIZE_FAULT,                  // 地址大小錯誤
-    TLB_CONFLICT_FAULT,                  // TLB 衝突錯誤
-    UNSUPPORTED_UPSTREAM_TRANSACTION     // 不支持的上游事務
+          cacheable(true), shareable(false),
+          page_size(PageSize::SIZE_4KB), level(3), descriptor_reads(0),
+          contiguous(false), fault_type(FaultType::NONE), fault_reason("") {}
 };
 
 // ============================================================================
@@ -135,12 +158,15 @@ struct StreamTableEntry {
     VMID vmid;                                   // 虛擬機ID
     uint8_t s1_format;                           // 階段1格式
     uint8_t s2_granule;                          // 階段2頁面粒度
+    uint32_t tlb_reserved;                       // 保留的 TLB 表項數（不被其他流淘汰）
+    uint32_t tlb_limit;                          // TLB 表項數上限（0 = 不限）
     
     // 默認構造函數：初始化為無效狀態
     StreamTableEntry() 
         : valid(false), s1_enabled(false), s2_enabled(false),
           s1_context_ptr(0), s2_translation_table_base(0),
-          vmid(0), s1_format(0), s2_granule(0) {}
+          vmid(0), s1_format(0), s2_granule(0),
+          tlb_reserved(0), tlb_limit(0) {}
 };
 
 // ============================================================================
@@ -8,6 +8,9 @@
 #include <unordered_map>
 #include <list>
 #include <optional>
+#include <array>
+#include <functional>
+#include <vector>
 
 namespace smmu {
 
@@ -17,35 +20,214 @@ namespace smmu {
 // ============================================================================
 
 struct TLBEntry {
-    VirtualAddress va;              // 虛擬地址
-    PhysicalAddress pa;             // 物理地址
+    VirtualAddress va;              // 虛擬地址（頁面基地址）
+    PhysicalAddress pa;             // 物理地址（頁面基地址）
     StreamID stream_id;             // 流ID（設備標識）
     ASID asid;                      // 地址空間ID
     VMID vmid;                      // 虛擬機ID
     PageSize page_size;             // 頁面大小
+    uint8_t level;                  // 葉子描述符所在的頁表級別
     MemoryType memory_type;         // 內存類型
     AccessPermission permission;    // 訪問權限
     bool cacheable;                 // 是否可緩存
     bool shareable;                 // 是否可共享
+    bool contiguous;                // 是否由連續位或軟件合併覆蓋多個描述符
     TranslationStage stage;         // 轉換階段
     uint64_t timestamp;             // 時間戳（用於LRU）
     
     // 默認構造函數：初始化所有字段
     TLBEntry() : va(0), pa(0), stream_id(0), asid(0), vmid(0),
-                 page_size(PageSize::SIZE_4KB),
+                 page_size(PageSize::SIZE_4KB), level(3),
                  memory_type(MemoryType::NORMAL_WB),
                  permission(AccessPermission::NONE),
-                 cacheable(true), shareable(false),
+                 cacheable(true), shareable(false), contiguous(false),
                  stage(TranslationStage::STAGE1),
                  timestamp(0) {}
 };
 
+// ============================================================================
+// 每個流的 TLB 分區（配額和計數器）
+// reserved: 保留的表項數，流的表項數不超過它時其表項不會被其他流淘汰
+// limit: 表項數上限（0 表示不限），達到上限後插入只淘汰本流的表項
+// 配額按 TLB 實例計算；並發模式下為流所在分片內的表項數
+// ============================================================================
+
+struct TLBStreamStats {
+    size_t reserved = 0;     // 保留表項數
+    size_t limit = 0;        // 表項數上限（0 = 不限）
+    size_t entries = 0;      // 當前表項數
+    uint64_t hits = 0;       // 命中次數
+    uint64_t misses = 0;     // 未命中次數（只統計已有分區的流，見 TLBPartitions::record_miss）
+    uint64_t evictions = 0;  // 因容量或配額被淘汰的表項數（不含無效化）
+    uint64_t bypasses = 0;   // 達到上限、組內沒有可替換的自有表項而未填入的次數（組相聯）
+};
+
+// 所有流的分區狀態，由 TLB 後端持有
+// 分區狀態創建後不刪除，表項可以保存指向它的指針（命中時直接計數）
+class TLBPartitions {
+public:
+    // 獲取流的分區（不存在時創建）
+    TLBStreamStats& get(StreamID stream_id) { return partitions_[stream_id]; }
+    
+    // 查找流的分區（不存在時返回 nullptr）
+    const TLBStreamStats* find(StreamID stream_id) const {
+        auto it = partitions_.find(stream_id);
+        return it == partitions_.end() ? nullptr : &it->second;
+    }
+    
+    // 記錄一次未命中；只計入已有分區的流（設置過配額或插入過表項），
+    // 查找路徑不創建分區，未配置或只產生錯誤的流不會使分區表增長
+    void record_miss(StreamID stream_id) {
+        auto it = partitions_.find(stream_id);
+        if (it != partitions_.end()) it->second.misses++;
+    }
+    
+    // 設置配額；沒有任何配額時淘汰退化為普通的替換策略
+    void set_quota(StreamID stream_id, size_t reserved, size_t limit) {
+        TLBStreamStats& partition = get(stream_id);
+        bool had = partition.reserved || partition.limit;
+        bool has = reserved || limit;
+        quota_count_ += static_cast<size_t>(has) - static_cast<size_t>(had);
+        partition.reserved = reserved;
+        partition.limit = limit;
+    }
+    
+    bool active() const { return quota_count_ > 0; }
+    
+    // 流已達到上限：插入時必須淘汰自己的表項
+    static bool at_limit(const TLBStreamStats& partition) {
+        return partition.limit && partition.entries >= partition.limit;
+    }
+    
+    // 流的表項處於保留額度內：不能被其他流淘汰
+    static bool is_protected(const TLBStreamStats& partition) {
+        return partition.entries <= partition.reserved;
+    }
+    
+    // 所有表項被清除（計數器保留）
+    void clear_entries() {
+        for (auto& item : partitions_) item.second.entries = 0;
+    }
+    
+    // 清零命中、未命中、淘汰和旁路計數（配額和表項數保留）
+    void reset_statistics() {
+        for (auto& item : partitions_) {
+            item.second.hits = item.second.misses = item.second.evictions = 0;
+            item.second.bypasses = 0;
+        }
+    }
+    
+private:
+    std::unordered_map<StreamID, TLBStreamStats> partitions_;
+    size_t quota_count_ = 0;  // 設置了配額的流數量
+};
+
+// ============================================================================
+// TLB 組織方式
+// ============================================================================
+
+enum class TLBOrganization {
+    FULLY_ASSOCIATIVE,  // 全相聯（哈希表 + LRU 鏈表）
+    SET_ASSOCIATIVE     // 組相聯（扁平數組，見 set_assoc_tlb.h）
+};
+
+// ============================================================================
+// TLB 替換策略（用於組相聯 TLB）
+// ============================================================================
+
+enum class ReplacementPolicy {
+    LRU,         // 真 LRU（每路時間戳）
+    PSEUDO_LRU,  // 樹形偽 LRU（每組 ways-1 個位）
+    RRIP,        // SRRIP（2 位重引用預測值）
+    RANDOM       // 隨機替換
+};
+
+// ============================================================================
+// TLB 接口
+// 所有 TLB 後端的公共接口，SMMU 通過它訪問 TLB
+// ============================================================================
+
+class TLBInterface {
+public:
+    virtual ~TLBInterface() = default;
+    
+    // 在 TLB 中查找地址轉換
+    // 返回：如果找到則返回 TLBEntry，否則返回空
+    virtual std::optional<TLBEntry> lookup(VirtualAddress va, StreamID stream_id,
+                                           ASID asid, VMID vmid) = 0;
+    
+    // 插入新的 TLB 表項（已滿時由後端決定淘汰哪一項）
+    virtual void insert(const TLBEntry& entry) = 0;
+    
+    // ========================================================================
+    // TLB 無效化操作
+    // ========================================================================
+    
+    virtual void invalidate_all() = 0;                               // 使所有表項無效
+    virtual void invalidate_by_asid(ASID asid) = 0;                  // 按 ASID 使表項無效
+    virtual void invalidate_by_vmid(VMID vmid) = 0;                  // 按 VMID 使表項無效
+    virtual void invalidate_by_va(VirtualAddress va, ASID asid) = 0; // 按虛擬地址使表項無效
+    virtual void invalidate_by_stream(StreamID stream_id) = 0;       // 按流ID使表項無效
+    
+    // 按虛擬地址範圍使表項無效：刪除與 [start, start + size) 重疊的表項
+    // ttl_level: 葉子級別提示（1-3 只刪除該級別的表項，0 表示不限）
+    virtual void invalidate_by_va_range(VirtualAddress start, uint64_t size,
+                                        ASID asid, uint8_t ttl_level = 0) = 0;
+    
+    // ========================================================================
+    // 統計信息查詢
+    // ========================================================================
+    
+    virtual size_t size() const = 0;        // 當前表項數量
+    virtual size_t capacity() const = 0;    // TLB 容量
+    virtual uint64_t hit_count() const = 0; // 命中次數
+    virtual uint64_t miss_count() const = 0;// 未命中次數
+    
+    // ========================================================================
+    // 按流分區
+    // ========================================================================
+    
+    // 設置流的保留表項數和上限（見 TLBStreamStats）
+    virtual void set_stream_quota(StreamID stream_id, size_t reserved, size_t limit) = 0;
+    
+    // 流的配額和計數器（未訪問過的流返回全零）
+    virtual TLBStreamStats stream_stats(StreamID stream_id) const = 0;
+    
+    // 清零所有流的命中、未命中和淘汰計數
+    virtual void reset_stream_stats() = 0;
+    
+    // ========================================================================
+    // 表項導出（狀態快照）
+    // ========================================================================
+    
+    // 把有效表項按從最舊到最新的順序追加到 out
+    // 按此順序插入一個空的 TLB 即可重建內容和淘汰順序（見各後端的說明）
+    virtual void export_entries(std::vector<TLBEntry>& out) const = 0;
+    
+    // ========================================================================
+    // 淘汰通知
+    // ========================================================================
+    
+    // 設置容量淘汰回調：表項因容量不足被淘汰時以該表項調用（無效化刪除的表項不觸發）
+    // 回調在持有 TLB 所在鎖時調用，不能再訪問該 TLB
+    using EvictionCallback = std::function<void(const TLBEntry&)>;
+    void set_eviction_callback(EvictionCallback callback) { eviction_callback_ = std::move(callback); }
+
+protected:
+    void notify_eviction(const TLBEntry& entry) const {
+        if (eviction_callback_) eviction_callback_(entry);
+    }
+
+private:
+    EvictionCallback eviction_callback_;
+};
+
 // ============================================================================
 // TLB 類
-// 實現帶 LRU 淘汰策略的轉換查找緩衝區
+// 實現帶 LRU 淘汰策略的全相聯轉換查找緩衝區
 // ============================================================================
 
-class TLB {
+class TLB : public TLBInterface {
 public:
     // 構造函數：創建指定容量的 TLB
     // capacity: TLB 可以存儲的最大表項數量（默認128）
@@ -54,30 +236,48 @@ public:
     // 在 TLB 中查找地址轉換
     // 返回：如果找到則返回 TLBEntry，否則返回空
     std::optional<TLBEntry> lookup(VirtualAddress va, StreamID stream_id, 
-                                    ASID asid, VMID vmid);
+                                    ASID asid, VMID vmid) override;
     
     // 插入新的 TLB 表項
     // 如果 TLB 已滿，會使用 LRU 策略淘汰最舊的表項
-    void insert(const TLBEntry& entry);
+    void insert(const TLBEntry& entry) override;
     
     // ========================================================================
     // TLB 無效化操作
     // ========================================================================
     
-    void invalidate_all();                              // 使所有表項無效
-    void invalidate_by_asid(ASID asid);                 // 按 ASID 使表項無效
-    void invalidate_by_vmid(VMID vmid);                 // 按 VMID 使表項無效
-    void invalidate_by_va(VirtualAddress va, ASID asid); // 按虛擬地址使表項無效
-    void invalidate_by_stream(StreamID stream_id);      // 按流ID使表項無效
+    void invalidate_all() override;                               // 使所有表項無效
+    void invalidate_by_asid(ASID asid) override;                  // 按 ASID 使表項無效
+    void invalidate_by_vmid(VMID vmid) override;                  // 按 VMID 使表項無效
+    void invalidate_by_va(VirtualAddress va, ASID asid) override; // 按虛擬地址使表項無效
+    void invalidate_by_stream(StreamID stream_id) override;       // 按流ID使表項無效
+    void invalidate_by_va_range(VirtualAddress start, uint64_t size,
+                                ASID asid, uint8_t ttl_level = 0) override; // 按地址範圍使表項無效
     
     // ========================================================================
     // 統計信息查詢
     // ========================================================================
     
-    size_t size() const { return entries_.size(); }      // 當前表項數量
-    size_t capacity() const { return capacity_; }        // TLB 容量
-    uint64_t hit_count() const { return hit_count_; }    // 命中次數
-    uint64_t miss_count() const { return miss_count_; }  // 未命中次數
+    size_t size() const override { return entries_.size(); }      // 當前表項數量
+    size_t capacity() const override { return capacity_; }        // TLB 容量
+    uint64_t hit_count() const override { return hit_count_; }    // 命中次數
+    uint64_t miss_count() const override { return miss_count_; }  // 未命中次數
+    
+    // ========================================================================
+    // 按流分區
+    // ========================================================================
+    
+    void set_stream_quota(StreamID stream_id, size_t reserved, size_t limit) override {
+        partitions_.set_quota(stream_id, reserved, limit);
+    }
+    TLBStreamStats stream_stats(StreamID stream_id) const override {
+        const TLBStreamStats* partition = partitions_.find(stream_id);
+        return partition ? *partition : TLBStreamStats();
+    }
+    void reset_stream_stats() override { partitions_.reset_statistics(); }
+    
+    // 按 LRU 順序導出（最久未使用的在前），重新插入後 LRU 順序相同
+    void export_entries(std::vector<TLBEntry>& out) const override;
     
 private:
     // ========================================================================
@@ -90,13 +290,15 @@ private:
         StreamID stream_id;      // 流ID
         ASID asid;               // 地址空間ID
         VMID vmid;               // 虛擬機ID
+        uint8_t page_shift;      // 頁面大小（log2），避免不同大小的表項互相別名
         
         // 相等比較運算符（用於哈希表查找）
         bool operator==(const TLBKey& other) const {
             return va_base == other.va_base && 
                    stream_id == other.stream_id &&
                    asid == other.asid && 
-                   vmid == other.vmid;
+                   vmid == other.vmid &&
+                   page_shift == other.page_shift;
         }
     };
     
@@ -111,15 +313,64 @@ private:
             return std::hash<uint64_t>()(key.va_base) ^
                    (std::hash<uint32_t>()(key.stream_id) << 1) ^
                    (std::hash<uint16_t>()(key.asid) << 2) ^
-                   (std::hash<uint16_t>()(key.vmid) << 3);
+                   (std::hash<uint16_t>()(key.vmid) << 3) ^
+                   (static_cast<size_t>(key.page_shift) << 5);
         }
     };
     
     // 獲取虛擬地址的頁面基地址
     VirtualAddress get_page_base(VirtualAddress va, PageSize page_size) const;
     
-    // 淘汰最近最少使用的表項
-    void evict_lru();
+    // 為 owner 的插入淘汰一個表項
+    // 沒有配額時淘汰 LRU 表項；owner 達到上限時淘汰它最久未使用的表項；
+    // 否則淘汰最久未使用的、不在保留額度內的表項（包括 owner 自己的額度）
+    // 各流的表項按使用順序串在 BY_STREAM 索引中，代價與流數成正比，與表項數無關
+    void evict(const TLBStreamStats& owner, StreamID owner_id);
+    
+    // ========================================================================
+    // 二級索引
+    // 每個表項同時串在按 ASID、VMID、StreamID 和頁面（基地址+大小）分組的
+    // 侵入式雙向鏈表中，無效化只訪問被刪除的表項
+    // ========================================================================
+    
+    enum IndexKind { BY_ASID, BY_VMID, BY_STREAM, BY_PAGE, NUM_INDEXES };
+    
+    struct TLBNode;
+    
+    struct IndexLinks {
+        TLBNode* prev = nullptr;
+        TLBNode* next = nullptr;
+    };
+    
+    // 索引分組：鏈表頭、鏈表尾和表項數量
+    // BY_STREAM 分組按使用順序排列（命中時移到鏈表頭），鏈表尾是該流最久未使用的表項
+    struct IndexGroup {
+        TLBNode* head = nullptr;
+        TLBNode* tail = nullptr;
+        size_t count = 0;
+    };
+    
+    // 表項在某個索引中所屬的分組鍵
+    // 頁面索引的鍵為 va_base | page_shift（va_base 至少 4KB 對齊，低位空閒）
+    static uint64_t index_key(const TLBKey& key, IndexKind kind) {
+        switch (kind) {
+            case BY_ASID: return key.asid;
+            case BY_VMID: return key.vmid;
+            case BY_STREAM: return key.stream_id;
+            default: return key.va_base | key.page_shift;
+        }
+    }
+    
+    void link_indexes(TLBNode* node, const TLBKey& key);
+    void unlink_indexes(TLBNode* node, const TLBKey& key);
+    
+    // 刪除某個分組中滿足條件的所有表項
+    template <typename Pred>
+    void invalidate_group(IndexKind kind, uint64_t group, Pred pred);
+    
+    // 維護每種頁面大小的駐留表項計數（查找時只探測駐留的大小）
+    void account_insert(uint8_t page_shift);
+    void account_erase(uint8_t page_shift);
     
     // ========================================================================
     // 私有成員變量
@@ -129,12 +380,51 @@ private:
     uint64_t timestamp_counter_;   // 時間戳計數器
     uint64_t hit_count_;           // 命中計數
     uint64_t miss_count_;          // 未命中計數
-    
-    // 使用哈希表存儲 TLB 表項（快速查找）
-    std::unordered_map<TLBKey, TLBEntry, TLBKeyHash> entries_;
+    uint64_t use_counter_;         // 使用順序計數器（插入和命中時遞增）
     
     // 使用鏈表維護 LRU 順序（最近使用的在前面）
     std::list<TLBKey> lru_list_;
+    
+    // ========================================================================
+    // TLB 節點
+    // 表項與其在 LRU 鏈表中的位置綁定，命中時可 O(1) 移動
+    // ========================================================================
+    
+    struct TLBNode {
+        TLBEntry entry;                          // 緩存的表項
+        std::list<TLBKey>::iterator lru_pos;     // 在 LRU 鏈表中的位置（同時保存鍵）
+        IndexLinks links[NUM_INDEXES];           // 在各個二級索引中的位置
+        TLBStreamStats* partition;               // 所屬流的分區
+        IndexGroup* stream_group;                // 所屬流的 BY_STREAM 分組
+        uint64_t last_use;                       // 最近一次插入或命中時的使用順序
+    };
+    
+    // 使用哈希表存儲 TLB 表項（快速查找）
+    // unordered_map 的節點地址在插入和刪除其他元素時保持不變，索引鏈表可以直接保存指針
+    std::unordered_map<TLBKey, TLBNode, TLBKeyHash> entries_;
+    
+    // 二級索引：分組鍵 -> 分組
+    std::unordered_map<uint64_t, IndexGroup> indexes_[NUM_INDEXES];
+    
+    // 將 LRU 位置和所屬流分組中的位置移到鏈表最前面（O(1)）
+    void touch(TLBNode& node);
+    
+    // 每種頁面大小（按 log2 索引）的駐留表項數，以及駐留大小的位圖
+    std::array<uint32_t, 64> size_counts_;
+    uint64_t resident_shifts_;
+    
+    // 按流分區
+    TLBPartitions partitions_;
+    
+    // 刪除表項並同步移除 LRU 位置，返回下一個迭代器
+    using EntryIterator = std::unordered_map<TLBKey, TLBNode, TLBKeyHash>::iterator;
+    EntryIterator erase_entry(EntryIterator it) {
+        unlink_indexes(&it->second, it->first);
+        account_erase(it->first.page_shift);
+        it->second.partition->entries--;
+        lru_list_.erase(it->second.lru_pos);
+        return entries_.erase(it);
+    }
 };
 
 } // namespace smmu
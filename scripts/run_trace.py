@@ -12,10 +12,12 @@ def main():
     include_dir = os.path.join(project_root, "include")
     trace_dir = os.path.join(project_root, "trace")
 
-    # Check if trace file is provided
+    # Check if trace file is provided (options such as --quiet are passed to the runner)
     trace_file = "trace.csv"
-    if len(sys.argv) > 1:
-        trace_file = sys.argv[1]
+    runner_options = [arg for arg in sys.argv[1:] if arg.startswith("-")]
+    positional = [arg for arg in sys.argv[1:] if not arg.startswith("-")]
+    if positional:
+        trace_file = positional[0]
 
     # If trace file is not absolute path, look in trace dir or current dir
     if not os.path.isabs(trace_file):
@@ -33,14 +35,16 @@ def main():
     source_files = [
         os.path.join(trace_dir, "trace_runner.cpp"),
         os.path.join(src_dir, "tlb.cpp"),
+        os.path.join(src_dir, "set_assoc_tlb.cpp"),
         os.path.join(src_dir, "page_table.cpp"),
+        os.path.join(src_dir, "page_walk_cache.cpp"),
         os.path.join(src_dir, "smmu.cpp"),
         os.path.join(src_dir, "smmu_registers.cpp")
     ]
 
     output_bin = os.path.join(script_dir, "trace_runner")
 
-    compile_cmd = ["g++", "-std=c++17", "-Wall", "-O2", f"-I{include_dir}", "-o", output_bin] + source_files
+    compile_cmd = ["g++", "-std=c++17", "-Wall", "-O2", "-pthread", f"-I{include_dir}", "-o", output_bin] + source_files
 
     try:
         subprocess.check_call(compile_cmd)
@@ -54,7 +58,7 @@ def main():
     print("-" * 40)
 
     try:
-        subprocess.check_call([output_bin, trace_file])
+        subprocess.check_call([output_bin] + runner_options + [trace_file])
     except subprocess.CalledProcessError:
         print("Execution failed.")
         # Cleanup
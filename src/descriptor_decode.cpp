@@ -0,0 +1,326 @@
+// 描述符批量解碼實現文件
+// 實現葉子緩存行描述符的批量解碼和多個 VA 的索引提取：
+// x86-64 上運行時檢測 AVX2，AArch64 上使用 NEON，其他情況（或定義了 SMMU_NO_SIMD）使用標量實現
+
+#include "page_table.h"
+
+#if !defined(SMMU_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SMMU_DESCRIPTOR_AVX2 1
+#include <immintrin.h>
+#elif !defined(SMMU_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+#define SMMU_DESCRIPTOR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace smmu {
+
+namespace {
+
+constexpr uint64_t ADDRESS_MASK = 0x0000FFFFFFFFF000ULL;
+
+static_assert(sizeof(LevelIndices) == 8, "LevelIndices is stored as one 64-bit word per VA");
+
+// 第 level 級索引的右移位數和掩碼（與遍歷器逐級計算的方式相同）
+inline unsigned index_shift(uint8_t granule_size, unsigned level) {
+    return granule_size + (3 - level) * (granule_size - 3);
+}
+
+inline uint64_t index_mask(uint8_t granule_size) {
+    return (1ULL << (granule_size - 3)) - 1;
+}
+
+inline unsigned start_level(uint8_t granule_size) {
+    return granule_size == 16 ? 1 : 0;
+}
+
+} // namespace
+
+// ============================================================================
+// 標量實現
+// ============================================================================
+
+// 無分支：無效描述符先整體清零，再把每個標誌位移到第 i 位
+void decode_descriptors_scalar(const uint64_t* raw, uint8_t level, DescriptorBatch& out) {
+    uint64_t planes[12] = {};
+    for (size_t i = 0; i < DescriptorBatch::WIDTH; i++) {
+        uint64_t desc = raw[i] & (0 - (raw[i] & 0x1));
+        out.address[i] = desc & ADDRESS_MASK;
+        planes[0] |= (desc & 0x1) << i;
+        planes[1] |= ((desc >> 1) & 0x1) << i;
+        planes[2] |= ((desc >> 2) & 0x1) << i;
+        planes[3] |= ((desc >> 3) & 0x1) << i;
+        planes[4] |= ((desc >> 4) & 0x1) << i;
+        planes[5] |= ((desc >> 7) & 0x1) << i;
+        planes[6] |= (((desc >> 8) | (desc >> 9)) & 0x1) << i;
+        planes[7] |= ((desc >> 10) & 0x1) << i;
+        planes[8] |= ((desc >> 51) & 0x1) << i;
+        planes[9] |= ((desc >> 52) & 0x1) << i;
+        planes[10] |= ((desc >> 53) & 0x1) << i;
+        planes[11] |= ((desc >> 54) & 0x1) << i;
+    }
+    out.valid = static_cast<uint8_t>(planes[0]);
+    out.table = level < 3 ? static_cast<uint8_t>(planes[1]) : 0;
+    out.attr_index[0] = static_cast<uint8_t>(planes[2]);
+    out.attr_index[1] = static_cast<uint8_t>(planes[3]);
+    out.attr_index[2] = static_cast<uint8_t>(planes[4]);
+    out.read_only = static_cast<uint8_t>(planes[5]);
+    out.shareable = static_cast<uint8_t>(planes[6]);
+    out.access_flag = static_cast<uint8_t>(planes[7]);
+    out.dirty = static_cast<uint8_t>(planes[8]);
+    out.contiguous = static_cast<uint8_t>(planes[9]);
+    out.pxn = static_cast<uint8_t>(planes[10]);
+    out.xn = static_cast<uint8_t>(planes[11]);
+}
+
+void extract_indices_scalar(const VirtualAddress* vas, size_t count, uint8_t granule_size,
+                            LevelIndices* out) {
+    uint64_t mask = index_mask(granule_size);
+    unsigned first = start_level(granule_size);
+    for (size_t i = 0; i < count; i++) {
+        for (unsigned level = 0; level < 4; level++) {
+            out[i].index[level] = level < first ? 0 : static_cast<uint16_t>(
+                (vas[i] >> index_shift(granule_size, level)) & mask);
+        }
+    }
+}
+
+// ============================================================================
+// AVX2 實現
+// 8 個描述符放在兩個 256 位寄存器中：把標誌位移到每個 64 位通道的符號位，
+// movemask 一次取出 4 個描述符的該位；無效描述符先整體清零
+// 索引：每個 VA 的四級索引在各自的 64 位通道中拼成一個字，直接存為 LevelIndices
+// ============================================================================
+
+#if SMMU_DESCRIPTOR_AVX2
+
+namespace {
+
+template <int BIT>
+__attribute__((target("avx2")))
+inline uint8_t plane_avx2(__m256i lo, __m256i hi) {
+    int low = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(lo, 63 - BIT)));
+    int high = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(hi, 63 - BIT)));
+    return static_cast<uint8_t>(low | (high << 4));
+}
+
+__attribute__((target("avx2")))
+void decode_descriptors_avx2(const uint64_t* raw, uint8_t level, DescriptorBatch& out) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(raw));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(raw + 4));
+
+    // 有效位擴展為整個通道的掩碼：0 - (desc & 1)
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i zero = _mm256_setzero_si256();
+    lo = _mm256_and_si256(lo, _mm256_sub_epi64(zero, _mm256_and_si256(lo, one)));
+    hi = _mm256_and_si256(hi, _mm256_sub_epi64(zero, _mm256_and_si256(hi, one)));
+
+    const __m256i address_mask = _mm256_set1_epi64x(static_cast<long long>(ADDRESS_MASK));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.address), _mm256_and_si256(lo, address_mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.address + 4), _mm256_and_si256(hi, address_mask));
+
+    out.valid = plane_avx2<0>(lo, hi);
+    out.table = level < 3 ? plane_avx2<1>(lo, hi) : 0;
+    out.attr_index[0] = plane_avx2<2>(lo, hi);
+    out.attr_index[1] = plane_avx2<3>(lo, hi);
+    out.attr_index[2] = plane_avx2<4>(lo, hi);
+    out.read_only = plane_avx2<7>(lo, hi);
+    out.shareable = plane_avx2<8>(lo, hi) | plane_avx2<9>(lo, hi);
+    out.access_flag = plane_avx2<10>(lo, hi);
+    out.dirty = plane_avx2<51>(lo, hi);
+    out.contiguous = plane_avx2<52>(lo, hi);
+    out.pxn = plane_avx2<53>(lo, hi);
+    out.xn = plane_avx2<54>(lo, hi);
+}
+
+__attribute__((target("avx2")))
+void extract_indices_avx2(const VirtualAddress* vas, size_t count, uint8_t granule_size,
+                          LevelIndices* out) {
+    const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(index_mask(granule_size)));
+    const unsigned first = start_level(granule_size);
+    __m128i shift[4];
+    for (unsigned level = 0; level < 4; level++) {
+        shift[level] = _mm_cvtsi32_si128(static_cast<int>(index_shift(granule_size, level)));
+    }
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vas + i));
+        __m256i l0 = _mm256_and_si256(_mm256_srl_epi64(va, shift[0]), mask);
+        __m256i l1 = _mm256_and_si256(_mm256_srl_epi64(va, shift[1]), mask);
+        __m256i l2 = _mm256_and_si256(_mm256_srl_epi64(va, shift[2]), mask);
+        __m256i l3 = _mm256_and_si256(_mm256_srl_epi64(va, shift[3]), mask);
+        if (first > 0) l0 = _mm256_setzero_si256();
+        __m256i packed = _mm256_or_si256(
+            _mm256_or_si256(l0, _mm256_slli_epi64(l1, 16)),
+            _mm256_or_si256(_mm256_slli_epi64(l2, 32), _mm256_slli_epi64(l3, 48)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    extract_indices_scalar(vas + i, count - i, granule_size, out + i);
+}
+
+} // namespace
+
+#endif // SMMU_DESCRIPTOR_AVX2
+
+// ============================================================================
+// NEON 實現
+// 每個寄存器兩個描述符；標誌位移到 bit 0 後按通道號左移，相加得到兩位
+// ============================================================================
+
+#if SMMU_DESCRIPTOR_NEON
+
+namespace {
+
+template <int BIT>
+inline uint8_t plane_neon(const uint64x2_t* v) {
+    static const int64_t lane_shift[2] = {0, 1};
+    const int64x2_t shifts = vld1q_s64(lane_shift);
+    const uint64x2_t one = vdupq_n_u64(1);
+    unsigned bits = 0;
+    for (unsigned r = 0; r < 4; r++) {
+        uint64x2_t b;
+        if constexpr (BIT == 0) {
+            b = vandq_u64(v[r], one);
+        } else {
+            b = vandq_u64(vshrq_n_u64(v[r], BIT), one);
+        }
+        bits |= static_cast<unsigned>(vaddvq_u64(vshlq_u64(b, shifts))) << (2 * r);
+    }
+    return static_cast<uint8_t>(bits);
+}
+
+void decode_descriptors_neon(const uint64_t* raw, uint8_t level, DescriptorBatch& out) {
+    const uint64x2_t one = vdupq_n_u64(1);
+    const uint64x2_t zero = vdupq_n_u64(0);
+    const uint64x2_t address_mask = vdupq_n_u64(ADDRESS_MASK);
+    uint64x2_t v[4];
+    for (unsigned r = 0; r < 4; r++) {
+        v[r] = vld1q_u64(raw + 2 * r);
+        v[r] = vandq_u64(v[r], vsubq_u64(zero, vandq_u64(v[r], one)));
+        vst1q_u64(out.address + 2 * r, vandq_u64(v[r], address_mask));
+    }
+
+    out.valid = plane_neon<0>(v);
+    out.table = level < 3 ? plane_neon<1>(v) : 0;
+    out.attr_index[0] = plane_neon<2>(v);
+    out.attr_index[1] = plane_neon<3>(v);
+    out.attr_index[2] = plane_neon<4>(v);
+    out.read_only = plane_neon<7>(v);
+    out.shareable = plane_neon<8>(v) | plane_neon<9>(v);
+    out.access_flag = plane_neon<10>(v);
+    out.dirty = plane_neon<51>(v);
+    out.contiguous = plane_neon<52>(v);
+    out.pxn = plane_neon<53>(v);
+    out.xn = plane_neon<54>(v);
+}
+
+void extract_indices_neon(const VirtualAddress* vas, size_t count, uint8_t granule_size,
+                          LevelIndices* out) {
+    const uint64x2_t mask = vdupq_n_u64(index_mask(granule_size));
+    const unsigned first = start_level(granule_size);
+    int64x2_t shift[4];
+    for (unsigned level = 0; level < 4; level++) {
+        shift[level] = vdupq_n_s64(-static_cast<int64_t>(index_shift(granule_size, level)));
+    }
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        uint64x2_t va = vld1q_u64(vas + i);
+        uint64x2_t l0 = vandq_u64(vshlq_u64(va, shift[0]), mask);
+        uint64x2_t l1 = vandq_u64(vshlq_u64(va, shift[1]), mask);
+        uint64x2_t l2 = vandq_u64(vshlq_u64(va, shift[2]), mask);
+        uint64x2_t l3 = vandq_u64(vshlq_u64(va, shift[3]), mask);
+        if (first > 0) l0 = vdupq_n_u64(0);
+        uint64x2_t packed = vorrq_u64(vorrq_u64(l0, vshlq_n_u64(l1, 16)),
+                                      vorrq_u64(vshlq_n_u64(l2, 32), vshlq_n_u64(l3, 48)));
+        uint64_t words[2];
+        vst1q_u64(words, packed);
+        std::memcpy(out + i, words, sizeof(words));
+    }
+    extract_indices_scalar(vas + i, count - i, granule_size, out + i);
+}
+
+} // namespace
+
+#endif // SMMU_DESCRIPTOR_NEON
+
+// ============================================================================
+// 內核選擇
+// 程序啟動時選擇一次（x86-64 按 CPU 是否支持 AVX2）
+// ============================================================================
+
+namespace {
+
+struct DescriptorKernels {
+    void (*decode)(const uint64_t*, uint8_t, DescriptorBatch&);
+    void (*indices)(const VirtualAddress*, size_t, uint8_t, LevelIndices*);
+    const char* name;
+};
+
+DescriptorKernels select_kernels() {
+#if SMMU_DESCRIPTOR_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {decode_descriptors_avx2, extract_indices_avx2, "avx2"};
+    }
+#elif SMMU_DESCRIPTOR_NEON
+    return {decode_descriptors_neon, extract_indices_neon, "neon"};
+#endif
+    return {decode_descriptors_scalar, extract_indices_scalar, "scalar"};
+}
+
+// 首次使用時選擇（函數內靜態變量），其他翻譯單元的靜態初始化中調用也安全
+const DescriptorKernels& kernels() {
+    static const DescriptorKernels selected = select_kernels();
+    return selected;
+}
+
+} // namespace
+
+void decode_descriptors(const uint64_t* raw, uint8_t level, DescriptorBatch& out) {
+    kernels().decode(raw, level, out);
+}
+
+void extract_indices(const VirtualAddress* vas, size_t count, uint8_t granule_size,
+                     LevelIndices* out) {
+    kernels().indices(vas, count, granule_size, out);
+}
+
+const char* descriptor_kernel_name() {
+    return kernels().name;
+}
+
+// ============================================================================
+// 逐個描述符的訪問
+// ============================================================================
+
+MemoryType DescriptorBatch::memory_type(size_t i) const {
+    unsigned attr = ((attr_index[0] >> i) & 1) | (((attr_index[1] >> i) & 1) << 1) |
+                    (((attr_index[2] >> i) & 1) << 2);
+    switch (attr) {
+        case 0: return MemoryType::DEVICE_nGnRnE;
+        case 1: return MemoryType::DEVICE_nGnRE;
+        case 2: return MemoryType::NORMAL_NC;
+        case 3: return MemoryType::NORMAL_WT;
+        default: return MemoryType::NORMAL_WB;
+    }
+}
+
+PageTableDescriptor DescriptorBatch::descriptor(size_t i) const {
+    PageTableDescriptor desc;
+    if (!((valid >> i) & 1)) return desc;
+    desc.valid = true;
+    desc.is_table = (table >> i) & 1;
+    desc.address = address[i];
+    desc.ap = permission(i);
+    desc.mem_attr = memory_type(i);
+    desc.shareable = (shareable >> i) & 1;
+    desc.access_flag = (access_flag >> i) & 1;
+    desc.dirty = (dirty >> i) & 1;
+    desc.contiguous = (contiguous >> i) & 1;
+    desc.privileged_execute_never = (pxn >> i) & 1;
+    desc.execute_never = (xn >> i) & 1;
+    return desc;
+}
+
+} // namespace smmu
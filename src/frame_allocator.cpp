@@ -0,0 +1,162 @@
+// 頁表幀分配器實現文件
+// 實現區域和板的切分、按大小的空閒鏈表，以及按所有者的幀記錄
+
+#include "frame_allocator.h"
+#include <algorithm>
+
+namespace smmu {
+
+// ============================================================================
+// 構造函數
+// ============================================================================
+
+FrameAllocator::FrameAllocator(SimpleMemoryModel& memory, uint64_t limit_bytes,
+                               uint64_t arena_bytes)
+    : memory_(memory), limit_bytes_(limit_bytes),
+      arena_bytes_(std::max<uint64_t>((arena_bytes + SLAB_BYTES - 1) & ~(SLAB_BYTES - 1),
+                                      SLAB_BYTES)),
+      arena_next_(0), arena_end_(0) {}
+
+int FrameAllocator::size_class_of(uint64_t size) {
+    switch (size) {
+        case 4096: return 0;
+        case 16384: return 1;
+        case 65536: return 2;
+        default: return -1;
+    }
+}
+
+// ============================================================================
+// 分配
+// 優先重用空閒鏈表中最近釋放的幀，其次從當前板切分，板用完後取新板
+// ============================================================================
+
+FrameAllocation FrameAllocator::allocate(uint64_t size, Owner owner) {
+    FrameAllocation result;
+    int size_class = size_class_of(size);
+    if (size_class < 0) {
+        result.error = FrameAllocError::INVALID_SIZE;
+        stats_.failures++;
+        return result;
+    }
+
+    SizeClass& cls = classes_[size_class];
+    PhysicalAddress pa;
+    if (!cls.free_list.empty()) {
+        pa = cls.free_list.back();
+        cls.free_list.pop_back();
+        stats_.recycled++;
+    } else {
+        if (cls.slab_next == cls.slab_end) {
+            PhysicalAddress slab = take_slab();
+            if (slab == 0) {
+                result.error = FrameAllocError::OUT_OF_MEMORY;
+                stats_.failures++;
+                return result;
+            }
+            cls.slab_next = slab;
+            cls.slab_end = slab + SLAB_BYTES;
+        }
+        pa = cls.slab_next;
+        cls.slab_next += size;
+    }
+
+    FrameRecord record{static_cast<uint8_t>(size_class), owner, 0};
+    if (owner != NO_OWNER) {
+        std::vector<PhysicalAddress>& owned = owners_[owner];
+        record.owner_index = static_cast<uint32_t>(owned.size());
+        owned.push_back(pa);
+    }
+    frames_[pa] = record;
+
+    stats_.allocations++;
+    stats_.allocated_bytes += size;
+    result.success = true;
+    result.pa = pa;
+    return result;
+}
+
+// 區域按 SLAB_BYTES 對齊：內存模型按幀對齊分配，多預留一塊板減一幀的空間用於對齊
+PhysicalAddress FrameAllocator::take_slab() {
+    if (arena_next_ == arena_end_) {
+        uint64_t request = arena_bytes_ + SLAB_BYTES - SimpleMemoryModel::FRAME_SIZE;
+        if (limit_bytes_ != 0 && stats_.reserved_bytes + request > limit_bytes_) return 0;
+        PhysicalAddress base = memory_.allocate_page(request);
+        if (base == 0) return 0;
+        stats_.reserved_bytes += request;
+        arena_next_ = (base + SLAB_BYTES - 1) & ~(SLAB_BYTES - 1);
+        arena_end_ = arena_next_ + arena_bytes_;
+    }
+    PhysicalAddress slab = arena_next_;
+    arena_next_ += SLAB_BYTES;
+    return slab;
+}
+
+// ============================================================================
+// 釋放
+// ============================================================================
+
+void FrameAllocator::recycle(PhysicalAddress pa, uint8_t size_class) {
+    uint64_t bytes = class_bytes(size_class);
+    memory_.discard(pa, bytes);
+    classes_[size_class].free_list.push_back(pa);
+    stats_.allocated_bytes -= bytes;
+    stats_.frees++;
+}
+
+FrameAllocError FrameAllocator::free_page(PhysicalAddress pa) {
+    auto it = frames_.find(pa);
+    if (it == frames_.end()) {
+        stats_.failures++;
+        return FrameAllocError::NOT_ALLOCATED;
+    }
+    FrameRecord record = it->second;
+    frames_.erase(it);
+
+    // 從所有者的列表中移除：最後一項移到被刪除的位置
+    if (record.owner != NO_OWNER) {
+        auto owner_it = owners_.find(record.owner);
+        std::vector<PhysicalAddress>& owned = owner_it->second;
+        PhysicalAddress moved = owned.back();
+        if (moved != pa) {
+            owned[record.owner_index] = moved;
+            frames_[moved].owner_index = record.owner_index;
+        }
+        owned.pop_back();
+        if (owned.empty()) owners_.erase(owner_it);
+    }
+
+    recycle(pa, record.size_class);
+    return FrameAllocError::NONE;
+}
+
+size_t FrameAllocator::release_owner(Owner owner) {
+    auto owner_it = owners_.find(owner);
+    if (owner_it == owners_.end()) return 0;
+    std::vector<PhysicalAddress> owned = std::move(owner_it->second);
+    owners_.erase(owner_it);
+
+    for (PhysicalAddress pa : owned) {
+        auto it = frames_.find(pa);
+        uint8_t size_class = it->second.size_class;
+        frames_.erase(it);
+        recycle(pa, size_class);
+    }
+    return owned.size();
+}
+
+// ============================================================================
+// 查詢
+// ============================================================================
+
+size_t FrameAllocator::owned_frames(Owner owner) const {
+    auto it = owners_.find(owner);
+    return it == owners_.end() ? 0 : it->second.size();
+}
+
+uint64_t FrameAllocator::frame_size(PhysicalAddress pa) const {
+    auto it = frames_.find(pa);
+    return it == frames_.end() ? 0 : class_bytes(it->second.size_class);
+}
+
+} // namespace smmu
@@ -0,0 +1,369 @@
+// 轉換路徑插樁實現文件
+// 實現延遲直方圖的分桶和百分位計算、上下文計數表，以及 JSON / Prometheus 導出
+
+#include "instrumentation.h"
+#include <algorithm>
+#include <cmath>
+
+namespace smmu {
+
+namespace {
+
+constexpr size_t NUM_INVALIDATION_TYPES = static_cast<size_t>(InvalidationType::COUNT);
+
+inline uint64_t load(const std::atomic<uint64_t>& counter) {
+    return counter.load(std::memory_order_relaxed);
+}
+
+inline void add(std::atomic<uint64_t>& counter, bool concurrent, uint64_t n = 1) {
+    if (concurrent) {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    } else {
+        counter.store(load(counter) + n, std::memory_order_relaxed);
+    }
+}
+
+// 按 TLB 未命中次數從多到少排序
+void sort_contexts(std::vector<ContextCounters>& contexts) {
+    std::sort(contexts.begin(), contexts.end(),
+              [](const ContextCounters& a, const ContextCounters& b) {
+                  if (a.tlb_misses != b.tlb_misses) return a.tlb_misses > b.tlb_misses;
+                  if (a.stream_id != b.stream_id) return a.stream_id < b.stream_id;
+                  return a.asid < b.asid;
+              });
+}
+
+void add_counters(ContextCounters& total, const ContextCounters& other) {
+    total.translations += other.translations;
+    total.tlb_hits += other.tlb_hits;
+    total.tlb_misses += other.tlb_misses;
+    total.page_walks += other.page_walks;
+    total.descriptor_reads += other.descriptor_reads;
+    total.faults += other.faults;
+}
+
+void write_context_json(std::ostream& os, const ContextCounters& c, bool with_key) {
+    os << "{";
+    if (with_key) os << "\"stream_id\":" << c.stream_id << ",\"asid\":" << c.asid << ",";
+    os << "\"translations\":" << c.translations
+       << ",\"tlb_hits\":" << c.tlb_hits
+       << ",\"tlb_misses\":" << c.tlb_misses
+       << ",\"page_walks\":" << c.page_walks
+       << ",\"descriptor_reads\":" << c.descriptor_reads
+       << ",\"faults\":" << c.faults << "}";
+}
+
+// Prometheus summary：分位數、_sum 和 _count
+void write_summary(std::ostream& os, const std::string& name,
+                   const LatencyHistogram::Snapshot& histogram) {
+    os << "# TYPE " << name << " summary\n";
+    for (double q : {0.5, 0.99, 0.999}) {
+        os << name << "{quantile=\"" << q << "\"} " << histogram.percentile(q) << "\n";
+    }
+    os << name << "_sum " << histogram.sum << "\n";
+    os << name << "_count " << histogram.count << "\n";
+}
+
+} // namespace
+
+// ============================================================================
+// 延遲直方圖
+// ============================================================================
+
+LatencyHistogram::LatencyHistogram(bool concurrent)
+    : concurrent_(concurrent), buckets_(std::make_unique<std::atomic<uint64_t>[]>(NUM_BUCKETS)),
+      count_(0), sum_(0), max_(0) {
+    for (size_t i = 0; i < NUM_BUCKETS; i++) buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucket_index(uint64_t value) {
+    constexpr uint64_t linear = 1ULL << SUB_BUCKET_BITS;
+    if (value < linear) return static_cast<size_t>(value);
+    unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+    unsigned shift = exponent - SUB_BUCKET_BITS;
+    uint64_t sub = (value >> shift) & (linear - 1);
+    return (static_cast<size_t>(shift + 1) << SUB_BUCKET_BITS) + static_cast<size_t>(sub);
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t index) {
+    constexpr size_t linear = size_t(1) << SUB_BUCKET_BITS;
+    if (index < linear) return index;
+    unsigned shift = static_cast<unsigned>(index >> SUB_BUCKET_BITS) - 1;
+    uint64_t lower = static_cast<uint64_t>(linear + (index & (linear - 1))) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    add(buckets_[bucket_index(value)], concurrent_);
+    add(count_, concurrent_);
+    add(sum_, concurrent_, value);
+    uint64_t current = load(max_);
+    while (value > current &&
+           !max_.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// 計數取各桶之和，與桶的內容保持一致
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snap;
+    snap.buckets.resize(NUM_BUCKETS);
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        snap.buckets[i] = load(buckets_[i]);
+        snap.count += snap.buckets[i];
+    }
+    snap.sum = load(sum_);
+    snap.max = load(max_);
+    if (snap.count == 0) snap.buckets.clear();
+    return snap;
+}
+
+void LatencyHistogram::reset() {
+    for (size_t i = 0; i < NUM_BUCKETS; i++) buckets_[i].store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double q) const {
+    if (count == 0) return 0;
+    uint64_t target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    target = std::min<uint64_t>(std::max<uint64_t>(target, 1), count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen >= target) return std::min(bucket_upper(i), max);
+    }
+    return max;
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot& other) {
+    if (other.count == 0) return;
+    if (buckets.empty()) buckets.assign(NUM_BUCKETS, 0);
+    for (size_t i = 0; i < NUM_BUCKETS; i++) buckets[i] += other.buckets[i];
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+void LatencyHistogram::Snapshot::write_json(std::ostream& os) const {
+    os << "{\"count\":" << count << ",\"mean\":" << mean()
+       << ",\"p50\":" << percentile(0.5) << ",\"p99\":" << percentile(0.99)
+       << ",\"p999\":" << percentile(0.999) << ",\"max\":" << max << "}";
+}
+
+// ============================================================================
+// 插樁計數器
+// ============================================================================
+
+const char* invalidation_type_to_string(InvalidationType type) {
+    switch (type) {
+        case InvalidationType::ALL: return "all";
+        case InvalidationType::ASID: return "asid";
+        case InvalidationType::VMID: return "vmid";
+        case InvalidationType::STREAM: return "stream";
+        case InvalidationType::VA_RANGE: return "va_range";
+        default: return "unknown";
+    }
+}
+
+// 上下文表容量和採樣間隔向上取整為 2 的冪
+Instrumentation::Instrumentation(size_t max_contexts, uint32_t hit_cycles,
+                                 uint32_t descriptor_read_cycles, uint32_t time_sampling,
+                                 bool concurrent)
+    : hit_cycles_(hit_cycles), descriptor_read_cycles_(descriptor_read_cycles),
+      timing_enabled_(time_sampling > 0), concurrent_(concurrent),
+      latency_cycles_(concurrent), latency_host_ns_(concurrent) {
+    size_t capacity = 1;
+    while (capacity < max_contexts) capacity <<= 1;
+    mask_ = capacity - 1;
+    uint32_t period = 1;
+    while (period < time_sampling) period <<= 1;
+    time_sampling_mask_ = period - 1;
+    contexts_ = std::make_unique<ContextSlot[]>(capacity);
+    for (auto& counter : walk_depth_) counter.store(0, std::memory_order_relaxed);
+    for (auto& counter : invalidations_) counter.store(0, std::memory_order_relaxed);
+}
+
+// 線性探測；空閒表項用 CAS 佔用，失敗時檢查是否被同一上下文搶先佔用
+Instrumentation::ContextSlot& Instrumentation::context_slot(StreamID stream_id, ASID asid) {
+    uint64_t key = ((static_cast<uint64_t>(stream_id) << 16) | asid) + 1;
+    size_t index = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask_;
+    for (size_t probe = 0; probe <= mask_; probe++) {
+        ContextSlot& slot = contexts_[(index + probe) & mask_];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current == key) return slot;
+        if (current == 0) {
+            if (slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel) ||
+                current == key) {
+                return slot;
+            }
+        }
+    }
+    return overflow_;
+}
+
+void Instrumentation::record_translation(StreamID stream_id, ASID asid, bool tlb_hit,
+                                         const TranslationResult& result) {
+    ContextSlot& slot = context_slot(stream_id, asid);
+    add(slot.translations);
+    add(tlb_hit ? slot.tlb_hits : slot.tlb_misses);
+    if (result.descriptor_reads > 0) {
+        add(slot.page_walks);
+        add(slot.descriptor_reads, result.descriptor_reads);
+    }
+    if (!result.success) add(slot.faults);
+    if (!tlb_hit) {
+        add(walk_depth_[std::min<size_t>(result.descriptor_reads,
+                                         InstrumentationSnapshot::MAX_WALK_DEPTH)]);
+    }
+    latency_cycles_.record(hit_cycles_ +
+                           static_cast<uint64_t>(result.descriptor_reads) * descriptor_read_cycles_);
+}
+
+void Instrumentation::read_slot(const ContextSlot& slot, ContextCounters& counters) {
+    counters.translations = load(slot.translations);
+    counters.tlb_hits = load(slot.tlb_hits);
+    counters.tlb_misses = load(slot.tlb_misses);
+    counters.page_walks = load(slot.page_walks);
+    counters.descriptor_reads = load(slot.descriptor_reads);
+    counters.faults = load(slot.faults);
+}
+
+void Instrumentation::clear_slot(ContextSlot& slot) {
+    for (std::atomic<uint64_t>* counter : {&slot.translations, &slot.tlb_hits, &slot.tlb_misses,
+                                           &slot.page_walks, &slot.descriptor_reads, &slot.faults}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+}
+
+// 只列出有轉換記錄的上下文
+InstrumentationSnapshot Instrumentation::snapshot() const {
+    InstrumentationSnapshot snap;
+    snap.enabled = true;
+    for (size_t i = 0; i <= mask_; i++) {
+        const ContextSlot& slot = contexts_[i];
+        uint64_t key = slot.key.load(std::memory_order_acquire);
+        if (key == 0) continue;
+        ContextCounters counters;
+        counters.stream_id = static_cast<StreamID>((key - 1) >> 16);
+        counters.asid = static_cast<ASID>((key - 1) & 0xFFFF);
+        read_slot(slot, counters);
+        if (counters.translations > 0) snap.contexts.push_back(counters);
+    }
+    sort_contexts(snap.contexts);
+    read_slot(overflow_, snap.overflow);
+
+    snap.walk_depth.resize(InstrumentationSnapshot::MAX_WALK_DEPTH + 1);
+    for (size_t i = 0; i < snap.walk_depth.size(); i++) snap.walk_depth[i] = load(walk_depth_[i]);
+    for (size_t i = 0; i < NUM_INVALIDATION_TYPES; i++) snap.invalidations[i] = load(invalidations_[i]);
+    snap.latency_cycles = latency_cycles_.snapshot();
+    snap.latency_host_ns = latency_host_ns_.snapshot();
+    return snap;
+}
+
+void Instrumentation::reset() {
+    for (size_t i = 0; i <= mask_; i++) clear_slot(contexts_[i]);
+    clear_slot(overflow_);
+    for (auto& counter : walk_depth_) counter.store(0, std::memory_order_relaxed);
+    for (auto& counter : invalidations_) counter.store(0, std::memory_order_relaxed);
+    latency_cycles_.reset();
+    latency_host_ns_.reset();
+}
+
+// ============================================================================
+// 快照合併
+// 相同 (StreamID, ASID) 的計數相加，其餘上下文追加後重新排序
+// ============================================================================
+
+void InstrumentationSnapshot::merge(const InstrumentationSnapshot& other) {
+    if (!other.enabled) return;
+    enabled = true;
+    for (const auto& context : other.contexts) {
+        auto it = std::find_if(contexts.begin(), contexts.end(), [&](const ContextCounters& c) {
+            return c.stream_id == context.stream_id && c.asid == context.asid;
+        });
+        if (it != contexts.end()) {
+            add_counters(*it, context);
+        } else {
+            contexts.push_back(context);
+        }
+    }
+    sort_contexts(contexts);
+    add_counters(overflow, other.overflow);
+    if (walk_depth.size() < other.walk_depth.size()) walk_depth.resize(other.walk_depth.size());
+    for (size_t i = 0; i < other.walk_depth.size(); i++) walk_depth[i] += other.walk_depth[i];
+    latency_cycles.merge(other.latency_cycles);
+    latency_host_ns.merge(other.latency_host_ns);
+    for (size_t i = 0; i < NUM_INVALIDATION_TYPES; i++) invalidations[i] += other.invalidations[i];
+}
+
+// ============================================================================
+// 導出
+// ============================================================================
+
+void InstrumentationSnapshot::write_json(std::ostream& os) const {
+    os << "{\"enabled\":" << (enabled ? "true" : "false") << ",\"contexts\":[";
+    for (size_t i = 0; i < contexts.size(); i++) {
+        if (i > 0) os << ",";
+        write_context_json(os, contexts[i], true);
+    }
+    os << "],\"overflow\":";
+    write_context_json(os, overflow, false);
+    os << ",\"walk_depth\":[";
+    for (size_t i = 0; i < walk_depth.size(); i++) os << (i > 0 ? "," : "") << walk_depth[i];
+    os << "],\"latency_cycles\":";
+    latency_cycles.write_json(os);
+    os << ",\"latency_host_ns\":";
+    latency_host_ns.write_json(os);
+    os << ",\"invalidations\":{";
+    for (size_t i = 0; i < NUM_INVALIDATION_TYPES; i++) {
+        os << (i > 0 ? "," : "") << "\""
+           << invalidation_type_to_string(static_cast<InvalidationType>(i)) << "\":"
+           << invalidations[i];
+    }
+    os << "}}";
+}
+
+void InstrumentationSnapshot::write_prometheus(std::ostream& os, const std::string& prefix) const {
+    struct Metric {
+        const char* name;
+        uint64_t ContextCounters::*field;
+    };
+    static const Metric metrics[] = {
+        {"translations_total", &ContextCounters::translations},
+        {"tlb_hits_total", &ContextCounters::tlb_hits},
+        {"tlb_misses_total", &ContextCounters::tlb_misses},
+        {"page_walks_total", &ContextCounters::page_walks},
+        {"descriptor_reads_total", &ContextCounters::descriptor_reads},
+        {"translation_faults_total", &ContextCounters::faults},
+    };
+    for (const Metric& metric : metrics) {
+        std::string name = prefix + "_" + metric.name;
+        os << "# TYPE " << name << " counter\n";
+        for (const auto& context : contexts) {
+            os << name << "{stream=\"" << context.stream_id << "\",asid=\"" << context.asid
+               << "\"} " << context.*metric.field << "\n";
+        }
+        if (overflow.translations > 0) {
+            os << name << "{stream=\"other\",asid=\"other\"} " << overflow.*metric.field << "\n";
+        }
+    }
+
+    os << "# TYPE " << prefix << "_walk_depth_total counter\n";
+    for (size_t i = 0; i < walk_depth.size(); i++) {
+        os << prefix << "_walk_depth_total{descriptor_reads=\"" << i << "\"} "
+           << walk_depth[i] << "\n";
+    }
+
+    os << "# TYPE " << prefix << "_invalidations_total counter\n";
+    for (size_t i = 0; i < NUM_INVALIDATION_TYPES; i++) {
+        os << prefix << "_invalidations_total{type=\""
+           << invalidation_type_to_string(static_cast<InvalidationType>(i)) << "\"} "
+           << invalidations[i] << "\n";
+    }
+
+    write_summary(os, prefix + "_translation_latency_cycles", latency_cycles);
+    write_summary(os, prefix + "_translation_latency_host_ns", latency_host_ns);
+}
+
+} // namespace smmu
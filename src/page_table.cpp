@@ -4,6 +4,7 @@
 #include "page_table.h"
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 
 namespace smmu {
 
@@ -13,60 +14,95 @@ namespace smmu {
 
 // 構造函數
 PageTableWalker::PageTableWalker(MemoryReadCallback memory_read)
-    : memory_read_(memory_read) {}
+    : memory_read_(memory_read), direct_memory_(nullptr), walk_cache_(nullptr),
+      contiguous_hint_(true) {}
+
+// ============================================================================
+// 內存後端
+// walk_table 按後端類型實例化，DirectMemory 的讀取在遍歷循環中內聯
+// ============================================================================
+
+// 通用路徑：經過 std::function 回調；沒有按塊讀取回調時逐個描述符讀取
+struct PageTableWalker::CallbackMemory {
+    const MemoryReadCallback& read;
+    const MemoryBlockReadCallback& block_read;
+    
+    bool read_descriptor(PhysicalAddress addr, uint64_t& desc) {
+        return read(addr, desc, 8);
+    }
+    
+    bool read_block(PhysicalAddress addr, void* data, size_t size) {
+        if (block_read) return block_read(addr, data, size);
+        uint64_t* words = static_cast<uint64_t*>(data);
+        for (size_t i = 0; i < size / 8; i++) {
+            if (!read(addr + i * 8, words[i], 8)) return false;
+        }
+        return true;
+    }
+};
+
+// 快速路徑：直接讀取 SimpleMemoryModel 的幀
+struct PageTableWalker::DirectMemory {
+    const SimpleMemoryModel& memory;
+    
+    bool read_descriptor(PhysicalAddress addr, uint64_t& desc) {
+        return memory.read_direct(addr, &desc, 8);
+    }
+    
+    bool read_block(PhysicalAddress addr, void* data, size_t size) {
+        return memory.read_direct(addr, data, size);
+    }
+};
 
 // ============================================================================
 // 獲取頁面大小
 // 根據頁表級別和粒度大小返回對應的頁面大小
 // ============================================================================
 
-PageSize PageTableWalker::get_page_size(uint8_t level, uint8_t granule_size) const {
+PageSize PageTableWalker::get_page_size(uint8_t level, uint8_t granule_size) {
     if (granule_size == 12) { // 4KB 粒度
         switch (level) {
-            case 0: return PageSize::SIZE_512MB;  // L0 塊大小
-            case 1: return PageSize::SIZE_2MB;    // L1 塊大小
-            case 2: return PageSize::SIZE_4KB;    // L2 頁面大小
+            case 1: return PageSize::SIZE_1GB;    // L1 塊大小
+            case 2: return PageSize::SIZE_2MB;    // L2 塊大小
             case 3: return PageSize::SIZE_4KB;    // L3 頁面大小
-            default: return PageSize::SIZE_4KB;
+            default: return PageSize::SIZE_4KB;   // L0 不允許塊描述符
         }
     } else if (granule_size == 14) { // 16KB 粒度
         switch (level) {
-            case 0: return PageSize::SIZE_1GB;    // L0 塊大小
-            case 1: return PageSize::SIZE_32MB;   // L1 塊大小
-            case 2: return PageSize::SIZE_16KB;   // L2 頁面大小
+            case 2: return PageSize::SIZE_32MB;   // L2 塊大小
             case 3: return PageSize::SIZE_16KB;   // L3 頁面大小
-            default: return PageSize::SIZE_16KB;
+            default: return PageSize::SIZE_16KB;  // L0/L1 不允許塊描述符
         }
     } else if (granule_size == 16) { // 64KB 粒度
         switch (level) {
-            case 1: return PageSize::SIZE_512MB;  // L1 塊大小
-            case 2: return PageSize::SIZE_64KB;   // L2 頁面大小
+            case 2: return PageSize::SIZE_512MB;  // L2 塊大小
             case 3: return PageSize::SIZE_64KB;   // L3 頁面大小
-            default: return PageSize::SIZE_64KB;
+            default: return PageSize::SIZE_64KB;  // L1 不允許塊描述符
         }
     }
     return PageSize::SIZE_4KB;
 }
 
 // ============================================================================
-// 從虛擬地址提取索引位
-// 根據頁表級別和粒度大小，從虛擬地址中提取對應的索引
+// 檢查指定級別是否允許葉子描述符
 // ============================================================================
 
-uint64_t PageTableWalker::get_index_bits(VirtualAddress va, uint8_t level,
-                                         uint8_t granule_size) const {
-    // 計算每級頁表的索引位數
-    // 每個描述符8字節，所以減3（log2(8) = 3）
-    uint8_t bits_per_level = granule_size - 3;
-    
-    // 計算需要右移的位數
-    // 例如：4KB粒度（granule_size=12），L0級別需要右移 12 + (3-0)*9 = 39位
-    uint64_t shift = granule_size + (3 - level) * bits_per_level;
-    
-    // 創建掩碼以提取索引位
-    uint64_t mask = (1ULL << bits_per_level) - 1;
-    
-    return (va >> shift) & mask;
+bool PageTableWalker::is_leaf_allowed(uint8_t level, uint8_t granule_size) {
+    if (level == 3) return true;              // L3 總是頁描述符
+    if (granule_size == 12) return level >= 1; // 4KB：L1/L2 可以是塊
+    return level == 2;                         // 16KB/64KB：只有 L2 可以是塊
+}
+
+// ============================================================================
+// 連續位覆蓋的描述符數量
+// 連續位表示一組對齊的相鄰描述符輸出地址連續、屬性相同，可以合併為一個 TLB 表項
+// ============================================================================
+
+uint64_t PageTableWalker::contiguous_entries(uint8_t level, uint8_t granule_size) {
+    if (granule_size == 12) return (level >= 1) ? 16 : 1;
+    if (granule_size == 14) return (level == 3) ? 128 : (level == 2 ? 32 : 1);
+    if (granule_size == 16) return (level >= 2) ? 32 : 1;
+    return 1;
 }
 
 // ============================================================================
@@ -82,12 +118,28 @@ uint64_t PageTableWalker::get_descriptor_address(PhysicalAddress table_base,
 }
 
 // ============================================================================
-// 讀取描述符
-// 從物理內存讀取64位描述符值
+// 讀取葉子緩存行
+// 一次讀取描述符所在的 64 字節緩存行並批量解碼全部 8 個描述符
 // ============================================================================
 
-bool PageTableWalker::read_descriptor(PhysicalAddress addr, uint64_t& desc) {
-    return memory_read_(addr, desc, 8);
+template <typename Memory>
+bool PageTableWalker::read_leaf_line(const WalkContext& ctx, Memory& memory,
+                                     PhysicalAddress addr, uint64_t& desc) {
+    LeafLine& line = *ctx.line;
+    PhysicalAddress line_addr = addr & ~static_cast<PhysicalAddress>(LeafLine::LINE_SIZE - 1);
+    uint64_t raw[LeafLine::ENTRIES];
+    if (!memory.read_block(line_addr, raw, sizeof(raw))) return false;
+    
+    uint8_t level = ctx.max_level;
+    line.page_size = get_page_size(level, ctx.granule_size);
+    line.level = level;
+    line.index = static_cast<uint8_t>((addr - line_addr) / 8);
+    line.va_base = (ctx.va & ~(static_cast<uint64_t>(line.page_size) - 1)) -
+                   static_cast<uint64_t>(line.page_size) * line.index;
+    line.count = static_cast<uint8_t>(LeafLine::ENTRIES);
+    decode_descriptors(raw, level, line.decoded);
+    desc = raw[line.index];
+    return true;
 }
 
 // ============================================================================
@@ -176,24 +228,68 @@ PageTableDescriptor PageTableWalker::parse_descriptor(uint64_t desc,
 // 從頂層頁表開始，逐級遍歷直到找到最終的物理地址
 // ============================================================================
 
-TranslationResult PageTableWalker::walk_table(const WalkContext& ctx) {
+template <typename Memory>
+TranslationResult PageTableWalker::walk_table(const WalkContext& ctx, Memory& memory) {
     TranslationResult result;
     
     PhysicalAddress table_base = ctx.ttb;      // 當前頁表基地址
     uint8_t current_level = ctx.start_level;   // 當前頁表級別
     
+    // 批量遍歷從與前一個地址共享的最深表繼續；否則查詢頁表遍歷緩存，
+    // 從最深的已緩存級別開始遍歷
+    if (ctx.resume_level > ctx.start_level) {
+        table_base = ctx.resume_table;
+        current_level = ctx.resume_level;
+    } else if (walk_cache_) {
+        bool hit = false;
+        for (uint8_t level = ctx.max_level; level > ctx.start_level; level--) {
+            if (walk_cache_->lookup(ctx.ttb, level, ctx.va, ctx.granule_size,
+                                    ctx.stage, ctx.asid, ctx.vmid, table_base)) {
+                current_level = level;
+                hit = true;
+                break;
+            }
+        }
+        if (!hit) {
+            walk_cache_->record_miss();
+        }
+    }
+    if (ctx.trace && ctx.resume_level <= ctx.start_level) ctx.trace->begin = current_level;
+    
     // 逐級遍歷頁表
     while (current_level <= ctx.max_level) {
-        // 步驟1：從虛擬地址中提取當前級別的索引
-        uint64_t index = get_index_bits(ctx.va, current_level, ctx.granule_size);
+        // 步驟1：當前級別的索引（遍歷開始前已提取）
+        uint64_t index = ctx.indices.index[current_level];
+        if (ctx.trace) {
+            ctx.trace->table[current_level] = table_base;
+            ctx.trace->end = static_cast<uint8_t>(current_level + 1);
+        }
         
         // 步驟2：計算描述符在頁表中的地址
-        PhysicalAddress desc_addr = get_descriptor_address(table_base, index, 
+        // 嵌套遍歷時當前表地址是 IPA，先經階段2轉換（緩存中保存的也是 IPA）
+        PhysicalAddress table_pa = table_base;
+        if (ctx.stage2) {
+            TranslationResult s2 = (*ctx.stage2)(table_base);
+            result.descriptor_reads += s2.descriptor_reads;
+            if (!s2.success) {
+                result.fault_type = s2.fault_type;
+                result.fault_reason = "Stage 2 fault on stage 1 table walk";
+                return result;
+            }
+            table_pa = s2.physical_addr;
+        }
+        PhysicalAddress desc_addr = get_descriptor_address(table_pa, index, 
                                                            ctx.granule_size);
         
-        // 步驟3：從內存讀取描述符
+        // 步驟3：從內存讀取描述符（最後一級按需讀取整個緩存行）
         uint64_t desc_value;
-        if (!read_descriptor(desc_addr, desc_value)) {
+        result.descriptor_reads++;
+        bool read_ok = (ctx.line && current_level == ctx.max_level)
+            ? read_leaf_line(ctx, memory, desc_addr, desc_value)
+            : memory.read_descriptor(desc_addr, desc_value);
+        if (!read_ok) {
+            // 只有超出物理地址範圍時讀取才會失敗
+            result.fault_type = FaultType::ADDRESS_SIZE_FAULT;
             result.fault_reason = "Failed to read descriptor";
             return result;
         }
@@ -204,6 +300,7 @@ TranslationResult PageTableWalker::walk_table(const WalkContext& ctx) {
         
         // 步驟5：檢查描述符是否有效
         if (!desc.valid) {
+            result.fault_type = FaultType::TRANSLATION_FAULT;
             result.fault_reason = "Translation fault: invalid descriptor";
             return result;
         }
@@ -211,15 +308,31 @@ TranslationResult PageTableWalker::walk_table(const WalkContext& ctx) {
         // 步驟6：判斷描述符類型
         if (!desc.is_table) {
             // 塊描述符或頁描述符 - 轉換完成
+            if (!is_leaf_allowed(current_level, ctx.granule_size)) {
+                result.fault_type = FaultType::TRANSLATION_FAULT;
+                result.fault_reason = "Translation fault: block descriptor not permitted at this level";
+                return result;
+            }
             
             // 計算頁面大小和偏移
+            // 連續位：映射擴大為整個對齊的連續範圍
             PageSize page_size = get_page_size(current_level, ctx.granule_size);
+            if (desc.contiguous && contiguous_hint_) {
+                uint64_t entries = contiguous_entries(current_level, ctx.granule_size);
+                if (entries > 1) {
+                    page_size = static_cast<PageSize>(static_cast<uint64_t>(page_size) * entries);
+                    result.contiguous = true;
+                }
+            }
             uint64_t page_mask = static_cast<uint64_t>(page_size) - 1;
             uint64_t offset = ctx.va & page_mask;  // 頁內偏移
             
             // 填充轉換結果
+            // 塊描述符的輸出地址低位（塊內偏移部分）為保留位，需清除
             result.success = true;
-            result.physical_addr = desc.address + offset;  // 物理地址 = 基地址 + 偏移
+            result.physical_addr = (desc.address & ~page_mask) + offset;  // 物理地址 = 基地址 + 偏移
+            result.page_size = page_size;
+            result.level = current_level;
             result.permission = desc.ap;
             result.memory_type = desc.mem_attr;
             result.cacheable = (desc.mem_attr == MemoryType::NORMAL_WB ||
@@ -231,9 +344,16 @@ TranslationResult PageTableWalker::walk_table(const WalkContext& ctx) {
         // 表描述符 - 繼續到下一級頁表
         table_base = desc.address;  // 更新頁表基地址為下一級頁表
         current_level++;            // 進入下一級
+        
+        // 緩存下一級頁表的基地址，供相鄰地址的遍歷直接使用
+        if (walk_cache_ && current_level <= ctx.max_level) {
+            walk_cache_->insert(ctx.ttb, current_level, ctx.va, ctx.granule_size,
+                                ctx.stage, ctx.asid, ctx.vmid, table_base);
+        }
     }
     
     // 超過最大級別仍未完成轉換
+    result.fault_type = FaultType::TRANSLATION_FAULT;
     result.fault_reason = "Translation fault: exceeded max level";
     return result;
 }
@@ -247,7 +367,11 @@ TranslationResult PageTableWalker::translate(VirtualAddress va,
                                             PhysicalAddress ttb,
                                             uint8_t granule_size,
                                             uint8_t ips_bits,
-                                            TranslationStage stage) {
+                                            TranslationStage stage,
+                                            ASID asid,
+                                            VMID vmid,
+                                            const Stage2TranslateCallback* stage2,
+                                            LeafLine* line) {
     // 初始化遍歷上下文
     WalkContext ctx;
     ctx.va = va;
@@ -255,26 +379,117 @@ TranslationResult PageTableWalker::translate(VirtualAddress va,
     ctx.granule_size = granule_size;
     ctx.ips_bits = ips_bits;
     ctx.stage = stage;
+    ctx.asid = asid;
+    ctx.vmid = vmid;
+    ctx.stage2 = stage2;
+    ctx.line = line;
+    if (line) line->count = 0;
+    
+    if (!set_levels(ctx)) {
+        // 無效的粒度大小
+        TranslationResult result;
+        result.fault_type = FaultType::TRANSLATION_FAULT;
+        result.fault_reason = "Invalid granule size";
+        return result;
+    }
+    
+    // 單個地址的各級索引（與 extract_indices 相同）
+    uint8_t bits_per_level = granule_size - 3;
+    for (uint8_t level = 0; level < 4; level++) {
+        ctx.indices.index[level] = level < ctx.start_level ? 0 : static_cast<uint16_t>(
+            (va >> (granule_size + (3 - level) * bits_per_level)) & ((1ULL << bits_per_level) - 1));
+    }
+    return run_walk(ctx);
+}
+
+// ============================================================================
+// 批量遍歷
+// 索引按塊一次提取；與前一個地址在 start_level..L-1 的索引都相同時，
+// 前一次遍歷在這些級別讀取的是同一組表描述符，可以直接從它在 L 級讀取的表繼續
+// ============================================================================
+
+void PageTableWalker::translate_batch(const VirtualAddress* vas,
+                                      size_t count,
+                                      PhysicalAddress ttb,
+                                      uint8_t granule_size,
+                                      uint8_t ips_bits,
+                                      TranslationStage stage,
+                                      TranslationResult* results,
+                                      ASID asid,
+                                      VMID vmid) {
+    WalkContext ctx;
+    ctx.ttb = ttb;
+    ctx.granule_size = granule_size;
+    ctx.ips_bits = ips_bits;
+    ctx.stage = stage;
+    ctx.asid = asid;
+    ctx.vmid = vmid;
+    ctx.stage2 = nullptr;
+    ctx.line = nullptr;
+    if (!set_levels(ctx)) {
+        for (size_t i = 0; i < count; i++) {
+            results[i] = TranslationResult();
+            results[i].fault_type = FaultType::TRANSLATION_FAULT;
+            results[i].fault_reason = "Invalid granule size";
+        }
+        return;
+    }
+    
+    constexpr size_t CHUNK = 64;
+    LevelIndices indices[CHUNK];
+    TableTrace trace;
+    LevelIndices previous{};
+    ctx.trace = &trace;
     
+    for (size_t base = 0; base < count; base += CHUNK) {
+        size_t n = std::min(CHUNK, count - base);
+        extract_indices(vas + base, n, granule_size, indices);
+        for (size_t i = 0; i < n; i++) {
+            ctx.va = vas[base + i];
+            ctx.indices = indices[i];
+            
+            // 共享的最深級別：該級別的表已被前一次遍歷讀取
+            uint8_t level = ctx.start_level;
+            while (level + 1 < trace.end &&
+                   previous.index[level] == ctx.indices.index[level]) {
+                level++;
+            }
+            if (level < trace.begin) level = ctx.start_level;
+            ctx.resume_level = level;
+            ctx.resume_table = trace.table[level];
+            
+            results[base + i] = run_walk(ctx);
+            previous = ctx.indices;
+        }
+    }
+}
+
+// ============================================================================
+// 遍歷級別和內存後端
+// ============================================================================
+
+bool PageTableWalker::set_levels(WalkContext& ctx) {
     // 根據粒度大小確定起始級別和最大級別
-    if (granule_size == 12) { // 4KB 粒度
+    if (ctx.granule_size == 12 || ctx.granule_size == 14) { // 4KB / 16KB 粒度
         ctx.start_level = 0;  // 從 L0 開始
         ctx.max_level = 3;    // 最多到 L3
-    } else if (granule_size == 14) { // 16KB 粒度
-        ctx.start_level = 0;
-        ctx.max_level = 3;
-    } else if (granule_size == 16) { // 64KB 粒度
+    } else if (ctx.granule_size == 16) { // 64KB 粒度
         ctx.start_level = 1;  // 從 L1 開始（64KB 沒有 L0）
         ctx.max_level = 3;
     } else {
-        // 無效的粒度大小
-        TranslationResult result;
-        result.fault_reason = "Invalid granule size";
-        return result;
+        return false;
     }
-    
-    // 執行頁表遍歷
-    return walk_table(ctx);
+    return true;
+}
+
+TranslationResult PageTableWalker::run_walk(const WalkContext& ctx) {
+    // 執行頁表遍歷（有直接內存時使用內聯讀取）
+    if (direct_memory_) {
+        DirectMemory memory{*direct_memory_};
+        return walk_table(ctx, memory);
+    }
+    CallbackMemory memory{memory_read_, block_read_};
+    return walk_table(ctx, memory);
 }
 
 // ============================================================================
@@ -282,26 +497,72 @@ TranslationResult PageTableWalker::translate(VirtualAddress va,
 // 用於測試的物理內存模擬器
 // ============================================================================
 
-// 構造函數：分配256MB內存，從0x1000開始分配（保留低地址）
+// 構造函數：只創建基數樹根，幀在首次寫入時分配；從0x1000開始分配（保留低地址）
 SimpleMemoryModel::SimpleMemoryModel() 
-    : memory_(MEMORY_SIZE, 0), next_alloc_(0x1000) {}
+    : root_(RADIX_FANOUT), resident_frames_(0), next_alloc_(0x1000) {}
+
+// 查找幀，路徑上缺失的節點和幀按需分配（make_unique 會清零）
+SimpleMemoryModel::Frame* SimpleMemoryModel::get_or_create_frame(PhysicalAddress addr) {
+    auto& mid = root_[(addr >> 36) & (RADIX_FANOUT - 1)];
+    if (!mid) mid = std::make_unique<MidNode>();
+    auto& leaf = mid->leaves[(addr >> 24) & (RADIX_FANOUT - 1)];
+    if (!leaf) leaf = std::make_unique<LeafNode>();
+    auto& frame = leaf->frames[(addr >> FRAME_SHIFT) & (RADIX_FANOUT - 1)];
+    if (!frame) {
+        frame = std::make_unique<Frame>();
+        resident_frames_++;
+    }
+    return frame.get();
+}
 
 // 向物理內存寫入數據
+// 跨幀的寫入按幀拆分
 void SimpleMemoryModel::write(PhysicalAddress addr, const void* data, size_t size) {
     // 檢查地址範圍是否有效
-    if (addr + size <= MEMORY_SIZE) {
-        std::memcpy(&memory_[addr], data, size);
+    if (addr >= PA_LIMIT || size > PA_LIMIT - addr) {
+        return;
+    }
+    
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        size_t offset = addr & (FRAME_SIZE - 1);
+        size_t chunk = std::min(size, FRAME_SIZE - offset);
+        std::memcpy(&get_or_create_frame(addr)->bytes[offset], src, chunk);
+        addr += chunk;
+        src += chunk;
+        size -= chunk;
     }
 }
 
 // 從物理內存讀取數據
-bool SimpleMemoryModel::read(PhysicalAddress addr, void* data, size_t size) {
+// 未分配的幀讀為0，不會觸發分配
+bool SimpleMemoryModel::read(PhysicalAddress addr, void* data, size_t size) const {
     // 檢查地址範圍是否有效
-    if (addr + size <= MEMORY_SIZE) {
-        std::memcpy(data, &memory_[addr], size);
-        return true;  // 讀取成功
+    if (addr >= PA_LIMIT || size > PA_LIMIT - addr) {
+        return false;  // 地址越界
+    }
+    
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        size_t offset = addr & (FRAME_SIZE - 1);
+        size_t chunk = std::min(size, FRAME_SIZE - offset);
+        const Frame* frame = find_frame(addr);
+        if (frame) {
+            std::memcpy(dst, &frame->bytes[offset], chunk);
+        } else {
+            std::memset(dst, 0, chunk);
+        }
+        addr += chunk;
+        dst += chunk;
+        size -= chunk;
     }
-    return false;  // 地址越界
+    return true;  // 讀取成功
+}
+
+// 幀數據指針（按需分配）
+uint8_t* SimpleMemoryModel::frame_data(PhysicalAddress addr) {
+    if (addr >= PA_LIMIT) return nullptr;
+    return get_or_create_frame(addr)->bytes;
 }
 
 // 寫入頁表項（64位）
@@ -309,17 +570,42 @@ void SimpleMemoryModel::write_pte(PhysicalAddress addr, uint64_t pte) {
     write(addr, &pte, sizeof(pte));
 }
 
+// 丟棄內存內容
+// 完整覆蓋的幀從基數樹中釋放，首尾部分覆蓋的幀清零
+void SimpleMemoryModel::discard(PhysicalAddress addr, size_t size) {
+    if (addr >= PA_LIMIT || size > PA_LIMIT - addr) {
+        return;
+    }
+    
+    while (size > 0) {
+        size_t offset = addr & (FRAME_SIZE - 1);
+        size_t chunk = std::min(size, FRAME_SIZE - offset);
+        MidNode* mid = root_[(addr >> 36) & (RADIX_FANOUT - 1)].get();
+        LeafNode* leaf = mid ? mid->leaves[(addr >> 24) & (RADIX_FANOUT - 1)].get() : nullptr;
+        if (leaf) {
+            auto& frame = leaf->frames[(addr >> FRAME_SHIFT) & (RADIX_FANOUT - 1)];
+            if (frame && chunk == FRAME_SIZE) {
+                frame.reset();
+                resident_frames_--;
+            } else if (frame) {
+                std::memset(&frame->bytes[offset], 0, chunk);
+            }
+        }
+        addr += chunk;
+        size -= chunk;
+    }
+}
+
 // 分配物理頁面
-// 簡單的順序分配器，不支持釋放
+// 簡單的順序分配器，不支持釋放；失敗時不移動分配指針
 PhysicalAddress SimpleMemoryModel::allocate_page(size_t size) {
-    PhysicalAddress addr = next_alloc_;
-    next_alloc_ += size;
-    
-    // 檢查是否超出內存範圍
-    if (next_alloc_ > MEMORY_SIZE) {
+    // 檢查是否超出物理地址範圍
+    if (size > PA_LIMIT - next_alloc_) {
         return 0; // 內存不足
     }
     
+    PhysicalAddress addr = next_alloc_;
+    next_alloc_ += size;
     return addr;
 }
 
@@ -0,0 +1,259 @@
+// 頁表構建器實現文件
+// 實現按範圍映射、塊描述符的選擇和拆分、連續位維護，以及頁表的批量分配
+
+#include "page_table_builder.h"
+#include <algorithm>
+
+namespace smmu {
+
+namespace {
+
+constexpr uint64_t ADDRESS_MASK = 0x0000FFFFFFFFF000ULL;  // 描述符輸出地址 [47:12]
+constexpr uint64_t VALID = 0x1;
+constexpr uint64_t TABLE_OR_PAGE = 0x2;                    // L0-L2 表描述符 / L3 頁描述符
+constexpr uint64_t ACCESS_FLAG = 1ULL << 10;
+constexpr uint64_t CONTIGUOUS = 1ULL << 52;
+constexpr uint64_t VA_LIMIT = 1ULL << 48;
+constexpr size_t MAX_CONTIGUOUS_ENTRIES = 128;             // 16KB 粒度 L3
+
+inline bool is_table_descriptor(uint64_t desc, uint8_t level) {
+    return level < 3 && (desc & (VALID | TABLE_OR_PAGE)) == (VALID | TABLE_OR_PAGE);
+}
+
+} // namespace
+
+// ============================================================================
+// 構造函數
+// ============================================================================
+
+PageTableBuilder::PageTableBuilder(SimpleMemoryModel& memory, uint8_t granule_size)
+    : PageTableBuilder(memory, granule_size, 0) {
+    if (valid_granule_) root_ = allocate_table();
+}
+
+PageTableBuilder::PageTableBuilder(SimpleMemoryModel& memory, uint8_t granule_size,
+                                   PhysicalAddress root)
+    : memory_(memory), frames_(nullptr), owner_(FrameAllocator::NO_OWNER),
+      granule_size_(granule_size),
+      start_level_(granule_size == 16 ? 1 : 0),
+      valid_granule_(granule_size == 12 || granule_size == 14 || granule_size == 16),
+      root_(root), pool_next_(0), pool_end_(0), chunk_tables_(1) {}
+
+PageTableBuilder::PageTableBuilder(FrameAllocator& frames, FrameAllocator::Owner owner,
+                                   uint8_t granule_size)
+    : PageTableBuilder(frames.memory(), granule_size, 0) {
+    frames_ = &frames;
+    owner_ = owner;
+    if (valid_granule_) root_ = allocate_table();
+}
+
+// ============================================================================
+// 描述符編碼
+// 與 PageTableWalker::parse_descriptor 的解碼對應：AttrIndx [4:2]、AP [7:6]、
+// SH [9:8]、AF (bit 10)、PXN (bit 53)、XN (bit 54)
+// ============================================================================
+
+uint64_t PageTableBuilder::encode_leaf(PhysicalAddress pa, uint8_t level,
+                                       const MappingAttributes& attrs) {
+    uint64_t desc = (pa & ADDRESS_MASK) | VALID | ACCESS_FLAG;
+    if (level == 3) desc |= TABLE_OR_PAGE;
+
+    uint64_t attr_index;
+    switch (attrs.memory_type) {
+        case MemoryType::DEVICE_nGnRnE: attr_index = 0; break;
+        case MemoryType::DEVICE_nGnRE:
+        case MemoryType::DEVICE_nGRE:
+        case MemoryType::DEVICE_GRE: attr_index = 1; break;
+        case MemoryType::NORMAL_NC: attr_index = 2; break;
+        case MemoryType::NORMAL_WT: attr_index = 3; break;
+        default: attr_index = 4; break;
+    }
+    desc |= attr_index << 2;
+
+    if (attrs.permission == AccessPermission::READ_ONLY) desc |= 2ULL << 6;  // AP[2:1] = 10
+    if (attrs.shareable) desc |= 3ULL << 8;                                   // 內部共享
+    if (attrs.privileged_execute_never) desc |= 1ULL << 53;
+    if (attrs.execute_never) desc |= 1ULL << 54;
+    return desc;
+}
+
+// ============================================================================
+// 範圍映射
+// ============================================================================
+
+bool PageTableBuilder::map_range(VirtualAddress va, PhysicalAddress pa, uint64_t size,
+                                 const MappingAttributes& attrs) {
+    if (!valid_granule_ || root_ == 0) return false;
+    if (((va | pa | size) & (granule_bytes() - 1)) != 0) return false;
+    if (va >= VA_LIMIT || size > VA_LIMIT - va) return false;
+    if (pa >= SimpleMemoryModel::PA_LIMIT || size > SimpleMemoryModel::PA_LIMIT - pa) return false;
+    if (size == 0) return true;
+    return map_level(root_, start_level_, va, pa, size, attrs);
+}
+
+// 按表項逐個處理：完整覆蓋且輸出地址對齊的表項寫入葉子描述符（先收集成一段再寫入），
+// 其餘表項進入下一級表
+bool PageTableBuilder::map_level(PhysicalAddress table, uint8_t level, VirtualAddress va,
+                                 PhysicalAddress pa, uint64_t size,
+                                 const MappingAttributes& attrs) {
+    uint64_t span = 1ULL << entry_shift(level);
+    uint64_t index_mask = (1ULL << (granule_size_ - 3)) - 1;
+    bool leaf_allowed = PageTableWalker::is_leaf_allowed(level, granule_size_);
+    uint64_t first_index = 0;
+
+    while (size > 0) {
+        uint64_t index = (va >> entry_shift(level)) & index_mask;
+        uint64_t chunk = std::min(size, span - (va & (span - 1)));
+        if (leaf_allowed && chunk == span && (pa & (span - 1)) == 0) {
+            if (run_.empty()) first_index = index;
+            run_.push_back(encode_leaf(pa, level, attrs));
+        } else {
+            // run_ 在遞歸前寫出，下一級可以重用同一個緩衝區
+            if (!run_.empty()) write_leaves(table, level, first_index, attrs);
+            PhysicalAddress next = next_table(table, level, index, va);
+            if (next == 0 || !map_level(next, level + 1, va, pa, chunk, attrs)) return false;
+        }
+        va += chunk;
+        pa += chunk;
+        size -= chunk;
+    }
+    if (!run_.empty()) write_leaves(table, level, first_index, attrs);
+    return true;
+}
+
+// ============================================================================
+// 下一級表
+// 塊被拆分為下一級表時，新表的每一項按原塊的屬性映射原塊的對應部分
+// ============================================================================
+
+PhysicalAddress PageTableBuilder::next_table(PhysicalAddress table, uint8_t level,
+                                             uint64_t index, VirtualAddress va) {
+    TableCache& cached = cache_[level + 1];
+    uint64_t prefix = va >> entry_shift(level);
+    if (cached.valid && cached.prefix == prefix) return cached.table;
+
+    PhysicalAddress entry = table + index * 8;
+    uint64_t desc = 0;
+    memory_.read(entry, &desc, sizeof(desc));
+
+    PhysicalAddress next;
+    if (is_table_descriptor(desc, level)) {
+        next = desc & ADDRESS_MASK;
+    } else {
+        next = allocate_table();
+        if (next == 0) return 0;
+        if (desc & VALID) {
+            uint8_t child = static_cast<uint8_t>(level + 1);
+            uint64_t child_span = 1ULL << entry_shift(child);
+            uint64_t block_pa = desc & ADDRESS_MASK & ~((1ULL << entry_shift(level)) - 1);
+            uint64_t attr_bits = (desc & ~ADDRESS_MASK & ~TABLE_OR_PAGE & ~CONTIGUOUS) |
+                                 (child == 3 ? TABLE_OR_PAGE : 0);
+            std::vector<uint64_t> children(table_bytes() / 8);
+            for (size_t i = 0; i < children.size(); i++) {
+                children[i] = (block_pa + i * child_span) | attr_bits;
+            }
+            memory_.write(next, children.data(), table_bytes());
+            stats_.splits++;
+        }
+        memory_.write_pte(entry, next | VALID | TABLE_OR_PAGE);
+        if (desc & CONTIGUOUS) clear_contiguous_group(table, level, index);
+    }
+    cached.valid = true;
+    cached.prefix = prefix;
+    cached.table = next;
+    return next;
+}
+
+// ============================================================================
+// 寫入葉子描述符
+// attrs.contiguous 時，整組位於本段內且輸出地址按整組對齊的描述符設置連續位；
+// 只被部分覆寫的組清除其餘描述符的連續位，避免遍歷器按不一致的組擴大映射
+// ============================================================================
+
+void PageTableBuilder::write_leaves(PhysicalAddress table, uint8_t level, uint64_t first_index,
+                                    const MappingAttributes& attrs) {
+    uint64_t count = run_.size();
+    uint64_t group = PageTableWalker::contiguous_entries(level, granule_size_);
+    uint64_t span = 1ULL << entry_shift(level);
+
+    if (attrs.contiguous && group > 1) {
+        for (uint64_t i = 0; i < count;) {
+            uint64_t index = first_index + i;
+            PhysicalAddress pa = run_[i] & ADDRESS_MASK;
+            if (index % group == 0 && i + group <= count && (pa & (group * span - 1)) == 0) {
+                for (uint64_t j = i; j < i + group; j++) run_[j] |= CONTIGUOUS;
+                i += group;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    memory_.write(table + first_index * 8, run_.data(), count * 8);
+    (level == 3 ? stats_.pages : stats_.blocks) += count;
+    run_.clear();
+
+    if (group > 1) {
+        uint64_t last_index = first_index + count - 1;
+        auto partial = [&](uint64_t index) {
+            uint64_t start = index - index % group;
+            return first_index > start || last_index < start + group - 1;
+        };
+        if (partial(first_index)) clear_contiguous_group(table, level, first_index);
+        if (last_index / group != first_index / group && partial(last_index)) {
+            clear_contiguous_group(table, level, last_index);
+        }
+    }
+
+    // 塊描述符可能替換了表，更深級別緩存的表不再可達
+    if (level < 3) {
+        for (uint8_t l = static_cast<uint8_t>(level + 1); l < 4; l++) cache_[l].valid = false;
+    }
+}
+
+void PageTableBuilder::clear_contiguous_group(PhysicalAddress table, uint8_t level,
+                                              uint64_t index) {
+    uint64_t group = PageTableWalker::contiguous_entries(level, granule_size_);
+    PhysicalAddress start = table + (index - index % group) * 8;
+    uint64_t entries[MAX_CONTIGUOUS_ENTRIES];
+    memory_.read(start, entries, group * 8);
+    bool changed = false;
+    for (uint64_t i = 0; i < group; i++) {
+        if (entries[i] & CONTIGUOUS) {
+            entries[i] &= ~CONTIGUOUS;
+            changed = true;
+        }
+    }
+    if (changed) memory_.write(start, entries, group * 8);
+}
+
+// ============================================================================
+// 頁表分配
+// 每批的表數從 1 開始加倍到 TABLES_PER_CHUNK，小的頁表不預留多餘的地址空間；
+// 大於 4KB 的表多分配一張表減一幀的空間用於對齊（內存模型按幀對齊分配）
+// 使用幀分配器時逐張分配，幀分配器保證按大小對齊且內容為 0
+// ============================================================================
+
+PhysicalAddress PageTableBuilder::allocate_table() {
+    if (frames_) {
+        FrameAllocation frame = frames_->allocate(table_bytes(), owner_);
+        if (!frame.success) return 0;
+        stats_.tables++;
+        return frame.pa;
+    }
+    if (pool_next_ == pool_end_) {
+        uint64_t bytes = table_bytes() * chunk_tables_;
+        PhysicalAddress base = memory_.allocate_page(bytes + table_bytes() -
+                                                     SimpleMemoryModel::FRAME_SIZE);
+        if (base == 0) return 0;
+        pool_next_ = (base + table_bytes() - 1) & ~(table_bytes() - 1);
+        pool_end_ = pool_next_ + bytes;
+        chunk_tables_ = std::min(chunk_tables_ * 2, TABLES_PER_CHUNK);
+    }
+    PhysicalAddress table = pool_next_;
+    pool_next_ += table_bytes();
+    stats_.tables++;
+    return table;
+}
+
+} // namespace smmu
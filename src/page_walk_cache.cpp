@@ -0,0 +1,160 @@
+// 頁表遍歷緩存實現文件
+// 實現中間級別表描述符的緩存、LRU 淘汰和無效化
+
+#include "page_walk_cache.h"
+
+namespace smmu {
+
+// ============================================================================
+// 構造函數
+// ============================================================================
+
+PageWalkCache::PageWalkCache(size_t entries_per_level, bool thread_safe)
+    : capacity_(entries_per_level), miss_count_(0), thread_safe_(thread_safe) {
+    hit_count_.fill(0);
+}
+
+// ============================================================================
+// 查找操作
+// 命中時把表項移到 LRU 鏈表前面並增加該級別的命中計數
+// ============================================================================
+
+bool PageWalkCache::lookup(PhysicalAddress ttb, uint8_t level, VirtualAddress va,
+                           uint8_t granule_size, TranslationStage stage,
+                           ASID asid, VMID vmid, PhysicalAddress& table_base) {
+    if (level >= NUM_LEVELS) return false;
+
+    auto guard = lock();
+    LevelCache& cache = levels_[level];
+    Key key{ttb, va_prefix(va, level, granule_size), asid, vmid, granule_size, stage};
+    auto it = cache.entries.find(key);
+    if (it == cache.entries.end()) {
+        return false;
+    }
+
+    cache.lru_list.splice(cache.lru_list.begin(), cache.lru_list, it->second.lru_pos);
+    hit_count_[level]++;
+    table_base = it->second.table_base;
+    return true;
+}
+
+// ============================================================================
+// 插入操作
+// 已存在則更新；已滿則淘汰該級別最久未使用的表項
+// ============================================================================
+
+void PageWalkCache::insert(PhysicalAddress ttb, uint8_t level, VirtualAddress va,
+                           uint8_t granule_size, TranslationStage stage,
+                           ASID asid, VMID vmid, PhysicalAddress table_base) {
+    if (level >= NUM_LEVELS || capacity_ == 0) return;
+
+    auto guard = lock();
+    LevelCache& cache = levels_[level];
+    Key key{ttb, va_prefix(va, level, granule_size), asid, vmid, granule_size, stage};
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end()) {
+        it->second.table_base = table_base;
+        cache.lru_list.splice(cache.lru_list.begin(), cache.lru_list, it->second.lru_pos);
+        return;
+    }
+
+    if (cache.entries.size() >= capacity_) {
+        cache.entries.erase(cache.lru_list.back());
+        cache.lru_list.pop_back();
+    }
+
+    cache.lru_list.push_front(key);
+    cache.entries.emplace(key, Node{table_base, cache.lru_list.begin()});
+}
+
+// ============================================================================
+// 無效化操作
+// ============================================================================
+
+// 使所有表項無效
+void PageWalkCache::invalidate_all() {
+    auto guard = lock();
+    for (auto& cache : levels_) {
+        cache.entries.clear();
+        cache.lru_list.clear();
+    }
+}
+
+// 按 ASID 使階段1表項無效（階段2表項不帶 ASID）
+void PageWalkCache::invalidate_by_asid(ASID asid) {
+    auto guard = lock();
+    for (auto& cache : levels_) {
+        erase_if(cache, [asid](const Key& key) {
+            return key.stage == TranslationStage::STAGE1 && key.asid == asid;
+        });
+    }
+}
+
+// 按 VMID 使表項無效（包括階段1和階段2）
+void PageWalkCache::invalidate_by_vmid(VMID vmid) {
+    auto guard = lock();
+    for (auto& cache : levels_) {
+        erase_if(cache, [vmid](const Key& key) { return key.vmid == vmid; });
+    }
+}
+
+// 使覆蓋指定虛擬地址的階段1表項無效
+void PageWalkCache::invalidate_by_va(VirtualAddress va, ASID asid) {
+    auto guard = lock();
+    for (uint8_t level = 0; level < NUM_LEVELS; level++) {
+        erase_if(levels_[level], [va, asid, level](const Key& key) {
+            return key.stage == TranslationStage::STAGE1 && key.asid == asid &&
+                   key.prefix == va_prefix(va, level, key.granule_size);
+        });
+    }
+}
+
+// 使與 [start, start + size) 重疊的階段1表項無效
+void PageWalkCache::invalidate_by_va_range(VirtualAddress start, uint64_t size, ASID asid) {
+    if (size == 0) return;
+    VirtualAddress last = (start + size - 1 < start) ? ~0ULL : start + size - 1;
+    auto guard = lock();
+    for (uint8_t level = 0; level < NUM_LEVELS; level++) {
+        erase_if(levels_[level], [start, last, asid, level](const Key& key) {
+            return key.stage == TranslationStage::STAGE1 && key.asid == asid &&
+                   key.prefix >= va_prefix(start, level, key.granule_size) &&
+                   key.prefix <= va_prefix(last, level, key.granule_size);
+        });
+    }
+}
+
+// ============================================================================
+// 統計信息
+// ============================================================================
+
+size_t PageWalkCache::size() const {
+    auto guard = lock();
+    size_t total = 0;
+    for (const auto& cache : levels_) {
+        total += cache.entries.size();
+    }
+    return total;
+}
+
+uint64_t PageWalkCache::hit_count(uint8_t level) const {
+    auto guard = lock();
+    return hit_count_[level];
+}
+
+uint64_t PageWalkCache::miss_count() const {
+    auto guard = lock();
+    return miss_count_;
+}
+
+void PageWalkCache::record_miss() {
+    auto guard = lock();
+    miss_count_++;
+}
+
+void PageWalkCache::reset_statistics() {
+    auto guard = lock();
+    hit_count_.fill(0);
+    miss_count_ = 0;
+}
+
+} // namespace smmu
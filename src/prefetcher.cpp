@@ -0,0 +1,205 @@
+// 轉換預取器實現文件
+// 實現步長檢測、預取緩衝區的查找和替換，以及無效化
+
+#include "prefetcher.h"
+
+namespace smmu {
+
+namespace {
+
+// 表項是否覆蓋 va
+inline bool covers(const TLBEntry& entry, VirtualAddress va) {
+    uint64_t page_mask = static_cast<uint64_t>(entry.page_size) - 1;
+    return (va & ~page_mask) == entry.va;
+}
+
+} // namespace
+
+// ============================================================================
+// 構造函數
+// ============================================================================
+
+TranslationPrefetcher::TranslationPrefetcher(size_t depth, size_t buffer_entries,
+                                             size_t stream_entries, bool thread_safe)
+    : depth_(depth), buffer_(buffer_entries), next_slot_(0),
+      streams_(stream_entries), issued_count_(0), hit_count_(0),
+      unused_count_(0), thread_safe_(thread_safe) {}
+
+// ============================================================================
+// 預取緩衝區查找
+// 命中的表項從緩衝區刪除，由調用者移入 TLB
+// ============================================================================
+
+std::optional<TLBEntry> TranslationPrefetcher::take(VirtualAddress va, StreamID stream_id,
+                                                    ASID asid, VMID vmid) {
+    auto guard = lock();
+    for (auto& slot : buffer_) {
+        if (slot.valid && slot.entry.stream_id == stream_id &&
+            slot.entry.asid == asid && slot.entry.vmid == vmid &&
+            covers(slot.entry, va)) {
+            slot.valid = false;
+            hit_count_++;
+            return slot.entry;
+        }
+    }
+    return std::nullopt;
+}
+
+// ============================================================================
+// 步長檢測
+// 同一流連續兩次未命中的頁號差相同（且非零）即認為是固定步長訪問，
+// 之後每次未命中只補齊與 depth 之間的差額，穩定狀態下每頁預取一個頁面
+// ============================================================================
+
+TranslationPrefetcher::Plan TranslationPrefetcher::observe(VirtualAddress va,
+                                                           StreamID stream_id,
+                                                           ASID asid, VMID vmid,
+                                                           PageSize page_size) {
+    Plan plan{0, 0, 0};
+    if (depth_ == 0 || streams_.empty() || buffer_.empty()) return plan;
+
+    auto guard = lock();
+    StreamState& state = streams_[stream_id % streams_.size()];
+    uint8_t shift = static_cast<uint8_t>(__builtin_ctzll(static_cast<uint64_t>(page_size)));
+    uint64_t page = va >> shift;
+
+    if (!state.valid || state.stream_id != stream_id || state.asid != asid ||
+        state.vmid != vmid || state.page_shift != shift) {
+        state = StreamState();
+        state.valid = true;
+        state.stream_id = stream_id;
+        state.asid = asid;
+        state.vmid = vmid;
+        state.page_shift = shift;
+        state.last_page = page;
+        return plan;
+    }
+
+    int64_t delta = static_cast<int64_t>(page - state.last_page);
+    if (delta == 0) return plan;  // 同一頁面再次未命中（例如被 TLB 淘汰後）
+    state.last_page = page;
+
+    if (delta != state.stride) {
+        state.stride = delta;
+        state.confidence = 0;
+        state.ahead = 0;
+        return plan;
+    }
+
+    if (state.confidence < 3) state.confidence++;
+    state.ahead = state.ahead > 0 ? state.ahead - 1 : 0;
+
+    plan.count = static_cast<uint32_t>(depth_ - state.ahead);
+    plan.stride = state.stride * (static_cast<int64_t>(1) << shift);
+    plan.start = va - (va & ((1ULL << shift) - 1)) +
+                 static_cast<uint64_t>(plan.stride) * (state.ahead + 1);
+    state.ahead = static_cast<uint32_t>(depth_);
+    return plan;
+}
+
+// ============================================================================
+// 放入預取表項
+// 已有相同頁面時覆蓋；否則按 FIFO 替換
+// ============================================================================
+
+void TranslationPrefetcher::fill(const TLBEntry& entry) {
+    if (buffer_.empty()) return;
+
+    auto guard = lock();
+    issued_count_++;
+    for (auto& slot : buffer_) {
+        if (slot.valid && slot.entry.stream_id == entry.stream_id &&
+            slot.entry.asid == entry.asid && slot.entry.vmid == entry.vmid &&
+            slot.entry.va == entry.va && slot.entry.page_size == entry.page_size) {
+            slot.entry = entry;
+            unused_count_++;  // 舊的表項未被使用
+            return;
+        }
+    }
+
+    Slot& slot = buffer_[next_slot_];
+    next_slot_ = (next_slot_ + 1) % buffer_.size();
+    if (slot.valid) unused_count_++;
+    slot.valid = true;
+    slot.entry = entry;
+}
+
+// ============================================================================
+// 無效化操作
+// ============================================================================
+
+void TranslationPrefetcher::invalidate_all() {
+    auto guard = lock();
+    discard_if([](const TLBEntry&) { return true; });
+}
+
+void TranslationPrefetcher::invalidate_by_asid(ASID asid) {
+    auto guard = lock();
+    discard_if([asid](const TLBEntry& entry) { return entry.asid == asid; });
+}
+
+void TranslationPrefetcher::invalidate_by_vmid(VMID vmid) {
+    auto guard = lock();
+    discard_if([vmid](const TLBEntry& entry) { return entry.vmid == vmid; });
+}
+
+void TranslationPrefetcher::invalidate_by_va(VirtualAddress va, ASID asid) {
+    auto guard = lock();
+    discard_if([va, asid](const TLBEntry& entry) {
+        return entry.asid == asid && covers(entry, va);
+    });
+}
+
+// 刪除與 [start, start + size) 重疊的表項
+void TranslationPrefetcher::invalidate_by_va_range(VirtualAddress start, uint64_t size,
+                                                   ASID asid) {
+    if (size == 0) return;
+    VirtualAddress last = (start + size - 1 < start) ? ~0ULL : start + size - 1;
+    auto guard = lock();
+    discard_if([start, last, asid](const TLBEntry& entry) {
+        uint64_t entry_last = entry.va + (static_cast<uint64_t>(entry.page_size) - 1);
+        return entry.asid == asid && entry.va <= last && entry_last >= start;
+    });
+}
+
+void TranslationPrefetcher::invalidate_by_stream(StreamID stream_id) {
+    auto guard = lock();
+    discard_if([stream_id](const TLBEntry& entry) { return entry.stream_id == stream_id; });
+}
+
+// ============================================================================
+// 統計信息
+// ============================================================================
+
+size_t TranslationPrefetcher::size() const {
+    auto guard = lock();
+    size_t count = 0;
+    for (const auto& slot : buffer_) {
+        if (slot.valid) count++;
+    }
+    return count;
+}
+
+uint64_t TranslationPrefetcher::issued_count() const {
+    auto guard = lock();
+    return issued_count_;
+}
+
+uint64_t TranslationPrefetcher::hit_count() const {
+    auto guard = lock();
+    return hit_count_;
+}
+
+uint64_t TranslationPrefetcher::unused_count() const {
+    auto guard = lock();
+    return unused_count_;
+}
+
+void TranslationPrefetcher::reset_statistics() {
+    auto guard = lock();
+    issued_count_ = 0;
+    hit_count_ = 0;
+    unused_count_ = 0;
+}
+
+} // namespace smmu
@@ -0,0 +1,445 @@
+// 組相聯 TLB 實現文件
+// 實現扁平數組布局的 TLB 以及 LRU / 偽 LRU / RRIP / 隨機替換策略
+
+#include "set_assoc_tlb.h"
+#include <algorithm>
+
+namespace smmu {
+
+// ============================================================================
+// 替換策略實現
+// ============================================================================
+
+namespace {
+
+// 真 LRU：每路記錄最近一次訪問的時間戳，淘汰時間戳最小的一路
+class LRUReplacement : public ReplacementState {
+public:
+    LRUReplacement(size_t sets, size_t ways)
+        : ways_(ways), stamps_(sets * ways, 0), clock_(0) {}
+
+    void on_hit(size_t set, size_t way) override { stamps_[set * ways_ + way] = ++clock_; }
+    void on_fill(size_t set, size_t way) override { stamps_[set * ways_ + way] = ++clock_; }
+
+    size_t victim(size_t set) override {
+        const uint64_t* row = &stamps_[set * ways_];
+        return static_cast<size_t>(std::min_element(row, row + ways_) - row);
+    }
+
+private:
+    size_t ways_;
+    std::vector<uint64_t> stamps_;
+    uint64_t clock_;
+};
+
+// 樹形偽 LRU：每組用 ways-1 個位組成二叉樹，每個節點指向較舊的一側
+// 路數不是2的冪時，按上取整的樹處理並跳過不存在的路
+class TreePLRUReplacement : public ReplacementState {
+public:
+    TreePLRUReplacement(size_t sets, size_t ways)
+        : ways_(ways), leaves_(1), bits_(sets, 0) {
+        while (leaves_ < ways_) leaves_ <<= 1;
+    }
+
+    void on_hit(size_t set, size_t way) override { touch(set, way); }
+    void on_fill(size_t set, size_t way) override { touch(set, way); }
+
+    size_t victim(size_t set) override {
+        uint64_t tree = bits_[set];
+        size_t node = 1;
+        size_t lo = 0, span = leaves_;
+        while (span > 1) {
+            span >>= 1;
+            // 節點位為 1 表示右側較舊；右側不存在時強制走左側
+            bool go_right = ((tree >> node) & 1) && (lo + span < ways_);
+            node = node * 2 + (go_right ? 1 : 0);
+            if (go_right) lo += span;
+        }
+        return lo;
+    }
+
+private:
+    // 沿路徑把每個節點指向被訪問路的另一側
+    void touch(size_t set, size_t way) {
+        uint64_t& tree = bits_[set];
+        size_t node = 1;
+        size_t lo = 0, span = leaves_;
+        while (span > 1) {
+            span >>= 1;
+            bool right = way >= lo + span;
+            if (right) {
+                tree &= ~(1ULL << node);  // 右側剛被訪問，左側較舊
+                lo += span;
+            } else {
+                tree |= (1ULL << node);   // 左側剛被訪問，右側較舊
+            }
+            node = node * 2 + (right ? 1 : 0);
+        }
+    }
+
+    size_t ways_;
+    size_t leaves_;
+    std::vector<uint64_t> bits_;  // 每組一個位圖（節點編號從1開始，最多64路）
+};
+
+// SRRIP：每路2位 RRPV，插入時設為 2（長重引用距離），命中時清零，
+// 淘汰 RRPV 為 3 的路，沒有則所有路加一後重試
+class RRIPReplacement : public ReplacementState {
+public:
+    static constexpr uint8_t RRPV_MAX = 3;
+    static constexpr uint8_t RRPV_INSERT = 2;
+
+    RRIPReplacement(size_t sets, size_t ways)
+        : ways_(ways), rrpv_(sets * ways, RRPV_MAX) {}
+
+    void on_hit(size_t set, size_t way) override { rrpv_[set * ways_ + way] = 0; }
+    void on_fill(size_t set, size_t way) override { rrpv_[set * ways_ + way] = RRPV_INSERT; }
+    void on_invalidate(size_t set, size_t way) override { rrpv_[set * ways_ + way] = RRPV_MAX; }
+
+    size_t victim(size_t set) override {
+        uint8_t* row = &rrpv_[set * ways_];
+        uint8_t oldest = *std::max_element(row, row + ways_);
+        uint8_t age = RRPV_MAX - oldest;
+        size_t victim_way = ways_;
+        for (size_t w = 0; w < ways_; w++) {
+            row[w] += age;  // 一次性老化，等價於反覆加一直到出現 RRPV_MAX
+            if (row[w] == RRPV_MAX && victim_way == ways_) {
+                victim_way = w;
+            }
+        }
+        return victim_way;
+    }
+
+private:
+    size_t ways_;
+    std::vector<uint8_t> rrpv_;
+};
+
+// 隨機替換：xorshift64 偽隨機數，種子固定以保證模擬可重現
+class RandomReplacement : public ReplacementState {
+public:
+    explicit RandomReplacement(size_t ways) : ways_(ways), state_(0x9E3779B97F4A7C15ULL) {}
+
+    void on_hit(size_t, size_t) override {}
+    void on_fill(size_t, size_t) override {}
+
+    size_t victim(size_t) override {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return static_cast<size_t>(state_ % ways_);
+    }
+
+private:
+    size_t ways_;
+    uint64_t state_;
+};
+
+// 頁面大小轉換為 log2
+uint8_t page_shift_of(PageSize page_size) {
+    return static_cast<uint8_t>(__builtin_ctzll(static_cast<uint64_t>(page_size)));
+}
+
+} // namespace
+
+std::unique_ptr<ReplacementState> make_replacement_state(ReplacementPolicy policy,
+                                                         size_t sets,
+                                                         size_t ways) {
+    switch (policy) {
+        case ReplacementPolicy::PSEUDO_LRU:
+            return std::make_unique<TreePLRUReplacement>(sets, ways);
+        case ReplacementPolicy::RRIP:
+            return std::make_unique<RRIPReplacement>(sets, ways);
+        case ReplacementPolicy::RANDOM:
+            return std::make_unique<RandomReplacement>(ways);
+        case ReplacementPolicy::LRU:
+        default:
+            return std::make_unique<LRUReplacement>(sets, ways);
+    }
+}
+
+// ============================================================================
+// 構造函數
+// 根據容量和路數計算組數（向下取整到2的冪，至少1組）
+// ============================================================================
+
+SetAssociativeTLB::SetAssociativeTLB(size_t capacity, size_t ways,
+                                     ReplacementPolicy policy)
+    : sets_(1), ways_(0), set_mask_(0), policy_(policy),
+      valid_count_(0), timestamp_counter_(0),
+      hit_count_(0), miss_count_(0), resident_shifts_(0) {
+    if (capacity == 0) capacity = 1;
+    if (ways == 0 || ways > capacity) ways = capacity;
+    // 偽 LRU 樹的位圖最多支持64路
+    if (policy == ReplacementPolicy::PSEUDO_LRU && ways > 64) ways = 64;
+
+    size_t sets = capacity / ways;
+    while (sets_ * 2 <= sets) sets_ <<= 1;
+    ways_ = ways;
+    set_mask_ = sets_ - 1;
+
+    Tag empty{};
+    empty.valid = false;
+    tags_.assign(sets_ * ways_, empty);
+    data_.resize(sets_ * ways_);
+    owners_.assign(sets_ * ways_, nullptr);
+    replacement_ = make_replacement_state(policy_, sets_, ways_);
+    size_counts_.fill(0);
+}
+
+// ============================================================================
+// 查找某頁面大小下匹配的路
+// ============================================================================
+
+size_t SetAssociativeTLB::find(VirtualAddress va, uint8_t page_shift,
+                               StreamID stream_id, ASID asid, VMID vmid) const {
+    VirtualAddress va_base = va & ~((1ULL << page_shift) - 1);
+    size_t base = set_index(va, page_shift) * ways_;
+    for (size_t w = 0; w < ways_; w++) {
+        const Tag& tag = tags_[base + w];
+        if (tag.valid && tag.page_shift == page_shift &&
+            tag.va_base == va_base && tag.stream_id == stream_id &&
+            tag.asid == asid && tag.vmid == vmid) {
+            return base + w;
+        }
+    }
+    return npos;
+}
+
+// ============================================================================
+// TLB 查找操作
+// 只探測當前有表項駐留的頁面大小（從大到小）
+// ============================================================================
+
+std::optional<TLBEntry> SetAssociativeTLB::lookup(VirtualAddress va, StreamID stream_id,
+                                                  ASID asid, VMID vmid) {
+    uint64_t shifts = resident_shifts_;
+    while (shifts) {
+        uint8_t shift = static_cast<uint8_t>(63 - __builtin_clzll(shifts));
+        shifts &= ~(1ULL << shift);
+
+        size_t slot = find(va, shift, stream_id, asid, vmid);
+        if (slot != npos) {
+            replacement_->on_hit(slot / ways_, slot % ways_);
+            hit_count_++;
+            owners_[slot]->hits++;
+            return data_[slot];
+        }
+    }
+
+    miss_count_++;
+    partitions_.record_miss(stream_id);
+    return std::nullopt;
+}
+
+// ============================================================================
+// TLB 插入操作
+// 已存在則原地更新；否則優先使用空閒路，組滿時由替換策略選擇犧牲路
+// ============================================================================
+
+void SetAssociativeTLB::insert(const TLBEntry& entry) {
+    uint8_t shift = page_shift_of(entry.page_size);
+    size_t slot = find(entry.va, shift, entry.stream_id, entry.asid, entry.vmid);
+    size_t set = set_index(entry.va, shift);
+
+    if (slot == npos) {
+        TLBStreamStats& owner = partitions_.get(entry.stream_id);
+        slot = choose_slot(set, owner);
+        if (slot == npos) {
+            owner.bypasses++;   // 達到上限且本組沒有自己的表項：不填入
+            return;
+        }
+        owners_[slot] = &owner;
+        owner.entries++;
+
+        Tag& tag = tags_[slot];
+        tag.va_base = entry.va & ~((1ULL << shift) - 1);
+        tag.stream_id = entry.stream_id;
+        tag.asid = entry.asid;
+        tag.vmid = entry.vmid;
+        tag.page_shift = shift;
+        tag.valid = true;
+        valid_count_++;
+        if (size_counts_[shift]++ == 0) {
+            resident_shifts_ |= (1ULL << shift);
+        }
+    }
+
+    data_[slot] = entry;
+    data_[slot].timestamp = timestamp_counter_++;
+    replacement_->on_fill(set, slot % ways_);
+}
+
+// ============================================================================
+// 選擇插入位置
+// ============================================================================
+
+size_t SetAssociativeTLB::choose_slot(size_t set, TLBStreamStats& owner) {
+    size_t base = set * ways_;
+
+    // 達到上限：只能替換本流在本組中最早插入的表項；本組沒有時旁路（不填入），
+    // 既不掃描其他組，也不淘汰其他流的表項
+    if (partitions_.active() && TLBPartitions::at_limit(owner)) {
+        size_t oldest = npos;
+        for (size_t w = 0; w < ways_; w++) {
+            size_t i = base + w;
+            if (tags_[i].valid && owners_[i] == &owner &&
+                (oldest == npos || data_[i].timestamp < data_[oldest].timestamp)) {
+                oldest = i;
+            }
+        }
+        if (oldest != npos) evict_slot(oldest);
+        return oldest;
+    }
+
+    for (size_t w = 0; w < ways_; w++) {
+        if (!tags_[base + w].valid) return base + w;
+    }
+
+    size_t slot = base + replacement_->victim(set);
+    if (partitions_.active() && TLBPartitions::is_protected(*owners_[slot])) {
+        size_t oldest = npos;
+        for (size_t w = 0; w < ways_; w++) {
+            size_t i = base + w;
+            if (!TLBPartitions::is_protected(*owners_[i]) &&
+                (oldest == npos || data_[i].timestamp < data_[oldest].timestamp)) {
+                oldest = i;
+            }
+        }
+        if (oldest != npos) slot = oldest;  // 整組都受保護時仍按替換策略淘汰
+    }
+    evict_slot(slot);
+    return slot;
+}
+
+void SetAssociativeTLB::evict_slot(size_t slot) {
+    owners_[slot]->evictions++;
+    notify_eviction(data_[slot]);
+    invalidate_slot(slot);
+}
+
+// ============================================================================
+// 使單個表項無效並維護駐留大小位圖
+// ============================================================================
+
+void SetAssociativeTLB::invalidate_slot(size_t slot) {
+    Tag& tag = tags_[slot];
+    if (!tag.valid) return;
+    tag.valid = false;
+    valid_count_--;
+    owners_[slot]->entries--;
+    if (--size_counts_[tag.page_shift] == 0) {
+        resident_shifts_ &= ~(1ULL << tag.page_shift);
+    }
+    replacement_->on_invalidate(slot / ways_, slot % ways_);
+}
+
+// ============================================================================
+// TLB 無效化操作
+// 按條件過濾的無效化順序掃描標籤數組（連續內存）
+// ============================================================================
+
+void SetAssociativeTLB::invalidate_all() {
+    for (size_t i = 0; i < tags_.size(); i++) {
+        invalidate_slot(i);
+    }
+}
+
+void SetAssociativeTLB::invalidate_by_asid(ASID asid) {
+    for (size_t i = 0; i < tags_.size(); i++) {
+        if (tags_[i].valid && tags_[i].asid == asid) invalidate_slot(i);
+    }
+}
+
+void SetAssociativeTLB::invalidate_by_vmid(VMID vmid) {
+    for (size_t i = 0; i < tags_.size(); i++) {
+        if (tags_[i].valid && tags_[i].vmid == vmid) invalidate_slot(i);
+    }
+}
+
+// 按虛擬地址無效化：每種駐留頁面大小只需檢查對應的一組
+void SetAssociativeTLB::invalidate_by_va(VirtualAddress va, ASID asid) {
+    uint64_t shifts = resident_shifts_;
+    while (shifts) {
+        uint8_t shift = static_cast<uint8_t>(__builtin_ctzll(shifts));
+        shifts &= shifts - 1;
+
+        VirtualAddress va_base = va & ~((1ULL << shift) - 1);
+        size_t base = set_index(va, shift) * ways_;
+        for (size_t w = 0; w < ways_; w++) {
+            const Tag& tag = tags_[base + w];
+            if (tag.valid && tag.page_shift == shift &&
+                tag.asid == asid && tag.va_base == va_base) {
+                invalidate_slot(base + w);
+            }
+        }
+    }
+}
+
+// 按虛擬地址範圍無效化
+// 範圍較小時只探測範圍內每個頁面對應的組，否則順序掃描整個標籤數組
+void SetAssociativeTLB::invalidate_by_va_range(VirtualAddress start, uint64_t size,
+                                               ASID asid, uint8_t ttl_level) {
+    if (size == 0) return;
+    VirtualAddress last = (start + size - 1 < start) ? ~0ULL : start + size - 1;  // 包含端點，防止溢出
+    auto overlaps = [&](size_t slot) {
+        const Tag& tag = tags_[slot];
+        uint64_t page_mask = (1ULL << tag.page_shift) - 1;
+        return tag.valid && tag.asid == asid &&
+               (ttl_level == 0 || data_[slot].level == ttl_level) &&
+               tag.va_base <= last && (tag.va_base | page_mask) >= start;
+    };
+    
+    // 逐組探測的代價：每種駐留大小的頁數（最多覆蓋所有組）乘以路數
+    uint64_t probes = 0;
+    uint64_t shifts = resident_shifts_;
+    while (shifts && probes <= tags_.size()) {
+        uint8_t shift = static_cast<uint8_t>(__builtin_ctzll(shifts));
+        shifts &= shifts - 1;
+        probes += std::min<uint64_t>((last >> shift) - (start >> shift) + 1, sets_) * ways_;
+    }
+    
+    if (probes > tags_.size()) {
+        for (size_t i = 0; i < tags_.size(); i++) {
+            if (overlaps(i)) invalidate_slot(i);
+        }
+        return;
+    }
+    
+    shifts = resident_shifts_;
+    while (shifts) {
+        uint8_t shift = static_cast<uint8_t>(__builtin_ctzll(shifts));
+        shifts &= shifts - 1;
+        uint64_t pages = std::min<uint64_t>((last >> shift) - (start >> shift) + 1, sets_);
+        for (uint64_t p = 0; p < pages; p++) {
+            size_t base = set_index(start + (p << shift), shift) * ways_;
+            for (size_t w = 0; w < ways_; w++) {
+                if (tags_[base + w].page_shift == shift && overlaps(base + w)) {
+                    invalidate_slot(base + w);
+                }
+            }
+        }
+    }
+}
+
+void SetAssociativeTLB::invalidate_by_stream(StreamID stream_id) {
+    for (size_t i = 0; i < tags_.size(); i++) {
+        if (tags_[i].valid && tags_[i].stream_id == stream_id) invalidate_slot(i);
+    }
+}
+
+// ============================================================================
+// 表項導出
+// 表項的時間戳是填入順序，按時間戳排序即從最早填入的開始
+// ============================================================================
+
+void SetAssociativeTLB::export_entries(std::vector<TLBEntry>& out) const {
+    size_t first = out.size();
+    for (size_t i = 0; i < tags_.size(); i++) {
+        if (tags_[i].valid) out.push_back(data_[i]);
+    }
+    std::sort(out.begin() + static_cast<std::ptrdiff_t>(first), out.end(),
+              [](const TLBEntry& a, const TLBEntry& b) { return a.timestamp < b.timestamp; });
+}
+
+} // namespace smmu
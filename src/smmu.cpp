@@ -3,26 +3,146 @@
 
 #include "smmu.h"
 #include <cstring>
+#include <algorithm>
+#include <chrono>
 
 namespace smmu {
 
+namespace {
+
+// 為每個線程分配一個遞增編號，用於選擇統計計數槽
+size_t this_thread_index() {
+    static std::atomic<size_t> next_index{0};
+    thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+// 組合兩個階段的訪問權限：兩個階段都允許的操作才允許
+AccessPermission combine_permission(AccessPermission s1, AccessPermission s2) {
+    auto readable = [](AccessPermission ap) {
+        return ap == AccessPermission::READ_ONLY || ap == AccessPermission::READ_WRITE;
+    };
+    auto writable = [](AccessPermission ap) {
+        return ap == AccessPermission::WRITE_ONLY || ap == AccessPermission::READ_WRITE;
+    };
+    bool read = readable(s1) && readable(s2);
+    bool write = writable(s1) && writable(s2);
+    if (read && write) return AccessPermission::READ_WRITE;
+    if (read) return AccessPermission::READ_ONLY;
+    if (write) return AccessPermission::WRITE_ONLY;
+    return AccessPermission::NONE;
+}
+
+// 軟件合併：葉子緩存行中包含本次遍歷描述符的最大對齊組（8/4/2 項），
+// 組內描述符全部有效、輸出地址連續且按組大小對齊、屬性相同
+// 有效性和屬性按位平面一次比較整組
+// 返回組內的描述符數量，無法合併時返回 1
+uint8_t coalesce_group(const LeafLine& line) {
+    const uint64_t page = static_cast<uint64_t>(line.page_size);
+    const DescriptorBatch& decoded = line.decoded;
+    const uint8_t leaf = decoded.leaf();
+    for (uint8_t n = static_cast<uint8_t>(LeafLine::ENTRIES); n > 1; n /= 2) {
+        uint8_t first = static_cast<uint8_t>(line.index & ~(n - 1));
+        uint8_t group = static_cast<uint8_t>(((1u << n) - 1) << first);
+        if ((leaf & group) != group || !decoded.same_attributes(group)) continue;
+        PhysicalAddress base = decoded.address[first] & ~(page - 1);
+        if (base & (n * page - 1)) continue;
+        bool ok = true;
+        for (uint8_t i = first + 1; i < first + n && ok; i++) {
+            ok = (decoded.address[i] & ~(page - 1)) == base + (i - first) * page;
+        }
+        if (ok) return n;
+    }
+    return 1;
+}
+
+} // namespace
+
 // ============================================================================
 // 構造函數和初始化
 // ============================================================================
 
 // SMMU 構造函數
 SMMU::SMMU(const SMMUConfig& config)
-    : config_(config), enabled_(false), timestamp_counter_(0) {
+    : config_(config), enabled_(false), concurrent_(config.thread_safe),
+      config_tables_(std::make_shared<ConfigTables>()),
+      timestamp_counter_(0) {
+    
+    // 並發模式下 TLB 按 StreamID 分片，總容量在分片之間平均分配
+    num_tlb_shards_ = (concurrent_ && config.tlb_shards > 1) ? config.tlb_shards : 1;
+    size_t shard_size = std::max<size_t>(1, config.tlb_size / num_tlb_shards_);
+    tlb_shards_ = std::make_unique<TLBShard[]>(num_tlb_shards_);
+    
+    // 創建 TLB，使用配置中指定的大小和組織方式
+    for (size_t i = 0; i < num_tlb_shards_; i++) {
+        if (config.tlb_organization == TLBOrganization::SET_ASSOCIATIVE) {
+            tlb_shards_[i].tlb = std::make_unique<SetAssociativeTLB>(
+                shard_size, config.tlb_ways, config.tlb_replacement);
+        } else {
+            tlb_shards_[i].tlb = std::make_unique<TLB>(shard_size);
+        }
+    }
+    
+    // 創建頁表遍歷緩存（大小為0時禁用）
+    if (config.walk_cache_size > 0) {
+        walk_cache_ = std::make_unique<PageWalkCache>(config.walk_cache_size, concurrent_);
+    }
+    
+    // 創建預取器（深度為0時禁用）
+    if (config.prefetch_depth > 0) {
+        prefetcher_ = std::make_unique<TranslationPrefetcher>(
+            config.prefetch_depth, config.prefetch_buffer_size,
+            config.prefetch_streams, concurrent_);
+    }
+    
+    // 創建插樁計數器（關閉時不分配）
+    if (config.instrumentation) {
+        instrumentation_ = std::make_unique<Instrumentation>(
+            config.instrumentation_contexts, config.model_hit_cycles,
+            config.model_descriptor_read_cycles, config.instrumentation_time_sampling,
+            concurrent_);
+    }
+    
+    // 創建階段2 TLB（大小為0時禁用）
+    if (config.s2_tlb_size > 0) {
+        s2_tlb_ = std::make_unique<TLB>(config.s2_tlb_size);
+    }
     
-    // 創建 TLB，使用配置中指定的大小
-    tlb_ = std::make_unique<TLB>(config.tlb_size);
+    // 一級流表預先覆蓋 stream_table_size 個流，二級表在配置流時分配
+    size_t l1_entries = (config.stream_table_size + (1U << STRTAB_SPLIT) - 1) >> STRTAB_SPLIT;
+    config_tables_->spans.resize(std::min<size_t>(l1_entries, 1U << (STREAM_ID_BITS - STRTAB_SPLIT)));
     
-    // 初始化統計信息為零
-    std::memset(&stats_, 0, sizeof(stats_));
+    // 統計計數槽（並發模式下每個線程一個槽）
+    num_stat_slots_ = concurrent_ ? STAT_SLOTS : 1;
+    stat_slots_ = std::make_unique<StatCounters[]>(num_stat_slots_);
+}
+
+// 當前線程的統計計數槽
+// 線程數超過槽數時多個線程共用一個槽，計數仍然正確（原子累加）
+SMMU::StatCounters& SMMU::local_stats() {
+    if (num_stat_slots_ == 1) return stat_slots_[0];
+    return stat_slots_[this_thread_index() % num_stat_slots_];
+}
+
+// 對每個 TLB 分片執行操作
+template <typename Fn>
+void SMMU::for_each_tlb_shard(Fn fn) {
+    for (size_t i = 0; i < num_tlb_shards_; i++) {
+        auto lock = maybe_lock(tlb_shards_[i].mutex);
+        fn(*tlb_shards_[i].tlb);
+    }
+}
+
+// 對階段2 TLB 執行無效化
+template <typename Fn>
+void SMMU::invalidate_s2_tlb(Fn fn) {
+    if (!s2_tlb_) return;
+    auto lock = maybe_lock(s2_tlb_mutex_);
+    fn(*s2_tlb_);
 }
 
 // 設置內存模型
-// 創建頁表遍歷器並綁定內存讀取回調
+// 創建頁表遍歷器，綁定內存讀取回調和直接讀取的內存模型
 void SMMU::set_memory_model(std::shared_ptr<SimpleMemoryModel> memory) {
     memory_ = memory;
     
@@ -34,6 +154,72 @@ void SMMU::set_memory_model(std::shared_ptr<SimpleMemoryModel> memory) {
     
     // 創建頁表遍歷器
     page_table_walker_ = std::make_unique<PageTableWalker>(memory_read);
+    page_table_walker_->set_walk_cache(walk_cache_.get());
+    page_table_walker_->set_contiguous_hint(config_.use_contiguous_hint);
+    page_table_walker_->set_block_read([this](PhysicalAddress addr, void* data, size_t size) {
+        return memory_->read(addr, data, size);
+    });
+    
+    // 內存模型類型已知：遍歷直接讀取，回調只作為通用路徑保留
+    page_table_walker_->set_direct_memory(memory_.get());
+}
+
+void SMMU::set_walk_memory(MemoryReadCallback read, MemoryBlockReadCallback block_read) {
+    if (!page_table_walker_) {
+        page_table_walker_ = std::make_unique<PageTableWalker>(std::move(read));
+        page_table_walker_->set_walk_cache(walk_cache_.get());
+        page_table_walker_->set_contiguous_hint(config_.use_contiguous_hint);
+    } else {
+        page_table_walker_->set_memory_read(std::move(read));
+    }
+    page_table_walker_->set_block_read(std::move(block_read));
+    page_table_walker_->set_direct_memory(nullptr);
+}
+
+// ============================================================================
+// 配置表快照
+// 並發模式下讀者原子地獲取快照；寫者複製當前表、修改後原子地發佈新表，
+// 舊快照在最後一個讀者釋放後銷毀（RCU 風格）
+// ============================================================================
+
+std::shared_ptr<const SMMU::ConfigTables> SMMU::load_config_tables() const {
+    if (concurrent_) {
+        return std::atomic_load(&config_tables_);
+    }
+    return config_tables_;
+}
+
+template <typename Mutator>
+void SMMU::update_stream_slot(StreamID stream_id, Mutator mutate) {
+    if (stream_id >> STREAM_ID_BITS) return;  // 超出 IDR1.SIDSIZE
+    size_t l1_index = stream_id >> STRTAB_SPLIT;
+    StreamID l2_index = stream_id & ((1U << STRTAB_SPLIT) - 1);
+    
+    if (!concurrent_) {
+        auto& spans = config_tables_->spans;
+        if (l1_index >= spans.size()) spans.resize(l1_index + 1);
+        if (!spans[l1_index]) spans[l1_index] = std::make_shared<StreamTableSpan>();
+        mutate(spans[l1_index]->slots[l2_index]);
+        return;
+    }
+    
+    // 複製一級表，二級表只複製被修改的一個
+    std::lock_guard<std::mutex> lock(config_write_mutex_);
+    auto updated = std::make_shared<ConfigTables>(*std::atomic_load(&config_tables_));
+    auto& spans = updated->spans;
+    if (l1_index >= spans.size()) spans.resize(l1_index + 1);
+    spans[l1_index] = spans[l1_index] ? std::make_shared<StreamTableSpan>(*spans[l1_index])
+                                      : std::make_shared<StreamTableSpan>();
+    mutate(spans[l1_index]->slots[l2_index]);
+    std::atomic_store(&config_tables_, updated);
+}
+
+// 查找流的表項：一級表和二級表各索引一次
+const SMMU::StreamSlot* SMMU::find_stream_slot(const ConfigTables& tables,
+                                               StreamID stream_id) {
+    size_t l1_index = stream_id >> STRTAB_SPLIT;
+    if (l1_index >= tables.spans.size() || !tables.spans[l1_index]) return nullptr;
+    return &tables.spans[l1_index]->slots[stream_id & ((1U << STRTAB_SPLIT) - 1)];
 }
 
 // ============================================================================
@@ -44,17 +230,28 @@ void SMMU::set_memory_model(std::shared_ptr<SimpleMemoryModel> memory) {
 // 每個設備（流）都有一個流表項，定義該設備的轉換配置
 void SMMU::configure_stream_table_entry(StreamID stream_id,
                                         const StreamTableEntry& ste) {
-    stream_table_[stream_id] = ste;
+    update_stream_slot(stream_id, [&](StreamSlot& slot) {
+        slot.present = true;
+        slot.ste = ste;
+    });
+    
+    // 配額立即生效；已超過新上限的表項在後續插入時逐步淘汰
+    TLBShard& shard = tlb_shard(stream_id);
+    auto lock = maybe_lock(shard.mutex);
+    shard.tlb->set_stream_quota(stream_id, ste.tlb_reserved, ste.tlb_limit);
 }
 
 // 獲取流表項
 // 如果流ID不存在，返回默認的無效表項
 StreamTableEntry SMMU::get_stream_table_entry(StreamID stream_id) const {
-    auto it = stream_table_.find(stream_id);
-    if (it != stream_table_.end()) {
-        return it->second;
-    }
-    return StreamTableEntry();  // 返回無效的默認表項
+    auto tables = load_config_tables();
+    const StreamTableEntry* ste = find_stream_table_entry(find_stream_slot(*tables, stream_id));
+    return ste ? *ste : StreamTableEntry();  // 不存在時返回無效的默認表項
+}
+
+// 查找流表項（不複製），不存在時返回 nullptr
+const StreamTableEntry* SMMU::find_stream_table_entry(const StreamSlot* slot) {
+    return (slot && slot->present) ? &slot->ste : nullptr;
 }
 
 // ============================================================================
@@ -66,20 +263,33 @@ StreamTableEntry SMMU::get_stream_table_entry(StreamID stream_id) const {
 void SMMU::configure_context_descriptor(StreamID stream_id,
                                         ASID asid,
                                         const ContextDescriptor& cd) {
-    // 使用 stream_id 和 asid 組合作為鍵
-    uint64_t key = make_cd_key(stream_id, asid);
-    context_descriptors_[key] = cd;
+    update_stream_slot(stream_id, [&](StreamSlot& slot) {
+        for (auto& entry : slot.context_descriptors) {
+            if (entry.first == asid) {
+                entry.second = cd;
+                return;
+            }
+        }
+        slot.context_descriptors.emplace_back(asid, cd);
+    });
 }
 
 // 獲取上下文描述符
 // 如果不存在，返回默認的無效描述符
 ContextDescriptor SMMU::get_context_descriptor(StreamID stream_id, ASID asid) const {
-    uint64_t key = make_cd_key(stream_id, asid);
-    auto it = context_descriptors_.find(key);
-    if (it != context_descriptors_.end()) {
-        return it->second;
+    auto tables = load_config_tables();
+    const ContextDescriptor* cd = find_context_descriptor(find_stream_slot(*tables, stream_id), asid);
+    return cd ? *cd : ContextDescriptor();  // 不存在時返回無效的默認描述符
+}
+
+// 查找上下文描述符（不複製），不存在時返回 nullptr
+// 每個流通常只有少數幾個地址空間，線性查找比哈希更快
+const ContextDescriptor* SMMU::find_context_descriptor(const StreamSlot* slot, ASID asid) {
+    if (!slot) return nullptr;
+    for (const auto& entry : slot->context_descriptors) {
+        if (entry.first == asid) return &entry.second;
     }
-    return ContextDescriptor();  // 返回無效的默認描述符
+    return nullptr;
 }
 
 // ============================================================================
@@ -88,18 +298,28 @@ ContextDescriptor SMMU::get_context_descriptor(StreamID stream_id, ASID asid) co
 
 TranslationResult SMMU::translate_stage1(VirtualAddress va,
                                          const StreamTableEntry& ste,
-                                         const ContextDescriptor& cd) {
+                                         const ContextDescriptor& cd,
+                                         bool report_faults,
+                                         LeafLine* line) {
     // 檢查上下文描述符是否有效
     if (!cd.valid) {
         TranslationResult result;
+        result.fault_type = FaultType::TRANSLATION_FAULT;
         result.fault_reason = "Invalid context descriptor";
         // 生成轉換錯誤事件
-        generate_event(FaultType::TRANSLATION_FAULT, 0, cd.asid, 
-                      ste.vmid, va, result.fault_reason);
-        stats_.translation_faults++;
+        if (report_faults) {
+            generate_event(FaultType::TRANSLATION_FAULT, 0, cd.asid, 
+                          ste.vmid, va, result.fault_reason);
+            bump(local_stats().translation_faults);
+        }
         return result;
     }
     
+    // 啟用階段2時，階段1頁表的每一級表地址都是 IPA
+    Stage2TranslateCallback stage2 = [this, &ste](PhysicalAddress ipa) {
+        return translate_ipa(ipa, ste);
+    };
+    
     // 執行頁表遍歷
     // 使用上下文描述符中的配置信息
     TranslationResult result = page_table_walker_->translate(
@@ -107,16 +327,22 @@ TranslationResult SMMU::translate_stage1(VirtualAddress va,
         cd.translation_table_base,    // 頁表基地址
         cd.translation_granule,       // 頁面粒度
         cd.ips,                       // 中間物理地址大小
-        TranslationStage::STAGE1      // 階段1
+        TranslationStage::STAGE1,     // 階段1
+        cd.asid,                      // 用於標記遍歷緩存表項
+        ste.vmid,
+        ste.s2_enabled ? &stage2 : nullptr,
+        line
     );
     
-    stats_.page_table_walks++;  // 增加頁表遍歷計數
+    StatCounters& stats = local_stats();
+    bump(stats.page_table_walks);  // 增加頁表遍歷計數
+    bump(stats.descriptor_reads, result.descriptor_reads);
     
     // 如果轉換失敗，生成事件
-    if (!result.success) {
-        generate_event(FaultType::TRANSLATION_FAULT, 0, cd.asid,
+    if (!result.success && report_faults) {
+        generate_event(result.fault_type, 0, cd.asid,
                       ste.vmid, va, result.fault_reason);
-        stats_.translation_faults++;
+        bump(local_stats().translation_faults);
     }
     
     return result;
@@ -127,7 +353,8 @@ TranslationResult SMMU::translate_stage1(VirtualAddress va,
 // ============================================================================
 
 TranslationResult SMMU::translate_stage2(PhysicalAddress ipa,
-                                         const StreamTableEntry& ste) {
+                                         const StreamTableEntry& ste,
+                                         bool report_faults) {
     // 如果階段2未啟用，直接返回輸入地址
     if (!ste.s2_enabled) {
         TranslationResult result;
@@ -136,22 +363,68 @@ TranslationResult SMMU::translate_stage2(PhysicalAddress ipa,
         return result;
     }
     
+    TranslationResult result = translate_ipa(ipa, ste);
+    bump(local_stats().descriptor_reads, result.descriptor_reads);
+    
+    // 如果轉換失敗，生成事件
+    if (!result.success && report_faults) {
+        generate_event(result.fault_type, 0, 0,
+                      ste.vmid, ipa, result.fault_reason);
+        bump(local_stats().translation_faults);
+    }
+    
+    return result;
+}
+
+// ============================================================================
+// IPA -> PA（階段2 TLB + 階段2頁表遍歷）
+// 階段2 TLB 表項的 StreamID 和 ASID 固定為 0，只按 VMID 和 IPA 匹配
+// ============================================================================
+
+TranslationResult SMMU::translate_ipa(PhysicalAddress ipa,
+                                      const StreamTableEntry& ste) {
+    StatCounters& stats = local_stats();
+    if (s2_tlb_) {
+        std::optional<TLBEntry> entry;
+        {
+            auto lock = maybe_lock(s2_tlb_mutex_);
+            entry = s2_tlb_->lookup(ipa, 0, 0, ste.vmid);
+        }
+        if (entry.has_value()) {
+            bump(stats.s2_tlb_hits);
+            return make_result_from_tlb(*entry, ipa);
+        }
+    }
+    bump(stats.s2_tlb_misses);
+    
     // 執行階段2頁表遍歷
     TranslationResult result = page_table_walker_->translate(
         ipa,                              // 中間物理地址（作為輸入）
         ste.s2_translation_table_base,    // 階段2頁表基地址
         ste.s2_granule,                   // 階段2頁面粒度
         48,                               // 假設48位物理地址
-        TranslationStage::STAGE2          // 階段2
+        TranslationStage::STAGE2,         // 階段2
+        0,                                // 階段2不使用 ASID
+        ste.vmid
     );
+    bump(stats.page_table_walks);
     
-    stats_.page_table_walks++;
-    
-    // 如果轉換失敗，生成事件
-    if (!result.success) {
-        generate_event(FaultType::TRANSLATION_FAULT, 0, 0,
-                      ste.vmid, ipa, result.fault_reason);
-        stats_.translation_faults++;
+    if (result.success && s2_tlb_) {
+        uint64_t page_mask = static_cast<uint64_t>(result.page_size) - 1;
+        TLBEntry entry;
+        entry.va = ipa & ~page_mask;
+        entry.pa = result.physical_addr & ~page_mask;
+        entry.vmid = ste.vmid;
+        entry.page_size = result.page_size;
+        entry.level = result.level;
+        entry.memory_type = result.memory_type;
+        entry.permission = result.permission;
+        entry.cacheable = result.cacheable;
+        entry.shareable = result.shareable;
+        entry.stage = TranslationStage::STAGE2;
+        
+        auto lock = maybe_lock(s2_tlb_mutex_);
+        s2_tlb_->insert(entry);
     }
     
     return result;
@@ -166,53 +439,463 @@ TranslationResult SMMU::translate(VirtualAddress va,
                                   StreamID stream_id,
                                   ASID asid,
                                   VMID vmid) {
-    stats_.total_translations++;  // 增加總轉換計數
+    bool tlb_hit = false;
+    if (!instrumentation_) return translate_lookup(va, stream_id, asid, vmid, tlb_hit);
+    
+    if (!instrumentation_->sample_host_time()) {
+        TranslationResult result = translate_lookup(va, stream_id, asid, vmid, tlb_hit);
+        instrumentation_->record_translation(stream_id, asid, tlb_hit, result);
+        return result;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    TranslationResult result = translate_lookup(va, stream_id, asid, vmid, tlb_hit);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    instrumentation_->record_translation(stream_id, asid, tlb_hit, result);
+    instrumentation_->record_host_time(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    return result;
+}
+
+TranslationResult SMMU::translate_lookup(VirtualAddress va,
+                                         StreamID stream_id,
+                                         ASID asid,
+                                         VMID vmid,
+                                         bool& tlb_hit) {
+    StatCounters& stats = local_stats();
+    bump(stats.total_translations);  // 增加總轉換計數
     
     // 檢查 SMMU 是否已啟用
-    if (!enabled_) {
+    if (!is_enabled()) {
         TranslationResult result;
+        result.fault_type = FaultType::TRANSLATION_FAULT;
         result.fault_reason = "SMMU is disabled";
         return result;
     }
     
-    // 步驟1：首先檢查 TLB（快速路徑）
-    auto tlb_entry = tlb_->lookup(va, stream_id, asid, vmid);
+    // 步驟1：首先檢查 TLB（快速路徑，只鎖定該流所在的分片）
+    std::optional<TLBEntry> tlb_entry;
+    {
+        TLBShard& shard = tlb_shard(stream_id);
+        auto lock = maybe_lock(shard.mutex);
+        tlb_entry = shard.tlb->lookup(va, stream_id, asid, vmid);
+    }
     if (tlb_entry.has_value()) {
         // TLB 命中！直接返回緩存的結果
-        stats_.tlb_hits++;
-        
-        TranslationResult result;
-        result.success = true;
-        result.physical_addr = tlb_entry->pa;
-        result.memory_type = tlb_entry->memory_type;
-        result.permission = tlb_entry->permission;
-        result.cacheable = tlb_entry->cacheable;
-        result.shareable = tlb_entry->shareable;
-        return result;
+        bump(stats.tlb_hits);
+        tlb_hit = true;
+        return make_result_from_tlb(*tlb_entry, va);
     }
     
     // TLB 未命中，需要進行完整的頁表遍歷
-    stats_.tlb_misses++;
+    bump(stats.tlb_misses);
+    
+    // 步驟2：獲取流表項和上下文描述符（快照在本次轉換期間保持有效）
+    auto tables = load_config_tables();
+    const StreamSlot* slot = find_stream_slot(*tables, stream_id);
+    const StreamTableEntry* ste = find_stream_table_entry(slot);
+    const ContextDescriptor* cd = (ste && ste->s1_enabled)
+        ? find_context_descriptor(slot, asid) : nullptr;
+    
+    // 步驟3和4：頁表遍歷並填充 TLB
+    return translate_miss(va, stream_id, asid, vmid, ste, cd);
+}
+
+// ============================================================================
+// 批量地址轉換
+// 同一批次內：
+//   - 相同 StreamID/ASID 的請求共用一次流表項和上下文描述符查找
+//   - 與上一個成功結果位於同一頁面的請求直接復用該結果（計入 batch_reuses）
+//   - 只啟用階段1時，未命中和其後同一上下文的請求一起交給
+//     PageTableWalker::translate_batch，共享上層表的遍歷（見 translate_walk_group）
+// ============================================================================
+
+void SMMU::translate_batch(const TranslationRequest* requests,
+                           TranslationResult* results,
+                           size_t count) {
+    // 批次內的配置查找緩存
+    bool have_ste = false;
+    StreamID cached_stream = 0;
+    const StreamSlot* cached_slot = nullptr;
+    const StreamTableEntry* cached_ste = nullptr;
+    bool have_cd = false;
+    StreamID cached_cd_stream = 0;
+    ASID cached_cd_asid = 0;
+    const ContextDescriptor* cached_cd = nullptr;
+    
+    // 整個批次使用同一個配置表快照
+    std::shared_ptr<const ConfigTables> tables;
+    StatCounters& stats = local_stats();
+    
+    // 上一個成功轉換的頁面（用於復用）
+    bool have_page = false;
+    TranslationRequest last_req{};
+    VirtualAddress last_page_base = 0;
+    uint64_t last_page_mask = 0;
+    size_t last_index = 0;
+    
+    // 插樁：採樣的請求的主機耗時從它的迭代開始計算
+    bool timed = false;
+    std::chrono::steady_clock::time_point start;
+    auto record = [&](size_t i, bool tlb_hit) {
+        instrumentation_->record_translation(requests[i].stream_id, requests[i].asid,
+                                             tlb_hit, results[i]);
+        if (!timed) return;
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        instrumentation_->record_host_time(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    };
+    
+    // 可以成組遍歷：只有階段1、沒有預取和葉子緩存行填充、不插樁（插樁按請求計時）
+    auto groupable = [this](const StreamTableEntry* ste, const ContextDescriptor* cd) {
+        return !instrumentation_ && !prefetcher_ && !config_.fill_leaf_neighbours &&
+               !config_.coalesce_leaf_pages && ste && ste->valid && ste->s1_enabled &&
+               !ste->s2_enabled && cd && cd->valid;
+    };
+    
+    for (size_t i = 0; i < count; i++) {
+        const TranslationRequest& req = requests[i];
+        TranslationResult& result = results[i];
+        bump(stats.total_translations);
+        if (instrumentation_) {
+            timed = instrumentation_->sample_host_time();
+            if (timed) start = std::chrono::steady_clock::now();
+        }
+        
+        if (!is_enabled()) {
+            result = TranslationResult();
+            result.fault_type = FaultType::TRANSLATION_FAULT;
+            result.fault_reason = "SMMU is disabled";
+            if (instrumentation_) record(i, false);
+            continue;
+        }
+        
+        // 與上一個頁面相同：復用結果，只替換頁內偏移
+        // 不查找 TLB，單獨計數，tlb_hits 只統計真正的 TLB 命中
+        if (have_page && req.stream_id == last_req.stream_id &&
+            req.asid == last_req.asid && req.vmid == last_req.vmid &&
+            (req.va & ~last_page_mask) == last_page_base) {
+            bump(stats.batch_reuses);
+            result = results[last_index];
+            result.physical_addr = (result.physical_addr & ~last_page_mask) |
+                                   (req.va & last_page_mask);
+            result.descriptor_reads = 0;
+            if (instrumentation_) record(i, true);
+            continue;
+        }
+        
+        std::optional<TLBEntry> tlb_entry;
+        {
+            TLBShard& shard = tlb_shard(req.stream_id);
+            auto lock = maybe_lock(shard.mutex);
+            tlb_entry = shard.tlb->lookup(req.va, req.stream_id, req.asid, req.vmid);
+        }
+        if (tlb_entry.has_value()) {
+            bump(stats.tlb_hits);
+            result = make_result_from_tlb(*tlb_entry, req.va);
+        } else {
+            bump(stats.tlb_misses);
+            
+            if (!tables) tables = load_config_tables();
+            if (!have_ste || cached_stream != req.stream_id) {
+                cached_slot = find_stream_slot(*tables, req.stream_id);
+                cached_ste = find_stream_table_entry(cached_slot);
+                cached_stream = req.stream_id;
+                have_ste = true;
+            }
+            
+            const ContextDescriptor* cd = nullptr;
+            if (cached_ste && cached_ste->s1_enabled) {
+                if (!have_cd || cached_cd_stream != req.stream_id || cached_cd_asid != req.asid) {
+                    cached_cd = find_context_descriptor(cached_slot, req.asid);
+                    cached_cd_stream = req.stream_id;
+                    cached_cd_asid = req.asid;
+                    have_cd = true;
+                }
+                cd = cached_cd;
+            }
+            
+            if (groupable(cached_ste, cd) && i + 1 < count &&
+                same_context(requests[i + 1], req)) {
+                i = translate_walk_group(requests, results, i, count, *cached_ste, *cd) - 1;
+                have_page = results[i].success;
+                if (have_page) {
+                    last_req = requests[i];
+                    last_page_mask = static_cast<uint64_t>(results[i].page_size) - 1;
+                    last_page_base = last_req.va & ~last_page_mask;
+                    last_index = i;
+                }
+                continue;
+            }
+            result = translate_miss(req.va, req.stream_id, req.asid, req.vmid,
+                                    cached_ste, cd);
+        }
+        
+        have_page = result.success;
+        if (have_page) {
+            last_req = req;
+            last_page_mask = static_cast<uint64_t>(result.page_size) - 1;
+            last_page_base = req.va & ~last_page_mask;
+            last_index = i;
+        }
+        if (instrumentation_) record(i, tlb_entry.has_value());
+    }
+}
+
+// ============================================================================
+// 成組遍歷
+// requests[first] 已確認 TLB 未命中；向後收集同一 (StreamID, ASID, VMID) 的請求
+// （最多 WALK_GROUP_SIZE 個），逐個查找 TLB，未命中的地址一次交給
+// PageTableWalker::translate_batch。與某個待遍歷地址位於同一粒度頁面的請求
+// 等待它的結果：成功時復用，失敗時單獨轉換（與逐個轉換一樣報告錯誤）
+// 與逐個 translate 相比結果相同；組內 TLB 查找先於前面請求的填充，
+// 因此落在前面請求剛填入的塊映射中的請求也會遍歷一次
+// ============================================================================
+
+size_t SMMU::translate_walk_group(const TranslationRequest* requests,
+                                  TranslationResult* results,
+                                  size_t first,
+                                  size_t count,
+                                  const StreamTableEntry& ste,
+                                  const ContextDescriptor& cd) {
+    constexpr uint8_t RESOLVED = 0xFF;   // 已由 TLB 命中或同頁復用得到結果
+    StatCounters& stats = local_stats();
+    const TranslationRequest& head = requests[first];
+    uint8_t granule = cd.translation_granule;
+    
+    VirtualAddress vas[WALK_GROUP_SIZE];       // 待遍歷的地址
+    size_t walk_request[WALK_GROUP_SIZE];      // 待遍歷地址對應的請求下標
+    TranslationResult walked[WALK_GROUP_SIZE];
+    uint8_t source[WALK_GROUP_SIZE];           // 每個請求等待的遍歷（或 RESOLVED）
+    size_t walks = 0;
+    
+    auto add_walk = [&](size_t i) {
+        vas[walks] = requests[i].va;
+        walk_request[walks] = i;
+        source[i - first] = static_cast<uint8_t>(walks++);
+    };
+    add_walk(first);
+    
+    size_t end = first + 1;
+    for (; end < count && end - first < WALK_GROUP_SIZE && same_context(requests[end], head); end++) {
+        const TranslationRequest& req = requests[end];
+        bump(stats.total_translations);
+        
+        // 與上一個已知結果同頁：直接復用
+        size_t prev = end - 1 - first;
+        const TranslationResult& last = results[end - 1];
+        if (source[prev] == RESOLVED && last.success) {
+            uint64_t mask = static_cast<uint64_t>(last.page_size) - 1;
+            if ((req.va & ~mask) == (requests[end - 1].va & ~mask)) {
+                bump(stats.batch_reuses);
+                results[end] = last;
+                results[end].physical_addr = (last.physical_addr & ~mask) | (req.va & mask);
+                results[end].descriptor_reads = 0;
+                source[end - first] = RESOLVED;
+                continue;
+            }
+        }
+        
+        // 與待遍歷的地址同一粒度頁面：等待該次遍歷
+        size_t pending = walks;
+        for (size_t k = 0; k < walks; k++) {
+            if ((vas[k] >> granule) == (req.va >> granule)) {
+                pending = k;
+                break;
+            }
+        }
+        if (pending < walks) {
+            source[end - first] = static_cast<uint8_t>(pending);
+            continue;
+        }
+        
+        std::optional<TLBEntry> tlb_entry;
+        {
+            TLBShard& shard = tlb_shard(req.stream_id);
+            auto lock = maybe_lock(shard.mutex);
+            tlb_entry = shard.tlb->lookup(req.va, req.stream_id, req.asid, req.vmid);
+        }
+        if (tlb_entry.has_value()) {
+            bump(stats.tlb_hits);
+            results[end] = make_result_from_tlb(*tlb_entry, req.va);
+            source[end - first] = RESOLVED;
+        } else {
+            bump(stats.tlb_misses);
+            add_walk(end);
+        }
+    }
+    
+    // 遍歷並按請求順序填充 TLB（與無效化互斥，同 translate_miss）
+    {
+        std::shared_lock<std::shared_mutex> walk_lock;
+        if (concurrent_) walk_lock = std::shared_lock<std::shared_mutex>(walk_mutex_);
+        page_table_walker_->translate_batch(vas, walks, cd.translation_table_base,
+                                            cd.translation_granule, cd.ips,
+                                            TranslationStage::STAGE1, walked,
+                                            cd.asid, ste.vmid);
+        for (size_t k = 0; k < walks; k++) {
+            const TranslationResult& result = walked[k];
+            const TranslationRequest& req = requests[walk_request[k]];
+            bump(stats.page_table_walks);
+            bump(stats.descriptor_reads, result.descriptor_reads);
+            if (result.success) {
+                if (result.contiguous) bump(stats.contiguous_fills);
+                insert_tlb_entry(make_tlb_entry(result, req.va, req.stream_id,
+                                                req.asid, req.vmid, ste));
+            } else {
+                generate_event(result.fault_type, 0, cd.asid, ste.vmid, req.va,
+                               result.fault_reason);
+                bump(stats.translation_faults);
+            }
+            results[walk_request[k]] = result;
+        }
+    }
+    
+    // 等待遍歷的同頁請求
+    for (size_t i = first + 1; i < end; i++) {
+        uint8_t k = source[i - first];
+        if (k == RESOLVED || walk_request[k] == i) continue;
+        const TranslationRequest& req = requests[i];
+        const TranslationResult& result = walked[k];
+        if (result.success) {
+            uint64_t mask = static_cast<uint64_t>(result.page_size) - 1;
+            bump(stats.batch_reuses);
+            results[i] = result;
+            results[i].physical_addr = (result.physical_addr & ~mask) | (req.va & mask);
+            results[i].descriptor_reads = 0;
+        } else {
+            bump(stats.tlb_misses);
+            results[i] = translate_miss(req.va, req.stream_id, req.asid, req.vmid, &ste, &cd);
+        }
+    }
+    return end;
+}
+
+std::vector<TranslationResult> SMMU::translate_batch(
+    const std::vector<TranslationRequest>& requests) {
+    std::vector<TranslationResult> results(requests.size());
+    translate_batch(requests.data(), results.data(), requests.size());
+    return results;
+}
+
+// ============================================================================
+// TLB 命中時構造轉換結果
+// ============================================================================
+
+TranslationResult SMMU::make_result_from_tlb(const TLBEntry& entry,
+                                             VirtualAddress va) const {
+    uint64_t page_mask = static_cast<uint64_t>(entry.page_size) - 1;
     
-    // 步驟2：獲取流表項
-    StreamTableEntry ste = get_stream_table_entry(stream_id);
-    if (!ste.valid) {
+    TranslationResult result;
+    result.success = true;
+    result.physical_addr = entry.pa | (va & page_mask);  // 頁基址 + 頁內偏移
+    result.page_size = entry.page_size;
+    result.level = entry.level;
+    result.memory_type = entry.memory_type;
+    result.permission = entry.permission;
+    result.cacheable = entry.cacheable;
+    result.shareable = entry.shareable;
+    result.contiguous = entry.contiguous;
+    return result;
+}
+
+// ============================================================================
+// TLB 未命中處理
+// 先查預取緩衝區，未命中時根據流表項配置執行階段1/階段2頁表遍歷，
+// 成功後填充 TLB 並按需預取後續頁面
+// ste/cd 為 nullptr 表示對應配置不存在
+// ============================================================================
+
+TranslationResult SMMU::translate_miss(VirtualAddress va,
+                                       StreamID stream_id,
+                                       ASID asid,
+                                       VMID vmid,
+                                       const StreamTableEntry* ste,
+                                       const ContextDescriptor* cd) {
+    // 與無效化互斥：無效化會等待所有進行中的遍歷（包括填充 TLB 和預取）完成
+    std::shared_lock<std::shared_mutex> walk_lock;
+    if (concurrent_) walk_lock = std::shared_lock<std::shared_mutex>(walk_mutex_);
+    
+    if (!ste || !ste->valid) {
         // 流表項無效，生成錯誤
         TranslationResult result;
+        result.fault_type = FaultType::TRANSLATION_FAULT;
         result.fault_reason = "Invalid stream table entry";
         generate_event(FaultType::TRANSLATION_FAULT, stream_id, asid,
                       vmid, va, result.fault_reason);
-        stats_.translation_faults++;
+        bump(local_stats().translation_faults);
         return result;
     }
     
+    // 預取緩衝區命中：表項移入 TLB，不需要遍歷
+    if (prefetcher_) {
+        std::optional<TLBEntry> prefetched = prefetcher_->take(va, stream_id, asid, vmid);
+        if (prefetched.has_value()) {
+            insert_tlb_entry(*prefetched);
+            prefetch_ahead(va, stream_id, asid, vmid, *ste, cd, prefetched->page_size);
+            return make_result_from_tlb(*prefetched, va);
+        }
+    }
+    
+    // 步驟3：根據配置執行轉換（需要時同時讀取葉子緩存行）
+    LeafLine line;
+    bool want_line = (config_.fill_leaf_neighbours || config_.coalesce_leaf_pages) &&
+                     ste->s1_enabled && !ste->s2_enabled;
+    TranslationResult result = walk_stages(va, stream_id, asid, vmid, *ste, cd, true,
+                                           want_line ? &line : nullptr);
+    
+    // 步驟4：如果轉換成功，將結果插入 TLB 以加速後續訪問
+    if (result.success) {
+        TLBEntry entry = make_tlb_entry(result, va, stream_id, asid, vmid, *ste);
+        StatCounters& stats = local_stats();
+        if (result.contiguous) bump(stats.contiguous_fills);
+        
+        // 連續位已覆蓋整個緩存行時不需要合併或填充相鄰表項
+        if (line.count > 0 && !result.contiguous) {
+            uint8_t group = config_.coalesce_leaf_pages ? coalesce_group(line) : 1;
+            uint8_t first = static_cast<uint8_t>(line.index & ~(group - 1));
+            if (group > 1) {
+                uint64_t span = static_cast<uint64_t>(line.page_size) * group;
+                entry.va = va & ~(span - 1);
+                entry.pa = line.decoded.address[first] & ~(span - 1);
+                entry.page_size = static_cast<PageSize>(span);
+                entry.contiguous = true;
+                bump(stats.coalesced_fills);
+            }
+            // 相鄰表項先插入，使本次訪問的表項在 LRU 中最新
+            if (config_.fill_leaf_neighbours) {
+                fill_neighbours(line, first, group, stream_id, asid, vmid, *ste);
+            }
+        }
+        insert_tlb_entry(entry);
+        if (prefetcher_) {
+            prefetch_ahead(va, stream_id, asid, vmid, *ste, cd, result.page_size);
+        }
+    }
+    
+    return result;
+}
+
+// ============================================================================
+// 按流表項配置執行階段1/階段2轉換
+// report_faults 為 false 時（預取）失敗不生成事件、不計入錯誤統計
+// ============================================================================
+
+TranslationResult SMMU::walk_stages(VirtualAddress va,
+                                    StreamID stream_id,
+                                    ASID asid,
+                                    VMID vmid,
+                                    const StreamTableEntry& ste,
+                                    const ContextDescriptor* cd,
+                                    bool report_faults,
+                                    LeafLine* line) {
     TranslationResult result;
     
-    // 步驟3：根據配置執行轉換
     if (ste.s1_enabled) {
-        // 階段1轉換已啟用
-        ContextDescriptor cd = get_context_descriptor(stream_id, asid);
-        result = translate_stage1(va, ste, cd);
+        // 階段1轉換已啟用（嵌套時緩存行中的輸出是 IPA，不讀取）
+        static const ContextDescriptor invalid_cd;
+        result = translate_stage1(va, ste, cd ? *cd : invalid_cd, report_faults,
+                                  ste.s2_enabled ? nullptr : line);
         
         if (!result.success) {
             return result;  // 階段1失敗，直接返回
@@ -221,60 +904,273 @@ TranslationResult SMMU::translate(VirtualAddress va,
         // 如果階段2也啟用，繼續進行階段2轉換
         if (ste.s2_enabled) {
             PhysicalAddress ipa = result.physical_addr;  // 階段1的輸出是階段2的輸入
-            result = translate_stage2(ipa, ste);
+            TranslationResult s1_result = result;
+            result = translate_stage2(ipa, ste, report_faults);
+            result.descriptor_reads += s1_result.descriptor_reads;
+            
+            // 組合映射：有效大小取兩個階段中較小者，權限取交集，內存類型取更嚴格者
+            if (result.success) {
+                if (static_cast<uint64_t>(s1_result.page_size) < static_cast<uint64_t>(result.page_size)) {
+                    result.page_size = s1_result.page_size;
+                    result.level = s1_result.level;
+                }
+                result.permission = combine_permission(s1_result.permission, result.permission);
+                result.memory_type = std::min(s1_result.memory_type, result.memory_type);
+                result.cacheable = s1_result.cacheable && result.cacheable;
+                result.shareable = s1_result.shareable || result.shareable;
+            }
         }
     } else if (ste.s2_enabled) {
         // 僅階段2轉換（虛擬機場景）
-        result = translate_stage2(va, ste);
+        result = translate_stage2(va, ste, report_faults);
     } else {
         // 沒有啟用任何轉換階段
+        result.fault_type = FaultType::TRANSLATION_FAULT;
         result.fault_reason = "No translation stages enabled";
-        generate_event(FaultType::TRANSLATION_FAULT, stream_id, asid,
-                      vmid, va, result.fault_reason);
-        stats_.translation_faults++;
-        return result;
+        if (report_faults) {
+            generate_event(FaultType::TRANSLATION_FAULT, stream_id, asid,
+                          vmid, va, result.fault_reason);
+            bump(local_stats().translation_faults);
+        }
     }
     
-    // 步驟4：如果轉換成功，將結果插入 TLB
-    if (result.success) {
-        TLBEntry entry;
-        entry.va = va;
-        entry.pa = result.physical_addr;
-        entry.stream_id = stream_id;
-        entry.asid = asid;
-        entry.vmid = vmid;
-        entry.page_size = PageSize::SIZE_4KB;  // 簡化處理，使用4KB
-        entry.memory_type = result.memory_type;
-        entry.permission = result.permission;
-        entry.cacheable = result.cacheable;
-        entry.shareable = result.shareable;
-        entry.stage = ste.s1_enabled ? TranslationStage::STAGE1 : TranslationStage::STAGE2;
-        
-        tlb_->insert(entry);  // 插入 TLB 以加速後續訪問
+    return result;
+}
+
+// ============================================================================
+// 由轉換結果構造 TLB 表項
+// 按頁表遍歷得到的真實頁面/塊大小緩存，一個塊只佔一個表項
+// ============================================================================
+
+TLBEntry SMMU::make_tlb_entry(const TranslationResult& result,
+                              VirtualAddress va,
+                              StreamID stream_id,
+                              ASID asid,
+                              VMID vmid,
+                              const StreamTableEntry& ste) const {
+    uint64_t page_mask = static_cast<uint64_t>(result.page_size) - 1;
+    
+    TLBEntry entry;
+    entry.va = va & ~page_mask;
+    entry.pa = result.physical_addr & ~page_mask;
+    entry.stream_id = stream_id;
+    entry.asid = asid;
+    entry.vmid = vmid;
+    entry.page_size = result.page_size;
+    entry.level = result.level;
+    entry.memory_type = result.memory_type;
+    entry.permission = result.permission;
+    entry.cacheable = result.cacheable;
+    entry.shareable = result.shareable;
+    entry.contiguous = result.contiguous;
+    if (ste.s1_enabled) {
+        entry.stage = ste.s2_enabled ? TranslationStage::STAGE1_AND_STAGE2
+                                     : TranslationStage::STAGE1;
+    } else {
+        entry.stage = TranslationStage::STAGE2;
     }
+    return entry;
+}
+
+void SMMU::insert_tlb_entry(const TLBEntry& entry) {
+    TLBShard& shard = tlb_shard(entry.stream_id);
+    auto lock = maybe_lock(shard.mutex);
+    shard.tlb->insert(entry);
+}
+
+// ============================================================================
+// 填充相鄰表項
+// 葉子緩存行中的 8 個描述符映射一段對齊的連續 VA，
+// 有效的頁描述符不需要再遍歷就可以直接放入 TLB
+// ============================================================================
+
+void SMMU::fill_neighbours(const LeafLine& line,
+                           uint8_t skip_first,
+                           uint8_t skip_count,
+                           StreamID stream_id,
+                           ASID asid,
+                           VMID vmid,
+                           const StreamTableEntry& ste) {
+    uint64_t page_mask = static_cast<uint64_t>(line.page_size) - 1;
+    uint64_t filled = 0;
     
-    return result;
+    const DescriptorBatch& decoded = line.decoded;
+    uint8_t skip = static_cast<uint8_t>(((1u << skip_count) - 1) << skip_first);
+    uint8_t pending = static_cast<uint8_t>(decoded.leaf() & ~skip & ((1u << line.count) - 1));
+    
+    TLBShard& shard = tlb_shard(stream_id);
+    auto lock = maybe_lock(shard.mutex);
+    for (; pending; pending &= static_cast<uint8_t>(pending - 1)) {
+        unsigned i = static_cast<unsigned>(__builtin_ctz(pending));
+        MemoryType memory_type = decoded.memory_type(i);
+        
+        TranslationResult neighbour;
+        neighbour.success = true;
+        neighbour.physical_addr = decoded.address[i] & ~page_mask;
+        neighbour.page_size = line.page_size;
+        neighbour.level = line.level;
+        neighbour.permission = decoded.permission(i);
+        neighbour.memory_type = memory_type;
+        neighbour.cacheable = (memory_type == MemoryType::NORMAL_WB ||
+                               memory_type == MemoryType::NORMAL_WT);
+        neighbour.shareable = decoded.is_shareable(i);
+        
+        VirtualAddress va = line.va_base + i * static_cast<uint64_t>(line.page_size);
+        shard.tlb->insert(make_tlb_entry(neighbour, va, stream_id, asid, vmid, ste));
+        filled++;
+    }
+    bump(local_stats().neighbour_fills, filled);
+}
+
+// ============================================================================
+// 預取
+// 在本次未命中處理的末尾遍歷步長檢測給出的後續頁面，結果放入預取緩衝區；
+// 遇到未映射的頁面即停止（不生成事件）
+// ============================================================================
+
+void SMMU::prefetch_ahead(VirtualAddress va,
+                          StreamID stream_id,
+                          ASID asid,
+                          VMID vmid,
+                          const StreamTableEntry& ste,
+                          const ContextDescriptor* cd,
+                          PageSize page_size) {
+    TranslationPrefetcher::Plan plan =
+        prefetcher_->observe(va, stream_id, asid, vmid, page_size);
+    VirtualAddress target = plan.start;
+    for (uint32_t i = 0; i < plan.count; i++) {
+        TranslationResult result = walk_stages(target, stream_id, asid, vmid, ste, cd, false);
+        if (!result.success) break;
+        prefetcher_->fill(make_tlb_entry(result, target, stream_id, asid, vmid, ste));
+        target += static_cast<uint64_t>(plan.stride);
+    }
+}
+
+// ============================================================================
+// 寄存器接口
+// ============================================================================
+
+uint32_t SMMU::read_register(RegisterOffset offset) const {
+    auto lock = maybe_lock(register_mutex_);
+    return registers_.read_register(offset);
+}
+
+uint64_t SMMU::read_register_64(RegisterOffset offset) const {
+    auto lock = maybe_lock(register_mutex_);
+    return registers_.read_register_64(offset);
+}
+
+// 寫入寄存器並處理副作用
+// 隊列啟用後 CMDQ_CONS / EVENTQ_PROD 由 SMMU 維護，GERROR 只由 SMMU 翻轉
+void SMMU::write_register(RegisterOffset offset, uint32_t value) {
+    bool doorbell = false;
+    bool toggled = false;  // SMMUEN 改變
+    {
+        auto lock = maybe_lock(register_mutex_);
+        switch (offset) {
+            case RegisterOffset::CMDQ_CONS:
+                if (cmdq_in_memory()) return;
+                break;
+            case RegisterOffset::EVENTQ_PROD:
+                if (eventq_in_memory()) return;
+                break;
+            case RegisterOffset::GERROR:
+                return;
+            default:
+                break;
+        }
+        registers_.write_register(offset, value);
+        
+        if (offset == RegisterOffset::CR0) {
+            bool enable = (value & CR0::SMMUEN) != 0;
+            toggled = enabled_.exchange(enable, std::memory_order_acq_rel) != enable;
+        }
+        // 寫 PROD、確認錯誤或啟用命令隊列後都可能有待處理的命令
+        doorbell = (offset == RegisterOffset::CMDQ_PROD ||
+                    offset == RegisterOffset::GERRORN ||
+                    offset == RegisterOffset::CR0) && cmdq_in_memory();
+    }
+    if (toggled) notify_invalidation(TranslationInvalidation::Scope::ALL);
+    if (doorbell) consume_command_queue();
+}
+
+void SMMU::write_register_64(RegisterOffset offset, uint64_t value) {
+    write_register(offset, static_cast<uint32_t>(value));
+    write_register(static_cast<RegisterOffset>(static_cast<uint32_t>(offset) + 4),
+                   static_cast<uint32_t>(value >> 32));
+}
+
+// 以下兩個函數需持有 register_mutex_
+bool SMMU::cmdq_in_memory() const {
+    return (registers_.read_register(RegisterOffset::CR0) & CR0::CMDQEN) != 0;
+}
+
+bool SMMU::eventq_in_memory() const {
+    return (registers_.read_register(RegisterOffset::CR0) & CR0::EVENTQEN) != 0;
 }
 
 // ============================================================================
 // 命令隊列操作
 // ============================================================================
 
+namespace {
+
+// 從 *_BASE 寄存器值中取出隊列深度（log2）
+uint8_t queue_log2size(uint64_t base) {
+    return static_cast<uint8_t>(std::min<uint64_t>(base & Q_BASE::LOG2SIZE_MASK,
+                                                   queue::MAX_LOG2SIZE));
+}
+
+// PROD/CONS 中的索引和回繞標誌（去掉 ERR / OVFLG 等字段）
+uint32_t queue_pointer(uint32_t value, uint8_t log2size) {
+    return value & (queue::index_mask(log2size) | queue::wrap_bit(log2size));
+}
+
+} // namespace
+
 // 提交命令到命令隊列
-void SMMU::submit_command(const Command& cmd) {
-    // 檢查隊列是否已滿
-    if (command_queue_.size() < config_.command_queue_size) {
-        command_queue_.push(cmd);
+bool SMMU::submit_command(const Command& cmd) {
+    {
+        auto lock = maybe_lock(register_mutex_);
+        if (cmdq_in_memory()) {
+            // 作為驅動寫入 PROD 處的表項，然後敲門鈴
+            uint64_t base = registers_.get_cmdq_base();
+            uint8_t log2size = queue_log2size(base);
+            uint32_t prod = queue_pointer(registers_.get_cmdq_prod(), log2size);
+            uint32_t cons = queue_pointer(registers_.get_cmdq_cons(), log2size);
+            if (!memory_ || queue::is_full(prod, cons, log2size)) return false;
+            
+            uint64_t raw[2];
+            queue::encode_command(cmd, raw);
+            memory_->write((base & Q_BASE::ADDR_MASK) +
+                           queue::slot(prod, log2size) * queue::COMMAND_ENTRY_SIZE,
+                           raw, sizeof(raw));
+            registers_.set_cmdq_prod(queue::advance(prod, 1, log2size));
+        } else {
+            // 檢查隊列是否已滿
+            auto queue_lock = maybe_lock(command_mutex_);
+            if (command_queue_.size() < config_.command_queue_size) {
+                command_queue_.push(cmd);
+                return true;
+            }
+            // 注意：如果隊列已滿，命令會被丟棄（實際硬件可能會阻塞）
+            return false;
+        }
     }
-    // 注意：如果隊列已滿，命令會被丟棄（實際硬件可能會阻塞）
+    consume_command_queue();
+    return true;
 }
 
 // 處理單個命令
 void SMMU::process_command(const Command& cmd) {
     switch (cmd.type) {
         case CommandType::CMD_SYNC:
-            // 同步命令：確保之前的命令都已完成
-            // 在這個簡化實現中不需要特殊處理
+            // 同步命令：之前的命令都已在此之前按順序執行完成
+            // 需要時通過寫 MSI 通知軟件，軟件無需阻塞等待門鈴返回
+            if (cmd.data.sync.cs == SYNC_CS_IRQ && cmd.data.sync.msi_address != 0 && memory_) {
+                memory_->write(cmd.data.sync.msi_address, &cmd.data.sync.msi_data,
+                               sizeof(cmd.data.sync.msi_data));
+            }
             break;
             
         case CommandType::CMD_CFGI_STE:
@@ -308,8 +1204,13 @@ void SMMU::process_command(const Command& cmd) {
             
         case CommandType::CMD_TLBI_NH_VA:
             // 按虛擬地址使 TLB 項無效
-            // 頁表更新時使用
-            invalidate_tlb_by_va(cmd.data.tlbi_va.va, cmd.data.tlbi_va.asid);
+            // 頁表更新時使用；tg 非 0 時為範圍無效化（批量解除映射）
+            if (cmd.data.tlbi_va.tg != 0) {
+                invalidate_tlb_by_va_range(cmd.data.tlbi_va.va, tlbi_range_size(cmd),
+                                           cmd.data.tlbi_va.asid, cmd.data.tlbi_va.ttl);
+            } else {
+                invalidate_tlb_by_va(cmd.data.tlbi_va.va, cmd.data.tlbi_va.asid);
+            }
             break;
             
         case CommandType::CMD_TLBI_S12_VMALL:
@@ -322,16 +1223,110 @@ void SMMU::process_command(const Command& cmd) {
             break;
     }
     
-    stats_.commands_processed++;  // 增加已處理命令計數
+    bump(local_stats().commands_processed);  // 增加已處理命令計數
 }
 
 // 處理所有待處理的命令
+// 命令在隊列鎖之外執行，提交者不會被無效化阻塞
 void SMMU::process_commands() {
-    while (!command_queue_.empty()) {
-        Command cmd = command_queue_.front();
-        command_queue_.pop();
+    while (true) {
+        Command cmd;
+        {
+            auto lock = maybe_lock(command_mutex_);
+            if (command_queue_.empty()) break;
+            cmd = command_queue_.front();
+            command_queue_.pop();
+        }
         process_command(cmd);
     }
+    
+    bool in_memory;
+    {
+        auto lock = maybe_lock(register_mutex_);
+        in_memory = cmdq_in_memory();
+    }
+    if (in_memory) consume_command_queue();
+}
+
+// 消費內存命令隊列
+// 每次從內存讀取一段連續的表項（不跨越隊列末尾），逐條解碼執行後一次性更新 CONS；
+// CMD_SYNC 在執行前先把 CONS 更新到自身之後，軟件看到 CONS 越過 SYNC 即表示之前的命令已完成
+void SMMU::consume_command_queue() {
+    constexpr uint32_t BATCH_ENTRIES = 64;
+    uint64_t raw[BATCH_ENTRIES][2];
+    
+    std::unique_lock<std::mutex> consumer(cmdq_consumer_mutex_, std::defer_lock);
+    while (true) {
+        // 已有線程在消費時直接返回：它在退出前會重新檢查 PROD
+        if (concurrent_ && !consumer.try_lock()) return;
+        
+        while (true) {
+            uint64_t base;
+            uint8_t log2size;
+            uint32_t prod;
+            uint32_t cons;
+            {
+                auto lock = maybe_lock(register_mutex_);
+                uint32_t unacked = registers_.read_register(RegisterOffset::GERROR) ^
+                                   registers_.read_register(RegisterOffset::GERRORN);
+                if (!cmdq_in_memory() || (unacked & GERROR::CMDQ_ERR)) break;
+                base = registers_.get_cmdq_base();
+                log2size = queue_log2size(base);
+                prod = queue_pointer(registers_.get_cmdq_prod(), log2size);
+                cons = queue_pointer(registers_.get_cmdq_cons(), log2size);
+            }
+            if (queue::is_empty(prod, cons, log2size)) break;
+            
+            uint32_t first = queue::slot(cons, log2size);
+            uint32_t count = std::min({queue::occupancy(prod, cons, log2size), BATCH_ENTRIES,
+                                       (1U << log2size) - first});
+            uint32_t error = CMDQ_CONS::CERROR_NONE;
+            uint32_t done = 0;
+            if (!memory_ ||
+                !memory_->read((base & Q_BASE::ADDR_MASK) + first * queue::COMMAND_ENTRY_SIZE,
+                               raw, count * queue::COMMAND_ENTRY_SIZE)) {
+                error = CMDQ_CONS::CERROR_ABT;
+            }
+            for (; error == CMDQ_CONS::CERROR_NONE && done < count; done++) {
+                Command cmd;
+                if (!queue::decode_command(raw[done], cmd)) {
+                    error = CMDQ_CONS::CERROR_ILL;
+                    break;
+                }
+                if (cmd.type == CommandType::CMD_SYNC) {
+                    auto lock = maybe_lock(register_mutex_);
+                    registers_.set_cmdq_cons(queue::advance(cons, done + 1, log2size));
+                }
+                process_command(cmd);
+            }
+            
+            // 出錯時 CONS 停在出錯的命令上
+            auto lock = maybe_lock(register_mutex_);
+            uint32_t new_cons = queue::advance(cons, done, log2size);
+            if (error != CMDQ_CONS::CERROR_NONE) {
+                registers_.set_cmdq_cons(new_cons | (error << CMDQ_CONS::ERR_SHIFT));
+                registers_.write_register(RegisterOffset::GERROR,
+                    registers_.read_register(RegisterOffset::GERROR) ^ GERROR::CMDQ_ERR);
+                bump(local_stats().command_errors);
+                break;
+            }
+            registers_.set_cmdq_cons(new_cons);
+        }
+        
+        if (!concurrent_) return;
+        consumer.unlock();
+        
+        // 釋放後再檢查一次，處理在釋放前一刻敲響、被 try_lock 拒絕的門鈴
+        auto lock = maybe_lock(register_mutex_);
+        uint64_t base = registers_.get_cmdq_base();
+        uint8_t log2size = queue_log2size(base);
+        uint32_t unacked = registers_.read_register(RegisterOffset::GERROR) ^
+                           registers_.read_register(RegisterOffset::GERRORN);
+        if (!cmdq_in_memory() || (unacked & GERROR::CMDQ_ERR) ||
+            queue::is_empty(registers_.get_cmdq_prod(), registers_.get_cmdq_cons(), log2size)) {
+            return;
+        }
+    }
 }
 
 // ============================================================================
@@ -342,31 +1337,94 @@ void SMMU::process_commands() {
 // 用於記錄錯誤和異常情況
 void SMMU::generate_event(FaultType fault_type, StreamID stream_id,
                           ASID asid, VMID vmid, VirtualAddress va,
-                          const std::string& description) {
-    // 檢查事件隊列是否已滿
-    if (event_queue_.size() < config_.event_queue_size) {
-        Event event;
-        event.fault_type = fault_type;
-        event.stream_id = stream_id;
-        event.asid = asid;
-        event.vmid = vmid;
-        event.va = va;
-        event.description = description;
-        event.timestamp = timestamp_counter_++;  // 分配時間戳
-        
-        event_queue_.push(event);
-        stats_.events_generated++;
+                          const char* description) {
+    Event event;
+    event.fault_type = fault_type;
+    event.stream_id = stream_id;
+    event.asid = asid;
+    event.vmid = vmid;
+    event.va = va;
+    event.description = description;
+    
+    auto lock = maybe_lock(event_mutex_);
+    event.timestamp = timestamp_counter_++;  // 分配時間戳
+    
+    bool queued;
+    {
+        auto register_lock = maybe_lock(register_mutex_);
+        if (eventq_in_memory()) {
+            queued = write_event_to_queue(event);
+        } else {
+            // 檢查事件隊列是否已滿
+            queued = event_queue_.size() < config_.event_queue_size;
+            if (queued) event_queue_.push(event);
+        }
+    }
+    bump(queued ? local_stats().events_generated : local_stats().events_dropped);
+}
+
+// 寫入內存事件隊列
+// 隊列已滿時丟棄事件；若上一次溢出已被確認（OVFLG == OVACKFLG），翻轉 OVFLG
+bool SMMU::write_event_to_queue(const Event& event) {
+    uint64_t base = registers_.get_eventq_base();
+    uint8_t log2size = queue_log2size(base);
+    uint32_t prod_reg = registers_.get_eventq_prod();
+    uint32_t cons_reg = registers_.get_eventq_cons();
+    uint32_t prod = queue_pointer(prod_reg, log2size);
+    
+    if (!memory_ || queue::is_full(prod, queue_pointer(cons_reg, log2size), log2size)) {
+        if (((prod_reg ^ cons_reg) & EVENTQ_PROD::OVFLG) == 0) {
+            registers_.set_eventq_prod(prod_reg ^ EVENTQ_PROD::OVFLG);
+        }
+        return false;
     }
-    // 注意：如果隊列已滿，事件會被丟棄
+    
+    uint64_t raw[4];
+    queue::encode_event(event, raw);
+    memory_->write((base & Q_BASE::ADDR_MASK) +
+                   queue::slot(prod, log2size) * queue::EVENT_ENTRY_SIZE,
+                   raw, sizeof(raw));
+    registers_.set_eventq_prod((prod_reg & EVENTQ_PROD::OVFLG) |
+                               queue::advance(prod, 1, log2size));
+    return true;
 }
 
 // 檢查是否有待處理的事件
 bool SMMU::has_events() const {
+    {
+        auto lock = maybe_lock(register_mutex_);
+        if (eventq_in_memory()) {
+            uint8_t log2size = queue_log2size(registers_.get_eventq_base());
+            return !queue::is_empty(registers_.get_eventq_prod(),
+                                    registers_.get_eventq_cons(), log2size);
+        }
+    }
+    auto lock = maybe_lock(event_mutex_);
     return !event_queue_.empty();
 }
 
 // 彈出並返回下一個事件
+// 內存隊列模式下作為軟件消費者：讀取 CONS 處的表項，前進 CONS 並確認溢出
 Event SMMU::pop_event() {
+    {
+        auto lock = maybe_lock(register_mutex_);
+        if (eventq_in_memory()) {
+            uint64_t base = registers_.get_eventq_base();
+            uint8_t log2size = queue_log2size(base);
+            uint32_t prod_reg = registers_.get_eventq_prod();
+            uint32_t cons = queue_pointer(registers_.get_eventq_cons(), log2size);
+            if (!memory_ || queue::is_empty(prod_reg, cons, log2size)) return Event();
+            
+            uint64_t raw[4];
+            memory_->read((base & Q_BASE::ADDR_MASK) +
+                          queue::slot(cons, log2size) * queue::EVENT_ENTRY_SIZE,
+                          raw, sizeof(raw));
+            registers_.set_eventq_cons((prod_reg & EVENTQ_PROD::OVFLG) |
+                                       queue::advance(cons, 1, log2size));
+            return queue::decode_event(raw);
+        }
+    }
+    auto lock = maybe_lock(event_mutex_);
     if (!event_queue_.empty()) {
         Event event = event_queue_.front();
         event_queue_.pop();
@@ -377,51 +1435,204 @@ Event SMMU::pop_event() {
 
 // ============================================================================
 // TLB 無效化操作
-// 這些函數直接委託給 TLB 對象
+// 這些函數委託給各個 TLB 分片
+// 頁表遍歷緩存與 TLB 一起無效化
+// 並發模式下先獲取 walk_mutex_ 獨佔鎖，等待進行中的遍歷完成，
+// 保證無效化返回後不會再有基於舊頁表的表項被填入
 // ============================================================================
 
 // 使所有 TLB 項無效
 void SMMU::invalidate_tlb_all() {
-    tlb_->invalidate_all();
+    auto walk_lock = maybe_lock(walk_mutex_);
+    for_each_tlb_shard([](TLBInterface& tlb) { tlb.invalidate_all(); });
+    if (walk_cache_) walk_cache_->invalidate_all();
+    invalidate_s2_tlb([](TLB& tlb) { tlb.invalidate_all(); });
+    if (prefetcher_) prefetcher_->invalidate_all();
+    notify_invalidation(TranslationInvalidation::Scope::ALL);
 }
 
 // 按 ASID 使 TLB 項無效
 void SMMU::invalidate_tlb_by_asid(ASID asid) {
-    tlb_->invalidate_by_asid(asid);
+    auto walk_lock = maybe_lock(walk_mutex_);
+    for_each_tlb_shard([asid](TLBInterface& tlb) { tlb.invalidate_by_asid(asid); });
+    if (walk_cache_) walk_cache_->invalidate_by_asid(asid);
+    if (prefetcher_) prefetcher_->invalidate_by_asid(asid);
+    notify_invalidation(TranslationInvalidation::Scope::ASID, 0, asid);
 }
 
 // 按 VMID 使 TLB 項無效
 void SMMU::invalidate_tlb_by_vmid(VMID vmid) {
-    tlb_->invalidate_by_vmid(vmid);
+    auto walk_lock = maybe_lock(walk_mutex_);
+    for_each_tlb_shard([vmid](TLBInterface& tlb) { tlb.invalidate_by_vmid(vmid); });
+    if (walk_cache_) walk_cache_->invalidate_by_vmid(vmid);
+    invalidate_s2_tlb([vmid](TLB& tlb) { tlb.invalidate_by_vmid(vmid); });
+    if (prefetcher_) prefetcher_->invalidate_by_vmid(vmid);
+    notify_invalidation(TranslationInvalidation::Scope::VMID, 0, 0, vmid);
 }
 
 // 按虛擬地址使 TLB 項無效
 void SMMU::invalidate_tlb_by_va(VirtualAddress va, ASID asid) {
-    tlb_->invalidate_by_va(va, asid);
+    auto walk_lock = maybe_lock(walk_mutex_);
+    for_each_tlb_shard([va, asid](TLBInterface& tlb) { tlb.invalidate_by_va(va, asid); });
+    if (walk_cache_) walk_cache_->invalidate_by_va(va, asid);
+    if (prefetcher_) prefetcher_->invalidate_by_va(va, asid);
+    notify_invalidation(TranslationInvalidation::Scope::VA_RANGE, 0, asid, 0, va, 1);
 }
 
-// 按流ID使 TLB 項無效
+// 按虛擬地址範圍使 TLB 項無效
+void SMMU::invalidate_tlb_by_va_range(VirtualAddress start, uint64_t size,
+                                      ASID asid, uint8_t ttl_level) {
+    auto walk_lock = maybe_lock(walk_mutex_);
+    for_each_tlb_shard([=](TLBInterface& tlb) {
+        tlb.invalidate_by_va_range(start, size, asid, ttl_level);
+    });
+    if (walk_cache_) walk_cache_->invalidate_by_va_range(start, size, asid);
+    if (prefetcher_) prefetcher_->invalidate_by_va_range(start, size, asid);
+    notify_invalidation(TranslationInvalidation::Scope::VA_RANGE, 0, asid, 0, start, size);
+}
+
+// 按流ID使 TLB 項無效（只涉及該流所在的分片）
+// 遍歷緩存和階段2 TLB 表項不帶流ID，流表項變更時保守地全部清空
 void SMMU::invalidate_tlb_by_stream(StreamID stream_id) {
-    tlb_->invalidate_by_stream(stream_id);
+    auto walk_lock = maybe_lock(walk_mutex_);
+    {
+        TLBShard& shard = tlb_shard(stream_id);
+        auto lock = maybe_lock(shard.mutex);
+        shard.tlb->invalidate_by_stream(stream_id);
+    }
+    if (walk_cache_) walk_cache_->invalidate_all();
+    invalidate_s2_tlb([](TLB& tlb) { tlb.invalidate_all(); });
+    if (prefetcher_) prefetcher_->invalidate_by_stream(stream_id);
+    notify_invalidation(TranslationInvalidation::Scope::STREAM, stream_id);
+}
+
+// 設置轉換失效回調，TLB 分片的容量淘汰也轉為通知
+void SMMU::set_invalidation_callback(InvalidationCallback callback) {
+    invalidation_callback_ = std::move(callback);
+    TLBInterface::EvictionCallback on_evict = nullptr;
+    if (invalidation_callback_) {
+        on_evict = [this](const TLBEntry& entry) {
+            notify_invalidation(TranslationInvalidation::Scope::ENTRY, entry.stream_id,
+                                entry.asid, entry.vmid, entry.va,
+                                static_cast<uint64_t>(entry.page_size));
+        };
+    }
+    for_each_tlb_shard([&on_evict](TLBInterface& tlb) { tlb.set_eviction_callback(on_evict); });
+}
+
+void SMMU::notify_invalidation(TranslationInvalidation::Scope scope, StreamID stream_id,
+                               ASID asid, VMID vmid, VirtualAddress va, uint64_t size) const {
+    static_assert(static_cast<size_t>(TranslationInvalidation::Scope::VA_RANGE) ==
+                  static_cast<size_t>(InvalidationType::VA_RANGE),
+                  "InvalidationType must follow TranslationInvalidation::Scope");
+    if (instrumentation_ && scope != TranslationInvalidation::Scope::ENTRY) {
+        instrumentation_->record_invalidation(static_cast<InvalidationType>(scope));
+    }
+    if (!invalidation_callback_) return;
+    TranslationInvalidation notice;
+    notice.scope = scope;
+    notice.stream_id = stream_id;
+    notice.asid = asid;
+    notice.vmid = vmid;
+    notice.va = va;
+    notice.size = size;
+    invalidation_callback_(notice);
 }
 
 // ============================================================================
 // 統計和控制
 // ============================================================================
 
+// 獲取統計信息
+// 匯總所有線程的計數槽；頁表遍歷緩存和預取器的計數由它們自身維護，在此合併
+SMMU::Statistics SMMU::get_statistics() const {
+    Statistics stats;
+    std::memset(&stats, 0, sizeof(stats));
+    for (size_t i = 0; i < num_stat_slots_; i++) {
+        const StatCounters& slot = stat_slots_[i];
+        stats.total_translations += slot.total_translations.load(std::memory_order_relaxed);
+        stats.tlb_hits += slot.tlb_hits.load(std::memory_order_relaxed);
+        stats.tlb_misses += slot.tlb_misses.load(std::memory_order_relaxed);
+        stats.page_table_walks += slot.page_table_walks.load(std::memory_order_relaxed);
+        stats.translation_faults += slot.translation_faults.load(std::memory_order_relaxed);
+        stats.permission_faults += slot.permission_faults.load(std::memory_order_relaxed);
+        stats.commands_processed += slot.commands_processed.load(std::memory_order_relaxed);
+        stats.events_generated += slot.events_generated.load(std::memory_order_relaxed);
+        stats.events_dropped += slot.events_dropped.load(std::memory_order_relaxed);
+        stats.command_errors += slot.command_errors.load(std::memory_order_relaxed);
+        stats.descriptor_reads += slot.descriptor_reads.load(std::memory_order_relaxed);
+        stats.s2_tlb_hits += slot.s2_tlb_hits.load(std::memory_order_relaxed);
+        stats.s2_tlb_misses += slot.s2_tlb_misses.load(std::memory_order_relaxed);
+        stats.neighbour_fills += slot.neighbour_fills.load(std::memory_order_relaxed);
+        stats.contiguous_fills += slot.contiguous_fills.load(std::memory_order_relaxed);
+        stats.coalesced_fills += slot.coalesced_fills.load(std::memory_order_relaxed);
+        stats.batch_reuses += slot.batch_reuses.load(std::memory_order_relaxed);
+    }
+    if (walk_cache_) {
+        for (uint8_t level = 0; level < PageWalkCache::NUM_LEVELS; level++) {
+            stats.walk_cache_hits[level] = walk_cache_->hit_count(level);
+        }
+        stats.walk_cache_misses = walk_cache_->miss_count();
+    }
+    if (prefetcher_) {
+        stats.prefetches_issued = prefetcher_->issued_count();
+        stats.prefetch_hits = prefetcher_->hit_count();
+        stats.prefetches_unused = prefetcher_->unused_count();
+    }
+    return stats;
+}
+
 // 重置所有統計計數器
 void SMMU::reset_statistics() {
-    std::memset(&stats_, 0, sizeof(stats_));
+    for (size_t i = 0; i < num_stat_slots_; i++) {
+        StatCounters& slot = stat_slots_[i];
+        for (std::atomic<uint64_t>* counter : {
+                 &slot.total_translations, &slot.tlb_hits, &slot.tlb_misses,
+                 &slot.page_table_walks, &slot.translation_faults,
+                 &slot.permission_faults, &slot.commands_processed,
+                 &slot.events_generated, &slot.events_dropped,
+                 &slot.command_errors, &slot.descriptor_reads,
+                 &slot.s2_tlb_hits, &slot.s2_tlb_misses,
+                 &slot.neighbour_fills, &slot.contiguous_fills,
+                 &slot.coalesced_fills, &slot.batch_reuses}) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+    }
+    if (walk_cache_) walk_cache_->reset_statistics();
+    if (prefetcher_) prefetcher_->reset_statistics();
+    for_each_tlb_shard([](TLBInterface& tlb) { tlb.reset_stream_stats(); });
+    if (instrumentation_) instrumentation_->reset();
+}
+
+// 獲取流的 TLB 分區統計
+TLBStreamStats SMMU::get_stream_tlb_statistics(StreamID stream_id) const {
+    TLBShard& shard = tlb_shard(stream_id);
+    auto lock = maybe_lock(shard.mutex);
+    return shard.tlb->stream_stats(stream_id);
+}
+
+// 插樁快照
+InstrumentationSnapshot SMMU::get_instrumentation() const {
+    if (!instrumentation_) return InstrumentationSnapshot();
+    return instrumentation_->snapshot();
 }
 
 // 啟用 SMMU
 void SMMU::enable() {
-    enabled_ = true;
+    auto lock = maybe_lock(register_mutex_);
+    registers_.set_smmu_enabled(true);
+    if (!enabled_.exchange(true, std::memory_order_acq_rel)) {
+        notify_invalidation(TranslationInvalidation::Scope::ALL);  // 旁路轉換不再有效
+    }
 }
 
 // 禁用 SMMU
 void SMMU::disable() {
-    enabled_ = false;
+    auto lock = maybe_lock(register_mutex_);
+    registers_.set_smmu_enabled(false);
+    if (enabled_.exchange(false, std::memory_order_acq_rel)) {
+        notify_invalidation(TranslationInvalidation::Scope::ALL);  // 之後的事務旁路
+    }
 }
 
 } // namespace smmu
@@ -0,0 +1,234 @@
+// SMMU 命令隊列和事件隊列實現文件
+// 實現命令和事件表項的編碼、解碼，以及範圍無效化命令的生成
+
+#include "smmu_queue.h"
+#include <algorithm>
+
+namespace smmu {
+
+namespace {
+
+// 取出 raw 中 [lsb, lsb + width) 位
+inline uint64_t bits(uint64_t raw, unsigned lsb, unsigned width) {
+    return (raw >> lsb) & ((width >= 64) ? ~0ULL : ((1ULL << width) - 1));
+}
+
+// 範圍粒度 log2 <-> TG 字段（0 單地址，1/2/3 = 4KB/16KB/64KB）
+inline uint64_t granule_to_tg(uint8_t granule) {
+    switch (granule) {
+        case 12: return 1;
+        case 14: return 2;
+        case 16: return 3;
+        default: return 0;
+    }
+}
+
+inline uint8_t tg_to_granule(uint64_t tg) {
+    static const uint8_t granules[4] = {0, 12, 14, 16};
+    return granules[tg & 3];
+}
+
+inline uint8_t fault_to_event_type(FaultType type) {
+    switch (type) {
+        case FaultType::TRANSLATION_FAULT: return queue::EventType::F_TRANSLATION;
+        case FaultType::PERMISSION_FAULT: return queue::EventType::F_PERMISSION;
+        case FaultType::ACCESS_FAULT: return queue::EventType::F_ACCESS;
+        case FaultType::ADDRESS_SIZE_FAULT: return queue::EventType::F_ADDR_SIZE;
+        case FaultType::TLB_CONFLICT_FAULT: return queue::EventType::F_TLB_CONFLICT;
+        case FaultType::UNSUPPORTED_UPSTREAM_TRANSACTION: return queue::EventType::F_UUT;
+        default: return 0;
+    }
+}
+
+inline FaultType event_type_to_fault(uint8_t type) {
+    switch (type) {
+        case queue::EventType::F_TRANSLATION: return FaultType::TRANSLATION_FAULT;
+        case queue::EventType::F_PERMISSION: return FaultType::PERMISSION_FAULT;
+        case queue::EventType::F_ACCESS: return FaultType::ACCESS_FAULT;
+        case queue::EventType::F_ADDR_SIZE: return FaultType::ADDRESS_SIZE_FAULT;
+        case queue::EventType::F_TLB_CONFLICT: return FaultType::TLB_CONFLICT_FAULT;
+        case queue::EventType::F_UUT: return FaultType::UNSUPPORTED_UPSTREAM_TRANSACTION;
+        default: return FaultType::NONE;
+    }
+}
+
+} // namespace
+
+// ============================================================================
+// 範圍無效化命令
+// ============================================================================
+
+// 把頁面範圍編碼為範圍 TLBI 命令
+// 從高位開始，每次取 scale 最大、num 最大的一塊
+std::vector<Command> make_tlbi_range_commands(VirtualAddress va, uint64_t pages,
+                                              ASID asid, uint8_t granule, uint8_t ttl) {
+    std::vector<Command> commands;
+    while (pages > 0) {
+        Command cmd;
+        cmd.type = CommandType::CMD_TLBI_NH_VA;
+        cmd.data.tlbi_va.va = va;
+        cmd.data.tlbi_va.asid = asid;
+        cmd.data.tlbi_va.ttl = ttl;
+
+        uint64_t covered = 1;
+        for (int scale = 3; scale >= 0; scale--) {
+            uint64_t unit = 1ULL << (5 * scale + 1);
+            if (pages >= unit) {
+                uint64_t num = std::min<uint64_t>(pages / unit, 32) - 1;
+                cmd.data.tlbi_va.tg = granule;
+                cmd.data.tlbi_va.scale = static_cast<uint8_t>(scale);
+                cmd.data.tlbi_va.num = static_cast<uint8_t>(num);
+                covered = (num + 1) * unit;
+                break;
+            }
+        }
+        // 不足兩頁時使用單地址形式（tg = 0）
+
+        commands.push_back(cmd);
+        pages -= covered;
+        va += covered << granule;
+    }
+    return commands;
+}
+
+namespace queue {
+
+// ============================================================================
+// 命令編碼和解碼
+// ============================================================================
+
+void encode_command(const Command& cmd, uint64_t raw[2]) {
+    raw[0] = 0;
+    raw[1] = 0;
+    switch (cmd.type) {
+        case CommandType::CMD_PREFETCH_CONFIG:
+            raw[0] = Opcode::PREFETCH_CONFIG;
+            break;
+        case CommandType::CMD_PREFETCH_ADDR:
+            raw[0] = Opcode::PREFETCH_ADDR;
+            break;
+        case CommandType::CMD_CFGI_STE:
+            raw[0] = Opcode::CFGI_STE |
+                     (static_cast<uint64_t>(cmd.data.cfgi_ste.stream_id) << 32);
+            break;
+        case CommandType::CMD_CFGI_CD:
+            raw[0] = Opcode::CFGI_CD |
+                     (static_cast<uint64_t>(cmd.data.cfgi_cd.stream_id) << 32);
+            raw[1] = cmd.data.cfgi_cd.asid;
+            break;
+        case CommandType::CMD_CFGI_ALL:
+            raw[0] = Opcode::CFGI_ALL;
+            break;
+        case CommandType::CMD_TLBI_NH_ALL:
+            raw[0] = Opcode::TLBI_NH_ALL;
+            break;
+        case CommandType::CMD_TLBI_NH_ASID:
+            raw[0] = Opcode::TLBI_NH_ASID |
+                     (static_cast<uint64_t>(cmd.data.tlbi_asid.asid) << 48);
+            break;
+        case CommandType::CMD_TLBI_NH_VA: {
+            const auto& r = cmd.data.tlbi_va;
+            raw[0] = Opcode::TLBI_NH_VA |
+                     (static_cast<uint64_t>(r.num & 0x1F) << 12) |
+                     (static_cast<uint64_t>(r.scale & 0x3) << 20) |
+                     (static_cast<uint64_t>(r.asid) << 48);
+            raw[1] = (r.va & ~0xFFFULL) |
+                     (static_cast<uint64_t>(r.ttl & 0x3) << 8) |
+                     (granule_to_tg(r.tg) << 10);
+            break;
+        }
+        case CommandType::CMD_TLBI_S12_VMALL:
+            raw[0] = Opcode::TLBI_S12_VMALL |
+                     (static_cast<uint64_t>(cmd.data.tlbi_vmall.vmid) << 32);
+            break;
+        case CommandType::CMD_SYNC:
+            raw[0] = Opcode::SYNC |
+                     (static_cast<uint64_t>(cmd.data.sync.cs & 0x3) << 12) |
+                     (static_cast<uint64_t>(cmd.data.sync.msi_data) << 32);
+            raw[1] = cmd.data.sync.msi_address & 0x000FFFFFFFFFFFFCULL;
+            break;
+    }
+}
+
+bool decode_command(const uint64_t raw[2], Command& cmd) {
+    cmd = Command();
+    switch (bits(raw[0], 0, 8)) {
+        case Opcode::PREFETCH_CONFIG:
+            cmd.type = CommandType::CMD_PREFETCH_CONFIG;
+            break;
+        case Opcode::PREFETCH_ADDR:
+            cmd.type = CommandType::CMD_PREFETCH_ADDR;
+            break;
+        case Opcode::CFGI_STE:
+            cmd.type = CommandType::CMD_CFGI_STE;
+            cmd.data.cfgi_ste.stream_id = static_cast<StreamID>(bits(raw[0], 32, 32));
+            break;
+        case Opcode::CFGI_CD:
+            cmd.type = CommandType::CMD_CFGI_CD;
+            cmd.data.cfgi_cd.stream_id = static_cast<StreamID>(bits(raw[0], 32, 32));
+            cmd.data.cfgi_cd.asid = static_cast<ASID>(bits(raw[1], 0, 16));
+            break;
+        case Opcode::CFGI_ALL:
+            cmd.type = CommandType::CMD_CFGI_ALL;
+            break;
+        case Opcode::TLBI_NH_ALL:
+            cmd.type = CommandType::CMD_TLBI_NH_ALL;
+            break;
+        case Opcode::TLBI_NH_ASID:
+            cmd.type = CommandType::CMD_TLBI_NH_ASID;
+            cmd.data.tlbi_asid.asid = static_cast<ASID>(bits(raw[0], 48, 16));
+            break;
+        case Opcode::TLBI_NH_VA: {
+            cmd.type = CommandType::CMD_TLBI_NH_VA;
+            auto& r = cmd.data.tlbi_va;
+            r.asid = static_cast<ASID>(bits(raw[0], 48, 16));
+            r.num = static_cast<uint8_t>(bits(raw[0], 12, 5));
+            r.scale = static_cast<uint8_t>(bits(raw[0], 20, 2));
+            r.ttl = static_cast<uint8_t>(bits(raw[1], 8, 2));
+            r.tg = tg_to_granule(bits(raw[1], 10, 2));
+            r.va = raw[1] & ~0xFFFULL;
+            break;
+        }
+        case Opcode::TLBI_S12_VMALL:
+            cmd.type = CommandType::CMD_TLBI_S12_VMALL;
+            cmd.data.tlbi_vmall.vmid = static_cast<VMID>(bits(raw[0], 32, 16));
+            break;
+        case Opcode::SYNC:
+            cmd.type = CommandType::CMD_SYNC;
+            cmd.data.sync.cs = static_cast<uint8_t>(bits(raw[0], 12, 2));
+            cmd.data.sync.msi_data = static_cast<uint32_t>(bits(raw[0], 32, 32));
+            cmd.data.sync.msi_address = raw[1] & 0x000FFFFFFFFFFFFCULL;
+            break;
+        default:
+            return false;  // 非法命令
+    }
+    return true;
+}
+
+// ============================================================================
+// 事件編碼和解碼
+// ============================================================================
+
+void encode_event(const Event& event, uint64_t raw[4]) {
+    raw[0] = fault_to_event_type(event.fault_type) |
+             (static_cast<uint64_t>(event.stream_id) << 32);
+    raw[1] = event.asid | (static_cast<uint64_t>(event.vmid) << 16);
+    raw[2] = event.va;
+    raw[3] = event.timestamp;
+}
+
+Event decode_event(const uint64_t raw[4]) {
+    Event event;
+    event.fault_type = event_type_to_fault(static_cast<uint8_t>(bits(raw[0], 0, 8)));
+    event.stream_id = static_cast<StreamID>(bits(raw[0], 32, 32));
+    event.asid = static_cast<ASID>(bits(raw[1], 0, 16));
+    event.vmid = static_cast<VMID>(bits(raw[1], 16, 16));
+    event.va = raw[2];
+    event.timestamp = raw[3];
+    event.description = fault_type_to_string(event.fault_type);
+    return event;
+}
+
+} // namespace queue
+
+} // namespace smmu
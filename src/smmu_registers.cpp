@@ -28,8 +28,10 @@ void RegisterInterface::init_idr_registers() {
     registers_[get_offset_value(RegisterOffset::IDR0)] = idr0;
     
     // IDR1 - 識別寄存器1
-    // 在這個簡化實現中設置為0
-    registers_[get_offset_value(RegisterOffset::IDR1)] = 0x00000000;
+    // 報告命令隊列和事件隊列支持的最大深度（2^19 項）和 24 位 StreamID
+    registers_[get_offset_value(RegisterOffset::IDR1)] =
+        (19U << IDR1::CMDQS_SHIFT) | (19U << IDR1::EVENTQS_SHIFT) |
+        (24U << IDR1::SIDSIZE_SHIFT);
     
     // IDR5 - 識別寄存器5
     // 在這個簡化實現中設置為0
@@ -0,0 +1,373 @@
+// SMMU 狀態快照實現文件
+// 實現快照文件的寫入、校驗和加載（文件格式見 smmu_snapshot.h）
+
+#include "smmu.h"
+#include <algorithm>
+#include <fstream>
+
+namespace smmu {
+
+using namespace snapshot_format;
+
+namespace {
+
+constexpr uint32_t NUM_SECTIONS = 7;        // 寫入的段數（STREAMS .. FRAME_DATA）
+constexpr uint32_t MAX_SECTIONS = 64;       // 讀取時接受的段數上限
+constexpr uint64_t RECORD_ALIGNMENT = 8;
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// 記錄順序寫入的輸出流，段之間用零填充到段的起始偏移
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::ostream& os) : os_(os), position_(0) {}
+
+    void write(const void* data, uint64_t bytes) {
+        os_.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        position_ += bytes;
+    }
+
+    void pad_to(uint64_t offset) {
+        static const char zeros[FRAME_ALIGNMENT] = {};
+        while (position_ < offset) {
+            write(zeros, std::min<uint64_t>(offset - position_, sizeof(zeros)));
+        }
+    }
+
+    template <typename Record>
+    void write_records(const std::vector<Record>& records) {
+        if (!records.empty()) write(records.data(), records.size() * sizeof(Record));
+    }
+
+    bool ok() const { return static_cast<bool>(os_); }
+
+private:
+    std::ostream& os_;
+    uint64_t position_;
+};
+
+// 讀取一個段的全部記錄（段已通過校驗）
+template <typename Record>
+bool read_section(std::istream& is, const SectionHeader* section, std::vector<Record>& out) {
+    out.clear();
+    if (!section || section->count == 0) return true;
+    out.resize(section->count);
+    is.seekg(static_cast<std::streamoff>(section->offset));
+    return static_cast<bool>(is.read(reinterpret_cast<char*>(out.data()),
+                                     static_cast<std::streamsize>(section->count * sizeof(Record))));
+}
+
+} // namespace
+
+// ============================================================================
+// 保存快照
+// 先收集流表、TLB 和統計信息，再一次寫出；幀數據在寫出時直接從內存模型複製
+// ============================================================================
+
+SnapshotError SMMU::save_snapshot(const std::string& path, SnapshotInfo* info) const {
+    std::vector<StreamRecord> streams;
+    std::vector<ContextRecord> contexts;
+    auto tables = load_config_tables();
+    for (size_t l1 = 0; l1 < tables->spans.size(); l1++) {
+        const StreamTableSpan* span = tables->spans[l1].get();
+        if (!span) continue;
+        for (StreamID l2 = 0; l2 < (1U << STRTAB_SPLIT); l2++) {
+            const StreamSlot& slot = span->slots[l2];
+            if (!slot.present && slot.context_descriptors.empty()) continue;
+            StreamRecord record{};
+            record.stream_id = static_cast<StreamID>((l1 << STRTAB_SPLIT) | l2);
+            record.present = slot.present ? 1 : 0;
+            record.context_count = static_cast<uint32_t>(slot.context_descriptors.size());
+            record.ste = slot.ste;
+            streams.push_back(record);
+            for (const auto& entry : slot.context_descriptors) {
+                ContextRecord context{};
+                context.asid = entry.first;
+                context.cd = entry.second;
+                contexts.push_back(context);
+            }
+        }
+    }
+
+    std::vector<TLBEntry> tlb_entries;
+    for (size_t i = 0; i < num_tlb_shards_; i++) {
+        auto lock = maybe_lock(tlb_shards_[i].mutex);
+        tlb_shards_[i].tlb->export_entries(tlb_entries);
+    }
+    std::vector<TLBEntry> s2_tlb_entries;
+    if (s2_tlb_) {
+        auto lock = maybe_lock(s2_tlb_mutex_);
+        s2_tlb_->export_entries(s2_tlb_entries);
+    }
+
+    Statistics stats = get_statistics();
+    std::vector<StatisticsRecord> statistics(1);
+    StatisticsRecord& counters = statistics[0];
+    counters.total_translations = stats.total_translations;
+    counters.tlb_hits = stats.tlb_hits;
+    counters.tlb_misses = stats.tlb_misses;
+    counters.page_table_walks = stats.page_table_walks;
+    counters.translation_faults = stats.translation_faults;
+    counters.permission_faults = stats.permission_faults;
+    counters.commands_processed = stats.commands_processed;
+    counters.events_generated = stats.events_generated;
+    counters.events_dropped = stats.events_dropped;
+    counters.command_errors = stats.command_errors;
+    counters.descriptor_reads = stats.descriptor_reads;
+    counters.s2_tlb_hits = stats.s2_tlb_hits;
+    counters.s2_tlb_misses = stats.s2_tlb_misses;
+    counters.neighbour_fills = stats.neighbour_fills;
+    counters.contiguous_fills = stats.contiguous_fills;
+    counters.coalesced_fills = stats.coalesced_fills;
+    counters.batch_reuses = stats.batch_reuses;
+
+    std::vector<uint64_t> frames;
+    if (memory_) {
+        frames.reserve(memory_->resident_frames());
+        memory_->for_each_frame([&](PhysicalAddress addr, const uint8_t*) { frames.push_back(addr); });
+    }
+
+    // 段表
+    SectionHeader sections[NUM_SECTIONS] = {
+        {STREAMS, sizeof(StreamRecord), 0, streams.size()},
+        {CONTEXTS, sizeof(ContextRecord), 0, contexts.size()},
+        {TLB_ENTRIES, sizeof(TLBEntry), 0, tlb_entries.size()},
+        {S2_TLB_ENTRIES, sizeof(TLBEntry), 0, s2_tlb_entries.size()},
+        {STATISTICS, sizeof(StatisticsRecord), 0, statistics.size()},
+        {FRAME_INDEX, sizeof(uint64_t), 0, frames.size()},
+        {FRAME_DATA, SimpleMemoryModel::FRAME_SIZE, 0, frames.size()},
+    };
+    uint64_t offset = sizeof(FileHeader) + sizeof(sections);
+    for (SectionHeader& section : sections) {
+        offset = align_up(offset, section.kind == FRAME_DATA ? FRAME_ALIGNMENT : RECORD_ALIGNMENT);
+        section.offset = offset;
+        offset += section.count * section.record_bytes;
+    }
+
+    FileHeader header{};
+    std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+    header.version = VERSION;
+    header.byte_order = ENDIAN_TAG;
+    header.section_count = NUM_SECTIONS;
+    header.flags = is_enabled() ? FLAG_ENABLED : 0;
+    header.next_allocation = memory_ ? memory_->next_allocation() : 0;
+    header.file_bytes = offset;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return SnapshotError::IO_ERROR;
+    SnapshotWriter writer(file);
+    writer.write(&header, sizeof(header));
+    writer.write(sections, sizeof(sections));
+    writer.pad_to(sections[0].offset);
+    writer.write_records(streams);
+    writer.pad_to(sections[1].offset);
+    writer.write_records(contexts);
+    writer.pad_to(sections[2].offset);
+    writer.write_records(tlb_entries);
+    writer.pad_to(sections[3].offset);
+    writer.write_records(s2_tlb_entries);
+    writer.pad_to(sections[4].offset);
+    writer.write_records(statistics);
+    writer.pad_to(sections[5].offset);
+    writer.write_records(frames);
+    writer.pad_to(sections[6].offset);
+    if (memory_) {
+        memory_->for_each_frame([&](PhysicalAddress, const uint8_t* bytes) {
+            writer.write(bytes, SimpleMemoryModel::FRAME_SIZE);
+        });
+    }
+    file.close();
+    if (!writer.ok() || file.fail()) return SnapshotError::IO_ERROR;
+
+    if (info) {
+        info->streams = streams.size();
+        info->context_descriptors = contexts.size();
+        info->tlb_entries = tlb_entries.size();
+        info->s2_tlb_entries = s2_tlb_entries.size();
+        info->frames = frames.size();
+        info->file_bytes = header.file_bytes;
+    }
+    return SnapshotError::NONE;
+}
+
+// ============================================================================
+// 加載快照
+// 校驗頭部和段表、讀入所有段（幀數據讀入臨時的內存模型）並檢查一致性之後才修改狀態：
+// 先交換內存模型的內容，再替換流表、重新填充 TLB、恢復統計計數器和啟用狀態
+// ============================================================================
+
+SnapshotError SMMU::load_snapshot(const std::string& path, SnapshotInfo* info) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return SnapshotError::IO_ERROR;
+    file.seekg(0, std::ios::end);
+    std::streamoff end = file.tellg();
+    if (end < 0) return SnapshotError::IO_ERROR;
+    uint64_t file_bytes = static_cast<uint64_t>(end);
+    file.seekg(0);
+
+    FileHeader header;
+    if (file_bytes < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        !std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic)) {
+        return SnapshotError::BAD_FORMAT;
+    }
+    if (header.version != VERSION || header.byte_order != ENDIAN_TAG) {
+        return SnapshotError::VERSION_MISMATCH;
+    }
+    if (header.file_bytes != file_bytes || header.section_count > MAX_SECTIONS ||
+        sizeof(header) + header.section_count * sizeof(SectionHeader) > file_bytes) {
+        return SnapshotError::BAD_FORMAT;
+    }
+
+    // 段表：未知的段被忽略，已知的段檢查記錄大小和範圍
+    std::vector<SectionHeader> section_table(header.section_count);
+    if (!file.read(reinterpret_cast<char*>(section_table.data()),
+                   static_cast<std::streamsize>(section_table.size() * sizeof(SectionHeader)))) {
+        return SnapshotError::IO_ERROR;
+    }
+    const SectionHeader* sections[FRAME_DATA + 1] = {};
+    for (const SectionHeader& section : section_table) {
+        if (section.kind < STREAMS || section.kind > FRAME_DATA) continue;
+        static const uint32_t record_bytes[FRAME_DATA + 1] = {
+            0, sizeof(StreamRecord), sizeof(ContextRecord), sizeof(TLBEntry), sizeof(TLBEntry),
+            sizeof(StatisticsRecord), sizeof(uint64_t), SimpleMemoryModel::FRAME_SIZE};
+        if (section.record_bytes != record_bytes[section.kind]) return SnapshotError::LAYOUT_MISMATCH;
+        if (sections[section.kind] || section.offset > file_bytes ||
+            section.count > (file_bytes - section.offset) / section.record_bytes) {
+            return SnapshotError::BAD_FORMAT;
+        }
+        sections[section.kind] = &section;
+    }
+
+    std::vector<StreamRecord> streams;
+    std::vector<ContextRecord> contexts;
+    std::vector<TLBEntry> tlb_entries;
+    std::vector<TLBEntry> s2_tlb_entries;
+    std::vector<StatisticsRecord> statistics;
+    std::vector<uint64_t> frames;
+    if (!read_section(file, sections[STREAMS], streams) ||
+        !read_section(file, sections[CONTEXTS], contexts) ||
+        !read_section(file, sections[TLB_ENTRIES], tlb_entries) ||
+        !read_section(file, sections[S2_TLB_ENTRIES], s2_tlb_entries) ||
+        !read_section(file, sections[STATISTICS], statistics) ||
+        !read_section(file, sections[FRAME_INDEX], frames)) {
+        return SnapshotError::IO_ERROR;
+    }
+
+    // 一致性：上下文描述符數與流記錄相符、StreamID 在範圍內、
+    // 幀地址按幀對齊且在物理地址範圍內、每個幀都有數據
+    uint64_t context_total = 0;
+    for (const StreamRecord& record : streams) {
+        if (record.stream_id >> STREAM_ID_BITS) return SnapshotError::BAD_FORMAT;
+        context_total += record.context_count;
+    }
+    if (context_total != contexts.size() || statistics.size() > 1) return SnapshotError::BAD_FORMAT;
+    for (uint64_t addr : frames) {
+        if ((addr & (SimpleMemoryModel::FRAME_SIZE - 1)) || addr >= SimpleMemoryModel::PA_LIMIT) {
+            return SnapshotError::BAD_FORMAT;
+        }
+    }
+    uint64_t frame_data_count = sections[FRAME_DATA] ? sections[FRAME_DATA]->count : 0;
+    if (frame_data_count != frames.size()) return SnapshotError::BAD_FORMAT;
+
+    // 幀：按段中的順序讀入臨時內存模型的幀，全部成功後才與當前內存模型交換
+    SimpleMemoryModel restored_memory;
+    if (!frames.empty()) {
+        file.seekg(static_cast<std::streamoff>(sections[FRAME_DATA]->offset));
+        for (uint64_t addr : frames) {
+            uint8_t* data = restored_memory.frame_data(addr);
+            if (!file.read(reinterpret_cast<char*>(data), SimpleMemoryModel::FRAME_SIZE)) {
+                return SnapshotError::IO_ERROR;
+            }
+        }
+    }
+    restored_memory.reserve_below(header.next_allocation);
+    if (!memory_) set_memory_model(std::make_shared<SimpleMemoryModel>());
+    memory_->swap(restored_memory);   // 舊內容隨 restored_memory 釋放
+
+    // 流表：構造新的配置表後一次發佈，一級表至少保持當前的大小
+    auto tables = std::make_shared<ConfigTables>();
+    tables->spans.resize(load_config_tables()->spans.size());
+    size_t next_context = 0;
+    for (const StreamRecord& record : streams) {
+        size_t l1_index = record.stream_id >> STRTAB_SPLIT;
+        if (l1_index >= tables->spans.size()) tables->spans.resize(l1_index + 1);
+        auto& span = tables->spans[l1_index];
+        if (!span) span = std::make_shared<StreamTableSpan>();
+        StreamSlot& slot = span->slots[record.stream_id & ((1U << STRTAB_SPLIT) - 1)];
+        slot.present = record.present != 0;
+        slot.ste = record.ste;
+        slot.context_descriptors.clear();
+        for (uint32_t i = 0; i < record.context_count; i++, next_context++) {
+            slot.context_descriptors.emplace_back(contexts[next_context].asid,
+                                                  contexts[next_context].cd);
+        }
+    }
+    if (concurrent_) {
+        std::lock_guard<std::mutex> lock(config_write_mutex_);
+        std::atomic_store(&config_tables_, tables);
+    } else {
+        config_tables_ = tables;
+    }
+
+    // TLB：清空所有緩存後按流表項設置配額，再按從舊到新的順序重新插入
+    invalidate_tlb_all();
+    reset_statistics();
+    for (const StreamRecord& record : streams) {
+        if (!record.present) continue;
+        TLBShard& shard = tlb_shard(record.stream_id);
+        auto lock = maybe_lock(shard.mutex);
+        shard.tlb->set_stream_quota(record.stream_id, record.ste.tlb_reserved, record.ste.tlb_limit);
+    }
+    for (const TLBEntry& entry : tlb_entries) {
+        TLBShard& shard = tlb_shard(entry.stream_id);
+        auto lock = maybe_lock(shard.mutex);
+        shard.tlb->insert(entry);
+    }
+    if (s2_tlb_) {
+        auto lock = maybe_lock(s2_tlb_mutex_);
+        for (const TLBEntry& entry : s2_tlb_entries) s2_tlb_->insert(entry);
+    }
+
+    // 統計計數器：全部放入第一個計數槽（讀取時匯總，總數不變）
+    if (!statistics.empty()) {
+        const StatisticsRecord& counters = statistics[0];
+        StatCounters& slot = stat_slots_[0];
+        slot.total_translations.store(counters.total_translations, std::memory_order_relaxed);
+        slot.tlb_hits.store(counters.tlb_hits, std::memory_order_relaxed);
+        slot.tlb_misses.store(counters.tlb_misses, std::memory_order_relaxed);
+        slot.page_table_walks.store(counters.page_table_walks, std::memory_order_relaxed);
+        slot.translation_faults.store(counters.translation_faults, std::memory_order_relaxed);
+        slot.permission_faults.store(counters.permission_faults, std::memory_order_relaxed);
+        slot.commands_processed.store(counters.commands_processed, std::memory_order_relaxed);
+        slot.events_generated.store(counters.events_generated, std::memory_order_relaxed);
+        slot.events_dropped.store(counters.events_dropped, std::memory_order_relaxed);
+        slot.command_errors.store(counters.command_errors, std::memory_order_relaxed);
+        slot.descriptor_reads.store(counters.descriptor_reads, std::memory_order_relaxed);
+        slot.s2_tlb_hits.store(counters.s2_tlb_hits, std::memory_order_relaxed);
+        slot.s2_tlb_misses.store(counters.s2_tlb_misses, std::memory_order_relaxed);
+        slot.neighbour_fills.store(counters.neighbour_fills, std::memory_order_relaxed);
+        slot.contiguous_fills.store(counters.contiguous_fills, std::memory_order_relaxed);
+        slot.coalesced_fills.store(counters.coalesced_fills, std::memory_order_relaxed);
+        slot.batch_reuses.store(counters.batch_reuses, std::memory_order_relaxed);
+    }
+
+    if (header.flags & FLAG_ENABLED) {
+        enable();
+    } else {
+        disable();
+    }
+
+    if (info) {
+        info->streams = streams.size();
+        info->context_descriptors = contexts.size();
+        info->tlb_entries = tlb_entries.size();
+        info->s2_tlb_entries = s2_tlb_entries.size();
+        info->frames = frames.size();
+        info->file_bytes = file_bytes;
+    }
+    return SnapshotError::NONE;
+}
+
+} // namespace smmu
@@ -12,7 +12,106 @@ namespace smmu {
 
 TLB::TLB(size_t capacity) 
     : capacity_(capacity), timestamp_counter_(0), 
-      hit_count_(0), miss_count_(0) {}
+      hit_count_(0), miss_count_(0), use_counter_(0), resident_shifts_(0) {
+    size_counts_.fill(0);
+}
+
+// ============================================================================
+// 駐留頁面大小記錄
+// ============================================================================
+
+void TLB::account_insert(uint8_t page_shift) {
+    if (size_counts_[page_shift]++ == 0) {
+        resident_shifts_ |= (1ULL << page_shift);
+    }
+}
+
+void TLB::account_erase(uint8_t page_shift) {
+    if (--size_counts_[page_shift] == 0) {
+        resident_shifts_ &= ~(1ULL << page_shift);
+    }
+}
+
+// ============================================================================
+// 二級索引維護
+// ============================================================================
+
+// 把表項插入到各個索引分組的鏈表頭
+void TLB::link_indexes(TLBNode* node, const TLBKey& key) {
+    for (int kind = 0; kind < NUM_INDEXES; kind++) {
+        IndexGroup& group = indexes_[kind][index_key(key, static_cast<IndexKind>(kind))];
+        IndexLinks& links = node->links[kind];
+        links.prev = nullptr;
+        links.next = group.head;
+        if (group.head) {
+            group.head->links[kind].prev = node;
+        } else {
+            group.tail = node;
+        }
+        group.head = node;
+        group.count++;
+        if (kind == BY_STREAM) node->stream_group = &group;
+    }
+}
+
+// 把表項從各個索引分組的鏈表中摘除，分組變空時刪除分組
+void TLB::unlink_indexes(TLBNode* node, const TLBKey& key) {
+    for (int kind = 0; kind < NUM_INDEXES; kind++) {
+        auto group = indexes_[kind].find(index_key(key, static_cast<IndexKind>(kind)));
+        IndexLinks& links = node->links[kind];
+        if (links.next) {
+            links.next->links[kind].prev = links.prev;
+        } else {
+            group->second.tail = links.prev;
+        }
+        if (links.prev) {
+            links.prev->links[kind].next = links.next;
+        } else {
+            group->second.head = links.next;
+        }
+        if (--group->second.count == 0) {
+            indexes_[kind].erase(group);
+        }
+        links.prev = links.next = nullptr;
+    }
+}
+
+// 把表項移到全局 LRU 鏈表和所屬流分組的鏈表頭
+void TLB::touch(TLBNode& node) {
+    lru_list_.splice(lru_list_.begin(), lru_list_, node.lru_pos);
+    node.last_use = use_counter_++;
+    
+    IndexLinks& links = node.links[BY_STREAM];
+    if (!links.prev) return;  // 已經在鏈表頭
+    IndexGroup& group = *node.stream_group;
+    links.prev->links[BY_STREAM].next = links.next;
+    if (links.next) {
+        links.next->links[BY_STREAM].prev = links.prev;
+    } else {
+        group.tail = links.prev;
+    }
+    links.prev = nullptr;
+    links.next = group.head;
+    group.head->links[BY_STREAM].prev = &node;
+    group.head = &node;
+}
+
+// 沿某個分組的鏈表刪除滿足條件的表項
+// 代價與分組大小成正比，與 TLB 總表項數無關
+template <typename Pred>
+void TLB::invalidate_group(IndexKind kind, uint64_t group, Pred pred) {
+    auto bucket = indexes_[kind].find(group);
+    if (bucket == indexes_[kind].end()) return;
+    
+    TLBNode* node = bucket->second.head;
+    while (node) {
+        TLBNode* next = node->links[kind].next;  // 刪除前先取得下一個
+        if (pred(node->entry)) {
+            erase_entry(entries_.find(*node->lru_pos));
+        }
+        node = next;
+    }
+}
 
 // ============================================================================
 // 獲取頁面基地址
@@ -33,28 +132,32 @@ VirtualAddress TLB::get_page_base(VirtualAddress va, PageSize page_size) const {
 
 std::optional<TLBEntry> TLB::lookup(VirtualAddress va, StreamID stream_id,
                                      ASID asid, VMID vmid) {
-    // 嘗試不同的頁面大小（從大到小）
+    // 嘗試當前駐留的頁面大小（從大到小）
     // 因為一個虛擬地址可能被不同大小的頁面映射
-    for (auto page_size : {PageSize::SIZE_1GB, PageSize::SIZE_2MB, 
-                           PageSize::SIZE_64KB, PageSize::SIZE_4KB}) {
+    uint64_t shifts = resident_shifts_;
+    while (shifts) {
+        uint8_t shift = static_cast<uint8_t>(63 - __builtin_clzll(shifts));
+        shifts &= ~(1ULL << shift);
+        
         // 計算該頁面大小下的基地址
-        VirtualAddress va_base = get_page_base(va, page_size);
-        TLBKey key{va_base, stream_id, asid, vmid};
+        VirtualAddress va_base = va & ~((1ULL << shift) - 1);
+        TLBKey key{va_base, stream_id, asid, vmid, shift};
         
         // 在哈希表中查找
         auto it = entries_.find(key);
         if (it != entries_.end()) {
             // 找到了！更新 LRU 列表（移到最前面）
-            lru_list_.remove(key);
-            lru_list_.push_front(key);
+            touch(it->second);
             
             hit_count_++;  // 增加命中計數
-            return it->second;
+            it->second.partition->hits++;
+            return it->second.entry;
         }
     }
     
     // 未找到，增加未命中計數
     miss_count_++;
+    partitions_.record_miss(stream_id);
     return std::nullopt;
 }
 
@@ -66,37 +169,71 @@ std::optional<TLBEntry> TLB::lookup(VirtualAddress va, StreamID stream_id,
 void TLB::insert(const TLBEntry& entry) {
     // 計算頁面基地址作為鍵
     VirtualAddress va_base = get_page_base(entry.va, entry.page_size);
-    TLBKey key{va_base, entry.stream_id, entry.asid, entry.vmid};
+    uint8_t shift = static_cast<uint8_t>(
+        __builtin_ctzll(static_cast<uint64_t>(entry.page_size)));
+    TLBKey key{va_base, entry.stream_id, entry.asid, entry.vmid, shift};
     
     // 檢查表項是否已存在
     auto it = entries_.find(key);
     if (it != entries_.end()) {
         // 表項已存在，更新它並移到 LRU 列表前面
-        lru_list_.remove(key);
-    } else if (entries_.size() >= capacity_) {
-        // TLB 已滿，需要淘汰最舊的表項
-        evict_lru();
+        it->second.entry = entry;
+        it->second.entry.timestamp = timestamp_counter_++;
+        touch(it->second);
+        return;
+    }
+    
+    // TLB 已滿或流已達到上限時需要先淘汰一個表項
+    TLBStreamStats& owner = partitions_.get(entry.stream_id);
+    if (entries_.size() >= capacity_ || TLBPartitions::at_limit(owner)) {
+        evict(owner, entry.stream_id);
     }
     
     // 插入新表項
-    TLBEntry new_entry = entry;
-    new_entry.timestamp = timestamp_counter_++;  // 分配新時間戳
-    entries_[key] = new_entry;
-    lru_list_.push_front(key);  // 添加到 LRU 列表前面
+    TLBNode node;
+    node.entry = entry;
+    node.partition = &owner;
+    owner.entries++;
+    node.entry.timestamp = timestamp_counter_++;  // 分配新時間戳
+    node.last_use = use_counter_++;
+    lru_list_.push_front(key);                    // 添加到 LRU 列表前面
+    node.lru_pos = lru_list_.begin();
+    auto inserted = entries_.emplace(key, node).first;
+    link_indexes(&inserted->second, key);
+    account_insert(shift);
 }
 
 // ============================================================================
-// 淘汰 LRU 表項
-// 移除最近最少使用的表項（LRU 列表末尾）
+// 淘汰表項
+// 默認淘汰 LRU 列表末尾（最舊的表項）；有配額時從流分組的鏈表尾選擇：
+// 達到上限的流淘汰自己的鏈表尾，全局最舊的表項受保護時淘汰
+// 未受保護的流中最久未使用的鏈表尾，都受保護時退化為 LRU 列表末尾
 // ============================================================================
 
-void TLB::evict_lru() {
+void TLB::evict(const TLBStreamStats& owner, StreamID owner_id) {
     if (lru_list_.empty()) return;
     
-    // 獲取 LRU 列表末尾的鍵（最舊的表項）
-    TLBKey lru_key = lru_list_.back();
-    lru_list_.pop_back();
-    entries_.erase(lru_key);  // 從哈希表中刪除
+    auto it = entries_.find(lru_list_.back());
+    if (partitions_.active()) {
+        TLBNode* victim = nullptr;
+        if (TLBPartitions::at_limit(owner)) {
+            victim = indexes_[BY_STREAM].find(owner_id)->second.tail;
+        } else if (TLBPartitions::is_protected(*it->second.partition)) {
+            for (const auto& group : indexes_[BY_STREAM]) {
+                TLBNode* tail = group.second.tail;
+                if (!TLBPartitions::is_protected(*tail->partition) &&
+                    (!victim || tail->last_use < victim->last_use)) {
+                    victim = tail;
+                }
+            }
+        }
+        if (victim) it = entries_.find(*victim->lru_pos);
+    }
+    
+    // 同時從 LRU 列表、索引和哈希表中刪除
+    it->second.partition->evictions++;
+    notify_eviction(it->second.entry);
+    erase_entry(it);
 }
 
 // ============================================================================
@@ -108,54 +245,77 @@ void TLB::evict_lru() {
 void TLB::invalidate_all() {
     entries_.clear();
     lru_list_.clear();
+    for (auto& index : indexes_) index.clear();
+    size_counts_.fill(0);
+    resident_shifts_ = 0;
+    partitions_.clear_entries();
 }
 
 // 按 ASID 使 TLB 表項無效
 // 用於地址空間切換時清除舊地址空間的緩存
 void TLB::invalidate_by_asid(ASID asid) {
-    auto it = entries_.begin();
-    while (it != entries_.end()) {
-        if (it->second.asid == asid) {
-            lru_list_.remove(it->first);  // 從 LRU 列表移除
-            it = entries_.erase(it);      // 從哈希表移除
-        } else {
-            ++it;
-        }
-    }
+    invalidate_group(BY_ASID, asid, [](const TLBEntry&) { return true; });
 }
 
 // 按 VMID 使 TLB 表項無效
 // 用於虛擬機切換時清除舊虛擬機的緩存
 void TLB::invalidate_by_vmid(VMID vmid) {
-    auto it = entries_.begin();
-    while (it != entries_.end()) {
-        if (it->second.vmid == vmid) {
-            lru_list_.remove(it->first);
-            it = entries_.erase(it);
-        } else {
-            ++it;
-        }
-    }
+    invalidate_group(BY_VMID, vmid, [](const TLBEntry&) { return true; });
 }
 
 // 按虛擬地址使 TLB 表項無效
 // 用於頁表更新後清除特定地址的緩存
+// 每種駐留的頁面大小查找一個頁面分組，只檢查映射同一頁面的表項
 void TLB::invalidate_by_va(VirtualAddress va, ASID asid) {
-    // 嘗試所有頁面大小，因為不知道該地址使用哪種頁面大小
-    for (auto page_size : {PageSize::SIZE_1GB, PageSize::SIZE_2MB,
-                           PageSize::SIZE_64KB, PageSize::SIZE_4KB}) {
-        VirtualAddress va_base = get_page_base(va, page_size);
+    uint64_t shifts = resident_shifts_;
+    while (shifts) {
+        uint8_t shift = static_cast<uint8_t>(__builtin_ctzll(shifts));
+        shifts &= shifts - 1;
         
-        auto it = entries_.begin();
-        while (it != entries_.end()) {
-            // 檢查 ASID 和頁面基地址是否匹配
-            if (it->second.asid == asid && 
-                get_page_base(it->second.va, it->second.page_size) == va_base) {
-                lru_list_.remove(it->first);
-                it = entries_.erase(it);
-            } else {
-                ++it;
-            }
+        VirtualAddress va_base = va & ~((1ULL << shift) - 1);
+        invalidate_group(BY_PAGE, va_base | shift,
+                         [asid](const TLBEntry& cached) { return cached.asid == asid; });
+    }
+}
+
+// 按虛擬地址範圍使 TLB 表項無效
+// 用於批量解除映射：一條範圍命令代替逐頁的 TLBI
+// 逐頁探測頁面分組與遍歷該 ASID 的分組之間選擇代價較小的一種，
+// 因此代價不超過 min(範圍內的頁數, 該 ASID 的表項數)
+void TLB::invalidate_by_va_range(VirtualAddress start, uint64_t size,
+                                 ASID asid, uint8_t ttl_level) {
+    if (size == 0) return;
+    auto asid_group = indexes_[BY_ASID].find(asid);
+    if (asid_group == indexes_[BY_ASID].end()) return;
+    
+    VirtualAddress last = (start + size - 1 < start) ? ~0ULL : start + size - 1;  // 包含端點，防止溢出
+    auto overlaps = [asid, ttl_level, start, last](const TLBEntry& cached) {
+        uint64_t page_mask = static_cast<uint64_t>(cached.page_size) - 1;
+        return cached.asid == asid &&
+               (ttl_level == 0 || cached.level == ttl_level) &&
+               cached.va <= last && (cached.va | page_mask) >= start;
+    };
+    
+    // 估算逐頁探測的次數（每種駐留頁面大小在範圍內的頁數之和）
+    uint64_t probes = 0;
+    uint64_t shifts = resident_shifts_;
+    while (shifts && probes <= asid_group->second.count) {
+        uint8_t shift = static_cast<uint8_t>(__builtin_ctzll(shifts));
+        shifts &= shifts - 1;
+        probes += (last >> shift) - (start >> shift) + 1;
+    }
+    
+    if (probes > asid_group->second.count) {
+        invalidate_group(BY_ASID, asid, overlaps);
+        return;
+    }
+    
+    shifts = resident_shifts_;
+    while (shifts) {
+        uint8_t shift = static_cast<uint8_t>(__builtin_ctzll(shifts));
+        shifts &= shifts - 1;
+        for (uint64_t page = start >> shift; page <= (last >> shift); page++) {
+            invalidate_group(BY_PAGE, (page << shift) | shift, overlaps);
         }
     }
 }
@@ -163,14 +323,18 @@ void TLB::invalidate_by_va(VirtualAddress va, ASID asid) {
 // 按流ID使 TLB 表項無效
 // 用於設備配置更改時清除該設備的所有緩存
 void TLB::invalidate_by_stream(StreamID stream_id) {
-    auto it = entries_.begin();
-    while (it != entries_.end()) {
-        if (it->second.stream_id == stream_id) {
-            lru_list_.remove(it->first);
-            it = entries_.erase(it);
-        } else {
-            ++it;
-        }
+    invalidate_group(BY_STREAM, stream_id, [](const TLBEntry&) { return true; });
+}
+
+// ============================================================================
+// 表項導出
+// 從 LRU 鏈表末尾（最久未使用）向前遍歷
+// ============================================================================
+
+void TLB::export_entries(std::vector<TLBEntry>& out) const {
+    out.reserve(out.size() + entries_.size());
+    for (auto it = lru_list_.rbegin(); it != lru_list_.rend(); ++it) {
+        out.push_back(entries_.find(*it)->second.entry);
     }
 }
 
@@ -8,7 +8,9 @@
 #include <systemc>
 #include <tlm>
 #include <tlm_utils/simple_initiator_socket.h>
+#include <tlm_utils/tlm_quantumkeeper.h>
 #include "tlm_types.h"
+#include <functional>
 #include <queue>
 
 namespace smmu_tlm {
@@ -44,6 +46,10 @@ public:
         , qos_config_(qos_config)
         , enabled_(true)
     {
+        // 註冊下游撤銷 DMI 的回調
+        initiator_socket.register_invalidate_direct_mem_ptr(
+            this, &SMMUTLMInitiator::invalidate_direct_mem_ptr);
+        
         SC_THREAD(process_thread);
     }
     
@@ -85,14 +91,13 @@ public:
         }
         
         // 發送事務
+        sc_core::sc_time start = delay;
         initiator_socket->b_transport(trans, delay);
         
         // 更新統計
         stats_.total_transactions++;
         stats_.read_transactions++;
-        if (port_type_ == OutputPortType::PTW_PORT) {
-            stats_.ptw_transactions++;
-        }
+        record_latency(delay - start);
         
         return trans.get_response_status();
     }
@@ -131,18 +136,39 @@ public:
         }
         
         // 發送事務
+        sc_core::sc_time start = delay;
         initiator_socket->b_transport(trans, delay);
         
         // 更新統計
         stats_.total_transactions++;
         stats_.write_transactions++;
-        if (port_type_ == OutputPortType::PTW_PORT) {
-            stats_.ptw_transactions++;
-        }
+        record_latency(delay - start);
         
         return trans.get_response_status();
     }
     
+    // ========================================================================
+    // DMI
+    // ========================================================================
+    
+    // 向下游請求包含 address（物理地址）的 DMI 區域
+    bool get_direct_mem_ptr(uint64_t address, tlm::tlm_command command,
+                            tlm::tlm_dmi& dmi_data) {
+        if (!enabled_) return false;
+        
+        tlm::tlm_generic_payload trans;
+        trans.set_command(command);
+        trans.set_address(address);
+        return initiator_socket->get_direct_mem_ptr(trans, dmi_data);
+    }
+    
+    // 設置下游撤銷 DMI 區域時的回調（參數為物理地址範圍，包含兩端）
+    using DMIInvalidateCallback = std::function<void(uint64_t start, uint64_t end)>;
+    
+    void set_dmi_invalidate_callback(DMIInvalidateCallback callback) {
+        dmi_invalidate_callback_ = callback;
+    }
+    
     // ========================================================================
     // 配置和控制
     // ========================================================================
@@ -201,15 +227,33 @@ public:
     }
 
 private:
+    // 下游撤銷 DMI 區域
+    void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end) {
+        if (dmi_invalidate_callback_) dmi_invalidate_callback_(start, end);
+    }
+    
+    // 記錄一個事務的延遲（PTW 端口同時計入 PTW 統計）
+    void record_latency(const sc_core::sc_time& latency) {
+        uint64_t ns = latency.value() / sc_core::sc_time(1, sc_core::SC_NS).value();
+        stats_.total_latency_cycles += ns;
+        if (port_type_ == OutputPortType::PTW_PORT) {
+            stats_.ptw_transactions++;
+            stats_.ptw_latency_cycles += ns;
+        }
+    }
+    
     // ========================================================================
     // 處理線程
-    // 處理排隊的事務
+    // 處理排隊的事務：延遲累加到量子保持器的本地時間，只在超過全局量子
+    // 或隊列變空時才 wait()，而不是每個事務同步一次
     // ========================================================================
     
     void process_thread() {
+        quantum_keeper_.reset();  // 按模擬開始時的全局量子計算同步點
         while (true) {
-            // 等待事務到達
+            // 等待事務到達（空閒前把本地時間同步到模擬時間）
             if (transaction_queue_.empty()) {
+                quantum_keeper_.sync();
                 wait(queue_event_);
             }
             
@@ -219,7 +263,7 @@ private:
                 transaction_queue_.pop();
                 
                 if (trans && enabled_) {
-                    sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+                    sc_core::sc_time delay = quantum_keeper_.get_local_time();
                     
                     // 根據 QoS 優先級添加延遲
                     if (qos_config_.priority < 15) {
@@ -230,8 +274,9 @@ private:
                     // 發送事務
                     initiator_socket->b_transport(*trans, delay);
                     
-                    // 等待延遲
-                    wait(delay);
+                    // 超過量子時同步
+                    quantum_keeper_.set(delay);
+                    if (quantum_keeper_.need_sync()) quantum_keeper_.sync();
                 }
                 
                 // 清理事務
@@ -250,10 +295,12 @@ private:
     QoSConfig qos_config_;                // QoS 配置
     bool enabled_;                        // 是否啟用
     TLMStatistics stats_;                 // 統計信息
+    DMIInvalidateCallback dmi_invalidate_callback_; // DMI 撤銷回調
     
     // 事務隊列（用於非阻塞模式）
     std::queue<tlm::tlm_generic_payload*> transaction_queue_;
     sc_core::sc_event queue_event_;       // 隊列事件
+    tlm_utils::tlm_quantumkeeper quantum_keeper_; // 排隊事務的本地時間
 };
 
 } // namespace smmu_tlm
@@ -7,9 +7,13 @@
 #include <systemc>
 #include <tlm>
 #include <tlm_utils/simple_target_socket.h>
+#include <tlm_utils/peq_with_get.h>
 #include "tlm_types.h"
 #include "smmu.h"
+#include <algorithm>
+#include <deque>
 #include <queue>
+#include <vector>
 #include <functional>
 
 namespace smmu_tlm {
@@ -17,6 +21,19 @@ namespace smmu_tlm {
 // ============================================================================
 // SMMU TLM Target Port
 // 每個輸入端口對應一個或多個設備
+//
+// 支持兩種時序風格：
+//   b_transport（LT）：同步轉換，延遲加到 delay 上返回
+//   nb_transport_fw/bw（AT）：四階段基本協議，最多 max_outstanding 個轉換同時在途，
+//     滿時推遲 END_REQ 形成反壓；轉換按完成時間亂序響應（命中可以越過未命中）
+// 延遲模型：translation_latency + 頁表遍歷時間；遍歷時間由 WalkTimeCallback 提供
+//   （描述符讀取經過 PTW 端口時），否則按描述符讀取次數 × ptw_read_latency 估算
+// AT 模式下用 MSHR 記錄在途的頁表遍歷：落在同一頁面的後續事務合併到該遍歷，
+//   與它同時完成，而不是按 TLB 命中計時
+// DMI：為轉換成功的頁面向下游（數據端口）請求 DMI 區域，按轉換重映射到 VA 後授予；
+//   SMMU 發出轉換失效通知（TLBI/CFGI、TLB 淘汰、啟用狀態改變）或下游撤銷時
+//   通過 invalidate_direct_mem_ptr 撤銷。DMI 區域只按地址區分，同一端口上
+//   授予新上下文（StreamID/ASID/VMID）的區域前先撤銷其他上下文的區域
 // ============================================================================
 
 class SMMUTLMTarget : public sc_core::sc_module {
@@ -35,17 +52,27 @@ public:
         , port_id_(port_id)
         , config_(config)
         , translation_callback_(nullptr)
+        , walk_time_callback_(nullptr)
+        , dmi_forward_callback_(nullptr)
+        , completion_peq_("completion_peq")
+        , outstanding_(0)
+        , blocked_request_(nullptr)
+        , blocked_time_(sc_core::SC_ZERO_TIME)
+        , response_in_progress_(nullptr)
     {
         // 註冊 TLM blocking transport 回調
         target_socket.register_b_transport(this, &SMMUTLMTarget::b_transport);
         
+        // 註冊 TLM non-blocking transport 回調（AT 模式）
+        target_socket.register_nb_transport_fw(this, &SMMUTLMTarget::nb_transport_fw);
+        
         // 註冊 TLM debug transport 回調
         target_socket.register_transport_dbg(this, &SMMUTLMTarget::transport_dbg);
         
         // 註冊 DMI 回調
         target_socket.register_get_direct_mem_ptr(this, &SMMUTLMTarget::get_direct_mem_ptr);
         
-        SC_THREAD(process_thread);
+        SC_THREAD(response_thread);
     }
     
     // 設置地址轉換回調函數
@@ -56,16 +83,83 @@ public:
         translation_callback_ = callback;
     }
     
+    // 設置頁表遍歷時間回調：返回最近一次轉換在 PTW 端口上花費的時間
+    // 設置後未命中的延遲使用該時間，而不是按描述符讀取次數估算
+    using WalkTimeCallback = std::function<sc_core::sc_time()>;
+    
+    void set_walk_time_callback(WalkTimeCallback callback) {
+        walk_time_callback_ = callback;
+    }
+    
+    // 設置 DMI 轉發回調：向下游請求包含指定物理地址的 DMI 區域
+    using DMIForwardCallback = std::function<bool(
+        smmu::PhysicalAddress, tlm::tlm_command, tlm::tlm_dmi&)>;
+    
+    void set_dmi_forward_callback(DMIForwardCallback callback) {
+        dmi_forward_callback_ = callback;
+    }
+    
+    // SMMU 轉換失效：撤銷受影響的 DMI 區域
+    void invalidate_translation(const smmu::TranslationInvalidation& notice) {
+        revoke_dmi_if([&notice](const DMIGrant& grant) {
+            return grant_affected(notice, grant);
+        });
+    }
+    
+    // 下游撤銷物理地址範圍 [start, end]：撤銷與之重疊的 DMI 區域
+    void invalidate_physical_range(uint64_t start, uint64_t end) {
+        revoke_dmi_if([start, end](const DMIGrant& grant) {
+            return grant.pa_start <= end && grant.pa_end >= start;
+        });
+    }
+    
+    // 當前有效的 DMI 區域數
+    size_t dmi_grant_count() const {
+        return dmi_grants_.size();
+    }
+    
+    // 當前在途的 AT 事務數
+    size_t outstanding() const {
+        return outstanding_;
+    }
+    
     // 獲取統計信息
     const TLMStatistics& get_statistics() const {
         return stats_;
     }
     
+    // 轉換延遲分佈（納秒）
+    smmu::LatencyHistogram::Snapshot get_latency_histogram() const {
+        return latency_histogram_.snapshot();
+    }
+    
     void reset_statistics() {
         stats_.reset();
+        latency_histogram_.reset();
     }
 
 private:
+    // 在途的頁表遍歷（MSHR）
+    struct MissEntry {
+        smmu::StreamID stream_id;
+        smmu::ASID asid;
+        smmu::VMID vmid;
+        smmu::VirtualAddress va_base;   // 頁面起始地址
+        uint64_t page_mask;             // 頁內偏移掩碼
+        sc_core::sc_time ready;         // 遍歷完成時間
+    };
+    
+    // 已授予的 DMI 區域（地址範圍包含兩端）
+    struct DMIGrant {
+        smmu::StreamID stream_id;
+        smmu::ASID asid;
+        smmu::VMID vmid;
+        smmu::VirtualAddress va_start;
+        smmu::VirtualAddress va_end;
+        smmu::PhysicalAddress pa_start;
+        smmu::PhysicalAddress pa_end;
+    };
+    
     // ========================================================================
     // TLM Blocking Transport
     // 處理來自設備的事務
@@ -73,10 +167,62 @@ private:
     
     virtual void b_transport(tlm::tlm_generic_payload& trans, 
                             sc_core::sc_time& delay) {
+        delay += translate_payload(trans, sc_core::sc_time_stamp() + delay, false);
+    }
+    
+    // ========================================================================
+    // TLM Non-blocking Transport（前向路徑）
+    // BEGIN_REQ：有空閒位置時立即以 END_REQ 接受，否則保留到有轉換完成
+    // END_RESP：響應握手結束，可以發送下一個響應
+    // ========================================================================
+    
+    virtual tlm::tlm_sync_enum nb_transport_fw(tlm::tlm_generic_payload& trans,
+                                               tlm::tlm_phase& phase,
+                                               sc_core::sc_time& delay) {
+        if (phase == tlm::BEGIN_REQ) {
+            if (trans.has_mm()) trans.acquire();
+            
+            if (outstanding_ >= config_.max_outstanding) {
+                // 在途轉換已滿：不返回 END_REQ，initiator 在此之前不能發送新請求
+                blocked_request_ = &trans;
+                blocked_time_ = sc_core::sc_time_stamp() + delay;
+                return tlm::TLM_ACCEPTED;
+            }
+            
+            accept_request(trans, delay);
+            phase = tlm::END_REQ;
+            return tlm::TLM_UPDATED;
+        }
+        
+        if (phase == tlm::END_RESP) {
+            if (response_in_progress_ == &trans) {
+                release(trans);
+                response_in_progress_ = nullptr;
+                end_resp_event_.notify(delay);
+            }
+            return tlm::TLM_COMPLETED;
+        }
+        
+        SC_REPORT_ERROR("SMMU_TLM_TARGET", "Illegal phase on nb_transport_fw");
+        return tlm::TLM_COMPLETED;
+    }
+    
+    // ========================================================================
+    // 地址轉換和延遲計算（LT 和 AT 共用）
+    // start: 事務開始時間（包含 initiator 的時間註釋）
+    // track_misses: 是否使用 MSHR 合併同一頁面的在途未命中（AT 模式）
+    // 返回轉換延遲
+    // ========================================================================
+    
+    sc_core::sc_time translate_payload(tlm::tlm_generic_payload& trans,
+                                       const sc_core::sc_time& start,
+                                       bool track_misses) {
+        sc_core::sc_time latency = config_.translation_latency;
+        
         // 檢查端口是否啟用
         if (!config_.enabled) {
             trans.set_response_status(tlm::TLM_GENERIC_ERROR_RESPONSE);
-            return;
+            return latency;
         }
         
         // 獲取 AXI 擴展
@@ -84,12 +230,9 @@ private:
         if (!axi_ext) {
             SC_REPORT_ERROR("SMMU_TLM_TARGET", "Missing AXI extension");
             trans.set_response_status(tlm::TLM_GENERIC_ERROR_RESPONSE);
-            return;
+            return latency;
         }
         
-        // 記錄事務開始時間
-        sc_core::sc_time start_time = sc_core::sc_time_stamp();
-        
         // 執行地址轉換
         smmu::VirtualAddress va = trans.get_address();
         smmu::TranslationResult result;
@@ -103,21 +246,47 @@ private:
             result.physical_addr = va;
         }
         
+        // 計算延遲：合併到在途遍歷的事務與該遍歷同時完成，
+        // 否則頁表遍歷的每次描述符讀取都經過 PTW 端口
+        const MissEntry* miss = nullptr;
+        if (track_misses) {
+            retire_misses(start);
+            miss = find_miss(va, axi_ext->stream_id, axi_ext->asid, axi_ext->vmid);
+        }
+        
+        if (miss) {
+            stats_.mshr_merges++;
+            if (miss->ready > start + latency) latency = miss->ready - start;
+        } else if (result.descriptor_reads > 0) {
+            stats_.page_walks++;
+            latency += walk_time_callback_
+                ? walk_time_callback_()
+                : config_.ptw_read_latency * static_cast<double>(result.descriptor_reads);
+            if (track_misses && result.success) {
+                MissEntry entry;
+                entry.stream_id = axi_ext->stream_id;
+                entry.asid = axi_ext->asid;
+                entry.vmid = axi_ext->vmid;
+                entry.page_mask = static_cast<uint64_t>(result.page_size) - 1;
+                entry.va_base = va & ~entry.page_mask;
+                entry.ready = start + latency;
+                misses_.push_back(entry);
+            }
+        }
+        
         // 處理轉換結果
         if (result.success) {
-            // 轉換成功，更新物理地址
+            // 轉換成功，更新物理地址；提示 initiator 可以請求 DMI
             trans.set_address(result.physical_addr);
             trans.set_response_status(tlm::TLM_OK_RESPONSE);
-            
-            // 添加轉換延遲（模擬 SMMU 處理時間）
-            delay += sc_core::sc_time(10, sc_core::SC_NS);
+            trans.set_dmi_allowed(config_.dmi_enabled && dmi_forward_callback_ != nullptr);
         } else {
             // 轉換失敗
             trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
             stats_.translation_errors++;
             
             SC_REPORT_WARNING("SMMU_TLM_TARGET", 
-                            ("Translation failed: " + result.fault_reason).c_str());
+                            (std::string("Translation failed: ") + result.fault_reason).c_str());
         }
         
         // 更新統計信息
@@ -127,11 +296,107 @@ private:
         } else {
             stats_.write_transactions++;
         }
+        uint64_t latency_ns = latency.value() / sc_core::sc_time(1, sc_core::SC_NS).value();
+        stats_.total_latency_cycles += latency_ns;
+        latency_histogram_.record(latency_ns);
+        
+        return latency;
+    }
+    
+    // ========================================================================
+    // MSHR 管理
+    // ========================================================================
+    
+    // 刪除在 now 之前已完成的遍歷
+    void retire_misses(const sc_core::sc_time& now) {
+        misses_.erase(std::remove_if(misses_.begin(), misses_.end(),
+                                     [&now](const MissEntry& entry) {
+                                         return entry.ready <= now;
+                                     }),
+                      misses_.end());
+    }
+    
+    // 查找覆蓋 va 的在途遍歷
+    const MissEntry* find_miss(smmu::VirtualAddress va, smmu::StreamID stream_id,
+                               smmu::ASID asid, smmu::VMID vmid) const {
+        for (const auto& entry : misses_) {
+            if (entry.stream_id == stream_id && entry.asid == asid &&
+                entry.vmid == vmid && (va & ~entry.page_mask) == entry.va_base) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+    
+    // ========================================================================
+    // AT 請求和響應處理
+    // ========================================================================
+    
+    // 接受請求：佔用一個在途位置，轉換完成時放入響應隊列
+    void accept_request(tlm::tlm_generic_payload& trans, const sc_core::sc_time& delay) {
+        outstanding_++;
+        if (outstanding_ > stats_.peak_outstanding) {
+            stats_.peak_outstanding = outstanding_;
+        }
         
-        // 計算延遲
-        sc_core::sc_time end_time = sc_core::sc_time_stamp() + delay;
-        sc_core::sc_time latency = end_time - start_time;
-        stats_.total_latency_cycles += latency.value() / sc_core::sc_time(1, sc_core::SC_NS).value();
+        sc_core::sc_time latency = translate_payload(trans, sc_core::sc_time_stamp() + delay, true);
+        completion_peq_.notify(trans, delay + latency);
+    }
+    
+    // 響應開始時釋放在途位置；有被阻塞的請求時補發 END_REQ 並接受它
+    void retire_request() {
+        outstanding_--;
+        if (blocked_request_) {
+            tlm::tlm_generic_payload* trans = blocked_request_;
+            sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+            tlm::tlm_phase phase = tlm::END_REQ;
+            blocked_request_ = nullptr;
+            target_socket->nb_transport_bw(*trans, phase, delay);
+            
+            // 請求的有效開始時間可能還在將來（時間註釋）
+            sc_core::sc_time now = sc_core::sc_time_stamp();
+            accept_request(*trans, blocked_time_ > now ? blocked_time_ - now : sc_core::SC_ZERO_TIME);
+        }
+    }
+    
+    void release(tlm::tlm_generic_payload& trans) {
+        if (trans.has_mm()) trans.release();
+    }
+    
+    // ========================================================================
+    // 響應線程
+    // 按完成順序發送 BEGIN_RESP；同一時間只有一個響應在握手中（響應排他規則）
+    // ========================================================================
+    
+    void response_thread() {
+        while (true) {
+            wait(completion_peq_.get_event() | end_resp_event_);
+            
+            while (true) {
+                while (tlm::tlm_generic_payload* trans = completion_peq_.get_next_transaction()) {
+                    completed_.push_back(trans);
+                }
+                if (response_in_progress_ || completed_.empty()) break;
+                
+                tlm::tlm_generic_payload* trans = completed_.front();
+                completed_.pop_front();
+                retire_request();
+                
+                tlm::tlm_phase phase = tlm::BEGIN_RESP;
+                sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+                tlm::tlm_sync_enum status = target_socket->nb_transport_bw(*trans, phase, delay);
+                
+                if (status == tlm::TLM_ACCEPTED) {
+                    // 等待 initiator 的 END_RESP
+                    response_in_progress_ = trans;
+                    break;
+                }
+                
+                // TLM_UPDATED（END_RESP）或 TLM_COMPLETED：響應已完成
+                release(*trans);
+                if (delay > sc_core::SC_ZERO_TIME) wait(delay);
+            }
+        }
     }
     
     // ========================================================================
@@ -146,24 +411,120 @@ private:
     
     // ========================================================================
     // DMI（Direct Memory Interface）
-    // 本實現不支持 DMI
+    // 授予的區域是轉換所在頁面與下游 DMI 區域的交集，
+    // 權限為描述符權限與下游權限的交集，延遲加上 TLB 命中的轉換延遲
     // ========================================================================
     
     virtual bool get_direct_mem_ptr(tlm::tlm_generic_payload& trans,
                                    tlm::tlm_dmi& dmi_data) {
-        // SMMU 不支持 DMI（因為需要動態地址轉換）
-        return false;
+        if (!config_.enabled || !config_.dmi_enabled ||
+            !translation_callback_ || !dmi_forward_callback_) {
+            return false;
+        }
+        
+        AXIExtension* axi_ext = get_axi_extension(trans);
+        if (!axi_ext) return false;
+        
+        smmu::VirtualAddress va = trans.get_address();
+        smmu::TranslationResult result = translation_callback_(
+            va, axi_ext->stream_id, axi_ext->asid, axi_ext->vmid);
+        if (!result.success) return false;
+        
+        uint64_t page_mask = static_cast<uint64_t>(result.page_size) - 1;
+        smmu::VirtualAddress va_base = va & ~page_mask;
+        smmu::PhysicalAddress pa_base = result.physical_addr & ~page_mask;
+        
+        tlm::tlm_dmi downstream;
+        if (!dmi_forward_callback_(result.physical_addr, trans.get_command(), downstream)) {
+            return false;
+        }
+        
+        // 頁面與下游區域的交集
+        smmu::PhysicalAddress pa_start = std::max<uint64_t>(pa_base, downstream.get_start_address());
+        smmu::PhysicalAddress pa_end = std::min<uint64_t>(pa_base + page_mask, downstream.get_end_address());
+        if (pa_start > pa_end) return false;
+        
+        // 權限交集
+        bool readable = downstream.is_read_allowed() &&
+                        (result.permission == smmu::AccessPermission::READ_ONLY ||
+                         result.permission == smmu::AccessPermission::READ_WRITE);
+        bool writable = downstream.is_write_allowed() &&
+                        (result.permission == smmu::AccessPermission::WRITE_ONLY ||
+                         result.permission == smmu::AccessPermission::READ_WRITE);
+        if (!readable && !writable) return false;
+        
+        // 同一端口上的 DMI 區域只按地址區分：切換上下文時撤銷舊區域
+        if (!dmi_grants_.empty()) {
+            const DMIGrant& current = dmi_grants_.front();
+            if (current.stream_id != axi_ext->stream_id || current.asid != axi_ext->asid ||
+                current.vmid != axi_ext->vmid) {
+                revoke_dmi_if([](const DMIGrant&) { return true; });
+            }
+        }
+        
+        DMIGrant grant;
+        grant.stream_id = axi_ext->stream_id;
+        grant.asid = axi_ext->asid;
+        grant.vmid = axi_ext->vmid;
+        grant.va_start = va_base + (pa_start - pa_base);
+        grant.va_end = va_base + (pa_end - pa_base);
+        grant.pa_start = pa_start;
+        grant.pa_end = pa_end;
+        bool known = std::any_of(dmi_grants_.begin(), dmi_grants_.end(),
+                                 [&grant](const DMIGrant& other) {
+                                     return other.va_start == grant.va_start &&
+                                            other.va_end == grant.va_end;
+                                 });
+        if (!known) dmi_grants_.push_back(grant);
+        stats_.dmi_grants++;
+        
+        dmi_data.set_dmi_ptr(downstream.get_dmi_ptr() + (pa_start - downstream.get_start_address()));
+        dmi_data.set_start_address(grant.va_start);
+        dmi_data.set_end_address(grant.va_end);
+        if (readable && writable) {
+            dmi_data.allow_read_write();
+        } else if (readable) {
+            dmi_data.allow_read();
+        } else {
+            dmi_data.allow_write();
+        }
+        dmi_data.set_read_latency(downstream.get_read_latency() + config_.translation_latency);
+        dmi_data.set_write_latency(downstream.get_write_latency() + config_.translation_latency);
+        return true;
     }
     
-    // ========================================================================
-    // 處理線程
-    // 用於異步處理和事件生成
-    // ========================================================================
+    // 失效通知是否影響該區域
+    static bool grant_affected(const smmu::TranslationInvalidation& notice,
+                               const DMIGrant& grant) {
+        using Scope = smmu::TranslationInvalidation::Scope;
+        uint64_t last = notice.size == 0 ? notice.va
+                      : (notice.va + notice.size - 1 < notice.va ? ~0ULL
+                                                                 : notice.va + notice.size - 1);
+        bool overlaps = grant.va_start <= last && grant.va_end >= notice.va;
+        switch (notice.scope) {
+            case Scope::ALL:      return true;
+            case Scope::ASID:     return grant.asid == notice.asid;
+            case Scope::VMID:     return grant.vmid == notice.vmid;
+            case Scope::STREAM:   return grant.stream_id == notice.stream_id;
+            case Scope::VA_RANGE: return grant.asid == notice.asid && overlaps;
+            case Scope::ENTRY:
+                return grant.stream_id == notice.stream_id && grant.asid == notice.asid &&
+                       grant.vmid == notice.vmid && overlaps;
+        }
+        return true;
+    }
     
-    void process_thread() {
-        while (true) {
-            wait(sc_core::sc_time(1, sc_core::SC_US));
-            // 可以在這裡處理異步事件
+    // 撤銷滿足條件的 DMI 區域
+    // 先從列表中刪除再通知 initiator，initiator 在回調中重新請求 DMI 也是安全的
+    template <typename Pred>
+    void revoke_dmi_if(Pred pred) {
+        auto first = std::stable_partition(dmi_grants_.begin(), dmi_grants_.end(),
+                                           [&pred](const DMIGrant& grant) { return !pred(grant); });
+        std::vector<DMIGrant> revoked(first, dmi_grants_.end());
+        dmi_grants_.erase(first, dmi_grants_.end());
+        for (const auto& grant : revoked) {
+            stats_.dmi_invalidations++;
+            target_socket->invalidate_direct_mem_ptr(grant.va_start, grant.va_end);
         }
     }
     
@@ -174,7 +535,22 @@ private:
     uint32_t port_id_;                    // 端口ID
     TLMPortConfig config_;                // 端口配置
     TranslationCallback translation_callback_; // 地址轉換回調
+    WalkTimeCallback walk_time_callback_; // 頁表遍歷時間回調
+    DMIForwardCallback dmi_forward_callback_; // DMI 轉發回調
     TLMStatistics stats_;                 // 統計信息
+    smmu::LatencyHistogram latency_histogram_{false}; // 轉換延遲分佈（只在模擬線程中記錄）
+    
+    // AT 模式狀態
+    tlm_utils::peq_with_get<tlm::tlm_generic_payload> completion_peq_; // 按完成時間排序的事務
+    std::deque<tlm::tlm_generic_payload*> completed_;  // 已完成、等待發送響應的事務
+    std::vector<MissEntry> misses_;                    // 在途的頁表遍歷（MSHR）
+    size_t outstanding_;                               // 已接受、尚未響應的事務數
+    tlm::tlm_generic_payload* blocked_request_;        // 因在途已滿而未接受的請求
+    sc_core::sc_time blocked_time_;                    // 該請求的開始時間
+    tlm::tlm_generic_payload* response_in_progress_;   // 等待 END_RESP 的響應
+    sc_core::sc_event end_resp_event_;                 // 響應握手結束
+    
+    std::vector<DMIGrant> dmi_grants_;                 // 已授予的 DMI 區域
 };
 
 } // namespace smmu_tlm
@@ -11,6 +11,7 @@
 #include "smmu_tlm_target.h"
 #include "smmu_tlm_initiator.h"
 #include "tlm_types.h"
+#include <algorithm>
 #include <vector>
 #include <memory>
 
@@ -52,6 +53,11 @@ public:
         // 初始化 SMMU
         smmu_->set_memory_model(memory_);
         
+        // 設置全局量子（在創建端口之前，端口的量子保持器按它計算同步點）
+        if (tlm_config_.global_quantum > sc_core::SC_ZERO_TIME) {
+            tlm::tlm_global_quantum::instance().set(tlm_config_.global_quantum);
+        }
+        
         // 創建輸入端口
         create_input_ports();
         
@@ -61,9 +67,15 @@ public:
         // 設置內存讀取回調（用於 PTW）
         setup_memory_callback();
         
+        // 設置 DMI 轉發和撤銷
+        setup_dmi();
+        
         // 註冊 SystemC 線程
+        // 處理線程由 work_event_ 喚醒；統計線程只在配置了輸出週期時創建
         SC_THREAD(smmu_process_thread);
-        SC_THREAD(statistics_thread);
+        if (tlm_config_.statistics_interval > sc_core::SC_ZERO_TIME) {
+            SC_THREAD(statistics_thread);
+        }
     }
     
     // ========================================================================
@@ -83,6 +95,13 @@ public:
         smmu_->configure_context_descriptor(stream_id, asid, cd);
     }
     
+    // 提交命令（喚醒 SMMU 處理線程，在下一個 delta 週期執行）
+    bool submit_command(const smmu::Command& cmd) {
+        bool accepted = smmu_->submit_command(cmd);
+        work_event_.notify(sc_core::SC_ZERO_TIME);
+        return accepted;
+    }
+    
     // 啟用/禁用 SMMU
     void enable_smmu() {
         smmu_->enable();
@@ -115,6 +134,12 @@ public:
             total_stats.write_transactions += stats.write_transactions;
             total_stats.translation_errors += stats.translation_errors;
             total_stats.total_latency_cycles += stats.total_latency_cycles;
+            total_stats.page_walks += stats.page_walks;
+            total_stats.mshr_merges += stats.mshr_merges;
+            total_stats.peak_outstanding = std::max(total_stats.peak_outstanding,
+                                                    stats.peak_outstanding);
+            total_stats.dmi_grants += stats.dmi_grants;
+            total_stats.dmi_invalidations += stats.dmi_invalidations;
         }
         
         // 添加輸出端口的統計
@@ -126,15 +151,35 @@ public:
         if (ptw_output_port) {
             const auto& stats = ptw_output_port->get_statistics();
             total_stats.ptw_transactions += stats.ptw_transactions;
+            total_stats.ptw_latency_cycles += stats.ptw_latency_cycles;
         }
         
         return total_stats;
     }
     
-    // 打印統計信息
-    void print_statistics() const {
+    // 所有輸入端口的轉換延遲分佈（納秒）
+    smmu::LatencyHistogram::Snapshot get_latency_histogram() const {
+        smmu::LatencyHistogram::Snapshot total;
+        for (const auto& port : input_ports) total.merge(port->get_latency_histogram());
+        return total;
+    }
+    
+    // SMMU 核心的插樁快照（smmu_config.instrumentation 為 true 時有內容）
+    smmu::InstrumentationSnapshot get_instrumentation() const {
+        return smmu_->get_instrumentation();
+    }
+    
+    // 打印統計信息（json 為 true 時輸出一個 JSON 對象）
+    void print_statistics(bool json = false) const {
+        if (json) {
+            write_statistics_json(std::cout);
+            std::cout << "\n";
+            return;
+        }
+        
         auto smmu_stats = get_smmu_statistics();
         auto tlm_stats = get_tlm_statistics();
+        auto latency = get_latency_histogram();
         
         std::cout << "\n╔════════════════════════════════════════╗\n";
         std::cout << "║   SMMU TLM Wrapper Statistics          ║\n";
@@ -152,9 +197,63 @@ public:
         std::cout << "  Read transactions:     " << tlm_stats.read_transactions << "\n";
         std::cout << "  Write transactions:    " << tlm_stats.write_transactions << "\n";
         std::cout << "  PTW transactions:      " << tlm_stats.ptw_transactions << "\n";
+        if (tlm_stats.ptw_transactions > 0) {
+            std::cout << "  PTW average latency:   "
+                      << static_cast<double>(tlm_stats.ptw_latency_cycles) / tlm_stats.ptw_transactions
+                      << " ns\n";
+        }
         std::cout << "  Translation errors:    " << tlm_stats.translation_errors << "\n";
+        std::cout << "  Page walks:            " << tlm_stats.page_walks << "\n";
+        std::cout << "  MSHR merges:           " << tlm_stats.mshr_merges << "\n";
+        std::cout << "  Peak outstanding:      " << tlm_stats.peak_outstanding << "\n";
+        std::cout << "  DMI grants:            " << tlm_stats.dmi_grants << "\n";
+        std::cout << "  DMI invalidations:     " << tlm_stats.dmi_invalidations << "\n";
         std::cout << "  Average latency:       " << tlm_stats.get_average_latency() 
+                  << " ns\n";
+        std::cout << "  Latency p50/p99/p999:  " << latency.percentile(0.5) << " / "
+                  << latency.percentile(0.99) << " / " << latency.percentile(0.999)
                   << " ns\n\n";
+        
+        // 按上下文的計數（未命中最多的在前）
+        auto instrumentation = get_instrumentation();
+        if (instrumentation.enabled) {
+            std::cout << "Per-context Statistics:\n";
+            for (const auto& context : instrumentation.contexts) {
+                std::cout << "  Stream " << context.stream_id << " ASID " << context.asid
+                          << ": " << context.translations << " translations, "
+                          << context.tlb_misses << " misses, "
+                          << context.page_walks << " walks, "
+                          << context.faults << " faults\n";
+            }
+            std::cout << "\n";
+        }
+    }
+    
+    // 統計信息導出為 JSON：SMMU 核心計數、TLM 端口計數、端口延遲分佈和核心插樁快照
+    void write_statistics_json(std::ostream& os) const {
+        auto smmu_stats = get_smmu_statistics();
+        auto tlm_stats = get_tlm_statistics();
+        
+        os << "{\"smmu\":{\"total_translations\":" << smmu_stats.total_translations
+           << ",\"tlb_hits\":" << smmu_stats.tlb_hits
+           << ",\"tlb_misses\":" << smmu_stats.tlb_misses
+           << ",\"page_table_walks\":" << smmu_stats.page_table_walks
+           << ",\"translation_faults\":" << smmu_stats.translation_faults
+           << "},\"tlm\":{\"total_transactions\":" << tlm_stats.total_transactions
+           << ",\"read_transactions\":" << tlm_stats.read_transactions
+           << ",\"write_transactions\":" << tlm_stats.write_transactions
+           << ",\"ptw_transactions\":" << tlm_stats.ptw_transactions
+           << ",\"translation_errors\":" << tlm_stats.translation_errors
+           << ",\"page_walks\":" << tlm_stats.page_walks
+           << ",\"mshr_merges\":" << tlm_stats.mshr_merges
+           << ",\"peak_outstanding\":" << tlm_stats.peak_outstanding
+           << ",\"dmi_grants\":" << tlm_stats.dmi_grants
+           << ",\"dmi_invalidations\":" << tlm_stats.dmi_invalidations
+           << "},\"latency_ns\":";
+        get_latency_histogram().write_json(os);
+        os << ",\"instrumentation\":";
+        get_instrumentation().write_json(os);
+        os << "}";
     }
     
     // ========================================================================
@@ -176,17 +275,30 @@ private:
             TLMPortConfig port_config;
             port_config.name = "input_port_" + std::to_string(i);
             port_config.enabled = true;
+            port_config.max_outstanding = tlm_config_.max_outstanding;
+            port_config.translation_latency = tlm_config_.translation_latency;
+            port_config.ptw_read_latency = tlm_config_.ptw_read_latency;
+            port_config.dmi_enabled = tlm_config_.dmi_enabled;
             
             auto port = std::make_unique<SMMUTLMTarget>(
                 port_config.name.c_str(), i, port_config);
             
-            // 設置地址轉換回調
+            // 設置地址轉換回調（每次轉換前清零 PTW 時間；
+            // 轉換失敗可能產生事件，喚醒處理線程）
             port->set_translation_callback(
                 [this](smmu::VirtualAddress va, smmu::StreamID sid, 
                        smmu::ASID asid, smmu::VMID vmid) {
-                    return smmu_->translate(va, sid, asid, vmid);
+                    walk_time_ = sc_core::SC_ZERO_TIME;
+                    smmu::TranslationResult result = smmu_->translate(va, sid, asid, vmid);
+                    if (!result.success) work_event_.notify(sc_core::SC_ZERO_TIME);
+                    return result;
                 });
             
+            // 遍歷經過 PTW 端口時，未命中的延遲為描述符讀取的實際時間
+            if (tlm_config_.ptw_via_port) {
+                port->set_walk_time_callback([this]() { return walk_time_; });
+            }
+            
             input_ports.push_back(std::move(port));
         }
         
@@ -213,9 +325,53 @@ private:
     }
     
     // 設置內存讀取回調（用於 PTW）
+    // 描述符讀取作為 PTW 端口上的 TLM 讀事務發出，下游返回的延遲累加到 walk_time_；
+    // 讀取在轉換過程中同步完成，PTW 端口下游的 b_transport 不能調用 wait()
     void setup_memory_callback() {
-        // PTW 需要通過 PTW 端口訪問內存
-        // 這裡我們直接使用內存模型，實際硬件中會通過 TLM 端口
+        if (!tlm_config_.ptw_via_port) return;  // 直接讀取內存模型，延遲按描述符數估算
+        
+        smmu::MemoryReadCallback read =
+            [this](smmu::PhysicalAddress addr, uint64_t& data, size_t size) {
+                return ptw_read(addr, &data, size);
+            };
+        smmu::MemoryBlockReadCallback block_read = nullptr;
+        if (tlm_config_.ptw_batch_leaf_line) {
+            block_read = [this](smmu::PhysicalAddress addr, void* data, size_t size) {
+                return ptw_read(addr, data, size);
+            };
+        }
+        smmu_->set_walk_memory(read, block_read);
+    }
+    
+    // 設置 DMI 轉發和撤銷
+    // 輸入端口的 DMI 請求經數據端口轉發到下游；SMMU 的轉換失效通知和
+    // 下游的 DMI 撤銷都轉發給所有輸入端口
+    void setup_dmi() {
+        if (!tlm_config_.dmi_enabled) return;
+        
+        for (auto& port : input_ports) {
+            port->set_dmi_forward_callback(
+                [this](smmu::PhysicalAddress pa, tlm::tlm_command command, tlm::tlm_dmi& dmi) {
+                    return data_output_port->get_direct_mem_ptr(pa, command, dmi);
+                });
+        }
+        
+        smmu_->set_invalidation_callback([this](const smmu::TranslationInvalidation& notice) {
+            for (auto& port : input_ports) port->invalidate_translation(notice);
+        });
+        
+        data_output_port->set_dmi_invalidate_callback([this](uint64_t start, uint64_t end) {
+            for (auto& port : input_ports) port->invalidate_physical_range(start, end);
+        });
+    }
+    
+    // 在 PTW 端口上讀取描述符
+    bool ptw_read(smmu::PhysicalAddress addr, void* data, size_t size) {
+        sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+        tlm::tlm_response_status status = ptw_output_port->send_read(
+            addr, static_cast<unsigned char*>(data), static_cast<unsigned int>(size), delay);
+        walk_time_ += delay;
+        return status == tlm::TLM_OK_RESPONSE;
     }
     
     // ========================================================================
@@ -223,6 +379,8 @@ private:
     // ========================================================================
     
     // SMMU 處理線程
+    // 空閒時不佔用模擬時間：提交命令或轉換失敗時由 work_event_ 喚醒，
+    // 執行待處理的命令並取出事件隊列中的所有事件
     void smmu_process_thread() {
         while (true) {
             // 處理 SMMU 命令隊列
@@ -232,22 +390,20 @@ private:
             while (smmu_->has_events()) {
                 auto event = smmu_->pop_event();
                 SC_REPORT_WARNING("SMMU_EVENT",
-                    ("Fault: " + event.description + 
+                    (std::string("Fault: ") + event.description + 
                      " at VA 0x" + std::to_string(event.va)).c_str());
             }
             
-            // 等待一段時間
-            wait(sc_core::sc_time(100, sc_core::SC_NS));
+            // 等待新的命令或事件
+            wait(work_event_);
         }
     }
     
-    // 統計線程
+    // 統計線程（statistics_interval 非 0 時創建）
     void statistics_thread() {
         while (true) {
-            wait(sc_core::sc_time(1, sc_core::SC_MS));
-            
-            // 可以在這裡定期輸出統計信息
-            // print_statistics();
+            wait(tlm_config_.statistics_interval);
+            print_statistics();
         }
     }
     
@@ -260,6 +416,8 @@ private:
     
     std::shared_ptr<smmu::SimpleMemoryModel> memory_;  // 內存模型
     std::unique_ptr<smmu::SMMU> smmu_;                 // SMMU 核心
+    sc_core::sc_time walk_time_;                       // 當前轉換在 PTW 端口上花費的時間
+    sc_core::sc_event work_event_;                     // 有待處理的命令或事件
 };
 
 } // namespace smmu_tlm
@@ -4,7 +4,9 @@
 
 #include <systemc>
 #include <tlm>
+#include <tlm_utils/tlm_quantumkeeper.h>
 #include "smmu_tlm_wrapper.h"
+#include "page_table_builder.h"
 #include <iostream>
 #include <iomanip>
 
@@ -13,7 +15,8 @@ using namespace smmu;
 
 // ============================================================================
 // 簡單的內存模型（TLM target）
-// 接收來自 SMMU 的轉換後事務
+// 接收來自 SMMU 的轉換後事務和頁表遍歷讀取
+// 內容保存在 SMMU 的內存模型中，PTW 端口讀到的就是測試寫入的頁表
 // ============================================================================
 
 class SimpleMemory : public sc_core::sc_module {
@@ -22,13 +25,14 @@ public:
     
     SC_HAS_PROCESS(SimpleMemory);
     
-    SimpleMemory(sc_core::sc_module_name name, size_t size = 256 * 1024 * 1024)
+    SimpleMemory(sc_core::sc_module_name name,
+                 std::shared_ptr<SimpleMemoryModel> backing)
         : sc_module(name)
         , target_socket("target_socket")
-        , memory_size_(size)
+        , backing_(backing)
     {
-        memory_.resize(size, 0);
         target_socket.register_b_transport(this, &SimpleMemory::b_transport);
+        target_socket.register_get_direct_mem_ptr(this, &SimpleMemory::get_direct_mem_ptr);
     }
     
 private:
@@ -39,31 +43,47 @@ private:
         unsigned int len = trans.get_data_length();
         
         // 檢查地址範圍
-        if (addr + len > memory_size_) {
+        if (addr + len > SimpleMemoryModel::PA_LIMIT) {
             trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
             return;
         }
         
         // 執行讀寫操作
         if (cmd == tlm::TLM_READ_COMMAND) {
-            std::memcpy(ptr, &memory_[addr], len);
+            backing_->read(addr, ptr, len);
         } else if (cmd == tlm::TLM_WRITE_COMMAND) {
-            std::memcpy(&memory_[addr], ptr, len);
+            backing_->write(addr, ptr, len);
         }
         
         // 添加內存訪問延遲
         delay += sc_core::sc_time(50, sc_core::SC_NS);
         
+        trans.set_dmi_allowed(true);
         trans.set_response_status(tlm::TLM_OK_RESPONSE);
     }
     
-    std::vector<unsigned char> memory_;
-    size_t memory_size_;
+    // 以 4KB 幀為單位授予 DMI
+    bool get_direct_mem_ptr(tlm::tlm_generic_payload& trans, tlm::tlm_dmi& dmi_data) {
+        uint64_t base = trans.get_address() & ~(SimpleMemoryModel::FRAME_SIZE - 1);
+        uint8_t* frame = backing_->frame_data(base);
+        if (!frame) return false;
+        
+        dmi_data.set_dmi_ptr(frame);
+        dmi_data.set_start_address(base);
+        dmi_data.set_end_address(base + SimpleMemoryModel::FRAME_SIZE - 1);
+        dmi_data.allow_read_write();
+        dmi_data.set_read_latency(sc_core::sc_time(50, sc_core::SC_NS));
+        dmi_data.set_write_latency(sc_core::sc_time(50, sc_core::SC_NS));
+        return true;
+    }
+    
+    std::shared_ptr<SimpleMemoryModel> backing_;
 };
 
 // ============================================================================
 // 設備模擬器（TLM initiator）
 // 模擬設備發起 DMA 訪問
+// 使用時間解耦：延遲累加到量子保持器的本地時間，超過全局量子才 wait()
 // ============================================================================
 
 class DeviceSimulator : public sc_core::sc_module {
@@ -81,14 +101,65 @@ public:
         , stream_id_(stream_id)
         , asid_(asid)
         , device_name_(device_name)
+        , dmi_valid_(false)
+        , dmi_accesses_(0)
+        , dmi_invalidations_(0)
     {
+        initiator_socket.register_invalidate_direct_mem_ptr(
+            this, &DeviceSimulator::invalidate_direct_mem_ptr);
         SC_THREAD(device_thread);
     }
     
 private:
+    // ========================================================================
+    // DMI
+    // SMMU 授予的 DMI 區域使用虛擬地址，命中時繞過 SMMU 直接訪問內存
+    // ========================================================================
+    
+    bool dmi_access(tlm::tlm_command cmd, uint64_t address,
+                    unsigned char* data, unsigned int length) {
+        if (!dmi_valid_ || address < dmi_.get_start_address() ||
+            address + length - 1 > dmi_.get_end_address()) {
+            return false;
+        }
+        bool is_read = cmd == tlm::TLM_READ_COMMAND;
+        if (is_read ? !dmi_.is_read_allowed() : !dmi_.is_write_allowed()) return false;
+        
+        unsigned char* ptr = dmi_.get_dmi_ptr() + (address - dmi_.get_start_address());
+        if (is_read) {
+            std::memcpy(data, ptr, length);
+        } else {
+            std::memcpy(ptr, data, length);
+        }
+        dmi_accesses_++;
+        advance(is_read ? dmi_.get_read_latency() : dmi_.get_write_latency());
+        return true;
+    }
+    
+    // b_transport 返回 DMI 提示後請求 DMI 區域
+    void request_dmi(tlm::tlm_generic_payload& trans, uint64_t address) {
+        if (!trans.is_dmi_allowed()) return;
+        trans.set_address(address);  // b_transport 已把地址改為物理地址
+        dmi_valid_ = initiator_socket->get_direct_mem_ptr(trans, dmi_);
+    }
+    
+    void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end) {
+        if (dmi_valid_ && start <= dmi_.get_end_address() && end >= dmi_.get_start_address()) {
+            dmi_valid_ = false;
+            dmi_invalidations_++;
+        }
+    }
+    
+    // 本地時間前進 delay，超過量子時與模擬時間同步
+    void advance(const sc_core::sc_time& delay) {
+        quantum_keeper_.inc(delay);
+        if (quantum_keeper_.need_sync()) quantum_keeper_.sync();
+    }
+    
     void device_thread() {
         // 等待系統初始化
         wait(sc_core::sc_time(100, sc_core::SC_NS));
+        quantum_keeper_.reset();
         
         std::cout << "\n[" << sc_core::sc_time_stamp() << "] "
                   << device_name_ << " starting DMA operations...\n";
@@ -97,21 +168,26 @@ private:
         for (int i = 0; i < 5; i++) {
             // 讀操作
             perform_dma_read(i * 0x1000, 64);
-            wait(sc_core::sc_time(200, sc_core::SC_NS));
+            advance(sc_core::sc_time(200, sc_core::SC_NS));
             
             // 寫操作
             perform_dma_write(i * 0x1000 + 0x100, 64);
-            wait(sc_core::sc_time(200, sc_core::SC_NS));
+            advance(sc_core::sc_time(200, sc_core::SC_NS));
         }
+        quantum_keeper_.sync();
         
         std::cout << "[" << sc_core::sc_time_stamp() << "] "
-                  << device_name_ << " completed DMA operations\n";
+                  << device_name_ << " completed DMA operations ("
+                  << dmi_accesses_ << " via DMI, " << dmi_invalidations_
+                  << " DMI revocations)\n";
     }
     
     void perform_dma_read(uint64_t address, unsigned int length) {
         unsigned char data[256];
+        if (dmi_access(tlm::TLM_READ_COMMAND, address, data, length)) return;
+        
         tlm::tlm_generic_payload trans;
-        sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+        sc_core::sc_time delay = quantum_keeper_.get_local_time();
         
         // 設置事務
         trans.set_command(tlm::TLM_READ_COMMAND);
@@ -134,24 +210,27 @@ private:
         initiator_socket->b_transport(trans, delay);
         
         if (trans.get_response_status() == tlm::TLM_OK_RESPONSE) {
-            std::cout << "[" << sc_core::sc_time_stamp() << "] "
+            std::cout << "[" << quantum_keeper_.get_current_time() << "] "
                       << device_name_ << " READ  VA=0x" << std::hex << address
                       << " len=" << std::dec << length << " - SUCCESS\n";
+            request_dmi(trans, address);
         } else {
-            std::cout << "[" << sc_core::sc_time_stamp() << "] "
+            std::cout << "[" << quantum_keeper_.get_current_time() << "] "
                       << device_name_ << " READ  VA=0x" << std::hex << address
                       << " - FAILED\n";
         }
         
-        wait(delay);
+        quantum_keeper_.set(delay);
+        if (quantum_keeper_.need_sync()) quantum_keeper_.sync();
     }
     
     void perform_dma_write(uint64_t address, unsigned int length) {
         unsigned char data[256];
         std::memset(data, 0xAA, length);
+        if (dmi_access(tlm::TLM_WRITE_COMMAND, address, data, length)) return;
         
         tlm::tlm_generic_payload trans;
-        sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+        sc_core::sc_time delay = quantum_keeper_.get_local_time();
         
         // 設置事務
         trans.set_command(tlm::TLM_WRITE_COMMAND);
@@ -174,21 +253,167 @@ private:
         initiator_socket->b_transport(trans, delay);
         
         if (trans.get_response_status() == tlm::TLM_OK_RESPONSE) {
-            std::cout << "[" << sc_core::sc_time_stamp() << "] "
+            std::cout << "[" << quantum_keeper_.get_current_time() << "] "
                       << device_name_ << " WRITE VA=0x" << std::hex << address
                       << " len=" << std::dec << length << " - SUCCESS\n";
+            request_dmi(trans, address);
         } else {
-            std::cout << "[" << sc_core::sc_time_stamp() << "] "
+            std::cout << "[" << quantum_keeper_.get_current_time() << "] "
                       << device_name_ << " WRITE VA=0x" << std::hex << address
                       << " - FAILED\n";
         }
         
-        wait(delay);
+        quantum_keeper_.set(delay);
+        if (quantum_keeper_.need_sync()) quantum_keeper_.sync();
     }
     
     StreamID stream_id_;
     ASID asid_;
     std::string device_name_;
+    tlm::tlm_dmi dmi_;           // 當前 DMI 區域（虛擬地址）
+    bool dmi_valid_;
+    uint64_t dmi_accesses_;
+    uint64_t dmi_invalidations_;
+    tlm_utils::tlm_quantumkeeper quantum_keeper_;
+};
+
+// ============================================================================
+// 事務內存管理器
+// AT 事務的生命週期跨越多次函數調用，由引用計數管理
+// ============================================================================
+
+class PayloadPool : public tlm::tlm_mm_interface {
+public:
+    ~PayloadPool() {
+        for (auto* trans : all_) delete trans;
+    }
+    
+    tlm::tlm_generic_payload* allocate() {
+        if (free_.empty()) {
+            all_.push_back(new tlm::tlm_generic_payload(this));
+            free_.push_back(all_.back());
+        }
+        tlm::tlm_generic_payload* trans = free_.back();
+        free_.pop_back();
+        return trans;
+    }
+    
+    void free(tlm::tlm_generic_payload* trans) override {
+        trans->reset();
+        free_.push_back(trans);
+    }
+    
+private:
+    std::vector<tlm::tlm_generic_payload*> all_;
+    std::vector<tlm::tlm_generic_payload*> free_;
+};
+
+// ============================================================================
+// AT 設備模擬器（nb_transport initiator）
+// 連續發出 DMA 讀突發而不等待響應，每個頁面 8 個突發，
+// 同一頁面的後續突發在 SMMU 中合併到第一個突發的頁表遍歷
+// ============================================================================
+
+class ATDeviceSimulator : public sc_core::sc_module {
+public:
+    tlm_utils::simple_initiator_socket<ATDeviceSimulator> initiator_socket;
+    
+    SC_HAS_PROCESS(ATDeviceSimulator);
+    
+    ATDeviceSimulator(sc_core::sc_module_name name,
+                      StreamID stream_id,
+                      ASID asid,
+                      const std::string& device_name,
+                      int num_bursts)
+        : sc_module(name)
+        , initiator_socket("initiator_socket")
+        , stream_id_(stream_id)
+        , asid_(asid)
+        , device_name_(device_name)
+        , num_bursts_(num_bursts)
+        , completed_(0)
+        , failed_(0)
+    {
+        initiator_socket.register_nb_transport_bw(this, &ATDeviceSimulator::nb_transport_bw);
+        SC_THREAD(device_thread);
+    }
+    
+private:
+    void device_thread() {
+        // 等待系統初始化
+        wait(sc_core::sc_time(100, sc_core::SC_NS));
+        
+        std::cout << "\n[" << sc_core::sc_time_stamp() << "] "
+                  << device_name_ << " issuing " << num_bursts_ << " AT bursts...\n";
+        sc_core::sc_time start_time = sc_core::sc_time_stamp();
+        
+        for (int i = 0; i < num_bursts_; i++) {
+            uint64_t address = (i / 8) * 0x1000 + (i % 8) * 0x200;
+            
+            AXIExtension axi_ext;
+            axi_ext.stream_id = stream_id_;
+            axi_ext.asid = asid_;
+            axi_ext.vmid = 0;
+            
+            tlm::tlm_generic_payload* trans = pool_.allocate();
+            trans->acquire();
+            create_axi_read(*trans, address, data_, sizeof(data_), axi_ext);
+            
+            tlm::tlm_phase phase = tlm::BEGIN_REQ;
+            sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+            tlm::tlm_sync_enum status = initiator_socket->nb_transport_fw(*trans, phase, delay);
+            
+            if (status == tlm::TLM_ACCEPTED) {
+                // SMMU 在途轉換已滿，等待 END_REQ
+                wait(end_req_event_);
+            } else if (status == tlm::TLM_COMPLETED) {
+                complete(*trans);
+            }
+            
+            // 每個突發佔用 2ns 的請求通道
+            wait(sc_core::sc_time(2, sc_core::SC_NS));
+        }
+        
+        if (completed_ < num_bursts_) wait(done_event_);
+        
+        std::cout << "[" << sc_core::sc_time_stamp() << "] "
+                  << device_name_ << " completed " << completed_ << " bursts ("
+                  << failed_ << " failed) in "
+                  << (sc_core::sc_time_stamp() - start_time) << "\n";
+    }
+    
+    tlm::tlm_sync_enum nb_transport_bw(tlm::tlm_generic_payload& trans,
+                                       tlm::tlm_phase& phase,
+                                       sc_core::sc_time& delay) {
+        if (phase == tlm::END_REQ) {
+            end_req_event_.notify(delay);
+            return tlm::TLM_ACCEPTED;
+        }
+        
+        if (phase == tlm::BEGIN_RESP) {
+            complete(trans);
+            return tlm::TLM_COMPLETED;
+        }
+        
+        return tlm::TLM_ACCEPTED;
+    }
+    
+    void complete(tlm::tlm_generic_payload& trans) {
+        if (trans.get_response_status() != tlm::TLM_OK_RESPONSE) failed_++;
+        trans.release();
+        if (++completed_ == num_bursts_) done_event_.notify();
+    }
+    
+    StreamID stream_id_;
+    ASID asid_;
+    std::string device_name_;
+    int num_bursts_;
+    int completed_;
+    int failed_;
+    PayloadPool pool_;
+    unsigned char data_[64];
+    sc_core::sc_event end_req_event_;
+    sc_core::sc_event done_event_;
 };
 
 // ============================================================================
@@ -201,6 +426,7 @@ public:
     std::unique_ptr<SMMUTLMWrapper> smmu;
     std::unique_ptr<SimpleMemory> memory;
     std::vector<std::unique_ptr<DeviceSimulator>> devices;
+    std::unique_ptr<ATDeviceSimulator> dma;
     
     SC_HAS_PROCESS(TopLevel);
     
@@ -212,12 +438,13 @@ public:
         smmu_config.tlb_size = 128;
         
         SMMUTLMConfig tlm_config;
-        tlm_config.num_input_ports = 3;  // 3個設備
+        tlm_config.num_input_ports = 4;  // 3個 LT 設備 + 1個 AT DMA 引擎
+        tlm_config.max_outstanding = 8;
         
         smmu = std::make_unique<SMMUTLMWrapper>("smmu", smmu_config, tlm_config);
         
         // 創建內存
-        memory = std::make_unique<SimpleMemory>("memory");
+        memory = std::make_unique<SimpleMemory>("memory", smmu->get_memory_model());
         
         // 連接 SMMU 輸出端口到內存
         smmu->data_output_port->initiator_socket.bind(memory->target_socket);
@@ -233,6 +460,10 @@ public:
             devices[i]->initiator_socket.bind(smmu->input_ports[i]->target_socket);
         }
         
+        // AT DMA 引擎：4 個頁面，每頁 8 個突發
+        dma = std::make_unique<ATDeviceSimulator>("dma", 3, 4, "DMA", 32);
+        dma->initiator_socket.bind(smmu->input_ports[3]->target_socket);
+        
         // 配置 SMMU
         SC_THREAD(setup_thread);
     }
@@ -257,8 +488,17 @@ private:
         
         std::cout << "SMMU configuration complete\n\n";
         
+        // 運行中使 GPU 的地址空間無效：SMMU 撤銷已授予 GPU 的 DMI 區域，
+        // GPU 之後的訪問重新經過 b_transport
+        wait(sc_core::sc_time(550, sc_core::SC_NS));
+        Command tlbi;
+        tlbi.type = CommandType::CMD_TLBI_NH_ASID;
+        tlbi.data.tlbi_asid.asid = 1;
+        smmu->submit_command(tlbi);
+        std::cout << "[" << sc_core::sc_time_stamp() << "] TLBI_NH_ASID 1 submitted\n";
+        
         // 等待模擬完成
-        wait(sc_core::sc_time(10, sc_core::SC_US));
+        wait(sc_core::sc_time(10, sc_core::SC_US) - sc_core::sc_time(550, sc_core::SC_NS));
         
         // 打印統計信息
         smmu->print_statistics();
@@ -271,29 +511,16 @@ private:
         auto memory_model = smmu->get_memory_model();
         
         // 為每個設備設置頁表
-        for (int dev = 0; dev < 3; dev++) {
-            PhysicalAddress l0 = memory_model->allocate_page();
-            PhysicalAddress l1 = memory_model->allocate_page();
-            PhysicalAddress l2 = memory_model->allocate_page();
-            PhysicalAddress l3 = memory_model->allocate_page();
-            
-            // 設置頁表層次結構
-            memory_model->write_pte(l0, l1 | 0x3);
-            memory_model->write_pte(l1, l2 | 0x3);
-            memory_model->write_pte(l2, l3 | 0x3);
-            
-            // 映射頁面
+        for (int dev = 0; dev < 4; dev++) {
+            // 映射 16 個頁面
+            PageTableBuilder tables(*memory_model);
             PhysicalAddress base_pa = 0x100000 + (dev * 0x100000);
-            for (int i = 0; i < 16; i++) {
-                PhysicalAddress pa = base_pa + (i * 0x1000);
-                uint64_t pte = pa | 0x403 | (0x4 << 2);
-                memory_model->write_pte(l3 + (i * 8), pte);
-            }
+            tables.map_range(0, base_pa, 16 * 0x1000);
             
             // 配置上下文描述符
             ContextDescriptor cd;
             cd.valid = true;
-            cd.translation_table_base = l0;
+            cd.translation_table_base = tables.root();
             cd.translation_granule = 12;
             cd.ips = 48;
             cd.asid = dev + 1;
@@ -307,7 +534,7 @@ private:
     
     void configure_smmu() {
         // 配置每個設備的流表項
-        for (int dev = 0; dev < 3; dev++) {
+        for (int dev = 0; dev < 4; dev++) {
             StreamTableEntry ste;
             ste.valid = true;
             ste.s1_enabled = true;
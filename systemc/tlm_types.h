@@ -93,9 +93,20 @@ struct TLMPortConfig {
     uint32_t address_range;       // 地址範圍
     bool enabled;                 // 是否啟用
     
+    // 時序模型（AT 模式和 b_transport 共用）
+    // 轉換延遲 = translation_latency + 描述符讀取次數 × ptw_read_latency
+    uint32_t max_outstanding;               // AT 模式最多同時進行的轉換數
+    sc_core::sc_time translation_latency;   // TLB 命中時的轉換延遲
+    sc_core::sc_time ptw_read_latency;      // 每次描述符讀取的延遲（PTW 端口）
+    bool dmi_enabled;                       // 是否為已轉換的頁面授予 DMI
+    
     TLMPortConfig() 
         : name("port"), base_address(0), 
-          address_range(0xFFFFFFFF), enabled(true) {}
+          address_range(0xFFFFFFFF), enabled(true),
+          max_outstanding(16),
+          translation_latency(10, sc_core::SC_NS),
+          ptw_read_latency(50, sc_core::SC_NS),
+          dmi_enabled(true) {}
 };
 
 // ============================================================================
@@ -109,9 +120,34 @@ struct SMMUTLMConfig {
     QoSConfig default_qos;        // 默認 QoS 配置
     QoSConfig ptw_qos;            // PTW 專用 QoS 配置
     
+    // 輸入端口時序（見 TLMPortConfig）
+    uint32_t max_outstanding;               // 每個輸入端口的最大在途轉換數
+    sc_core::sc_time translation_latency;   // TLB 命中時的轉換延遲
+    sc_core::sc_time ptw_read_latency;      // 每次描述符讀取的延遲（ptw_via_port 為 false 時使用）
+    
+    // 頁表遍歷
+    bool ptw_via_port;            // 描述符讀取經過 PTW 端口（延遲由下游決定）
+    bool ptw_batch_leaf_line;     // 葉子緩存行作為一個 64 字節事務讀取（否則每個描述符一個事務）
+    
+    // DMI：輸入端口為已轉換的頁面授予經數據端口轉發、按轉換重映射的 DMI 區域
+    bool dmi_enabled;
+    
+    // 時間解耦
+    // global_quantum 非 0 時在構造 wrapper 時設置 tlm_global_quantum，
+    // 輸出端口的排隊事務和使用 tlm_quantumkeeper 的設備按該量子同步；0 保留現有設置
+    // statistics_interval 非 0 時按該週期打印統計信息；0 不創建統計線程
+    sc_core::sc_time global_quantum;
+    sc_core::sc_time statistics_interval;
+    
     SMMUTLMConfig() 
         : num_input_ports(4), num_output_ports(2), 
-          ptw_qos_enabled(true) {
+          ptw_qos_enabled(true), max_outstanding(16),
+          translation_latency(10, sc_core::SC_NS),
+          ptw_read_latency(50, sc_core::SC_NS),
+          ptw_via_port(true), ptw_batch_leaf_line(true),
+          dmi_enabled(true),
+          global_quantum(1, sc_core::SC_US),
+          statistics_interval(sc_core::SC_ZERO_TIME) {
         // PTW 使用更高的優先級
         ptw_qos.priority = 15;
         ptw_qos.urgency = 15;
@@ -130,11 +166,19 @@ struct TLMStatistics {
     uint64_t ptw_transactions;     // PTW 事務數
     uint64_t translation_errors;   // 轉換錯誤數
     uint64_t total_latency_cycles; // 總延遲週期
+    uint64_t page_walks;           // 發起頁表遍歷的事務數（TLB 未命中）
+    uint64_t mshr_merges;          // 合併到在途未命中的事務數
+    uint64_t peak_outstanding;     // 同時在途事務數的峰值（AT 模式）
+    uint64_t ptw_latency_cycles;   // PTW 事務的總延遲
+    uint64_t dmi_grants;           // 授予的 DMI 區域數
+    uint64_t dmi_invalidations;    // 撤銷的 DMI 區域數
     
     TLMStatistics() 
         : total_transactions(0), read_transactions(0), 
           write_transactions(0), ptw_transactions(0),
-          translation_errors(0), total_latency_cycles(0) {}
+          translation_errors(0), total_latency_cycles(0),
+          page_walks(0), mshr_merges(0), peak_outstanding(0),
+          ptw_latency_cycles(0), dmi_grants(0), dmi_invalidations(0) {}
     
     void reset() {
         total_transactions = 0;
@@ -143,6 +187,12 @@ struct TLMStatistics {
         ptw_transactions = 0;
         translation_errors = 0;
         total_latency_cycles = 0;
+        page_walks = 0;
+        mshr_merges = 0;
+        peak_outstanding = 0;
+        ptw_latency_cycles = 0;
+        dmi_grants = 0;
+        dmi_invalidations = 0;
     }
     
     double get_average_latency() const {
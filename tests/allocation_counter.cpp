@@ -0,0 +1,32 @@
+// 全局分配計數實現文件
+// 替換函數放在單獨的翻譯單元中，調用處看不到 malloc / free，
+// 編譯器不會把內聯後的 new 與 free 配對報告 -Wmismatched-new-delete
+
+#include "allocation_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<size_t> g_allocation_count{0};
+
+void* counted_allocate(std::size_t size) {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+size_t smmu::allocation_count() {
+    return g_allocation_count.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) { return counted_allocate(size); }
+void* operator new[](std::size_t size) { return counted_allocate(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
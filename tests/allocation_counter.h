@@ -0,0 +1,17 @@
+// 全局分配計數頭文件
+// 替換全局 operator new / delete（定義在 allocation_counter.cpp），統計堆分配次數，
+// 用於驗證轉換命中路徑不分配堆內存；測試程序和基準測試程序鏈接同一個實現
+
+#ifndef SMMU_ALLOCATION_COUNTER_H
+#define SMMU_ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+namespace smmu {
+
+// 程序啟動以來 operator new / new[] 的調用次數（所有線程）
+size_t allocation_count();
+
+} // namespace smmu
+
+#endif // SMMU_ALLOCATION_COUNTER_H
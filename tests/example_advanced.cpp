@@ -4,6 +4,7 @@
 
 #include "smmu.h"
 #include "smmu_registers.h"
+#include "page_table_builder.h"
 #include <iostream>
 #include <iomanip>
 #include <vector>
@@ -165,27 +166,11 @@ public:
     
 private:
     PhysicalAddress setup_page_table_for_device(StreamID stream_id) {
-        // Allocate page tables
-        PhysicalAddress l0 = memory_->allocate_page();
-        PhysicalAddress l1 = memory_->allocate_page();
-        PhysicalAddress l2 = memory_->allocate_page();
-        PhysicalAddress l3 = memory_->allocate_page();
-        
-        // Setup page table hierarchy
-        memory_->write_pte(l0, l1 | 0x3);
-        memory_->write_pte(l1, l2 | 0x3);
-        memory_->write_pte(l2, l3 | 0x3);
-        
-        // Map pages with device-specific physical addresses
+        // Map 16 pages with device-specific physical addresses
+        PageTableBuilder tables(*memory_);
         PhysicalAddress base_pa = 0x200000 + (stream_id * 0x100000);
-        
-        for (int i = 0; i < 16; i++) {
-            PhysicalAddress pa = base_pa + (i * 0x1000);
-            uint64_t pte = pa | 0x403 | (0x4 << 2); // Valid, page, AF, RW
-            memory_->write_pte(l3 + (i * 8), pte);
-        }
-        
-        return l0;
+        tables.map_range(0, base_pa, 16 * 0x1000);
+        return tables.root();
     }
     
     std::string permission_to_string(AccessPermission perm) {
@@ -3,9 +3,21 @@
 
 #include "smmu.h"
 #include "smmu_registers.h"
+#include "page_table_builder.h"
+#include "frame_allocator.h"
+#include "allocation_counter.h"
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 
 using namespace smmu;
 
@@ -331,6 +343,2347 @@ void test_register_interface() {
     std::cout << std::dec << "\n";
 }
 
+// ============================================================================
+// 測試6：組相聯 TLB
+// 比較不同替換策略在相同訪問序列下的命中情況
+// ============================================================================
+
+void test_set_associative_tlb() {
+    std::cout << "=== Test 6: Set-Associative TLB ===\n\n";
+    
+    struct PolicyCase {
+        ReplacementPolicy policy;
+        const char* name;
+    };
+    PolicyCase cases[] = {
+        {ReplacementPolicy::LRU, "LRU"},
+        {ReplacementPolicy::PSEUDO_LRU, "PSEUDO_LRU"},
+        {ReplacementPolicy::RRIP, "RRIP"},
+        {ReplacementPolicy::RANDOM, "RANDOM"},
+    };
+    
+    for (const auto& c : cases) {
+        // 16 項，4 路 -> 4 組
+        SetAssociativeTLB tlb(16, 4, c.policy);
+        
+        // 在同一組內放入 6 個頁面（組索引 = VPN % 4），超過 4 路
+        for (int i = 0; i < 6; i++) {
+            TLBEntry entry;
+            entry.va = static_cast<VirtualAddress>(i) * 4 * 0x1000;
+            entry.pa = 0x100000 + entry.va;
+            entry.asid = 1;
+            tlb.insert(entry);
+            // 反覆訪問第一個頁面，使其成為熱點
+            tlb.lookup(0x0, 0, 1, 0);
+        }
+        
+        bool hot_resident = tlb.lookup(0x0, 0, 1, 0).has_value();
+        std::cout << "  " << c.name << ": sets=" << tlb.num_sets()
+                  << " ways=" << tlb.num_ways()
+                  << " size=" << tlb.size()
+                  << " hits=" << tlb.hit_count()
+                  << " misses=" << tlb.miss_count()
+                  << " hot page resident: " << (hot_resident ? "Yes" : "No") << "\n";
+    }
+    
+    // 通過 SMMUConfig 選擇組相聯 TLB
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    SMMUConfig config;
+    config.tlb_size = 64;
+    config.tlb_organization = TLBOrganization::SET_ASSOCIATIVE;
+    config.tlb_ways = 4;
+    config.tlb_replacement = ReplacementPolicy::PSEUDO_LRU;
+    SMMU smmu(config);
+    smmu.set_memory_model(memory);
+    
+    PhysicalAddress ttb;
+    setup_simple_page_table(*memory, ttb);
+    
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    smmu.configure_stream_table_entry(0, ste);
+    
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = ttb;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    smmu.configure_context_descriptor(0, 1, cd);
+    smmu.enable();
+    
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 16; i++) {
+            smmu.translate(i * 0x1000, 0, 1, 0);
+        }
+    }
+    
+    auto stats = smmu.get_statistics();
+    std::cout << "\nSMMU with set-associative TLB (64 entries, 4 ways, PSEUDO_LRU):\n";
+    std::cout << "  TLB hits: " << stats.tlb_hits << "\n";
+    std::cout << "  TLB misses: " << stats.tlb_misses << "\n\n";
+}
+
+// ============================================================================
+// 測試7：大頁（塊）映射
+// 驗證 2MB/1GB 塊映射在 TLB 中只佔一個表項
+// ============================================================================
+
+void test_block_mappings() {
+    std::cout << "=== Test 7: Block Mappings (2MB / 1GB) ===\n\n";
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    SMMU smmu;
+    smmu.set_memory_model(memory);
+    
+    PhysicalAddress l0 = memory->allocate_page();
+    PhysicalAddress l1 = memory->allocate_page();
+    PhysicalAddress l2 = memory->allocate_page();
+    
+    // L0[0] -> L1 表
+    memory->write_pte(l0, l1 | 0x3);
+    // L1[1]：1GB 塊，VA 0x40000000 -> PA 0x80000000
+    // Valid (bit 0) = 1, Block (bit 1) = 0, AF (bit 10) = 1, Normal WB
+    memory->write_pte(l1 + 1 * 8, 0x80000000ULL | 0x401 | (0x4 << 2));
+    // L1[2] -> L2 表
+    memory->write_pte(l1 + 2 * 8, l2 | 0x3);
+    // L2[0]：2MB 塊，VA 0x80000000 -> PA 0x600000
+    memory->write_pte(l2, 0x600000ULL | 0x401 | (0x4 << 2));
+    
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    smmu.configure_stream_table_entry(0, ste);
+    
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = l0;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    smmu.configure_context_descriptor(0, 1, cd);
+    smmu.enable();
+    
+    // 在每個塊內訪問多個 4KB 頁面
+    VirtualAddress test_vas[] = {
+        0x80000000, 0x80001234, 0x801FF000,   // 2MB 塊
+        0x40000000, 0x40123456, 0x7FFFF000    // 1GB 塊
+    };
+    
+    for (auto va : test_vas) {
+        auto result = smmu.translate(va, 0, 1, 0);
+        std::cout << "  VA 0x" << std::hex << va << " -> ";
+        if (result.success) {
+            std::cout << "PA 0x" << result.physical_addr
+                      << " (page size 0x" << static_cast<uint64_t>(result.page_size)
+                      << ", level " << std::dec << static_cast<int>(result.level) << ")\n";
+        } else {
+            std::cout << "FAULT (" << result.fault_reason << ")\n" << std::dec;
+        }
+    }
+    
+    auto stats = smmu.get_statistics();
+    std::cout << "\n  TLB hits: " << stats.tlb_hits
+              << " (expected 4)\n";
+    std::cout << "  TLB misses: " << stats.tlb_misses
+              << " (expected 2, one per block)\n\n";
+}
+
+// ============================================================================
+// 測試8：頁表遍歷緩存
+// 相鄰頁面的遍歷應從緩存的 L3 表開始，每次未命中只讀一個描述符
+// ============================================================================
+
+void test_page_walk_cache() {
+    std::cout << "=== Test 8: Page Walk Cache ===\n\n";
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    SMMU smmu;
+    smmu.set_memory_model(memory);
+    
+    PhysicalAddress ttb;
+    setup_simple_page_table(*memory, ttb);
+    
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    smmu.configure_stream_table_entry(0, ste);
+    
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = ttb;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    smmu.configure_context_descriptor(0, 1, cd);
+    smmu.enable();
+    
+    // 順序訪問16個頁面：第一次遍歷讀4個描述符，之後每次只讀 L3 描述符
+    for (int i = 0; i < 16; i++) {
+        smmu.translate(i * 0x1000, 0, 1, 0);
+    }
+    
+    auto stats = smmu.get_statistics();
+    std::cout << "Sequential walks over 16 pages:\n";
+    std::cout << "  Page table walks: " << stats.page_table_walks << "\n";
+    std::cout << "  Descriptor reads: " << stats.descriptor_reads << " (expected 19)\n";
+    for (int level = 1; level < 4; level++) {
+        std::cout << "  Walk cache hits at L" << level << ": "
+                  << stats.walk_cache_hits[level] << "\n";
+    }
+    std::cout << "  Walk cache misses: " << stats.walk_cache_misses << "\n\n";
+    
+    // TLBI by ASID 同時使遍歷緩存無效
+    Command cmd;
+    cmd.type = CommandType::CMD_TLBI_NH_ASID;
+    cmd.data.tlbi_asid.asid = 1;
+    smmu.submit_command(cmd);
+    smmu.process_commands();
+    smmu.reset_statistics();
+    
+    smmu.translate(0x3000, 0, 1, 0);
+    stats = smmu.get_statistics();
+    std::cout << "After CMD_TLBI_NH_ASID:\n";
+    std::cout << "  Descriptor reads: " << stats.descriptor_reads << " (expected 4)\n";
+    std::cout << "  Walk cache misses: " << stats.walk_cache_misses << "\n\n";
+}
+
+// ============================================================================
+// 測試9：稀疏內存模型
+// 驗證 4GB 以上的物理地址可讀寫，且只為寫入過的幀分配內存
+// ============================================================================
+
+void test_sparse_memory() {
+    std::cout << "=== Test 9: Sparse Memory Model ===\n\n";
+    
+    SimpleMemoryModel memory;
+    std::cout << "Resident frames after construction: " << memory.resident_frames() << "\n";
+    
+    // 寫入 4GB 以上的地址，並跨越幀邊界
+    PhysicalAddress high_pa = 0x100000000ULL + 0xFFC;
+    uint64_t pattern = 0x1122334455667788ULL;
+    memory.write(high_pa, &pattern, sizeof(pattern));
+    
+    uint64_t readback = 0;
+    bool ok = memory.read(high_pa, &readback, sizeof(readback));
+    std::cout << "Write/read at PA 0x" << std::hex << high_pa << ": "
+              << (ok && readback == pattern ? "✅ match" : "❌ mismatch")
+              << std::dec << "\n";
+    std::cout << "Resident frames after cross-frame write: "
+              << memory.resident_frames() << " (expected 2)\n";
+    
+    // 未寫入過的區域讀為0，且不分配幀
+    uint64_t untouched = 0xFFFFFFFFFFFFFFFFULL;
+    memory.read(0x7FFF00000000ULL, &untouched, sizeof(untouched));
+    std::cout << "Untouched memory reads as zero: " << (untouched == 0 ? "Yes" : "No") << "\n";
+    
+    // 超出48位物理地址範圍的讀取失敗
+    bool out_of_range = memory.read(SimpleMemoryModel::PA_LIMIT, &untouched, sizeof(untouched));
+    std::cout << "Read beyond 48-bit PA rejected: " << (!out_of_range ? "Yes" : "No") << "\n";
+    std::cout << "Resident frames: " << memory.resident_frames() << "\n\n";
+}
+
+// ============================================================================
+// 測試10：批量地址轉換
+// 批量接口的結果應與逐個調用 translate 一致；同一上下文的未命中成組遍歷，
+// 共享上層表，描述符讀取只計實際讀取
+// ============================================================================
+
+void test_batch_translation() {
+    std::cout << "=== Test 10: Batch Translation ===\n\n";
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress ttb;
+    setup_simple_page_table(*memory, ttb);
+    
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = ttb;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    
+    // 每個頁面 4 個突發訪問，最後附加一個未映射的地址
+    constexpr int PAGES = 16;
+    std::vector<TranslationRequest> requests;
+    for (int page = 0; page < PAGES; page++) {
+        for (int beat = 0; beat < 4; beat++) {
+            requests.push_back({static_cast<VirtualAddress>(page * 0x1000 + beat * 0x40), 0, 1, 0});
+        }
+    }
+    requests.push_back({0x200000, 0, 1, 0});
+    
+    for (size_t walk_cache_size : {size_t(16), size_t(0)}) {
+        SMMUConfig config;
+        config.walk_cache_size = walk_cache_size;
+        SMMU batch_smmu(config);
+        SMMU single_smmu(config);
+        for (SMMU* smmu : {&batch_smmu, &single_smmu}) {
+            smmu->set_memory_model(memory);
+            smmu->configure_stream_table_entry(0, ste);
+            smmu->configure_context_descriptor(0, 1, cd);
+            smmu->enable();
+        }
+        
+        auto results = batch_smmu.translate_batch(requests);
+        
+        size_t matches = 0;
+        for (size_t i = 0; i < requests.size(); i++) {
+            auto expected = single_smmu.translate(requests[i].va, requests[i].stream_id,
+                                                  requests[i].asid, requests[i].vmid);
+            if (expected.success == results[i].success &&
+                expected.physical_addr == results[i].physical_addr &&
+                expected.fault_type == results[i].fault_type) {
+                matches++;
+            }
+        }
+        
+        // 同頁復用不查找 TLB：單獨計數，tlb_hits 與 TLB 自身的按流命中計數一致
+        auto stats = batch_smmu.get_statistics();
+        auto single = single_smmu.get_statistics();
+        TLBStreamStats stream = batch_smmu.get_stream_tlb_statistics(0);
+        bool counted = stats.batch_reuses == PAGES * 3 && stats.tlb_hits == stream.hits &&
+                       stats.tlb_misses == stream.misses &&
+                       stats.tlb_hits + stats.tlb_misses + stats.batch_reuses == requests.size() &&
+                       stats.page_table_walks == single.page_table_walks &&
+                       stats.translation_faults == single.translation_faults;
+        
+        // 16 個頁面共用 L0-L2 表：成組遍歷只有第一個頁面讀取上層描述符；
+        // 有遍歷緩存時逐個轉換也從 L3 開始，讀取數相同
+        uint64_t shared_reads = walk_cache_size ? 0 : (PAGES - 1) * 3;
+        bool reads_ok = stats.descriptor_reads + shared_reads == single.descriptor_reads;
+        
+        std::cout << "Batch of " << requests.size() << " requests (walk cache "
+                  << (walk_cache_size ? "on" : "off") << "):\n";
+        std::cout << "  Results matching translate(): " << matches << "/" << requests.size() << " "
+                  << (matches == requests.size() ? "✅" : "❌") << "\n";
+        std::cout << "  TLB hits: " << stats.tlb_hits << "\n";
+        std::cout << "  TLB misses: " << stats.tlb_misses << "\n";
+        std::cout << "  Same-page reuses: " << stats.batch_reuses << " "
+                  << (counted ? "✅" : "❌") << "\n";
+        std::cout << "  Page table walks: " << stats.page_table_walks << "\n";
+        std::cout << "  Descriptor reads: " << stats.descriptor_reads << " (translate(): "
+                  << single.descriptor_reads << ") " << (reads_ok ? "✅" : "❌") << "\n\n";
+    }
+}
+
+// ============================================================================
+// 測試11：TLB 命中路徑不分配內存
+// ============================================================================
+
+void test_hit_path_allocations() {
+    std::cout << "=== Test 11: Allocation-Free Hit Path ===\n\n";
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress ttb;
+    setup_simple_page_table(*memory, ttb);
+    
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = ttb;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    
+    SMMU smmu;
+    smmu.set_memory_model(memory);
+    smmu.configure_stream_table_entry(0, ste);
+    smmu.configure_context_descriptor(0, 1, cd);
+    smmu.enable();
+    
+    // 預熱 TLB
+    for (VirtualAddress va = 0; va < 0x10000; va += 0x1000) {
+        smmu.translate(va, 0, 1, 0);
+    }
+    
+    // 命中路徑
+    size_t before = allocation_count();
+    size_t hits = 0;
+    for (int round = 0; round < 100; round++) {
+        for (VirtualAddress va = 0; va < 0x10000; va += 0x1000) {
+            if (smmu.translate(va + 0x10, 0, 1, 0).success) hits++;
+        }
+    }
+    size_t hit_allocations = allocation_count() - before;
+    
+    // 失敗路徑：錯誤原因為靜態字符串
+    before = allocation_count();
+    auto fault = smmu.translate(0x200000, 0, 1, 0);
+    size_t fault_allocations = allocation_count() - before;
+    
+    std::cout << "TLB-hit translations: " << hits << "\n";
+    std::cout << "  Heap allocations: " << hit_allocations << " "
+              << (hit_allocations == 0 ? "✅" : "❌") << "\n";
+    std::cout << "Faulting translation: " << fault_type_to_string(fault.fault_type)
+              << " (" << fault.fault_reason << ")\n";
+    std::cout << "  Heap allocations (event queue only): " << fault_allocations << "\n\n";
+}
+
+// ============================================================================
+// 測試12：並發模式（多線程轉換與並發無效化）
+// ============================================================================
+
+void test_concurrent_translation() {
+    std::cout << "=== Test 12: Concurrent Translation ===\n\n";
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress ttb;
+    setup_simple_page_table(*memory, ttb);
+    
+    SMMUConfig config;
+    config.thread_safe = true;
+    config.tlb_size = 256;
+    config.tlb_shards = 8;
+    SMMU smmu(config);
+    smmu.set_memory_model(memory);
+    
+    const int num_threads = 8;
+    const int iterations = 20000;
+    
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = ttb;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    for (StreamID sid = 0; sid < num_threads; sid++) {
+        smmu.configure_stream_table_entry(sid, ste);
+        smmu.configure_context_descriptor(sid, 1, cd);
+    }
+    smmu.enable();
+    
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> wrong{0};
+    
+    // 轉換線程：每個線程模擬一個使用獨立 StreamID 的設備
+    std::vector<std::thread> workers;
+    for (int t = 0; t < num_threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (int i = 0; i < iterations; i++) {
+                VirtualAddress va = (i % 16) * 0x1000 + (t * 0x40);
+                auto result = smmu.translate(va, static_cast<StreamID>(t), 1, 0);
+                if (!result.success || result.physical_addr != 0x100000 + va) {
+                    wrong++;
+                }
+            }
+        });
+    }
+    
+    // 控制線程：並發地發出無效化命令並更新無關流的配置
+    uint64_t commands = 0;
+    std::thread control([&]() {
+        while (running.load()) {
+            Command cmd;
+            cmd.type = (commands % 2) ? CommandType::CMD_TLBI_NH_ASID
+                                      : CommandType::CMD_TLBI_NH_ALL;
+            cmd.data.tlbi_asid.asid = 1;
+            smmu.submit_command(cmd);
+            smmu.process_commands();
+            smmu.configure_stream_table_entry(100, ste);
+            commands++;
+        }
+    });
+    
+    for (auto& worker : workers) worker.join();
+    running = false;
+    control.join();
+    
+    auto stats = smmu.get_statistics();
+    uint64_t expected_total = static_cast<uint64_t>(num_threads) * iterations;
+    bool totals_ok = stats.total_translations == expected_total &&
+                     stats.tlb_hits + stats.tlb_misses == expected_total &&
+                     stats.commands_processed == commands;
+    
+    std::cout << num_threads << " threads x " << iterations << " translations, "
+              << commands << " concurrent invalidations\n";
+    std::cout << "  Wrong results: " << wrong.load() << " "
+              << (wrong.load() == 0 ? "✅" : "❌") << "\n";
+    std::cout << "  Aggregated statistics consistent: "
+              << (totals_ok ? "✅" : "❌") << "\n";
+    std::cout << "  TLB hits: " << stats.tlb_hits
+              << ", misses: " << stats.tlb_misses << "\n\n";
+}
+
+// ============================================================================
+// 測試13：索引化 TLB 無效化
+// 隨機填充後交替執行各類無效化，與逐項檢查的參考模型比較剩餘表項
+// ============================================================================
+
+void test_indexed_invalidation() {
+    std::cout << "=== Test 13: Indexed TLB Invalidation ===\n\n";
+    
+    // 4KB / 2MB / 1GB 表項，分佈在 4 個 ASID、2 個 VMID、4 個流中
+    std::vector<TLBEntry> entries;
+    uint64_t seed = 12345;
+    auto next_random = [&seed]() {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed >> 33;
+    };
+    const PageSize sizes[] = {PageSize::SIZE_4KB, PageSize::SIZE_2MB, PageSize::SIZE_1GB};
+    for (int i = 0; i < 400; i++) {
+        TLBEntry entry;
+        entry.page_size = sizes[next_random() % 3];
+        uint64_t mask = static_cast<uint64_t>(entry.page_size) - 1;
+        entry.va = (next_random() % 64) * 0x1000 * ((next_random() % 2) ? 1 : 0x200) & ~mask;
+        entry.pa = 0x100000000ULL + i * 0x40000000ULL;
+        entry.asid = static_cast<ASID>(next_random() % 4);
+        entry.vmid = static_cast<VMID>(next_random() % 2);
+        entry.stream_id = static_cast<StreamID>(next_random() % 4);
+        entries.push_back(entry);
+    }
+    
+    TLB tlb(1024);
+    std::vector<TLBEntry> reference;
+    auto same_key = [](const TLBEntry& a, const TLBEntry& b) {
+        return a.va == b.va && a.page_size == b.page_size && a.asid == b.asid &&
+               a.vmid == b.vmid && a.stream_id == b.stream_id;
+    };
+    for (const auto& entry : entries) {
+        tlb.insert(entry);
+        bool exists = false;
+        for (const auto& r : reference) exists = exists || same_key(r, entry);
+        if (!exists) reference.push_back(entry);
+    }
+    
+    // 參考模型：按條件刪除並檢查 TLB 剩餘表項是否一致
+    bool all_match = true;
+    auto check = [&](const char* name, auto pred) {
+        std::vector<TLBEntry> kept;
+        for (const auto& r : reference) {
+            if (!pred(r)) kept.push_back(r);
+        }
+        reference.swap(kept);
+        
+        bool match = tlb.size() == reference.size();
+        for (const auto& r : reference) {
+            auto found = tlb.lookup(r.va, r.stream_id, r.asid, r.vmid);
+            match = match && found.has_value();
+        }
+        all_match = all_match && match;
+        std::cout << "  " << std::left << std::setw(22) << name << std::right
+                  << "remaining " << std::setw(3) << tlb.size()
+                  << " (expected " << std::setw(3) << reference.size() << ") "
+                  << (match ? "✅" : "❌") << "\n";
+    };
+    
+    tlb.invalidate_by_va(0x1000, 1);
+    check("by VA 0x1000 ASID 1", [](const TLBEntry& e) {
+        uint64_t mask = static_cast<uint64_t>(e.page_size) - 1;
+        return e.asid == 1 && e.va == (0x1000 & ~mask);
+    });
+    tlb.invalidate_by_asid(2);
+    check("by ASID 2", [](const TLBEntry& e) { return e.asid == 2; });
+    tlb.invalidate_by_stream(3);
+    check("by stream 3", [](const TLBEntry& e) { return e.stream_id == 3; });
+    tlb.invalidate_by_vmid(1);
+    check("by VMID 1", [](const TLBEntry& e) { return e.vmid == 1; });
+    tlb.invalidate_by_asid(7);
+    check("by ASID 7 (absent)", [](const TLBEntry&) { return false; });
+    
+    std::cout << "All invalidations match reference: " << (all_match ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試14：範圍 TLB 無效化
+// 檢查範圍命令的編碼，並在兩種 TLB 上與參考模型比較範圍無效化的結果
+// ============================================================================
+
+void test_range_invalidation() {
+    std::cout << "=== Test 14: Range TLB Invalidation ===\n\n";
+    
+    // 64MB（16384 個 4KB 頁面）只需一條命令：scale 2, num 7
+    auto commands = make_tlbi_range_commands(0x40000000, 16384, 1);
+    std::cout << "64MB range encoded as " << commands.size() << " command(s), "
+              << "size 0x" << std::hex << tlbi_range_size(commands[0]) << std::dec << " "
+              << (commands.size() == 1 && tlbi_range_size(commands[0]) == 64ULL << 20 ? "✅" : "❌")
+              << "\n";
+    
+    // 任意頁數的命令應無縫覆蓋整個範圍
+    uint64_t covered = 0;
+    bool contiguous = true;
+    for (const auto& cmd : make_tlbi_range_commands(0x40000000, 1000, 1)) {
+        contiguous = contiguous && cmd.data.tlbi_va.va == 0x40000000 + covered;
+        covered += cmd.data.tlbi_va.tg ? tlbi_range_size(cmd) : 0x1000;
+    }
+    std::cout << "1000 pages covered contiguously: "
+              << (contiguous && covered == 1000 * 0x1000ULL ? "✅" : "❌") << "\n";
+    
+    // 4KB 頁面和 2MB 塊分佈在 0-16MB 內，兩個 ASID
+    std::vector<TLBEntry> entries;
+    for (int i = 0; i < 256; i++) {
+        TLBEntry entry;
+        bool block = (i % 8) == 0;
+        entry.page_size = block ? PageSize::SIZE_2MB : PageSize::SIZE_4KB;
+        entry.level = block ? 2 : 3;
+        entry.va = block ? (i / 8) % 8 * 0x200000ULL : i * 0x11000ULL;
+        entry.pa = 0x80000000ULL + i * 0x200000ULL;
+        entry.asid = static_cast<ASID>(i % 2);
+        entries.push_back(entry);
+    }
+    
+    struct RangeCase { VirtualAddress start; uint64_t size; ASID asid; uint8_t ttl; };
+    const RangeCase cases[] = {
+        {0x100000, 0x300000, 0, 0},   // 跨越 2MB 塊邊界
+        {0x0, 0x1000000, 1, 3},       // 只清除 L3 頁面
+        {0x5000, 0x1000, 0, 0},       // 單頁
+        {0x0, ~0ULL, 1, 0},           // 整個地址空間
+    };
+    
+    auto overlaps = [](const TLBEntry& e, const RangeCase& c) {
+        uint64_t mask = static_cast<uint64_t>(e.page_size) - 1;
+        VirtualAddress last = c.start + c.size - 1 < c.start ? ~0ULL : c.start + c.size - 1;
+        return e.asid == c.asid && (c.ttl == 0 || e.level == c.ttl) &&
+               e.va <= last && (e.va | mask) >= c.start;
+    };
+    
+    auto run = [&](const char* name, TLBInterface& tlb) {
+        std::vector<TLBEntry> reference;
+        for (const auto& entry : entries) {
+            tlb.insert(entry);
+            bool exists = false;
+            for (const auto& r : reference) {
+                exists = exists || (r.va == entry.va && r.asid == entry.asid &&
+                                    r.page_size == entry.page_size);
+            }
+            if (!exists) reference.push_back(entry);
+        }
+        
+        bool match = true;
+        for (const auto& c : cases) {
+            tlb.invalidate_by_va_range(c.start, c.size, c.asid, c.ttl);
+            std::vector<TLBEntry> kept;
+            for (const auto& r : reference) {
+                if (!overlaps(r, c)) kept.push_back(r);
+            }
+            reference.swap(kept);
+            match = match && tlb.size() == reference.size();
+            for (const auto& r : reference) {
+                match = match && tlb.lookup(r.va, r.stream_id, r.asid, r.vmid).has_value();
+            }
+        }
+        std::cout << "  " << std::left << std::setw(22) << name << std::right
+                  << "remaining " << std::setw(3) << tlb.size()
+                  << " (expected " << std::setw(3) << reference.size() << ") "
+                  << (match ? "✅" : "❌") << "\n";
+    };
+    
+    TLB fully_associative(1024);
+    SetAssociativeTLB set_associative(1024, 8);
+    run("Fully associative", fully_associative);
+    run("Set associative", set_associative);
+    
+    // 通過命令隊列提交範圍命令
+    SMMU smmu;
+    smmu.set_memory_model(std::make_shared<SimpleMemoryModel>());
+    smmu.enable();
+    bool accepted = true;
+    for (const auto& cmd : make_tlbi_range_commands(0x0, 16384, 1)) {
+        accepted = accepted && smmu.submit_command(cmd);
+    }
+    smmu.process_commands();
+    std::cout << "Range command processed: "
+              << (accepted && smmu.get_statistics().commands_processed == 1 ? "✅" : "❌")
+              << "\n\n";
+}
+
+// ============================================================================
+// 測試15：內存命令隊列和事件隊列
+// 驅動直接在內存中寫入命令並敲門鈴，檢查 CONS、CMD_SYNC 完成信號、
+// 非法命令的錯誤處理、隊列回繞以及事件隊列溢出
+// ============================================================================
+
+void test_memory_queues() {
+    std::cout << "=== Test 15: Memory-Resident Command and Event Queues ===\n\n";
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    SMMU smmu;
+    smmu.set_memory_model(memory);
+    
+    PhysicalAddress ttb;
+    setup_simple_page_table(*memory, ttb);
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    smmu.configure_stream_table_entry(0, ste);
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = ttb;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    smmu.configure_context_descriptor(0, 1, cd);
+    
+    // 16 項命令隊列、4 項事件隊列，隊列內存先寫入一次使其常駐
+    const uint8_t cmdq_log2size = 4;
+    const uint8_t eventq_log2size = 2;
+    PhysicalAddress cmdq = memory->allocate_page(4096);
+    PhysicalAddress eventq = memory->allocate_page(4096);
+    PhysicalAddress sync_word = memory->allocate_page(4096);
+    std::vector<uint8_t> zeros(4096, 0);
+    for (PhysicalAddress page : {cmdq, eventq, sync_word}) {
+        memory->write(page, zeros.data(), zeros.size());
+    }
+    smmu.write_register_64(RegisterOffset::CMDQ_BASE, cmdq | cmdq_log2size);
+    smmu.write_register_64(RegisterOffset::EVENTQ_BASE, eventq | eventq_log2size);
+    smmu.write_register(RegisterOffset::CR0, CR0::SMMUEN | CR0::CMDQEN | CR0::EVENTQEN);
+    std::cout << "SMMU enabled via CR0: " << (smmu.is_enabled() ? "✅" : "❌") << "\n";
+    
+    auto write_entry = [&](uint32_t index, const Command& cmd) {
+        uint64_t raw[2];
+        queue::encode_command(cmd, raw);
+        memory->write(cmdq + (index % 16) * queue::COMMAND_ENTRY_SIZE, raw, sizeof(raw));
+    };
+    
+    // 填充 TLB，然後一次門鈴提交 3 條 TLBI 和一條帶 MSI 的 CMD_SYNC
+    for (VirtualAddress va : {0x1000, 0x2000, 0x3000}) smmu.translate(va, 0, 1, 0);
+    for (uint32_t i = 0; i < 3; i++) {
+        Command tlbi;
+        tlbi.type = CommandType::CMD_TLBI_NH_VA;
+        tlbi.data.tlbi_va.va = 0x1000 * (i + 1);
+        tlbi.data.tlbi_va.asid = 1;
+        write_entry(i, tlbi);
+    }
+    Command sync;
+    sync.type = CommandType::CMD_SYNC;
+    sync.data.sync.cs = SYNC_CS_IRQ;
+    sync.data.sync.msi_address = sync_word;
+    sync.data.sync.msi_data = 0xC0FFEE;
+    write_entry(3, sync);
+    smmu.write_register(RegisterOffset::CMDQ_PROD, 4);
+    
+    uint32_t msi = 0;
+    memory->read(sync_word, &msi, sizeof(msi));
+    auto before = smmu.get_statistics().tlb_misses;
+    for (VirtualAddress va : {0x1000, 0x2000, 0x3000}) smmu.translate(va, 0, 1, 0);
+    std::cout << "Doorbell consumed batch (CONS = "
+              << smmu.read_register(RegisterOffset::CMDQ_CONS) << "): "
+              << (smmu.read_register(RegisterOffset::CMDQ_CONS) == 4 ? "✅" : "❌") << "\n";
+    std::cout << "CMD_SYNC wrote MSI: " << (msi == 0xC0FFEE ? "✅" : "❌") << "\n";
+    std::cout << "TLBI took effect: "
+              << (smmu.get_statistics().tlb_misses - before == 3 ? "✅" : "❌") << "\n";
+    
+    // 非法命令：處理停在出錯的表項上，確認前不再消費
+    uint64_t illegal[2] = {0xFF, 0};
+    memory->write(cmdq + 4 * queue::COMMAND_ENTRY_SIZE, illegal, sizeof(illegal));
+    write_entry(5, Command());
+    smmu.write_register(RegisterOffset::CMDQ_PROD, 6);
+    uint32_t cons = smmu.read_register(RegisterOffset::CMDQ_CONS);
+    uint32_t gerror = smmu.read_register(RegisterOffset::GERROR);
+    bool stopped = (cons & ~CMDQ_CONS::ERR_MASK) == 4 &&
+                   (cons & CMDQ_CONS::ERR_MASK) >> CMDQ_CONS::ERR_SHIFT == CMDQ_CONS::CERROR_ILL &&
+                   (gerror & GERROR::CMDQ_ERR) != 0;
+    std::cout << "Illegal command halts queue with CERROR_ILL: " << (stopped ? "✅" : "❌") << "\n";
+    
+    // 驅動把出錯的表項替換為 CMD_SYNC，寫 GERRORN 確認後繼續
+    write_entry(4, Command());
+    smmu.write_register(RegisterOffset::GERRORN, gerror);
+    std::cout << "Resumed after GERRORN ack: "
+              << (smmu.read_register(RegisterOffset::CMDQ_CONS) == 6 ? "✅" : "❌") << "\n";
+    
+    // 通過 submit_command 提交超過隊列深度的命令，索引回繞
+    bool accepted = true;
+    for (int i = 0; i < 20; i++) accepted = accepted && smmu.submit_command(Command());
+    uint32_t wrapped = smmu.read_register(RegisterOffset::CMDQ_CONS);
+    std::cout << "Wrapped queue (CONS = 0x" << std::hex << wrapped << std::dec << "): "
+              << (accepted && wrapped == queue::advance(6, 20, cmdq_log2size) &&
+                  wrapped == smmu.read_register(RegisterOffset::CMDQ_PROD) ? "✅" : "❌") << "\n";
+    
+    // 事件隊列溢出：6 個錯誤寫入 4 項隊列
+    for (int i = 0; i < 6; i++) smmu.translate(0x800000 + i * 0x1000, 0, 1, 0);
+    uint32_t prod = smmu.read_register(RegisterOffset::EVENTQ_PROD);
+    auto stats = smmu.get_statistics();
+    std::cout << "Event queue overflow flagged (OVFLG, dropped " << stats.events_dropped << "): "
+              << ((prod & EVENTQ_PROD::OVFLG) && stats.events_dropped == 2 ? "✅" : "❌") << "\n";
+    
+    int popped = 0;
+    bool in_order = true;
+    while (smmu.has_events()) {
+        Event event = smmu.pop_event();
+        in_order = in_order && event.fault_type == FaultType::TRANSLATION_FAULT &&
+                   event.va == 0x800000 + popped * 0x1000ULL;
+        popped++;
+    }
+    uint32_t event_cons = smmu.read_register(RegisterOffset::EVENTQ_CONS);
+    std::cout << "Drained " << popped << " events in order, overflow acknowledged: "
+              << (popped == 4 && in_order && (event_cons & EVENTQ_CONS::OVACKFLG) ? "✅" : "❌")
+              << "\n";
+    
+    // 並發模式：多個線程同時提交，門鈴由正在消費的線程代為處理，命令不丟失
+    SMMUConfig concurrent_config;
+    concurrent_config.thread_safe = true;
+    SMMU shared(concurrent_config);
+    shared.set_memory_model(memory);
+    shared.write_register_64(RegisterOffset::CMDQ_BASE, cmdq | cmdq_log2size);
+    shared.write_register(RegisterOffset::CR0, CR0::SMMUEN | CR0::CMDQEN);
+    std::atomic<uint64_t> submitted{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&shared, &submitted]() {
+            Command tlbi;
+            tlbi.type = CommandType::CMD_TLBI_NH_ASID;
+            tlbi.data.tlbi_asid.asid = 1;
+            for (int i = 0; i < 200; i++) {
+                if (shared.submit_command(tlbi)) submitted++;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    shared.process_commands();
+    std::cout << "Concurrent submitters: " << shared.get_statistics().commands_processed
+              << " of " << submitted.load() << " accepted commands processed "
+              << (shared.get_statistics().commands_processed == submitted.load() &&
+                  shared.read_register(RegisterOffset::CMDQ_CONS) ==
+                      shared.read_register(RegisterOffset::CMDQ_PROD) ? "✅" : "❌")
+              << "\n\n";
+}
+
+// ============================================================================
+// 測試16：二級線性流表
+// 稀疏的大 StreamID、每個流多個上下文描述符、原地更新和超出 SIDSIZE 的 StreamID
+// ============================================================================
+
+void test_stream_table() {
+    std::cout << "=== Test 16: Two-Level Stream Table ===\n\n";
+    
+    for (bool thread_safe : {false, true}) {
+        SMMUConfig config;
+        config.thread_safe = thread_safe;
+        SMMU smmu(config);
+        
+        // SR-IOV 風格的 StreamID：總線號在高位，功能號在低位
+        const StreamID sids[] = {0, 255, 256, 0x1234, 0x10000, 0xFFFFFF};
+        for (StreamID sid : sids) {
+            StreamTableEntry ste;
+            ste.valid = true;
+            ste.s1_enabled = true;
+            ste.vmid = static_cast<VMID>(sid & 0xFFFF);
+            smmu.configure_stream_table_entry(sid, ste);
+            for (ASID asid = 1; asid <= 3; asid++) {
+                ContextDescriptor cd;
+                cd.valid = true;
+                cd.asid = asid;
+                cd.translation_table_base = (static_cast<uint64_t>(sid) << 16) | (asid << 12);
+                smmu.configure_context_descriptor(sid, asid, cd);
+            }
+        }
+        
+        // 更新已有的上下文描述符，不應生成新表項
+        ContextDescriptor updated = smmu.get_context_descriptor(0x1234, 2);
+        updated.translation_table_base = 0xABC000;
+        smmu.configure_context_descriptor(0x1234, 2, updated);
+        
+        bool all_found = true;
+        for (StreamID sid : sids) {
+            all_found = all_found && smmu.get_stream_table_entry(sid).valid &&
+                        smmu.get_stream_table_entry(sid).vmid == (sid & 0xFFFF);
+            for (ASID asid = 1; asid <= 3; asid++) {
+                uint64_t expected = (sid == 0x1234 && asid == 2)
+                    ? 0xABC000 : ((static_cast<uint64_t>(sid) << 16) | (asid << 12));
+                all_found = all_found &&
+                            smmu.get_context_descriptor(sid, asid).translation_table_base == expected;
+            }
+        }
+        
+        // 未配置的流、未配置的 ASID 和超出 24 位的 StreamID
+        StreamTableEntry big;
+        big.valid = true;
+        smmu.configure_stream_table_entry(0x1000000, big);
+        bool absent = !smmu.get_stream_table_entry(257).valid &&
+                      !smmu.get_context_descriptor(0, 9).valid &&
+                      !smmu.get_stream_table_entry(0x1000000).valid;
+        
+        std::cout << (thread_safe ? "Concurrent" : "Single-threaded") << " mode: "
+                  << "lookups " << (all_found ? "✅" : "❌")
+                  << ", absent entries " << (absent ? "✅" : "❌") << "\n";
+    }
+    std::cout << "\n";
+}
+
+// ============================================================================
+// 測試17：嵌套轉換
+// 階段1頁表本身位於 IPA 空間（IPA 與 PA 不同），遍歷時每一級表地址都經過階段2轉換；
+// 驗證描述符讀取數、階段2 TLB 的復用、權限組合和按 VMID 的無效化
+// ============================================================================
+
+// 在 4KB 粒度的 4 級頁表中映射一個頁面，按需分配中間級別的表（表位於 PA 空間）
+// 返回葉子描述符的地址
+static PhysicalAddress map_page_4k(SimpleMemoryModel& memory, PhysicalAddress root,
+                        uint64_t in, PhysicalAddress out, uint64_t attrs) {
+    PhysicalAddress table = root;
+    for (int level = 0; level < 3; level++) {
+        PhysicalAddress entry = table + ((in >> (39 - level * 9)) & 0x1FF) * 8;
+        uint64_t desc = 0;
+        memory.read(entry, &desc, 8);
+        if ((desc & 1) == 0) {
+            desc = memory.allocate_page() | 0x3;
+            memory.write_pte(entry, desc);
+        }
+        table = desc & 0x0000FFFFFFFFF000ULL;
+    }
+    PhysicalAddress leaf = table + ((in >> 12) & 0x1FF) * 8;
+    memory.write_pte(leaf, out | attrs | 0x3);
+    return leaf;
+}
+
+void test_nested_translation() {
+    std::cout << "=== Test 17: Nested Stage 1 + Stage 2 Translation ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);  // AF=1，Normal WB，讀寫
+    constexpr uint64_t NORMAL_RO = NORMAL_RW | 0xC0;    // AP=11，只讀
+    constexpr uint64_t IPA_OFFSET = 0x40000000;         // 階段1表的 IPA = PA + IPA_OFFSET
+    constexpr uint64_t DATA_IPA = 0x50000000;
+    constexpr PhysicalAddress DATA_PA = 0x200000;
+    constexpr VMID VM = 5;
+    
+    for (bool cached : {false, true}) {
+        auto memory = std::make_shared<SimpleMemoryModel>();
+        
+        // 階段1表：在 PA 空間分配，描述符中保存下一級表的 IPA
+        PhysicalAddress s1_tables[4];
+        for (auto& table : s1_tables) table = memory->allocate_page();
+        for (int level = 0; level < 3; level++) {
+            memory->write_pte(s1_tables[level], (s1_tables[level + 1] + IPA_OFFSET) | 0x3);
+        }
+        for (int i = 0; i < 16; i++) {
+            memory->write_pte(s1_tables[3] + i * 8, (DATA_IPA + i * 0x1000) | NORMAL_RW | 0x3);
+        }
+        
+        // 階段2表：階段1表頁面和數據頁面的 IPA -> PA，第3頁在階段2只讀
+        PhysicalAddress s2_root = memory->allocate_page();
+        PhysicalAddress s2_leaves[4];
+        for (int level = 0; level < 4; level++) {
+            s2_leaves[level] = map_page_4k(*memory, s2_root, s1_tables[level] + IPA_OFFSET,
+                                           s1_tables[level], NORMAL_RW);
+        }
+        for (int i = 0; i < 16; i++) {
+            map_page_4k(*memory, s2_root, DATA_IPA + i * 0x1000, DATA_PA + i * 0x1000,
+                        i == 3 ? NORMAL_RO : NORMAL_RW);
+        }
+        
+        SMMUConfig config;
+        config.walk_cache_size = cached ? 16 : 0;
+        config.s2_tlb_size = cached ? 64 : 0;
+        SMMU smmu(config);
+        smmu.set_memory_model(memory);
+        
+        StreamTableEntry ste;
+        ste.valid = true;
+        ste.s1_enabled = true;
+        ste.s2_enabled = true;
+        ste.s2_translation_table_base = s2_root;
+        ste.s2_granule = 12;
+        ste.vmid = VM;
+        smmu.configure_stream_table_entry(0, ste);
+        
+        ContextDescriptor cd;
+        cd.valid = true;
+        cd.translation_table_base = s1_tables[0] + IPA_OFFSET;
+        cd.translation_granule = 12;
+        cd.ips = 48;
+        cd.asid = 1;
+        smmu.configure_context_descriptor(0, 1, cd);
+        smmu.enable();
+        
+        // 冷遍歷：4 次階段1讀取 + 5 次階段2遍歷（4 個表地址和輸出）各 4 次讀取；
+        // 有遍歷緩存時後面的階段2遍歷共用上層表：4 + 4 + 1 * 3 + 2（輸出 IPA 從 L2 開始）
+        uint8_t cold_reads = cached ? 13 : 24;
+        auto first = smmu.translate(0x0, 0, 1, VM);
+        bool cold_ok = first.success && first.physical_addr == DATA_PA &&
+                       first.descriptor_reads == cold_reads;
+        
+        // 相鄰頁面：有緩存時階段1從 L3 開始（表地址命中階段2 TLB），輸出的階段2遍歷也從 L3 開始
+        auto second = smmu.translate(0x1000, 0, 1, VM);
+        uint8_t expected_reads = cached ? 2 : 24;
+        bool warm_ok = second.success && second.physical_addr == DATA_PA + 0x1000 &&
+                       second.descriptor_reads == expected_reads;
+        
+        // 組合權限：階段1可寫、階段2只讀 -> 只讀；再次訪問命中組合 TLB 表項
+        auto ro = smmu.translate(0x3010, 0, 1, VM);
+        auto ro_hit = smmu.translate(0x3020, 0, 1, VM);
+        bool perm_ok = ro.success && ro.permission == AccessPermission::READ_ONLY &&
+                       ro_hit.descriptor_reads == 0 && ro_hit.physical_addr == DATA_PA + 0x3020 &&
+                       ro_hit.permission == AccessPermission::READ_ONLY;
+        
+        auto stats = smmu.get_statistics();
+        bool s2_tlb_ok = cached ? stats.s2_tlb_hits > 0 : stats.s2_tlb_hits == 0;
+        
+        // CMD_TLBI_S12_VMALL 清除組合表項、階段2 TLB 和遍歷緩存：下一次轉換重新冷遍歷
+        Command vmall;
+        vmall.type = CommandType::CMD_TLBI_S12_VMALL;
+        vmall.data.tlbi_vmall.vmid = VM;
+        smmu.submit_command(vmall);
+        smmu.process_commands();
+        auto again = smmu.translate(0x0, 0, 1, VM);
+        bool vmall_ok = again.success && again.descriptor_reads == cold_reads;
+        
+        // 撤銷 L2 表頁面的階段2映射：階段1遍歷在讀取 L2 描述符前失敗
+        memory->write_pte(s2_leaves[2], 0);
+        smmu.invalidate_tlb_by_vmid(VM);
+        auto faulted = smmu.translate(0x5000, 0, 1, VM);
+        bool fault_ok = !faulted.success &&
+                        faulted.fault_type == FaultType::TRANSLATION_FAULT &&
+                        std::string(faulted.fault_reason) == "Stage 2 fault on stage 1 table walk";
+        
+        std::cout << (cached ? "With S2 TLB and walk cache" : "Uncached") << ":\n";
+        std::cout << "  Cold nested walk: " << static_cast<int>(first.descriptor_reads)
+                  << " reads " << (cold_ok ? "✅" : "❌") << "\n";
+        std::cout << "  Neighbouring page: " << static_cast<int>(second.descriptor_reads)
+                  << " reads " << (warm_ok ? "✅" : "❌") << "\n";
+        std::cout << "  Combined permission: " << (perm_ok ? "✅" : "❌")
+                  << ", S2 TLB hits " << stats.s2_tlb_hits << " " << (s2_tlb_ok ? "✅" : "❌") << "\n";
+        std::cout << "  After TLBI_S12_VMALL: " << static_cast<int>(again.descriptor_reads)
+                  << " reads " << (vmall_ok ? "✅" : "❌") << "\n";
+        std::cout << "  Stage 2 fault on table walk: " << (fault_ok ? "✅" : "❌") << "\n";
+    }
+    std::cout << "\n";
+}
+
+// ============================================================================
+// 測試18：順序訪問預取
+// 驗證步長檢測、預取緩衝區命中、映射末尾的預取不產生事件，
+// 以及無效化會丟棄已預取的表項
+// ============================================================================
+
+void test_prefetching() {
+    std::cout << "=== Test 18: Sequential Stream Prefetching ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr VirtualAddress VA = 0x10000000;
+    constexpr PhysicalAddress PA = 0x800000;
+    constexpr int PAGES = 64;
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress root = memory->allocate_page();
+    PhysicalAddress leaves[PAGES];
+    for (int i = 0; i < PAGES; i++) {
+        leaves[i] = map_page_4k(*memory, root, VA + i * 0x1000, PA + i * 0x1000, NORMAL_RW);
+    }
+    
+    SMMUConfig config;
+    config.tlb_size = 16;
+    config.prefetch_depth = 4;
+    SMMU smmu(config);
+    smmu.set_memory_model(memory);
+    
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    smmu.configure_stream_table_entry(3, ste);
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = root;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    smmu.configure_context_descriptor(3, 1, cd);
+    smmu.enable();
+    
+    // 順序掃描：前三頁建立步長，之後每個新頁面都由預取緩衝區滿足
+    bool correct = true;
+    size_t zero_read_misses = 0;
+    for (int i = 0; i < PAGES; i++) {
+        for (int offset = 0; offset < 4096; offset += 1024) {
+            auto result = smmu.translate(VA + i * 0x1000 + offset, 3, 1);
+            correct = correct && result.success &&
+                      result.physical_addr == PA + i * 0x1000 + offset;
+            if (offset == 0 && result.descriptor_reads == 0) zero_read_misses++;
+        }
+    }
+    auto stats = smmu.get_statistics();
+    bool sweep_ok = correct && stats.tlb_misses == PAGES &&
+                    stats.prefetch_hits == PAGES - 3 &&
+                    stats.prefetches_issued == PAGES - 3 &&
+                    stats.prefetches_unused == 0 &&
+                    zero_read_misses == PAGES - 3 &&
+                    stats.events_generated == 0;
+    std::cout << "Ascending sweep: " << stats.prefetch_hits << "/" << stats.tlb_misses
+              << " misses served by prefetch, " << stats.prefetches_issued << " issued "
+              << (sweep_ok ? "✅" : "❌") << "\n";
+    
+    // 降序掃描（步長 -1）
+    smmu.invalidate_tlb_all();
+    smmu.reset_statistics();
+    for (int i = PAGES - 1; i >= 0; i--) smmu.translate(VA + i * 0x1000, 3, 1);
+    stats = smmu.get_statistics();
+    bool descending_ok = stats.prefetch_hits == PAGES - 3;
+    std::cout << "Descending sweep: " << stats.prefetch_hits << " prefetch hits "
+              << (descending_ok ? "✅" : "❌") << "\n";
+    
+    // 無固定步長的訪問不觸發預取
+    smmu.invalidate_tlb_all();
+    smmu.reset_statistics();
+    const int pattern[] = {5, 17, 2, 40, 33, 9, 60, 21, 12, 50};
+    for (int page : pattern) smmu.translate(VA + page * 0x1000, 3, 1);
+    stats = smmu.get_statistics();
+    bool random_ok = stats.prefetches_issued == 0;
+    std::cout << "Irregular pattern: " << stats.prefetches_issued << " prefetches "
+              << (random_ok ? "✅" : "❌") << "\n";
+    
+    // 已預取但尚未使用的頁面被重新映射：TLBI 之後不能使用舊的預取表項
+    smmu.invalidate_tlb_all();
+    smmu.reset_statistics();
+    for (int i = 0; i < 3; i++) smmu.translate(VA + i * 0x1000, 3, 1);  // 預取第 3-6 頁
+    memory->write_pte(leaves[4], (PA + 0x100000) | NORMAL_RW | 0x3);
+    smmu.invalidate_tlb_by_va(VA + 4 * 0x1000, 1);
+    smmu.translate(VA + 3 * 0x1000, 3, 1);
+    auto remapped = smmu.translate(VA + 4 * 0x1000, 3, 1);
+    stats = smmu.get_statistics();
+    bool invalidate_ok = remapped.success && remapped.physical_addr == PA + 0x100000 &&
+                         stats.prefetches_unused >= 1;
+    std::cout << "Invalidation drops stale prefetch: "
+              << (invalidate_ok ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試19：葉子緩存行填充
+// 最後一級一次讀取 8 個相鄰描述符，有效的相鄰頁面直接填入 TLB；
+// 無效的描述符不填充，屬性按各自的描述符設置
+// ============================================================================
+
+void test_leaf_line_fill() {
+    std::cout << "=== Test 19: Leaf Cache Line Fill ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr uint64_t NORMAL_RO = NORMAL_RW | 0xC0;
+    constexpr VirtualAddress VA = 0x20000000;
+    constexpr PhysicalAddress PA = 0x900000;
+    constexpr int PAGES = 16;
+    constexpr int HOLE = 10;      // 未映射的頁面
+    constexpr int READ_ONLY = 5;  // 只讀的頁面
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress root = memory->allocate_page();
+    for (int i = 0; i < PAGES; i++) {
+        if (i == HOLE) continue;
+        map_page_4k(*memory, root, VA + i * 0x1000, PA + i * 0x7000,
+                    i == READ_ONLY ? NORMAL_RO : NORMAL_RW);
+    }
+    
+    for (bool fill : {false, true}) {
+        SMMUConfig config;
+        config.fill_leaf_neighbours = fill;
+        SMMU smmu(config);
+        smmu.set_memory_model(memory);
+        
+        StreamTableEntry ste;
+        ste.valid = true;
+        ste.s1_enabled = true;
+        smmu.configure_stream_table_entry(0, ste);
+        ContextDescriptor cd;
+        cd.valid = true;
+        cd.translation_table_base = root;
+        cd.translation_granule = 12;
+        cd.ips = 48;
+        cd.asid = 1;
+        smmu.configure_context_descriptor(0, 1, cd);
+        smmu.enable();
+        
+        bool correct = true;
+        for (int i = 0; i < PAGES; i++) {
+            auto result = smmu.translate(VA + i * 0x1000 + 0x80, 0, 1);
+            if (i == HOLE) {
+                correct = correct && !result.success;
+                continue;
+            }
+            AccessPermission expected = (i == READ_ONLY) ? AccessPermission::READ_ONLY
+                                                         : AccessPermission::READ_WRITE;
+            correct = correct && result.success &&
+                      result.physical_addr == PA + i * 0x7000 + 0x80 &&
+                      result.permission == expected;
+        }
+        
+        // 有填充時：每個緩存行一次遍歷，空洞頁面仍然未命中；無填充時每頁一次
+        auto stats = smmu.get_statistics();
+        uint64_t expected_misses = fill ? 3 : PAGES;
+        uint64_t expected_fills = fill ? PAGES - 3 : 0;
+        bool ok = correct && stats.tlb_misses == expected_misses &&
+                  stats.neighbour_fills == expected_fills;
+        std::cout << (fill ? "With neighbour fill" : "Without neighbour fill") << ": "
+                  << stats.tlb_misses << " misses, " << stats.neighbour_fills
+                  << " neighbour fills, " << stats.descriptor_reads << " descriptor reads "
+                  << (ok ? "✅" : "❌") << "\n";
+    }
+    std::cout << "\n";
+}
+
+// ============================================================================
+// 測試20：連續頁面合併
+// 設置了連續位的 16 個頁面緩存為一個 64KB 表項，使其中任一頁面無效化
+// 會移除整個表項；未設置連續位時，葉子緩存行中 PA 連續且屬性相同的
+// 對齊頁面組由軟件合併為一個表項
+// ============================================================================
+
+void test_contiguous_coalescing() {
+    std::cout << "=== Test 20: Contiguous Page Coalescing ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr uint64_t NORMAL_RO = NORMAL_RW | 0xC0;
+    constexpr uint64_t CONTIGUOUS = 1ULL << 52;
+    constexpr VirtualAddress HINT_VA = 0x30000000;
+    constexpr VirtualAddress MERGE_VA = 0x30100000;
+    constexpr PhysicalAddress HINT_PA = 0xA00000;
+    constexpr PhysicalAddress MERGE_PA = 0xB00000;
+    constexpr int PAGES = 16;
+    constexpr int READ_ONLY = 11;  // 屬性不同的頁面
+    constexpr int MOVED = 13;      // PA 不連續的頁面
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress root = memory->allocate_page();
+    auto merge_pa = [&](int i) {
+        return i == MOVED ? MERGE_PA + 0x100000 : MERGE_PA + i * 0x1000;
+    };
+    for (int i = 0; i < PAGES; i++) {
+        map_page_4k(*memory, root, HINT_VA + i * 0x1000, HINT_PA + i * 0x1000,
+                    NORMAL_RW | CONTIGUOUS);
+        map_page_4k(*memory, root, MERGE_VA + i * 0x1000, merge_pa(i),
+                    i == READ_ONLY ? NORMAL_RO : NORMAL_RW);
+    }
+    
+    auto make_smmu = [&](bool hint, bool coalesce) {
+        SMMUConfig config;
+        config.use_contiguous_hint = hint;
+        config.coalesce_leaf_pages = coalesce;
+        auto smmu = std::make_unique<SMMU>(config);
+        smmu->set_memory_model(memory);
+        
+        StreamTableEntry ste;
+        ste.valid = true;
+        ste.s1_enabled = true;
+        smmu->configure_stream_table_entry(0, ste);
+        ContextDescriptor cd;
+        cd.valid = true;
+        cd.translation_table_base = root;
+        cd.translation_granule = 12;
+        cd.ips = 48;
+        cd.asid = 1;
+        smmu->configure_context_descriptor(0, 1, cd);
+        smmu->enable();
+        return smmu;
+    };
+    
+    // 連續位：一次遍歷覆蓋 64KB，無效化其中一頁移除整個表項
+    for (bool hint : {true, false}) {
+        auto smmu = make_smmu(hint, false);
+        bool correct = true;
+        for (int i = 0; i < PAGES; i++) {
+            auto result = smmu->translate(HINT_VA + i * 0x1000 + 0x40, 0, 1);
+            correct = correct && result.success &&
+                      result.physical_addr == HINT_PA + i * 0x1000 + 0x40 &&
+                      result.contiguous == hint &&
+                      result.page_size == (hint ? PageSize::SIZE_64KB : PageSize::SIZE_4KB);
+        }
+        auto stats = smmu->get_statistics();
+        uint64_t expected_misses = hint ? 1 : PAGES;
+        bool ok = correct && stats.tlb_misses == expected_misses &&
+                  stats.contiguous_fills == (hint ? 1u : 0u);
+        std::cout << (hint ? "Contiguous hint" : "Hint ignored") << ": "
+                  << stats.tlb_misses << " misses for " << PAGES << " pages "
+                  << (ok ? "✅" : "❌") << "\n";
+        
+        if (hint) {
+            smmu->invalidate_tlb_by_va(HINT_VA + 5 * 0x1000, 1);
+            smmu->translate(HINT_VA, 0, 1);
+            bool invalidate_ok = smmu->get_statistics().tlb_misses == 2;
+            std::cout << "TLBI of one page drops the whole span: "
+                      << (invalidate_ok ? "✅" : "❌") << "\n";
+        }
+    }
+    
+    // 軟件合併：頁面 0-7 合併為 32KB，8-9 和 14-15 各合併為 8KB；
+    // 頁面 11 屬性不同、頁面 13 PA 不連續，10-13 各自單獨緩存
+    for (bool coalesce : {true, false}) {
+        auto smmu = make_smmu(true, coalesce);
+        bool correct = true;
+        for (int i = 0; i < PAGES; i++) {
+            auto result = smmu->translate(MERGE_VA + i * 0x1000 + 0x40, 0, 1);
+            AccessPermission expected = (i == READ_ONLY) ? AccessPermission::READ_ONLY
+                                                         : AccessPermission::READ_WRITE;
+            correct = correct && result.success &&
+                      result.physical_addr == merge_pa(i) + 0x40 &&
+                      result.permission == expected;
+        }
+        auto stats = smmu->get_statistics();
+        uint64_t expected_misses = coalesce ? 7 : PAGES;
+        uint64_t expected_merges = coalesce ? 3 : 0;
+        bool ok = correct && stats.tlb_misses == expected_misses &&
+                  stats.coalesced_fills == expected_merges;
+        std::cout << (coalesce ? "With coalescing" : "Without coalescing") << ": "
+                  << stats.tlb_misses << " misses, " << stats.coalesced_fills
+                  << " coalesced fills " << (ok ? "✅" : "❌") << "\n";
+    }
+    std::cout << "\n";
+}
+
+// ============================================================================
+// 測試21：直接內存讀取路徑
+// 遍歷器直接讀取 SimpleMemoryModel 時不調用回調，結果（包括葉子緩存行、
+// 描述符讀取數和錯誤）與回調路徑完全相同
+// ============================================================================
+
+void test_direct_memory_walk() {
+    std::cout << "=== Test 21: Direct Memory Walk Path ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr VirtualAddress VA = 0x40000000;
+    
+    SimpleMemoryModel memory;
+    PhysicalAddress root = memory.allocate_page();
+    for (int i = 0; i < 8; i++) {
+        if (i == 3) continue;  // 空洞
+        map_page_4k(memory, root, VA + i * 0x1000, 0x700000 + i * 0x3000,
+                    NORMAL_RW | (i == 5 ? 0xC0 : 0));
+    }
+    // VA + 4MB 為 2MB 塊：在已有的 L2 表中寫入塊描述符（bit 1 = 0）
+    PhysicalAddress table = root;
+    for (int level = 0; level < 2; level++) {
+        uint64_t desc = 0;
+        memory.read(table + ((VA >> (39 - level * 9)) & 0x1FF) * 8, &desc, 8);
+        table = desc & 0x0000FFFFFFFFF000ULL;
+    }
+    memory.write_pte(table + (((VA + 0x400000) >> 21) & 0x1FF) * 8,
+                     0x40000000 | NORMAL_RW | 0x1);
+    
+    uint64_t callback_reads = 0;
+    MemoryReadCallback read = [&](PhysicalAddress addr, uint64_t& data, size_t size) {
+        callback_reads++;
+        return memory.read(addr, &data, size);
+    };
+    PageTableWalker callback_walker(read);
+    PageTableWalker direct_walker(read);
+    direct_walker.set_direct_memory(&memory);
+    
+    auto same = [](const TranslationResult& a, const TranslationResult& b) {
+        return a.success == b.success && a.physical_addr == b.physical_addr &&
+               a.permission == b.permission && a.page_size == b.page_size &&
+               a.level == b.level && a.descriptor_reads == b.descriptor_reads &&
+               a.fault_type == b.fault_type;
+    };
+    auto same_line = [](const LeafLine& a, const LeafLine& b) {
+        if (a.count != b.count || a.index != b.index || a.va_base != b.va_base) return false;
+        for (size_t i = 0; i < a.count; i++) {
+            if (a.descriptor(i).valid != b.descriptor(i).valid ||
+                a.descriptor(i).address != b.descriptor(i).address ||
+                a.descriptor(i).ap != b.descriptor(i).ap) return false;
+        }
+        return true;
+    };
+    
+    // 4KB 頁、空洞、只讀頁、2MB 塊和未映射的 L2 表項
+    std::vector<VirtualAddress> vas;
+    for (int i = 0; i < 8; i++) vas.push_back(VA + i * 0x1000 + 0x10);
+    vas.push_back(VA + 0x400000 + 0x12345);
+    vas.push_back(VA + 0x600000);
+    
+    bool equal = true;
+    for (bool with_line : {false, true}) {
+        for (VirtualAddress va : vas) {
+            LeafLine a, b;
+            auto expected = callback_walker.translate(va, root, 12, 48, TranslationStage::STAGE1,
+                                                      0, 0, nullptr, with_line ? &a : nullptr);
+            uint64_t before = callback_reads;
+            auto actual = direct_walker.translate(va, root, 12, 48, TranslationStage::STAGE1,
+                                                  0, 0, nullptr, with_line ? &b : nullptr);
+            equal = equal && same(expected, actual) && same_line(a, b) &&
+                    callback_reads == before;
+        }
+    }
+    
+    // 表地址超出物理地址範圍：兩條路徑都報告地址大小錯誤
+    auto callback_fault = callback_walker.translate(VA, SimpleMemoryModel::PA_LIMIT, 12, 48,
+                                                    TranslationStage::STAGE1);
+    auto direct_fault = direct_walker.translate(VA, SimpleMemoryModel::PA_LIMIT, 12, 48,
+                                                TranslationStage::STAGE1);
+    bool fault_ok = same(callback_fault, direct_fault) &&
+                    direct_fault.fault_type == FaultType::ADDRESS_SIZE_FAULT;
+    
+    std::cout << "Direct path matches callback path: " << (equal ? "✅" : "❌") << "\n";
+    std::cout << "Out-of-range table address faults on both paths: "
+              << (fault_ok ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試22：TLB 按流分區
+// 流 1 反覆訪問 16 個頁面，流 2 每輪交替掃描 64 個新頁面；沒有配額時流 2 沖掉
+// 流 1 的全部表項，流 1 保留 16 項或流 2 限制為 32 項時流 1 全部命中
+// ============================================================================
+
+void test_tlb_partitioning() {
+    std::cout << "=== Test 22: Per-Stream TLB Partitioning ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr VirtualAddress VA = 0x50000000;
+    constexpr int HOT_PAGES = 16;
+    constexpr int SWEEP_PAGES = 64;
+    constexpr int ROUNDS = 8;
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress root = memory->allocate_page();
+    for (int i = 0; i < SWEEP_PAGES * ROUNDS; i++) {
+        map_page_4k(*memory, root, VA + i * 0x1000, 0x2000000 + i * 0x1000, NORMAL_RW);
+    }
+    
+    struct Case {
+        const char* name;
+        uint32_t hot_reserved;
+        uint32_t sweep_limit;
+    };
+    const Case cases[] = {
+        {"No quotas", 0, 0},
+        {"Hot stream reserves 16", HOT_PAGES, 0},
+        {"Sweeping stream limited to 32", 0, 32},
+    };
+    
+    for (TLBOrganization organization : {TLBOrganization::FULLY_ASSOCIATIVE,
+                                         TLBOrganization::SET_ASSOCIATIVE}) {
+        bool set_assoc = organization == TLBOrganization::SET_ASSOCIATIVE;
+        for (const Case& c : cases) {
+            SMMUConfig config;
+            config.tlb_size = 64;
+            config.tlb_organization = organization;
+            SMMU smmu(config);
+            smmu.set_memory_model(memory);
+            
+            ContextDescriptor cd;
+            cd.valid = true;
+            cd.translation_table_base = root;
+            cd.translation_granule = 12;
+            cd.ips = 48;
+            cd.asid = 1;
+            for (StreamID stream : {1u, 2u}) {
+                StreamTableEntry ste;
+                ste.valid = true;
+                ste.s1_enabled = true;
+                ste.tlb_reserved = (stream == 1) ? c.hot_reserved : 0;
+                ste.tlb_limit = (stream == 2) ? c.sweep_limit : 0;
+                smmu.configure_stream_table_entry(stream, ste);
+                smmu.configure_context_descriptor(stream, 1, cd);
+            }
+            smmu.enable();
+            
+            size_t max_sweep_entries = 0;
+            // 交替訪問：熱頁面尚未全部載入時 TLB 已經被填滿
+            for (int round = 0; round < ROUNDS; round++) {
+                for (int i = 0; i < HOT_PAGES; i++) {
+                    smmu.translate(VA + i * 0x1000, 1, 1);
+                    for (int j = 0; j < SWEEP_PAGES / HOT_PAGES; j++) {
+                        int page = round * SWEEP_PAGES + i * (SWEEP_PAGES / HOT_PAGES) + j;
+                        smmu.translate(VA + page * 0x1000, 2, 1);
+                    }
+                }
+                max_sweep_entries = std::max(max_sweep_entries,
+                                             smmu.get_stream_tlb_statistics(2).entries);
+            }
+            
+            TLBStreamStats hot = smmu.get_stream_tlb_statistics(1);
+            TLBStreamStats sweep = smmu.get_stream_tlb_statistics(2);
+            bool protected_hot = c.hot_reserved || c.sweep_limit;
+            bool ok = protected_hot
+                ? (hot.misses == HOT_PAGES && hot.hits == HOT_PAGES * (ROUNDS - 1) &&
+                   hot.evictions == 0 && hot.entries == HOT_PAGES)
+                : (hot.hits == 0 && hot.evictions > 0);
+            ok = ok && sweep.misses == SWEEP_PAGES * ROUNDS && sweep.evictions > 0 &&
+                 (c.sweep_limit == 0 || max_sweep_entries <= c.sweep_limit);
+            ok = ok && (set_assoc || sweep.bypasses == 0);
+            std::cout << (set_assoc ? "[set-assoc] " : "[fully-assoc] ") << c.name
+                      << ": hot stream " << hot.hits << " hits / " << hot.misses
+                      << " misses, sweeping stream " << sweep.evictions << " evictions, "
+                      << sweep.bypasses << " bypasses " << (ok ? "✅" : "❌") << "\n";
+            
+            // 重置統計：計數器清零，配額和表項數保留
+            smmu.reset_statistics();
+            TLBStreamStats after = smmu.get_stream_tlb_statistics(1);
+            if (after.hits || after.misses || after.evictions ||
+                after.entries != hot.entries || after.reserved != c.hot_reserved) {
+                std::cout << "reset_statistics kept per-stream counters ❌\n";
+            }
+        }
+    }
+    
+    // 組相聯：達到上限的流在目標組中沒有自己的表項時旁路，不淘汰其他流的表項
+    {
+        SetAssociativeTLB tlb(16, 4, ReplacementPolicy::LRU);   // 4 組，組索引 = VPN % 4
+        tlb.set_stream_quota(2, 0, 1);
+        auto fill = [&tlb](StreamID stream, uint64_t vpn) {
+            TLBEntry entry;
+            entry.va = vpn * 0x1000;
+            entry.pa = 0x100000 + entry.va;
+            entry.stream_id = stream;
+            entry.asid = 1;
+            tlb.insert(entry);
+        };
+        for (uint64_t w = 0; w < 4; w++) fill(1, 1 + w * 4);   // 流 1 填滿組 1
+        fill(2, 0);    // 組 0：流 2 的第一個表項
+        fill(2, 5);    // 組 1：流 2 已達上限且組內沒有自己的表項 -> 旁路
+        fill(2, 4);    // 組 0：替換流 2 自己的表項
+        TLBStreamStats owner = tlb.stream_stats(2);
+        TLBStreamStats other = tlb.stream_stats(1);
+        bool ok = owner.entries == 1 && owner.bypasses == 1 && owner.evictions == 1 &&
+                  other.entries == 4 && other.evictions == 0 &&
+                  tlb.lookup(4 * 0x1000, 2, 1, 0).has_value() &&
+                  !tlb.lookup(5 * 0x1000, 2, 1, 0).has_value();
+        std::cout << "[set-assoc] Capped stream with no way in the set: " << owner.bypasses
+                  << " bypass, other stream kept " << other.entries << " entries "
+                  << (ok ? "✅" : "❌") << "\n";
+    }
+    
+    // 查找不創建分區：沒有配額也沒有表項的流的未命中只計入總數
+    {
+        TLB fully(16);
+        SetAssociativeTLB set_assoc(16, 4, ReplacementPolicy::LRU);
+        bool ok = true;
+        for (TLBInterface* tlb : {static_cast<TLBInterface*>(&fully),
+                                  static_cast<TLBInterface*>(&set_assoc)}) {
+            tlb->lookup(0x1000, 7, 1, 0);
+            TLBEntry entry;
+            entry.va = 0x2000;
+            entry.pa = 0x102000;
+            entry.stream_id = 7;
+            entry.asid = 1;
+            tlb->insert(entry);
+            tlb->lookup(0x1000, 7, 1, 0);
+            ok = ok && tlb->miss_count() == 2 && tlb->stream_stats(7).misses == 1;
+        }
+        std::cout << "Lookups of unknown streams create no per-stream state "
+                  << (ok ? "✅" : "❌") << "\n";
+    }
+    std::cout << "\n";
+}
+
+// ============================================================================
+// 測試23：遍歷內存回調
+// set_walk_memory 之後描述符讀取全部經過回調（葉子緩存行按塊讀取或逐個讀取），
+// TLB 命中不讀取內存，再次 set_memory_model 恢復直接讀取
+// ============================================================================
+
+void test_walk_memory_callbacks() {
+    std::cout << "=== Test 23: Walk Memory Callbacks ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr VirtualAddress VA = 0x60000000;
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress root = memory->allocate_page();
+    for (int i = 0; i < 32; i++) {
+        map_page_4k(*memory, root, VA + i * 0x1000, 0x3000000 + i * 0x1000, NORMAL_RW);
+    }
+    
+    // 禁用遍歷緩存，每次遍歷都讀取全部四級描述符
+    SMMUConfig config;
+    config.walk_cache_size = 0;
+    config.fill_leaf_neighbours = true;
+    SMMU smmu(config);
+    smmu.set_memory_model(memory);
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    smmu.configure_stream_table_entry(1, ste);
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = root;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.asid = 1;
+    smmu.configure_context_descriptor(1, 1, cd);
+    smmu.enable();
+    
+    uint64_t reads = 0, block_reads = 0, bytes = 0;
+    MemoryReadCallback read = [&](PhysicalAddress addr, uint64_t& data, size_t size) {
+        reads++;
+        bytes += size;
+        return memory->read(addr, &data, size);
+    };
+    MemoryBlockReadCallback block_read = [&](PhysicalAddress addr, void* data, size_t size) {
+        block_reads++;
+        bytes += size;
+        return memory->read(addr, data, size);
+    };
+    
+    // 按塊讀取葉子緩存行：3 個表描述符 + 1 個 64 字節的行
+    smmu.set_walk_memory(read, block_read);
+    auto first = smmu.translate(VA + 0x10, 1, 1);
+    bool batched = first.success && first.physical_addr == 0x3000010 &&
+                   first.descriptor_reads == 4 && reads == 3 && block_reads == 1 &&
+                   bytes == 3 * 8 + LeafLine::LINE_SIZE;
+    std::cout << "Batched leaf line: " << reads << " reads + " << block_reads
+              << " block read, " << bytes << " bytes " << (batched ? "✅" : "❌") << "\n";
+    
+    // TLB 命中（包括鄰近表項填充的頁面）不讀取內存
+    uint64_t before = reads + block_reads;
+    auto hit = smmu.translate(VA + 0x1000, 1, 1);
+    bool no_reads = hit.success && hit.descriptor_reads == 0 && reads + block_reads == before;
+    std::cout << "TLB hit reads nothing: " << (no_reads ? "✅" : "❌") << "\n";
+    
+    // 沒有按塊讀取回調：葉子緩存行按 8 個描述符逐個讀取
+    reads = block_reads = bytes = 0;
+    smmu.set_walk_memory(read);
+    auto second = smmu.translate(VA + 0x10000, 1, 1);
+    bool unbatched = second.success && second.physical_addr == 0x3010000 &&
+                     reads == 3 + LeafLine::ENTRIES && block_reads == 0;
+    std::cout << "Per-descriptor reads: " << reads << " reads "
+              << (unbatched ? "✅" : "❌") << "\n";
+    
+    // 恢復直接讀取
+    reads = block_reads = 0;
+    smmu.set_memory_model(memory);
+    auto direct = smmu.translate(VA + 0x18000, 1, 1);
+    bool restored = direct.success && direct.descriptor_reads > 0 &&
+                    reads == 0 && block_reads == 0;
+    std::cout << "set_memory_model restores direct reads: "
+              << (restored ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試24：轉換失效通知
+// 直接無效化、TLBI/CFGI 命令、容量淘汰和 SMMUEN 改變都發出通知，
+// 淘汰通知帶被淘汰表項的範圍；另外驗證 frame_data 與 read/write 共享幀
+// ============================================================================
+
+void test_invalidation_notifications() {
+    std::cout << "=== Test 24: Translation Invalidation Notifications ===\n\n";
+    
+    using Scope = TranslationInvalidation::Scope;
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr VirtualAddress VA = 0x70000000;
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress root = memory->allocate_page();
+    for (int i = 0; i < 8; i++) {
+        map_page_4k(*memory, root, VA + i * 0x1000, 0x4000000 + i * 0x1000, NORMAL_RW);
+    }
+    
+    for (TLBOrganization organization : {TLBOrganization::FULLY_ASSOCIATIVE,
+                                         TLBOrganization::SET_ASSOCIATIVE}) {
+        SMMUConfig config;
+        config.tlb_size = 4;
+        config.tlb_ways = 4;
+        config.tlb_organization = organization;
+        SMMU smmu(config);
+        smmu.set_memory_model(memory);
+        StreamTableEntry ste;
+        ste.valid = true;
+        ste.s1_enabled = true;
+        smmu.configure_stream_table_entry(3, ste);
+        ContextDescriptor cd;
+        cd.valid = true;
+        cd.translation_table_base = root;
+        cd.translation_granule = 12;
+        cd.ips = 48;
+        cd.asid = 5;
+        smmu.configure_context_descriptor(3, 5, cd);
+        
+        std::vector<TranslationInvalidation> notices;
+        smmu.set_invalidation_callback([&](const TranslationInvalidation& notice) {
+            notices.push_back(notice);
+        });
+        smmu.enable();
+        bool enabled = notices.size() == 1 && notices[0].scope == Scope::ALL;
+        
+        // 8 個頁面放入 4 項 TLB：第 5 個頁面起每次淘汰一項
+        notices.clear();
+        for (int i = 0; i < 8; i++) smmu.translate(VA + i * 0x1000, 3, 5);
+        bool evictions = notices.size() == 4;
+        for (const auto& notice : notices) {
+            evictions = evictions && notice.scope == Scope::ENTRY && notice.stream_id == 3 &&
+                        notice.asid == 5 && notice.size == 0x1000 &&
+                        notice.va >= VA && notice.va < VA + 0x8000 && (notice.va & 0xFFF) == 0;
+        }
+        
+        // 命令：TLBI_NH_VA、CFGI_STE、TLBI_NH_ASID
+        notices.clear();
+        Command tlbi;
+        tlbi.type = CommandType::CMD_TLBI_NH_VA;
+        tlbi.data.tlbi_va.va = VA + 0x7000;
+        tlbi.data.tlbi_va.asid = 5;
+        Command cfgi;
+        cfgi.type = CommandType::CMD_CFGI_STE;
+        cfgi.data.cfgi_ste.stream_id = 3;
+        Command tlbi_asid;
+        tlbi_asid.type = CommandType::CMD_TLBI_NH_ASID;
+        tlbi_asid.data.tlbi_asid.asid = 5;
+        smmu.submit_command(tlbi);
+        smmu.submit_command(cfgi);
+        smmu.submit_command(tlbi_asid);
+        smmu.process_commands();
+        bool commands = notices.size() == 3 &&
+                        notices[0].scope == Scope::VA_RANGE && notices[0].asid == 5 &&
+                        notices[0].va == VA + 0x7000 && notices[0].size == 1 &&
+                        notices[1].scope == Scope::STREAM && notices[1].stream_id == 3 &&
+                        notices[2].scope == Scope::ASID && notices[2].asid == 5;
+        
+        // 範圍無效化和禁用；重複禁用不再通知
+        notices.clear();
+        smmu.invalidate_tlb_by_va_range(VA, 0x4000, 5);
+        smmu.disable();
+        smmu.disable();
+        bool others = notices.size() == 2 && notices[0].scope == Scope::VA_RANGE &&
+                      notices[0].size == 0x4000 && notices[1].scope == Scope::ALL;
+        
+        // 取消回調後不再通知
+        smmu.set_invalidation_callback(nullptr);
+        smmu.enable();
+        for (int i = 0; i < 8; i++) smmu.translate(VA + i * 0x1000, 3, 5);
+        bool cleared = notices.size() == 2;
+        
+        bool ok = enabled && evictions && commands && others && cleared;
+        std::cout << (organization == TLBOrganization::SET_ASSOCIATIVE ? "[set-assoc] "
+                                                                       : "[fully-assoc] ")
+                  << "enable/evict/command/range/disable notices "
+                  << (ok ? "✅" : "❌") << "\n";
+    }
+    
+    // frame_data 與 read/write 訪問同一幀
+    uint8_t* frame = memory->frame_data(0x5000123);
+    uint32_t value = 0x12345678, readback = 0;
+    std::memcpy(frame + 0x123, &value, sizeof(value));
+    memory->read(0x5000123, &readback, sizeof(readback));
+    bool shared = frame && readback == value &&
+                  memory->frame_data(0x5000FFF) == frame &&
+                  memory->frame_data(SimpleMemoryModel::PA_LIMIT) == nullptr;
+    std::cout << "frame_data shares frames with read/write: "
+              << (shared ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試25：轉換路徑插樁
+// ============================================================================
+
+void test_instrumentation() {
+    std::cout << "=== Test 25: Translation Instrumentation ===\n\n";
+    
+    constexpr uint64_t NORMAL_RW = 0x400 | (0x4 << 2);
+    constexpr VirtualAddress VA = 0x80000000;
+    
+    // 直方圖分桶：每個值不超過所在桶的上界，桶上界落在同一個桶
+    bool buckets = true;
+    for (uint64_t value : {0ULL, 7ULL, 8ULL, 10ULL, 210ULL, 4095ULL, 123456789ULL, ~0ULL}) {
+        size_t index = LatencyHistogram::bucket_index(value);
+        uint64_t upper = LatencyHistogram::bucket_upper(index);
+        buckets = buckets && index < LatencyHistogram::NUM_BUCKETS && upper >= value &&
+                  upper - value <= value / 8 && LatencyHistogram::bucket_index(upper) == index;
+    }
+    std::cout << "Histogram buckets bound values within 12.5%: "
+              << (buckets ? "✅" : "❌") << "\n";
+    
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PhysicalAddress root1 = memory->allocate_page();
+    PhysicalAddress root2 = memory->allocate_page();
+    for (int i = 0; i < 4; i++) {
+        map_page_4k(*memory, root1, VA + i * 0x1000, 0x6000000 + i * 0x1000, NORMAL_RW);
+    }
+    map_page_4k(*memory, root2, VA, 0x7000000, NORMAL_RW);
+    
+    // 禁用遍歷緩存，每次未命中讀取四級描述符
+    SMMUConfig config;
+    config.walk_cache_size = 0;
+    config.instrumentation = true;
+    config.instrumentation_time_sampling = 1;  // 每次轉換都測量主機耗時
+    SMMU smmu(config);
+    smmu.set_memory_model(memory);
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    smmu.configure_stream_table_entry(1, ste);
+    smmu.configure_stream_table_entry(2, ste);
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    cd.translation_table_base = root1;
+    cd.asid = 1;
+    smmu.configure_context_descriptor(1, 1, cd);
+    cd.translation_table_base = root2;
+    cd.asid = 2;
+    smmu.configure_context_descriptor(2, 2, cd);
+    smmu.enable();
+    
+    // 流1：4 個頁面各兩次（4 未命中 + 4 命中）；流2：1 個頁面三次（批量），
+    // 同頁復用計為命中；流9 未配置（未命中、不遍歷、失敗）
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 4; i++) smmu.translate(VA + i * 0x1000, 1, 1);
+    }
+    std::vector<TranslationRequest> batch = {{VA, 2, 2, 0}, {VA + 8, 2, 2, 0}, {VA + 16, 2, 2, 0}};
+    smmu.translate_batch(batch);
+    smmu.translate(VA, 9, 0);
+    
+    InstrumentationSnapshot snap = smmu.get_instrumentation();
+    auto context_is = [](const ContextCounters& c, StreamID sid, ASID asid, uint64_t hits,
+                         uint64_t misses, uint64_t walks, uint64_t faults) {
+        return c.stream_id == sid && c.asid == asid && c.translations == hits + misses &&
+               c.tlb_hits == hits && c.tlb_misses == misses && c.page_walks == walks &&
+               c.descriptor_reads == walks * 4 && c.faults == faults;
+    };
+    bool contexts = snap.enabled && snap.contexts.size() == 3 &&
+                    context_is(snap.contexts[0], 1, 1, 4, 4, 4, 0) &&
+                    context_is(snap.contexts[1], 2, 2, 2, 1, 1, 0) &&
+                    context_is(snap.contexts[2], 9, 0, 0, 1, 0, 1);
+    std::cout << "Per-context counters sorted by misses: " << (contexts ? "✅" : "❌") << "\n";
+    
+    // 遍歷深度：5 次四級遍歷，1 次未遍歷；模型延遲：7 次 10 週期，5 次 210 週期
+    bool depth = snap.walk_depth.size() == InstrumentationSnapshot::MAX_WALK_DEPTH + 1 &&
+                 snap.walk_depth[4] == 5 && snap.walk_depth[0] == 1;
+    bool latency = snap.latency_cycles.count == 12 && snap.latency_cycles.max == 210 &&
+                   snap.latency_cycles.percentile(0.5) == 10 &&
+                   snap.latency_cycles.percentile(0.99) == 210 &&
+                   snap.latency_cycles.sum == 7 * 10 + 5 * 210 &&
+                   snap.latency_host_ns.count == 12;
+    std::cout << "Walk depth distribution: " << (depth ? "✅" : "❌") << "\n";
+    std::cout << "Latency histograms (p50 " << snap.latency_cycles.percentile(0.5)
+              << ", p99 " << snap.latency_cycles.percentile(0.99) << " cycles): "
+              << (latency ? "✅" : "❌") << "\n";
+    
+    // 無效化按類型計數（啟用 SMMU 計為一次 ALL）
+    smmu.invalidate_tlb_by_asid(1);
+    Command tlbi;
+    tlbi.type = CommandType::CMD_TLBI_NH_VA;
+    tlbi.data.tlbi_va.va = VA;
+    tlbi.data.tlbi_va.asid = 2;
+    smmu.submit_command(tlbi);
+    smmu.process_commands();
+    snap = smmu.get_instrumentation();
+    bool invalidations = snap.invalidations[static_cast<size_t>(InvalidationType::ALL)] == 1 &&
+                         snap.invalidations[static_cast<size_t>(InvalidationType::ASID)] == 1 &&
+                         snap.invalidations[static_cast<size_t>(InvalidationType::VA_RANGE)] == 1 &&
+                         snap.invalidations[static_cast<size_t>(InvalidationType::STREAM)] == 0;
+    std::cout << "Invalidation counts by type: " << (invalidations ? "✅" : "❌") << "\n";
+    
+    // 導出
+    std::ostringstream json, prometheus;
+    snap.write_json(json);
+    snap.write_prometheus(prometheus);
+    bool exported = json.str().find("\"stream_id\":1,\"asid\":1,\"translations\":8") != std::string::npos &&
+                    json.str().find("\"invalidations\":{\"all\":1,\"asid\":1") != std::string::npos &&
+                    prometheus.str().find("smmu_tlb_misses_total{stream=\"1\",asid=\"1\"} 4\n") != std::string::npos &&
+                    prometheus.str().find("smmu_translation_latency_cycles{quantile=\"0.99\"} 210\n") != std::string::npos;
+    std::cout << "JSON / Prometheus export: " << (exported ? "✅" : "❌") << "\n";
+
+    // 合併：相同上下文相加，其餘追加；未開啟插樁的快照不影響結果
+    InstrumentationSnapshot merged = snap;
+    merged.merge(snap);
+    merged.merge(InstrumentationSnapshot());
+    bool merge = merged.contexts.size() == 3 &&
+                 context_is(merged.contexts[0], 1, 1, 8, 8, 8, 0) &&
+                 merged.walk_depth[4] == 10 && merged.latency_cycles.count == 24 &&
+                 merged.invalidations[static_cast<size_t>(InvalidationType::ASID)] == 2;
+    std::cout << "Snapshot merge: " << (merge ? "✅" : "❌") << "\n";
+
+    // 重置後清零；未開啟插樁時快照為空
+    smmu.reset_statistics();
+    snap = smmu.get_instrumentation();
+    SMMU plain((SMMUConfig()));
+    InstrumentationSnapshot none = plain.get_instrumentation();
+    bool reset = snap.enabled && snap.contexts.empty() && snap.latency_cycles.count == 0 &&
+                 !none.enabled && none.contexts.empty();
+    std::cout << "Reset and disabled snapshots are empty: " << (reset ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試26：頁表構建器
+// 對齊允許時使用塊描述符，塊按需拆分，連續位只設置在完整的組上；
+// 驗證三種粒度和批量映射的表數量
+// ============================================================================
+
+void test_page_table_builder() {
+    std::cout << "=== Test 26: Page Table Builder ===\n\n";
+    
+    SimpleMemoryModel memory;
+    PageTableWalker walker([&](PhysicalAddress addr, uint64_t& data, size_t size) {
+        return memory.read(addr, &data, size);
+    });
+    walker.set_direct_memory(&memory);
+    auto walk = [&](const PageTableBuilder& tables, VirtualAddress va) {
+        return walker.translate(va, tables.root(), tables.granule_size(), 48,
+                                TranslationStage::STAGE1);
+    };
+    auto maps_to = [](const TranslationResult& r, PhysicalAddress pa, uint8_t level, PageSize size) {
+        return r.success && r.physical_addr == pa && r.level == level && r.page_size == size;
+    };
+    
+    // 4KB 粒度：1GB + 2MB + 8KB 得到 L1 塊、L2 塊和兩個頁面
+    constexpr VirtualAddress VA = 0x40000000;
+    constexpr PhysicalAddress PA = 0x80000000;
+    constexpr uint64_t GB = 0x40000000, MB2 = 0x200000;
+    PageTableBuilder tables(memory);
+    bool mapped = tables.map_range(VA, PA, GB + MB2 + 0x2000);
+    bool blocks = mapped && tables.stats().blocks == 2 && tables.stats().pages == 2 &&
+                  tables.stats().tables == 4 &&
+                  maps_to(walk(tables, VA + 0x123456), PA + 0x123456, 1, PageSize::SIZE_1GB) &&
+                  maps_to(walk(tables, VA + GB + 0x1000), PA + GB + 0x1000, 2, PageSize::SIZE_2MB) &&
+                  maps_to(walk(tables, VA + GB + MB2 + 0x1234), PA + GB + MB2 + 0x1234, 3,
+                          PageSize::SIZE_4KB) &&
+                  !walk(tables, VA + GB + MB2 + 0x2000).success;
+    std::cout << "1GB / 2MB blocks and pages: " << (blocks ? "✅" : "❌") << "\n";
+    
+    // 輸出地址未按 2MB 對齊時退回頁面；未按粒度對齊的參數被拒絕
+    uint64_t pages_before = tables.stats().pages;
+    bool fallback = tables.map_range(0x200000, 0x10001000, MB2) &&
+                    tables.stats().pages == pages_before + 512 &&
+                    maps_to(walk(tables, 0x3FF000), 0x10200000, 3, PageSize::SIZE_4KB) &&
+                    !tables.map_range(0x1800, 0x1000, 0x1000) &&
+                    !tables.map_range(0x1000, 0x1000, 0x800) &&
+                    !PageTableBuilder(memory, 13).map_range(0, 0, 0x2000);
+    std::cout << "Misaligned output falls back to pages: " << (fallback ? "✅" : "❌") << "\n";
+    
+    // 在 2MB 塊中重新映射一個只讀頁面：塊拆分為 L3 表，其餘頁面保持原映射
+    MappingAttributes read_only;
+    read_only.permission = AccessPermission::READ_ONLY;
+    bool split = tables.map(VA + GB + 0x5000, 0x90000000, read_only) &&
+                 tables.stats().splits == 1 &&
+                 maps_to(walk(tables, VA + GB + 0x4000), PA + GB + 0x4000, 3, PageSize::SIZE_4KB) &&
+                 maps_to(walk(tables, VA + GB + 0x1FF000), PA + GB + 0x1FF000, 3, PageSize::SIZE_4KB) &&
+                 walk(tables, VA + GB + 0x5000).physical_addr == 0x90000000 &&
+                 walk(tables, VA + GB + 0x5000).permission == AccessPermission::READ_ONLY &&
+                 walk(tables, VA + GB + 0x4000).permission == AccessPermission::READ_WRITE;
+    std::cout << "Block split keeps the rest of the block: " << (split ? "✅" : "❌") << "\n";
+    
+    // 連續位：16 個對齊頁面合併為 64KB；覆寫其中一頁後整組清除連續位
+    MappingAttributes contiguous;
+    contiguous.contiguous = true;
+    constexpr VirtualAddress CVA = 0x10000000;
+    bool contig = tables.map_range(CVA, 0x20000000, 0x10000 + 0x1000, contiguous);
+    TranslationResult grouped = walk(tables, CVA + 0x3000);
+    TranslationResult single = walk(tables, CVA + 0x10000);
+    contig = contig && grouped.contiguous && grouped.page_size == static_cast<PageSize>(0x10000) &&
+             grouped.physical_addr == 0x20003000 && !single.contiguous;
+    tables.map(CVA + 0x8000, 0x30000000);
+    TranslationResult neighbour = walk(tables, CVA + 0x3000);
+    contig = contig && !neighbour.contiguous && neighbour.page_size == PageSize::SIZE_4KB &&
+             neighbour.physical_addr == 0x20003000 &&
+             walk(tables, CVA + 0x8000).physical_addr == 0x30000000;
+    std::cout << "Contiguous groups set and cleared: " << (contig ? "✅" : "❌") << "\n";
+    
+    // 在已有的根表上繼續構建
+    PageTableBuilder more(memory, 12, tables.root());
+    bool reuse = more.map(0x7000000000, 0x5000) && more.stats().tables == 2 &&
+                 maps_to(walk(tables, 0x7000000010), 0x5010, 3, PageSize::SIZE_4KB) &&
+                 maps_to(walk(tables, VA + 0x10), PA + 0x10, 1, PageSize::SIZE_1GB);
+    std::cout << "Builders share an existing root: " << (reuse ? "✅" : "❌") << "\n";
+    
+    // 16KB 粒度：32MB 塊 + 16KB 頁面；64KB 粒度：512MB 塊 + 64KB 頁面（從 L1 開始，表按 64KB 對齊）
+    PageTableBuilder tables16(memory, 14);
+    PageTableBuilder tables64(memory, 16);
+    bool granules = tables16.map_range(0x4000000, 0x6000000, 0x2000000 + 0x4000) &&
+                    maps_to(walk(tables16, 0x4001234), 0x6001234, 2, PageSize::SIZE_32MB) &&
+                    maps_to(walk(tables16, 0x6000010), 0x8000010, 3, PageSize::SIZE_16KB) &&
+                    tables64.start_level() == 1 && tables64.root() % 0x10000 == 0 &&
+                    tables64.map_range(0x20000000, 0x40000000, 0x20000000 + 0x10000) &&
+                    maps_to(walk(tables64, 0x20012345), 0x40012345, 2, PageSize::SIZE_512MB) &&
+                    maps_to(walk(tables64, 0x40001234), 0x60001234, 3, PageSize::SIZE_64KB) &&
+                    tables64.stats().tables == 3;
+    std::cout << "16KB / 64KB granules: " << (granules ? "✅" : "❌") << "\n";
+    
+    // 批量映射 1GB 的 4KB 頁面：512 張 L3 表，每張表一次寫入
+    PageTableBuilder bulk(memory);
+    bool bulk_ok = bulk.map_range(0x8000000000, 0x1000, GB) &&
+                   bulk.stats().pages == GB / 0x1000 && bulk.stats().tables == 3 + 512 &&
+                   maps_to(walk(bulk, 0x8000000000 + 0x12345678), 0x1000 + 0x12345678, 3,
+                           PageSize::SIZE_4KB);
+    std::cout << "Bulk 1GB of 4KB pages (" << bulk.stats().tables << " tables): "
+              << (bulk_ok ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試27：頁表幀分配器
+// 按大小分板、釋放重用、按所有者釋放整個地址空間，以及顯式的失敗報告；
+// 反復創建和銷毀地址空間時預留的物理內存和駐留幀數保持不變
+// ============================================================================
+
+void test_frame_allocator() {
+    std::cout << "=== Test 27: Frame Allocator ===\n\n";
+    
+    SimpleMemoryModel memory;
+    FrameAllocator frames(memory);
+    
+    // 同一大小的幀在板中緊湊排列，16KB / 64KB 幀按大小對齊
+    FrameAllocation a = frames.allocate(4096);
+    FrameAllocation b = frames.allocate(4096);
+    FrameAllocation c = frames.allocate(16384);
+    FrameAllocation d = frames.allocate(65536);
+    bool packed = a.success && b.success && c.success && d.success &&
+                  b.pa == a.pa + 4096 && a.pa % FrameAllocator::SLAB_BYTES == 0 &&
+                  c.pa % 16384 == 0 && d.pa % 65536 == 0 &&
+                  frames.frame_size(c.pa) == 16384 && frames.stats().allocated_bytes == 90112;
+    std::cout << "Size classes packed and aligned: " << (packed ? "✅" : "❌") << "\n";
+    
+    // 釋放的幀被重用且讀為 0；錯誤的大小、未分配或重複釋放的地址返回錯誤
+    uint64_t marker = 0xDEADBEEF;
+    memory.write(a.pa + 64, &marker, sizeof(marker));
+    FrameAllocError freed = frames.free_page(a.pa);
+    FrameAllocation again = frames.allocate(4096);
+    uint64_t value = 1;
+    memory.read(again.pa + 64, &value, sizeof(value));
+    FrameAllocation bad = frames.allocate(8192);
+    bool recycled = freed == FrameAllocError::NONE && again.pa == a.pa && value == 0 &&
+                    frames.stats().recycled == 1 &&
+                    !bad.success && bad.pa == 0 && bad.error == FrameAllocError::INVALID_SIZE &&
+                    frames.free_page(b.pa) == FrameAllocError::NONE &&
+                    frames.free_page(b.pa) == FrameAllocError::NOT_ALLOCATED &&
+                    frames.free_page(c.pa + 4096) == FrameAllocError::NOT_ALLOCATED;
+    std::cout << "Free, recycle and error reporting: " << (recycled ? "✅" : "❌") << "\n";
+    
+    // 按所有者（ASID）構建頁表，release_owner 釋放整個地址空間
+    PageTableWalker walker([&](PhysicalAddress addr, uint64_t& data, size_t size) {
+        return memory.read(addr, &data, size);
+    });
+    size_t baseline_frames = memory.resident_frames();
+    PageTableBuilder space(frames, 7);
+    bool owned = space.map_range(0x10000000, 0x80000000, 0x400000 + 0x3000) &&
+                 frames.owned_frames(7) == space.stats().tables &&
+                 walker.translate(0x10401234, space.root(), 12, 48,
+                                  TranslationStage::STAGE1).physical_addr == 0x80401234;
+    size_t released = frames.release_owner(7);
+    owned = owned && released == 4 && frames.owned_frames(7) == 0 &&
+            memory.resident_frames() == baseline_frames &&
+            !walker.translate(0x10401234, space.root(), 12, 48, TranslationStage::STAGE1).success &&
+            frames.release_owner(7) == 0;
+    std::cout << "Address space released by owner (" << released << " tables): "
+              << (owned ? "✅" : "❌") << "\n";
+    
+    // 反復創建和銷毀地址空間：第一輪之後不再預留新內存
+    uint64_t reserved = 0;
+    bool bounded = true;
+    for (int round = 0; round < 200; round++) {
+        FrameAllocator::Owner asid = static_cast<FrameAllocator::Owner>(round % 4);
+        PageTableBuilder tables(frames, asid, round % 2 ? 16 : 12);
+        bounded = bounded && tables.map_range(0x40000000 + round * 0x100000ULL, 0x1000000,
+                                              0x100000) &&
+                  tables.map(0x7F0000000000ULL, 0x2000000ULL + round * 0x10000ULL);
+        frames.release_owner(asid);
+        if (round == 0) reserved = frames.stats().reserved_bytes;
+    }
+    bounded = bounded && frames.stats().reserved_bytes == reserved &&
+              memory.resident_frames() == baseline_frames;
+    std::cout << "200 address spaces with bounded memory: " << (bounded ? "✅" : "❌") << "\n";
+    
+    // 達到上限時返回 OUT_OF_MEMORY，釋放後可以再次分配；內存模型耗盡時不移動分配指針
+    SimpleMemoryModel small_memory;
+    FrameAllocator limited(small_memory, 2 * FrameAllocator::SLAB_BYTES, FrameAllocator::SLAB_BYTES);
+    FrameAllocation first = limited.allocate(65536);
+    FrameAllocation full = limited.allocate(65536);
+    bool limit = first.success && !full.success && full.error == FrameAllocError::OUT_OF_MEMORY &&
+                 limited.stats().failures == 1 &&
+                 limited.free_page(first.pa) == FrameAllocError::NONE &&
+                 limited.allocate(65536).pa == first.pa &&
+                 PageTableBuilder(limited, 1).root() == 0;
+    PhysicalAddress next = small_memory.allocate_page();
+    limit = limit && small_memory.allocate_page(SimpleMemoryModel::PA_LIMIT) == 0 &&
+            small_memory.allocate_page() == next + 4096;
+    std::cout << "Explicit out-of-memory reporting: " << (limit ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試28：描述符批量解碼和批量遍歷
+// 向量內核與標量實現、parse_descriptor 結果一致；批量索引與逐個提取一致；
+// 批量遍歷的結果與逐個轉換相同，且共享上層表時讀取更少的描述符
+// ============================================================================
+
+void test_batch_decode() {
+    std::cout << "=== Test 28: Batched Descriptor Decode (" << descriptor_kernel_name()
+              << ") ===\n\n";
+    
+    PageTableWalker parser([](PhysicalAddress, uint64_t& data, size_t) { data = 0; return true; });
+    auto same_descriptor = [](const PageTableDescriptor& a, const PageTableDescriptor& b) {
+        return a.valid == b.valid && a.is_table == b.is_table && a.address == b.address &&
+               a.ap == b.ap && a.mem_attr == b.mem_attr && a.shareable == b.shareable &&
+               a.access_flag == b.access_flag && a.dirty == b.dirty &&
+               a.contiguous == b.contiguous &&
+               a.privileged_execute_never == b.privileged_execute_never &&
+               a.execute_never == b.execute_never;
+    };
+    
+    // 隨機描述符（約四分之一無效），所有級別
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    auto next_random = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    bool decode_ok = true;
+    for (int round = 0; round < 2000 && decode_ok; round++) {
+        uint64_t raw[DescriptorBatch::WIDTH];
+        for (uint64_t& desc : raw) {
+            desc = next_random();
+            if ((desc >> 60) == 0) desc &= ~1ULL;
+        }
+        uint8_t level = static_cast<uint8_t>(round % 4);
+        DescriptorBatch fast, scalar;
+        decode_descriptors(raw, level, fast);
+        decode_descriptors_scalar(raw, level, scalar);
+        for (size_t i = 0; i < DescriptorBatch::WIDTH; i++) {
+            PageTableDescriptor expected = parser.parse_descriptor(raw[i], level, 12);
+            decode_ok = decode_ok && same_descriptor(fast.descriptor(i), expected) &&
+                        same_descriptor(scalar.descriptor(i), expected) &&
+                        fast.address[i] == scalar.address[i];
+        }
+        decode_ok = decode_ok && fast.valid == scalar.valid && fast.table == scalar.table &&
+                    fast.leaf() == scalar.leaf() && fast.shareable == scalar.shareable;
+    }
+    std::cout << "Kernel matches parse_descriptor: " << (decode_ok ? "✅" : "❌") << "\n";
+    
+    // 位平面的屬性比較：只有屬性不同的描述符所在的組不一致
+    uint64_t uniform[DescriptorBatch::WIDTH];
+    for (size_t i = 0; i < DescriptorBatch::WIDTH; i++) uniform[i] = 0x40000000 + i * 0x1000 + 0x713;
+    uniform[6] |= 1ULL << 54;
+    DescriptorBatch planes;
+    decode_descriptors(uniform, 3, planes);
+    bool attrs = planes.leaf() == 0xFF && planes.same_attributes(0x3F) &&
+                 !planes.same_attributes(0xFF) && planes.same_attributes(0x40) &&
+                 planes.memory_type(0) == MemoryType::NORMAL_WB &&
+                 planes.permission(0) == AccessPermission::READ_WRITE && planes.is_shareable(0);
+    std::cout << "Attribute planes: " << (attrs ? "✅" : "❌") << "\n";
+    
+    // 批量索引：三種粒度，數量不是向量寬度的倍數
+    std::vector<VirtualAddress> vas(37);
+    for (VirtualAddress& va : vas) va = next_random() & 0x0000FFFFFFFFFFFFULL;
+    bool indices_ok = true;
+    for (uint8_t granule : {12, 14, 16}) {
+        std::vector<LevelIndices> fast(vas.size()), scalar(vas.size());
+        extract_indices(vas.data(), vas.size(), granule, fast.data());
+        extract_indices_scalar(vas.data(), vas.size(), granule, scalar.data());
+        for (size_t i = 0; i < vas.size(); i++) {
+            for (unsigned level = 0; level < 4; level++) {
+                indices_ok = indices_ok && fast[i].index[level] == scalar[i].index[level];
+            }
+        }
+    }
+    LevelIndices known;
+    VirtualAddress known_va = (3ULL << 39) | (5ULL << 30) | (7ULL << 21) | (9ULL << 12) | 0x123;
+    extract_indices(&known_va, 1, 12, &known);
+    indices_ok = indices_ok && known.index[0] == 3 && known.index[1] == 5 &&
+                 known.index[2] == 7 && known.index[3] == 9;
+    std::cout << "Batched index extraction: " << (indices_ok ? "✅" : "❌") << "\n";
+    
+    // 批量遍歷：1024 個連續頁面、一個 2MB 塊和未映射的地址，有無遍歷緩存各一次
+    SimpleMemoryModel memory;
+    PageTableBuilder tables(memory);
+    tables.map_range(0x10000000, 0x80001000, 1024 * 0x1000);   // 輸出地址未按 2MB 對齊：全部為頁面
+    tables.map_range(0x40000000, 0xC0000000, 0x200000);
+    std::vector<VirtualAddress> walk_vas;
+    for (uint64_t i = 0; i < 1024; i++) walk_vas.push_back(0x10000000 + i * 0x1000 + (i & 0xFF));
+    walk_vas.push_back(0x40012345);
+    walk_vas.push_back(0x10400000);
+    walk_vas.push_back(0x10001000);
+    walk_vas.push_back(0x5000000000);
+    walk_vas.push_back(0x10002000);
+    
+    bool batch_ok = true;
+    uint64_t single_reads = 0, batch_reads = 0;
+    for (bool cached : {false, true}) {
+        PageWalkCache cache(16);
+        PageTableWalker walker([&](PhysicalAddress addr, uint64_t& data, size_t size) {
+            return memory.read(addr, &data, size);
+        });
+        walker.set_direct_memory(&memory);
+        PageTableWalker reference = walker;
+        if (cached) walker.set_walk_cache(&cache);
+        
+        std::vector<TranslationResult> results(walk_vas.size());
+        walker.translate_batch(walk_vas.data(), walk_vas.size(), tables.root(), 12, 48,
+                               TranslationStage::STAGE1, results.data());
+        for (size_t i = 0; i < walk_vas.size(); i++) {
+            TranslationResult expected = reference.translate(walk_vas[i], tables.root(), 12, 48,
+                                                             TranslationStage::STAGE1);
+            batch_ok = batch_ok && results[i].success == expected.success &&
+                       results[i].physical_addr == expected.physical_addr &&
+                       results[i].page_size == expected.page_size &&
+                       results[i].level == expected.level &&
+                       results[i].fault_type == expected.fault_type &&
+                       results[i].descriptor_reads <= expected.descriptor_reads;
+            if (!cached) {
+                single_reads += expected.descriptor_reads;
+                batch_reads += results[i].descriptor_reads;
+            }
+        }
+    }
+    batch_ok = batch_ok && batch_reads < single_reads / 2;
+    std::cout << "Batch walk matches single walks (" << batch_reads << " vs " << single_reads
+              << " descriptor reads): " << (batch_ok ? "✅" : "❌") << "\n\n";
+}
+
+// ============================================================================
+// 測試29：狀態快照
+// 保存後加載到新的 SMMU：流表、上下文描述符、統計計數器和內存幀相同，
+// 已緩存的轉換直接命中；TLB 配置不同時按淘汰順序保留最新的表項；
+// 無效或截斷的文件被拒絕且不修改狀態
+// ============================================================================
+
+void test_snapshot() {
+    std::cout << "=== Test 29: State Snapshot ===\n\n";
+    
+    const std::string path = "smmu_test_snapshot.bin";
+    constexpr VirtualAddress VA = 0x10000000;
+    constexpr PhysicalAddress PA = 0x80000000;
+    constexpr size_t PAGES = 64;
+    
+    // 流 1 / 2 共用一個地址空間；流 2 設置 TLB 配額，流 3 只配置了上下文描述符
+    auto memory = std::make_shared<SimpleMemoryModel>();
+    PageTableBuilder tables(*memory);
+    tables.map_range(VA, PA, PAGES * 4096);
+    SMMU smmu;
+    smmu.set_memory_model(memory);
+    StreamTableEntry ste;
+    ste.valid = true;
+    ste.s1_enabled = true;
+    ContextDescriptor cd;
+    cd.valid = true;
+    cd.translation_table_base = tables.root();
+    cd.translation_granule = 12;
+    cd.ips = 48;
+    smmu.configure_stream_table_entry(1, ste);
+    ste.tlb_reserved = 4;
+    ste.tlb_limit = 8;
+    smmu.configure_stream_table_entry(2, ste);
+    for (StreamID stream = 1; stream <= 3; stream++) {
+        cd.asid = static_cast<ASID>(stream);
+        smmu.configure_context_descriptor(stream, cd.asid, cd);
+    }
+    smmu.enable();
+    
+    // 按順序訪問所有頁面，再訪問第一個頁面使其成為最新的表項
+    for (size_t i = 0; i < PAGES; i++) smmu.translate(VA + i * 4096, 1, 1);
+    smmu.translate(VA, 1, 1);
+    smmu.translate(VA + 0x3000, 2, 2);
+    
+    SnapshotInfo saved;
+    SnapshotError error = smmu.save_snapshot(path, &saved);
+    bool written = error == SnapshotError::NONE && saved.streams == 3 &&
+                   saved.context_descriptors == 3 && saved.tlb_entries == PAGES + 1 &&
+                   saved.frames == memory->resident_frames() &&
+                   saved.file_bytes % 4096 == 0;
+    std::cout << "Snapshot written (" << saved.tlb_entries << " TLB entries, " << saved.frames
+              << " frames, " << saved.file_bytes << " bytes): "
+              << (written ? "✅" : "❌") << "\n";
+    
+    // 相同配置加載：配置、計數器和內存相同，已緩存的頁面不再遍歷
+    // 內存模型中快照之外的幀被丟棄
+    constexpr PhysicalAddress STALE = 0x7000000000;
+    auto restored_memory = std::make_shared<SimpleMemoryModel>();
+    restored_memory->write_pte(STALE, 0xDEAD);
+    SMMU restored;
+    restored.set_memory_model(restored_memory);
+    SnapshotInfo loaded;
+    error = restored.load_snapshot(path, &loaded);
+    uint64_t stale_value = 0;
+    restored_memory->read(STALE, &stale_value, sizeof(stale_value));
+    SMMU::Statistics before = smmu.get_statistics();
+    SMMU::Statistics after = restored.get_statistics();
+    StreamTableEntry restored_ste = restored.get_stream_table_entry(2);
+    bool same = error == SnapshotError::NONE && restored.is_enabled() &&
+                loaded.tlb_entries == saved.tlb_entries && loaded.frames == saved.frames &&
+                restored_ste.valid && restored_ste.tlb_reserved == 4 && restored_ste.tlb_limit == 8 &&
+                restored.get_context_descriptor(3, 3).translation_table_base == tables.root() &&
+                !restored.get_stream_table_entry(3).valid &&
+                after.total_translations == before.total_translations &&
+                after.tlb_hits == before.tlb_hits && after.tlb_misses == before.tlb_misses &&
+                after.descriptor_reads == before.descriptor_reads &&
+                restored_memory->resident_frames() == memory->resident_frames() &&
+                stale_value == 0 &&
+                restored_memory->next_allocation() == memory->next_allocation() &&
+                restored.get_stream_tlb_statistics(2).entries == 1 &&
+                restored.get_stream_tlb_statistics(2).reserved == 4;
+    bool warm = true;
+    for (size_t i = 0; i < PAGES; i++) {
+        TranslationResult r = restored.translate(VA + i * 4096 + 0x10, 1, 1);
+        warm = warm && r.success && r.physical_addr == PA + i * 4096 + 0x10;
+    }
+    warm = warm && restored.get_statistics().tlb_hits == before.tlb_hits + PAGES &&
+           restored.get_statistics().page_table_walks == before.page_table_walks;
+    std::cout << "Restored configuration, counters and memory: " << (same ? "✅" : "❌") << "\n";
+    std::cout << "Restored TLB hits without walks: " << (warm ? "✅" : "❌") << "\n";
+    
+    // 較小的 TLB 保留最新的 16 個表項；並發模式下表項按 StreamID 插入各自的分片
+    // 沒有設置內存模型時加載創建一個，未緩存的頁面從恢復的頁表遍歷
+    SMMUConfig small_config;
+    small_config.tlb_size = 16;
+    SMMU small(small_config);
+    bool reordered = small.load_snapshot(path) == SnapshotError::NONE;
+    uint64_t hits = small.get_statistics().tlb_hits;
+    reordered = reordered && small.translate(VA, 1, 1).success &&
+                small.translate(VA + (PAGES - 1) * 4096, 1, 1).success &&
+                small.get_statistics().tlb_hits == hits + 2 &&
+                small.translate(VA + (PAGES - 16) * 4096, 1, 1).physical_addr ==
+                    PA + (PAGES - 16) * 4096 &&
+                small.get_statistics().tlb_hits == hits + 2;
+    SMMUConfig sharded_config;
+    sharded_config.tlb_size = 512;
+    sharded_config.thread_safe = true;
+    sharded_config.tlb_shards = 4;
+    SMMU sharded(sharded_config);
+    bool sharded_ok = sharded.load_snapshot(path) == SnapshotError::NONE;
+    hits = sharded.get_statistics().tlb_hits;
+    for (size_t i = 0; i < PAGES; i += 7) {
+        sharded_ok = sharded_ok && sharded.translate(VA + i * 4096, 1, 1).success;
+    }
+    sharded_ok = sharded_ok && sharded.get_statistics().tlb_hits == hits + (PAGES + 6) / 7;
+    std::cout << "Smaller TLB keeps most recent entries: " << (reordered ? "✅" : "❌") << "\n";
+    std::cout << "Restored into sharded TLB: " << (sharded_ok ? "✅" : "❌") << "\n";
+    
+    // 組相聯 TLB 按填入順序導出
+    SetAssociativeTLB set_assoc(16, 4);
+    for (uint64_t i = 0; i < 6; i++) {
+        TLBEntry entry;
+        entry.va = VA + ((5 - i) << 12);
+        entry.pa = PA;
+        entry.stream_id = 1;
+        entry.page_size = PageSize::SIZE_4KB;
+        set_assoc.insert(entry);
+    }
+    std::vector<TLBEntry> exported;
+    set_assoc.export_entries(exported);
+    bool fill_order = exported.size() == 6;
+    for (size_t i = 0; i < exported.size() && fill_order; i++) {
+        fill_order = exported[i].va == VA + ((5 - i) << 12);
+    }
+    std::cout << "Set-associative export in fill order: " << (fill_order ? "✅" : "❌") << "\n";
+    
+    // 錯誤：文件不存在、不是快照、截斷；失敗時狀態不變
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    const std::string bad_path = "smmu_test_snapshot_bad.bin";
+    {
+        std::ofstream out(bad_path, std::ios::binary);
+        out << "not a snapshot";
+    }
+    restored_memory->write_pte(STALE, 0xBEEF);
+    size_t frames_before = restored_memory->resident_frames();
+    SnapshotError not_snapshot = restored.load_snapshot(bad_path);
+    {
+        std::ofstream out(bad_path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 4096));
+    }
+    SnapshotError truncated = restored.load_snapshot(bad_path);
+    uint64_t translations = restored.get_statistics().total_translations;
+    uint64_t marker = 0;
+    restored_memory->read(STALE, &marker, sizeof(marker));
+    bool rejected = restored.load_snapshot("no_such_dir/snapshot.bin") == SnapshotError::IO_ERROR &&
+                    marker == 0xBEEF && restored_memory->resident_frames() == frames_before &&
+                    not_snapshot == SnapshotError::BAD_FORMAT &&
+                    truncated == SnapshotError::BAD_FORMAT &&
+                    restored.get_statistics().total_translations == translations &&
+                    restored.translate(VA, 1, 1).success &&
+                    restored.get_statistics().tlb_hits == before.tlb_hits + PAGES + 1;
+    std::cout << "Invalid files rejected (" << snapshot_error_to_string(truncated) << "): "
+              << (rejected ? "✅" : "❌") << "\n\n";
+    std::remove(path.c_str());
+    std::remove(bad_path.c_str());
+}
+
 // ============================================================================
 // 主函數：運行所有測試
 // ============================================================================
@@ -348,6 +2701,30 @@ int main() {
         test_tlb_invalidation();       // 測試3：TLB 無效化
         test_command_queue();          // 測試4：命令隊列
         test_register_interface();     // 測試5：寄存器接口
+        test_set_associative_tlb();    // 測試6：組相聯 TLB
+        test_block_mappings();         // 測試7：大頁映射
+        test_page_walk_cache();        // 測試8：頁表遍歷緩存
+        test_sparse_memory();          // 測試9：稀疏內存模型
+        test_batch_translation();      // 測試10：批量地址轉換
+        test_hit_path_allocations();   // 測試11：命中路徑不分配內存
+        test_concurrent_translation(); // 測試12：並發模式
+        test_indexed_invalidation();   // 測試13：索引化 TLB 無效化
+        test_range_invalidation();     // 測試14：範圍 TLB 無效化
+        test_memory_queues();          // 測試15：內存命令隊列和事件隊列
+        test_stream_table();           // 測試16：二級線性流表
+        test_nested_translation();     // 測試17：嵌套轉換
+        test_prefetching();            // 測試18：順序訪問預取
+        test_leaf_line_fill();         // 測試19：葉子緩存行填充
+        test_contiguous_coalescing();  // 測試20：連續頁面合併
+        test_direct_memory_walk();     // 測試21：直接內存讀取路徑
+        test_tlb_partitioning();       // 測試22：TLB 按流分區
+        test_walk_memory_callbacks();  // 測試23：遍歷內存回調
+        test_invalidation_notifications(); // 測試24：轉換失效通知
+        test_instrumentation();        // 測試25：轉換路徑插樁
+        test_page_table_builder();     // 測試26：頁表構建器
+        test_frame_allocator();        // 測試27：頁表幀分配器
+        test_batch_decode();           // 測試28：描述符批量解碼和批量遍歷
+        test_snapshot();               // 測試29：狀態快照
         
         std::cout << "╔════════════════════════════════════════╗\n";
         std::cout << "║      All tests completed! ✅           ║\n";
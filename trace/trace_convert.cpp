@@ -0,0 +1,68 @@
+// Converts a CSV trace into the binary trace format read by trace_runner
+// Usage: trace_convert <input.csv> <output.bin>
+
+#include "trace_format.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+using namespace smmu;
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.csv> <output.bin>\n";
+        return 1;
+    }
+
+    std::ifstream input(argv[1]);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open file " << argv[1] << "\n";
+        return 1;
+    }
+    std::ofstream output(argv[2], std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        std::cerr << "Error: Could not create file " << argv[2] << "\n";
+        return 1;
+    }
+
+    // The record count is patched into the header once the input is consumed
+    trace::TraceFileHeader header = trace::make_header(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // Records are written in blocks to keep memory bounded for large traces
+    constexpr size_t BLOCK_RECORDS = 4096;
+    std::vector<trace::TraceRecord> block;
+    block.reserve(BLOCK_RECORDS);
+    auto write_block = [&]() {
+        output.write(reinterpret_cast<const char*>(block.data()),
+                     static_cast<std::streamsize>(block.size() * sizeof(trace::TraceRecord)));
+        header.record_count += block.size();
+        block.clear();
+    };
+
+    size_t errors = 0;
+    auto on_error = [&errors](size_t line, const char* message) {
+        std::cerr << "Error: line " << line << ": " << message << "\n";
+        errors++;
+    };
+
+    trace::CsvTraceReader reader(input);
+    trace::TraceRecord record;
+    while (reader.next(record, on_error)) {
+        block.push_back(record);
+        if (block.size() == BLOCK_RECORDS) write_block();
+    }
+    write_block();
+
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!output) {
+        std::cerr << "Error: Failed writing " << argv[2] << "\n";
+        return 1;
+    }
+
+    std::cout << "Converted " << header.record_count << " records to " << argv[2];
+    if (errors > 0) std::cout << " (" << errors << " malformed lines skipped)";
+    std::cout << "\n";
+    return 0;
+}
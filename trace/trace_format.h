@@ -0,0 +1,226 @@
+// SMMU trace formats shared by trace_runner and trace_convert
+//
+// Two on-disk formats are supported:
+//   - CSV: human-editable, one command per line (see TRACE_README.md)
+//   - Binary: a fixed header followed by fixed-width 24-byte records,
+//     designed to be memory-mapped and streamed without parsing
+//
+// Binary layout (little-endian):
+//   TraceFileHeader (32 bytes)
+//   TraceRecord[record_count] (24 bytes each)
+
+#ifndef SMMU_TRACE_FORMAT_H
+#define SMMU_TRACE_FORMAT_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <istream>
+
+namespace smmu {
+namespace trace {
+
+// ============================================================================
+// Binary format
+// ============================================================================
+
+constexpr char TRACE_MAGIC[8] = {'S', 'M', 'M', 'U', 'T', 'R', 'C', '\0'};
+constexpr uint32_t TRACE_VERSION = 1;
+
+struct TraceFileHeader {
+    char magic[8];          // TRACE_MAGIC
+    uint32_t version;       // TRACE_VERSION
+    uint32_t record_size;   // sizeof(TraceRecord)
+    uint64_t record_count;  // number of records following the header
+    uint64_t reserved;
+};
+
+enum class RecordType : uint8_t {
+    STREAM = 1,  // stream_id -> asid
+    MAP = 2,     // asid: va -> pa, FLAG_READ_ONLY
+    ACCESS = 3,  // stream_id accesses va, FLAG_WRITE
+};
+
+constexpr uint8_t FLAG_READ_ONLY = 0x1;  // MAP: read-only mapping
+constexpr uint8_t FLAG_WRITE = 0x1;      // ACCESS: write access
+
+// One command; unused fields are zero
+struct TraceRecord {
+    RecordType type;
+    uint8_t flags;
+    uint16_t asid;
+    uint32_t stream_id;
+    uint64_t va;
+    uint64_t pa;
+};
+
+static_assert(sizeof(TraceFileHeader) == 32, "TraceFileHeader must be 32 bytes");
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord must be 24 bytes");
+
+inline bool is_binary_header(const TraceFileHeader& header) {
+    return std::memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0;
+}
+
+inline TraceFileHeader make_header(uint64_t record_count) {
+    TraceFileHeader header;
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.record_count = record_count;
+    header.reserved = 0;
+    return header;
+}
+
+// ============================================================================
+// CSV format
+// Parsed in place with strtoull; no per-field string allocation
+// ============================================================================
+
+namespace detail {
+
+inline const char* skip_blank(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+// Split the next comma-separated field, trimming surrounding whitespace.
+// Returns false when no fields remain.
+inline bool next_field(const char*& p, const char* end,
+                       const char*& field, size_t& length) {
+    p = skip_blank(p, end);
+    if (p >= end) return false;
+    const char* start = p;
+    while (p < end && *p != ',') p++;
+    const char* stop = p;
+    while (stop > start && (stop[-1] == ' ' || stop[-1] == '\t' || stop[-1] == '\r')) stop--;
+    if (p < end) p++;  // consume ','
+    field = start;
+    length = static_cast<size_t>(stop - start);
+    return true;
+}
+
+inline bool field_equals(const char* field, size_t length, const char* word) {
+    size_t word_length = std::strlen(word);
+    return length == word_length && std::memcmp(field, word, length) == 0;
+}
+
+// Parse a hex (0x-prefixed) or decimal number
+inline bool parse_number(const char* field, size_t length, uint64_t& value) {
+    char buffer[32];
+    if (length == 0 || length >= sizeof(buffer)) return false;
+    std::memcpy(buffer, field, length);
+    buffer[length] = '\0';
+    int base = (length > 2 && buffer[0] == '0' && (buffer[1] == 'x' || buffer[1] == 'X')) ? 16 : 10;
+    char* parsed_end = nullptr;
+    value = std::strtoull(buffer, &parsed_end, base);
+    return parsed_end == buffer + length;
+}
+
+} // namespace detail
+
+enum class ParseStatus {
+    RECORD,  // a record was produced
+    SKIP,    // blank line or comment
+    ERROR,   // malformed line; error describes why
+};
+
+// Parse one CSV line into a record
+inline ParseStatus parse_csv_line(const std::string& line, TraceRecord& record,
+                                  const char*& error) {
+    const char* p = line.data();
+    const char* end = p + line.size();
+    const char* comment = static_cast<const char*>(std::memchr(p, '#', line.size()));
+    if (comment) end = comment;
+
+    const char* fields[5];
+    size_t lengths[5];
+    size_t count = 0;
+    const char* field;
+    size_t length;
+    while (count < 5 && detail::next_field(p, end, field, length)) {
+        if (length == 0) continue;  // empty cell
+        fields[count] = field;
+        lengths[count] = length;
+        count++;
+    }
+    if (count == 0) return ParseStatus::SKIP;
+
+    std::memset(&record, 0, sizeof(record));
+    uint64_t values[3] = {0, 0, 0};
+    const size_t args = count - 1;
+
+    if (detail::field_equals(fields[0], lengths[0], "STREAM")) {
+        // STREAM, <StreamID>, <ASID>
+        if (args < 2 || !detail::parse_number(fields[1], lengths[1], values[0]) ||
+            !detail::parse_number(fields[2], lengths[2], values[1])) {
+            error = "STREAM command requires StreamID and ASID";
+            return ParseStatus::ERROR;
+        }
+        record.type = RecordType::STREAM;
+        record.stream_id = static_cast<uint32_t>(values[0]);
+        record.asid = static_cast<uint16_t>(values[1]);
+    } else if (detail::field_equals(fields[0], lengths[0], "MAP")) {
+        // MAP, <ASID>, <VA>, <PA>, [RW/RO]
+        if (args < 3 || !detail::parse_number(fields[1], lengths[1], values[0]) ||
+            !detail::parse_number(fields[2], lengths[2], values[1]) ||
+            !detail::parse_number(fields[3], lengths[3], values[2])) {
+            error = "MAP command requires ASID, VA, PA";
+            return ParseStatus::ERROR;
+        }
+        record.type = RecordType::MAP;
+        record.asid = static_cast<uint16_t>(values[0]);
+        record.va = values[1];
+        record.pa = values[2];
+        if (args > 3 && detail::field_equals(fields[4], lengths[4], "RO")) {
+            record.flags |= FLAG_READ_ONLY;
+        }
+    } else if (detail::field_equals(fields[0], lengths[0], "ACCESS")) {
+        // ACCESS, <StreamID>, <VA>, [R/W]
+        if (args < 2 || !detail::parse_number(fields[1], lengths[1], values[0]) ||
+            !detail::parse_number(fields[2], lengths[2], values[1])) {
+            error = "ACCESS command requires StreamID and VA";
+            return ParseStatus::ERROR;
+        }
+        record.type = RecordType::ACCESS;
+        record.stream_id = static_cast<uint32_t>(values[0]);
+        record.va = values[1];
+        if (args > 2 && detail::field_equals(fields[3], lengths[3], "W")) {
+            record.flags |= FLAG_WRITE;
+        }
+    } else {
+        return ParseStatus::SKIP;  // unknown commands are ignored
+    }
+    return ParseStatus::RECORD;
+}
+
+// Stream records from a CSV file one line at a time
+class CsvTraceReader {
+public:
+    explicit CsvTraceReader(std::istream& input) : input_(input), line_number_(0) {}
+
+    // Returns false at end of file; malformed lines are reported and skipped
+    template <typename ErrorHandler>
+    bool next(TraceRecord& record, ErrorHandler on_error) {
+        while (std::getline(input_, line_)) {
+            line_number_++;
+            const char* error = nullptr;
+            switch (parse_csv_line(line_, record, error)) {
+                case ParseStatus::RECORD: return true;
+                case ParseStatus::ERROR: on_error(line_number_, error); break;
+                case ParseStatus::SKIP: break;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::istream& input_;
+    std::string line_;
+    size_t line_number_;
+};
+
+} // namespace trace
+} // namespace smmu
+
+#endif // SMMU_TRACE_FORMAT_H
@@ -1,268 +1,700 @@
 #include "smmu.h"
 #include "smmu_registers.h"
 #include "page_table.h"
+#include "page_table_builder.h"
+#include "trace_format.h"
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <vector>
+#include <deque>
 #include <string>
-#include <map>
+#include <unordered_map>
 #include <iomanip>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace smmu;
 
-// Helper class to manage page table creation
-class PageTableManager {
-    std::shared_ptr<SimpleMemoryModel> memory;
-    PhysicalAddress root_table_pa;
+// Compact replay log shared by all partitions.
+// Each partition formats lines into its own buffer and appends whole buffers under the lock,
+// so lines of different streams may interleave but each stream keeps trace order.
+//   S <stream> <asid> <table>           stream bound to an ASID
+//   M <asid> <va> <pa> RW|RO            mapping added
+//   A <stream> <asid> <va> <pa>         translated access
+//   A <stream> <asid> <va> F <reason>   faulted access
+class ReplayLog {
+public:
+    static constexpr size_t BUFFER_BYTES = 64 * 1024;  // partition buffer size before it is written out
+
+    explicit ReplayLog(std::ostream& os) : os_(os) {}
+
+    // Write and clear a partition buffer
+    void append(std::string& buffer) {
+        if (buffer.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        os_.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+    static void append_number(std::string& out, uint64_t value, int base = 10) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value, base);
+        if (base == 16) out += "0x";
+        out.append(digits, result.ptr);
+    }
+
+private:
+    std::mutex mutex_;
+    std::ostream& os_;
+};
 
+// One replay partition: an independent SMMU instance for the streams routed to it.
+// All partitions read the same page table memory; only the dispatcher writes it, and only
+// while every partition is idle.
+// Consecutive ACCESS records are collected and translated with translate_batch;
+// the batch is flushed before any STREAM record so ordering is preserved.
+class ReplayPartition {
 public:
-    PageTableManager(std::shared_ptr<SimpleMemoryModel> mem) : memory(mem) {
-        // Allocate L0 table immediately
-        root_table_pa = memory->allocate_page(4096);
+    static constexpr size_t BATCH_SIZE = 256;
+
+    struct StreamSummary {
+        uint32_t stream_id = 0;
+        uint32_t asid = 0;       // last ASID bound by a STREAM record
+        uint64_t accesses = 0;
+        uint64_t faults = 0;
+    };
+
+    ReplayPartition(std::shared_ptr<SimpleMemoryModel> memory, bool instrumented, ReplayLog* log)
+        : log_(log), last_summary_(nullptr) {
+        SMMUConfig config;
+        config.tlb_size = 128; // Larger TLB for trace
+        config.instrumentation = instrumented; // per-context counters and latency histograms
+        smmu_ = std::make_unique<SMMU>(config);
+        smmu_->set_memory_model(memory);
+        smmu_->enable();
+        requests_.reserve(BATCH_SIZE);
+        results_.resize(BATCH_SIZE);
     }
 
-    PhysicalAddress get_root_pa() const { return root_table_pa; }
+    // STREAM records carry the root table address of the ASID in pa (resolved by the dispatcher)
+    void handle(const trace::TraceRecord& record) {
+        if (record.type == trace::RecordType::STREAM) {
+            translate_pending();
+            configure_stream(record.stream_id, record.asid, record.pa);
+        } else if (record.type == trace::RecordType::ACCESS) {
+            access(record.stream_id, record.va);
+        }
+    }
 
-    // Map VA to PA with permissions using 4-level walking (4KB granule)
-    void map(VirtualAddress va, PhysicalAddress pa, AccessPermission ap) {
-        // L0 (Root) - Index bits 47:39
-        uint64_t l0_index = (va >> 39) & 0x1FF;
-        PhysicalAddress l0_entry_addr = root_table_pa + (l0_index * 8);
-        uint64_t l0_desc = 0;
-        memory->read(l0_entry_addr, &l0_desc, 8);
+    // Translate any pending accesses and write out the log buffer
+    void flush() {
+        translate_pending();
+        if (log_) log_->append(log_buffer_);
+    }
 
-        if ((l0_desc & 1) == 0) { // Invalid, allocate L1
-            PhysicalAddress l1_table = memory->allocate_page(4096);
-            l0_desc = l1_table | 3; // Table descriptor, Valid
-            memory->write_pte(l0_entry_addr, l0_desc);
+    const SMMU& smmu() const { return *smmu_; }
+    const std::unordered_map<uint32_t, StreamSummary>& streams() const { return streams_; }
+
+private:
+    void configure_stream(uint32_t stream_id, uint32_t asid, PhysicalAddress table_root) {
+        stream_asid_map_[stream_id] = asid;
+        summary_for(stream_id).asid = asid;
+
+        StreamTableEntry ste;
+        ste.valid = true;
+        ste.s1_enabled = true;
+        ste.s2_enabled = false;
+        smmu_->configure_stream_table_entry(stream_id, ste);
+
+        ContextDescriptor cd;
+        cd.valid = true;
+        cd.translation_table_base = table_root;
+        cd.translation_granule = 12; // 4KB
+        cd.ips = 48;
+        cd.asid = asid;
+        smmu_->configure_context_descriptor(stream_id, asid, cd);
+        if (log_) {
+            log_buffer_ += "S ";
+            ReplayLog::append_number(log_buffer_, stream_id);
+            log_buffer_ += ' ';
+            ReplayLog::append_number(log_buffer_, asid);
+            log_buffer_ += ' ';
+            ReplayLog::append_number(log_buffer_, table_root, 16);
+            log_buffer_ += '\n';
         }
-        PhysicalAddress l1_table_pa = l0_desc & 0xFFFFFFFFF000ULL;
-
-        // L1 - Index bits 38:30
-        uint64_t l1_index = (va >> 30) & 0x1FF;
-        PhysicalAddress l1_entry_addr = l1_table_pa + (l1_index * 8);
-        uint64_t l1_desc = 0;
-        memory->read(l1_entry_addr, &l1_desc, 8);
-
-        if ((l1_desc & 1) == 0) { // Invalid, allocate L2
-            PhysicalAddress l2_table = memory->allocate_page(4096);
-            l1_desc = l2_table | 3;
-            memory->write_pte(l1_entry_addr, l1_desc);
+    }
+
+    void access(uint32_t stream_id, uint64_t va) {
+        uint32_t inferred_asid = 0;
+        auto it = stream_asid_map_.find(stream_id);
+        if (it != stream_asid_map_.end()) {
+            inferred_asid = it->second;
         }
-        PhysicalAddress l2_table_pa = l1_desc & 0xFFFFFFFFF000ULL;
-
-        // L2 - Index bits 29:21
-        uint64_t l2_index = (va >> 21) & 0x1FF;
-        PhysicalAddress l2_entry_addr = l2_table_pa + (l2_index * 8);
-        uint64_t l2_desc = 0;
-        memory->read(l2_entry_addr, &l2_desc, 8);
-
-        if ((l2_desc & 1) == 0) { // Invalid, allocate L3
-            PhysicalAddress l3_table = memory->allocate_page(4096);
-            l2_desc = l3_table | 3;
-            memory->write_pte(l2_entry_addr, l2_desc);
+
+        requests_.push_back({va, stream_id, static_cast<ASID>(inferred_asid), 0});
+        if (requests_.size() == BATCH_SIZE) translate_pending();
+    }
+
+    void translate_pending() {
+        if (requests_.empty()) return;
+        smmu_->translate_batch(requests_.data(), results_.data(), requests_.size());
+        for (size_t i = 0; i < requests_.size(); i++) {
+            StreamSummary& summary = summary_for(requests_[i].stream_id);
+            summary.accesses++;
+            if (!results_[i].success) summary.faults++;
+            if (log_) log_access(requests_[i], results_[i]);
         }
-        PhysicalAddress l3_table_pa = l2_desc & 0xFFFFFFFFF000ULL;
-
-        // L3 - Index bits 20:12
-        uint64_t l3_index = (va >> 12) & 0x1FF;
-        PhysicalAddress l3_entry_addr = l3_table_pa + (l3_index * 8);
-
-        // Create Page Descriptor
-        // PA | AF(1) | SH(0) | AP(RW=0) | Valid(1) | Page(1)
-        uint64_t l3_desc = (pa & 0xFFFFFFFFF000ULL) | (1 << 10) | 3;
-
-        // Set permissions
-        // AP[2:1]
-        // 00 = RW, EL1
-        // 10 = RO, EL1
-        if (ap == AccessPermission::READ_ONLY) {
-             l3_desc |= (1 << 7); // Set AP[2] = 1 (RO)
+        requests_.clear();
+        if (log_ && log_buffer_.size() >= ReplayLog::BUFFER_BYTES) log_->append(log_buffer_);
+    }
+
+    void log_access(const TranslationRequest& request, const TranslationResult& result) {
+        log_buffer_ += "A ";
+        ReplayLog::append_number(log_buffer_, request.stream_id);
+        log_buffer_ += ' ';
+        ReplayLog::append_number(log_buffer_, request.asid);
+        log_buffer_ += ' ';
+        ReplayLog::append_number(log_buffer_, request.va, 16);
+        if (result.success) {
+            log_buffer_ += ' ';
+            ReplayLog::append_number(log_buffer_, result.physical_addr, 16);
+        } else {
+            log_buffer_ += " F ";
+            log_buffer_ += result.fault_reason;
         }
+        log_buffer_ += '\n';
+    }
 
-        memory->write_pte(l3_entry_addr, l3_desc);
+    // Accesses usually come in runs from one stream; remember the last summary
+    StreamSummary& summary_for(uint32_t stream_id) {
+        if (last_summary_ && last_summary_->stream_id == stream_id) return *last_summary_;
+        StreamSummary& summary = streams_[stream_id];
+        summary.stream_id = stream_id;
+        last_summary_ = &summary;
+        return summary;
     }
-};
 
-struct TraceLine {
-    std::string type;
-    std::vector<std::string> args;
+    ReplayLog* log_;
+    std::unique_ptr<SMMU> smmu_;
+    std::unordered_map<uint32_t, uint32_t> stream_asid_map_; // StreamID -> ASID
+    std::unordered_map<uint32_t, StreamSummary> streams_;
+    StreamSummary* last_summary_;   // element of streams_ (node addresses are stable)
+    std::vector<TranslationRequest> requests_;
+    std::vector<TranslationResult> results_;
+    std::string log_buffer_;
 };
 
-std::vector<TraceLine> parse_csv(const std::string& filename) {
-    std::vector<TraceLine> lines;
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << filename << "\n";
-        return lines;
+// Worker thread replaying the chunks the dispatcher queues for its partitions.
+// The dispatcher only queues records of partitions owned by this worker, so partition
+// state is never shared between threads.
+class ReplayWorker {
+public:
+    static constexpr size_t MAX_QUEUED_CHUNKS = 8;
+
+    ReplayWorker(const std::vector<std::unique_ptr<ReplayPartition>>& partitions,
+                 std::vector<ReplayPartition*> owned)
+        : partitions_(partitions), owned_(std::move(owned)), busy_(false), stopping_(false),
+          thread_(&ReplayWorker::run, this) {}
+
+    ~ReplayWorker() { stop(); }
+
+    // Queue a chunk, waiting while MAX_QUEUED_CHUNKS are pending.
+    // chunk is replaced by an empty (recycled) vector.
+    void submit(std::vector<trace::TraceRecord>& chunk) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return queue_.size() < MAX_QUEUED_CHUNKS; });
+        queue_.push_back(std::move(chunk));
+        if (!spare_.empty()) {
+            chunk = std::move(spare_.back());
+            spare_.pop_back();
+        } else {
+            chunk = std::vector<trace::TraceRecord>();
+        }
+        lock.unlock();
+        work_cv_.notify_one();
+    }
+
+    // Wait until every queued chunk has been replayed and its partitions flushed
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        // Remove comments
-        size_t comment_pos = line.find('#');
-        if (comment_pos != std::string::npos) {
-            line = line.substr(0, comment_pos);
+    void stop() {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
         }
+        work_cv_.notify_one();
+        thread_.join();
+    }
 
-        if (line.empty()) continue;
-
-        std::stringstream ss(line);
-        std::string cell;
-        TraceLine trace_line;
-        bool first = true;
-
-        while (std::getline(ss, cell, ',')) {
-            // Trim whitespace
-            size_t first_char = cell.find_first_not_of(" \t");
-            if (first_char == std::string::npos) continue; // empty or whitespace only
-            size_t last_char = cell.find_last_not_of(" \t");
-            cell = cell.substr(first_char, (last_char - first_char + 1));
-
-            if (first) {
-                trace_line.type = cell;
-                first = false;
-            } else {
-                trace_line.args.push_back(cell);
-            }
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            work_cv_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+            if (queue_.empty()) return;
+            std::vector<trace::TraceRecord> chunk = std::move(queue_.front());
+            queue_.pop_front();
+            busy_ = true;
+            lock.unlock();
+            done_cv_.notify_all();  // room for another chunk
+
+            size_t count = partitions_.size();
+            for (const auto& record : chunk) partitions_[record.stream_id % count]->handle(record);
+            for (ReplayPartition* partition : owned_) partition->flush();
+            chunk.clear();
+
+            lock.lock();
+            spare_.push_back(std::move(chunk));
+            busy_ = false;
+            done_cv_.notify_all();
         }
+    }
 
-        if (!trace_line.type.empty()) {
-            lines.push_back(trace_line);
+    const std::vector<std::unique_ptr<ReplayPartition>>& partitions_;
+    std::vector<ReplayPartition*> owned_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;   // chunk queued or stopping
+    std::condition_variable done_cv_;   // chunk taken or finished
+    std::deque<std::vector<trace::TraceRecord>> queue_;
+    std::vector<std::vector<trace::TraceRecord>> spare_;
+    bool busy_;
+    bool stopping_;
+    std::thread thread_;
+};
+
+// Replays trace records against one or more SMMU partitions.
+// ACCESS and STREAM records go to partition stream_id % partitions, so each stream keeps
+// trace order within its partition. MAP writes the shared page tables, so it waits for every
+// partition to finish the records before it (a global ordering point).
+// Results depend only on the number of partitions, never on the number of threads.
+class TraceReplayer {
+public:
+    static constexpr size_t CHUNK_RECORDS = 4096;
+
+    TraceReplayer(size_t partitions, size_t threads, bool instrumented, ReplayLog* log)
+        : log_(log), threads_(1), records_(0), maps_(0) {
+        memory_ = std::make_shared<SimpleMemoryModel>();
+        partitions = std::max<size_t>(partitions, 1);
+        for (size_t i = 0; i < partitions; i++) {
+            partitions_.push_back(std::make_unique<ReplayPartition>(memory_, instrumented, log));
+        }
+        threads = std::min(std::max<size_t>(threads, 1), partitions);
+        threads_ = threads;
+        if (threads > 1) {
+            pending_.resize(threads);
+            for (size_t t = 0; t < threads; t++) {
+                std::vector<ReplayPartition*> owned;
+                for (size_t p = t; p < partitions; p += threads) owned.push_back(partitions_[p].get());
+                workers_.push_back(std::make_unique<ReplayWorker>(partitions_, std::move(owned)));
+                pending_[t].reserve(CHUNK_RECORDS);
+            }
         }
     }
-    return lines;
-}
 
-uint64_t parse_hex_or_dec(const std::string& s) {
-    if (s.find("0x") == 0 || s.find("0X") == 0) {
-        return std::stoull(s, nullptr, 16);
+    void handle(const trace::TraceRecord& record) {
+        records_++;
+        switch (record.type) {
+            case trace::RecordType::STREAM: {
+                // allocate_page only advances the allocator, so partitions can keep walking
+                trace::TraceRecord bound = record;
+                bound.pa = table_for(record.asid).root();
+                route(bound);
+                break;
+            }
+            case trace::RecordType::MAP:
+                barrier();
+                map(record.asid, record.va, record.pa,
+                    (record.flags & trace::FLAG_READ_ONLY) ? AccessPermission::READ_ONLY
+                                                           : AccessPermission::READ_WRITE);
+                break;
+            case trace::RecordType::ACCESS:
+                route(record);
+                break;
+            default:
+                break;
+        }
     }
-    return std::stoull(s, nullptr, 10);
-}
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <trace_file.csv>\n";
-        return 1;
+    // Replay everything still queued and stop the worker threads
+    void finish() {
+        barrier();
+        workers_.clear();
     }
 
-    std::string trace_file = argv[1];
-    auto commands = parse_csv(trace_file);
+    SMMU::Statistics statistics() const {
+        SMMU::Statistics total;
+        std::memset(&total, 0, sizeof(total));
+        for (const auto& partition : partitions_) {
+            SMMU::Statistics stats = partition->smmu().get_statistics();
+            total.total_translations += stats.total_translations;
+            total.tlb_hits += stats.tlb_hits;
+            total.tlb_misses += stats.tlb_misses;
+            total.page_table_walks += stats.page_table_walks;
+            total.translation_faults += stats.translation_faults;
+            total.permission_faults += stats.permission_faults;
+            total.commands_processed += stats.commands_processed;
+            total.events_generated += stats.events_generated;
+            total.events_dropped += stats.events_dropped;
+            total.command_errors += stats.command_errors;
+            total.descriptor_reads += stats.descriptor_reads;
+            for (size_t level = 0; level < PageWalkCache::NUM_LEVELS; level++) {
+                total.walk_cache_hits[level] += stats.walk_cache_hits[level];
+            }
+            total.walk_cache_misses += stats.walk_cache_misses;
+            total.s2_tlb_hits += stats.s2_tlb_hits;
+            total.s2_tlb_misses += stats.s2_tlb_misses;
+            total.prefetches_issued += stats.prefetches_issued;
+            total.prefetch_hits += stats.prefetch_hits;
+            total.prefetches_unused += stats.prefetches_unused;
+            total.neighbour_fills += stats.neighbour_fills;
+            total.contiguous_fills += stats.contiguous_fills;
+            total.coalesced_fills += stats.coalesced_fills;
+            total.batch_reuses += stats.batch_reuses;
+        }
+        return total;
+    }
 
-    // Setup SMMU
-    auto memory = std::make_shared<SimpleMemoryModel>();
-    SMMUConfig config;
-    config.tlb_size = 128; // Larger TLB for trace
-    SMMU smmu(config);
-    smmu.set_memory_model(memory);
-    smmu.enable();
+    InstrumentationSnapshot instrumentation() const {
+        InstrumentationSnapshot total;
+        for (const auto& partition : partitions_) total.merge(partition->smmu().get_instrumentation());
+        return total;
+    }
 
-    std::map<uint32_t, std::shared_ptr<PageTableManager>> asid_tables;
-    std::map<uint32_t, uint32_t> stream_asid_map; // StreamID -> ASID
+    // Per-stream summaries of all partitions, sorted by StreamID
+    std::vector<ReplayPartition::StreamSummary> streams() const {
+        std::vector<ReplayPartition::StreamSummary> all;
+        for (const auto& partition : partitions_) {
+            for (const auto& entry : partition->streams()) all.push_back(entry.second);
+        }
+        std::sort(all.begin(), all.end(), [](const auto& a, const auto& b) {
+            return a.stream_id < b.stream_id;
+        });
+        return all;
+    }
 
-    std::cout << "Starting SMMU Trace Runner with " << trace_file << "\n";
-    std::cout << "================================================\n";
+    uint64_t records() const { return records_; }
+    uint64_t accesses() const { return statistics().total_translations; }
+    uint64_t maps() const { return maps_; }
+    size_t partitions() const { return partitions_.size(); }
+    size_t threads() const { return threads_; }  // worker threads used (still valid after finish)
+
+private:
+    void route(const trace::TraceRecord& record) {
+        size_t partition = record.stream_id % partitions_.size();
+        if (workers_.empty()) {
+            partitions_[partition]->handle(record);
+            return;
+        }
+        size_t worker = partition % workers_.size();
+        pending_[worker].push_back(record);
+        if (pending_[worker].size() == CHUNK_RECORDS) {
+            workers_[worker]->submit(pending_[worker]);
+            pending_[worker].reserve(CHUNK_RECORDS);
+        }
+    }
 
-    for (const auto& cmd : commands) {
-        if (cmd.type == "STREAM") {
-            // STREAM, <StreamID>, <ASID>
-            if (cmd.args.size() < 2) {
-                std::cerr << "Error: STREAM command requires StreamID and ASID\n";
-                continue;
-            }
-            uint32_t stream_id = parse_hex_or_dec(cmd.args[0]);
-            uint32_t asid = parse_hex_or_dec(cmd.args[1]);
-
-            stream_asid_map[stream_id] = asid;
-
-            StreamTableEntry ste;
-            ste.valid = true;
-            ste.s1_enabled = true;
-            ste.s2_enabled = false;
-            smmu.configure_stream_table_entry(stream_id, ste);
-
-            // Ensure context descriptor is set up if we have a table for this ASID
-            if (asid_tables.find(asid) != asid_tables.end()) {
-                 ContextDescriptor cd;
-                 cd.valid = true;
-                 cd.translation_table_base = asid_tables[asid]->get_root_pa();
-                 cd.translation_granule = 12; // 4KB
-                 cd.ips = 48;
-                 cd.asid = asid;
-                 smmu.configure_context_descriptor(stream_id, asid, cd);
-                 std::cout << "[CONFIG] Stream " << stream_id << " -> ASID " << asid << " (Table: 0x" << std::hex << cd.translation_table_base << std::dec << ")\n";
-            } else {
-                 // Create table if not exists, just so we have one
-                 asid_tables[asid] = std::make_shared<PageTableManager>(memory);
-                 ContextDescriptor cd;
-                 cd.valid = true;
-                 cd.translation_table_base = asid_tables[asid]->get_root_pa();
-                 cd.translation_granule = 12;
-                 cd.ips = 48;
-                 cd.asid = asid;
-                 smmu.configure_context_descriptor(stream_id, asid, cd);
-                 std::cout << "[CONFIG] Stream " << stream_id << " -> ASID " << asid << " (New Table: 0x" << std::hex << cd.translation_table_base << std::dec << ")\n";
+    // Wait until every record routed so far has been replayed
+    void barrier() {
+        if (workers_.empty()) {
+            for (auto& partition : partitions_) partition->flush();
+            return;
+        }
+        for (size_t t = 0; t < workers_.size(); t++) {
+            if (!pending_[t].empty()) {
+                workers_[t]->submit(pending_[t]);
+                pending_[t].reserve(CHUNK_RECORDS);
             }
+        }
+        for (auto& worker : workers_) worker->wait_idle();
+    }
 
-        } else if (cmd.type == "MAP") {
-            // MAP, <ASID>, <VA>, <PA>, [RW/RO]
-            if (cmd.args.size() < 3) {
-                 std::cerr << "Error: MAP command requires ASID, VA, PA\n";
-                 continue;
-            }
-            uint32_t asid = parse_hex_or_dec(cmd.args[0]);
-            uint64_t va = parse_hex_or_dec(cmd.args[1]);
-            uint64_t pa = parse_hex_or_dec(cmd.args[2]);
-            AccessPermission ap = AccessPermission::READ_WRITE;
-            if (cmd.args.size() > 3 && cmd.args[3] == "RO") {
-                ap = AccessPermission::READ_ONLY;
-            }
+    void map(uint32_t asid, uint64_t va, uint64_t pa, AccessPermission ap) {
+        MappingAttributes attrs;
+        attrs.permission = ap;
+        table_for(asid).map(va & ~0xFFFULL, pa & ~0xFFFULL, attrs);
+        maps_++;
+        if (log_) {
+            std::string line = "M ";
+            ReplayLog::append_number(line, asid);
+            line += ' ';
+            ReplayLog::append_number(line, va, 16);
+            line += ' ';
+            ReplayLog::append_number(line, pa, 16);
+            line += (ap == AccessPermission::READ_ONLY) ? " RO\n" : " RW\n";
+            log_->append(line);
+        }
+    }
 
-            if (asid_tables.find(asid) == asid_tables.end()) {
-                asid_tables[asid] = std::make_shared<PageTableManager>(memory);
-            }
+    // 4KB-granule tables, one per ASID
+    PageTableBuilder& table_for(uint32_t asid) {
+        auto& table = asid_tables_[asid];
+        if (!table) table = std::make_unique<PageTableBuilder>(*memory_);
+        return *table;
+    }
 
-            asid_tables[asid]->map(va, pa, ap);
-            std::cout << "[MAP] ASID " << asid << ": VA 0x" << std::hex << va << " -> PA 0x" << pa << std::dec << "\n";
+    ReplayLog* log_;
+    std::shared_ptr<SimpleMemoryModel> memory_;
+    std::unordered_map<uint32_t, std::unique_ptr<PageTableBuilder>> asid_tables_;
+    std::vector<std::unique_ptr<ReplayPartition>> partitions_;
+    std::vector<std::unique_ptr<ReplayWorker>> workers_;     // empty: replay on the calling thread
+    std::vector<std::vector<trace::TraceRecord>> pending_;   // per worker, submitted every CHUNK_RECORDS
+    size_t threads_;
+    uint64_t records_;
+    uint64_t maps_;
+};
 
-        } else if (cmd.type == "ACCESS") {
-            // ACCESS, <StreamID>, <VA>, [RW/RO]
-            if (cmd.args.size() < 2) {
-                std::cerr << "Error: ACCESS command requires StreamID and VA\n";
-                continue;
-            }
-            uint32_t stream_id = parse_hex_or_dec(cmd.args[0]);
-            uint64_t va = parse_hex_or_dec(cmd.args[1]);
-            bool is_write = false;
-            if (cmd.args.size() > 2 && cmd.args[2] == "W") {
-                is_write = true;
-            }
+// Read-only memory mapping of a binary trace file
+class MappedTrace {
+public:
+    MappedTrace() : data_(nullptr), size_(0) {}
+    ~MappedTrace() {
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+    }
 
-            uint32_t inferred_asid = 0;
-            if (stream_asid_map.find(stream_id) != stream_asid_map.end()) {
-                 inferred_asid = stream_asid_map[stream_id];
-            }
+    bool open(const std::string& filename, std::string& error) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "Could not open file " + filename;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(trace::TraceFileHeader))) {
+            ::close(fd);
+            error = "File too small for a binary trace header";
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            error = "mmap failed";
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(mapping);
+        madvise(mapping, size_, MADV_SEQUENTIAL);
+
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (!trace::is_binary_header(header_) || header_.version != trace::TRACE_VERSION ||
+            header_.record_size != sizeof(trace::TraceRecord)) {
+            error = "Unsupported binary trace header";
+            return false;
+        }
+        uint64_t available = (size_ - sizeof(header_)) / sizeof(trace::TraceRecord);
+        if (header_.record_count > available) {
+            error = "Binary trace is truncated";
+            return false;
+        }
+        return true;
+    }
 
-             auto result = smmu.translate(va, stream_id, inferred_asid, 0);
+    uint64_t record_count() const { return header_.record_count; }
 
-             std::cout << "[ACCESS] Stream " << stream_id << " (ASID " << inferred_asid << ") VA 0x" << std::hex << va;
-             if (result.success) {
-                 std::cout << " -> PA 0x" << result.physical_addr << " ✅";
-             } else {
-                 std::cout << " -> FAULT (" << result.fault_reason << ") ❌";
-             }
-             std::cout << std::dec << "\n";
-        }
+    const trace::TraceRecord* records() const {
+        return reinterpret_cast<const trace::TraceRecord*>(data_ + sizeof(trace::TraceFileHeader));
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    trace::TraceFileHeader header_;
+};
+
+// Replay summary plus the instrumentation snapshot as one JSON document
+void write_json_report(std::ostream& os, const TraceReplayer& replayer, double seconds) {
+    auto stats = replayer.statistics();
+    os << "{\"records\":" << replayer.records()
+       << ",\"accesses\":" << replayer.accesses()
+       << ",\"partitions\":" << replayer.partitions()
+       << ",\"threads\":" << replayer.threads()
+       << ",\"replay_seconds\":" << seconds
+       << ",\"statistics\":{\"total_translations\":" << stats.total_translations
+       << ",\"tlb_hits\":" << stats.tlb_hits
+       << ",\"tlb_misses\":" << stats.tlb_misses
+       << ",\"batch_reuses\":" << stats.batch_reuses
+       << ",\"page_table_walks\":" << stats.page_table_walks
+       << ",\"descriptor_reads\":" << stats.descriptor_reads
+       << ",\"translation_faults\":" << stats.translation_faults
+       << "},\"streams\":[";
+    bool first = true;
+    for (const auto& stream : replayer.streams()) {
+        os << (first ? "" : ",") << "{\"stream_id\":" << stream.stream_id
+           << ",\"asid\":" << stream.asid << ",\"accesses\":" << stream.accesses
+           << ",\"faults\":" << stream.faults << "}";
+        first = false;
+    }
+    os << "],\"instrumentation\":";
+    replayer.instrumentation().write_json(os);
+    os << "}\n";
+}
+
+// Write to the named file, or stdout for "-"
+bool write_output(const std::string& path, const std::function<void(std::ostream&)>& write) {
+    if (path == "-") {
+        write(std::cout);
+        return true;
+    }
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not write " << path << "\n";
+        return false;
     }
+    write(file);
+    return true;
+}
+
+// Binary traces start with TRACE_MAGIC; anything else is treated as CSV
+bool is_binary_trace(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    trace::TraceFileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    return trace::is_binary_header(header);
+}
+
+// Text summary: totals, then the busiest streams unless quiet
+void print_summary(const TraceReplayer& replayer, double seconds, bool quiet) {
+    constexpr size_t MAX_LISTED_STREAMS = 16;
 
-    // Print stats
-    auto stats = smmu.get_statistics();
+    auto stats = replayer.statistics();
     std::cout << "\nFinal Statistics:\n";
     std::cout << "  Hits: " << stats.tlb_hits << "\n";
     std::cout << "  Misses: " << stats.tlb_misses << "\n";
+    std::cout << "  Same-page reuses: " << stats.batch_reuses << "\n";
     std::cout << "  Faults: " << stats.translation_faults << "\n";
+    std::cout << "  Records: " << replayer.records() << " (" << replayer.accesses() << " accesses, "
+              << replayer.maps() << " maps)\n";
+    std::cout << "  Partitions: " << replayer.partitions() << " (" << replayer.threads()
+              << (replayer.threads() == 1 ? " thread)\n" : " threads)\n");
+    std::cout << "  Replay time: " << std::fixed << std::setprecision(3) << seconds << " s";
+    if (seconds > 0) {
+        std::cout << " (" << std::setprecision(2) << replayer.records() / seconds / 1e6 << " M records/s)";
+    }
+    std::cout << "\n";
+    if (quiet) return;
+
+    auto streams = replayer.streams();
+    std::stable_sort(streams.begin(), streams.end(), [](const auto& a, const auto& b) {
+        return a.accesses > b.accesses;
+    });
+    if (streams.empty()) return;
+    std::cout << "\nStreams (by accesses):\n";
+    for (size_t i = 0; i < streams.size() && i < MAX_LISTED_STREAMS; i++) {
+        const auto& stream = streams[i];
+        std::cout << "  Stream " << stream.stream_id << " (ASID " << stream.asid << "): "
+                  << stream.accesses << " accesses, " << stream.faults << " faults\n";
+    }
+    if (streams.size() > MAX_LISTED_STREAMS) {
+        std::cout << "  ... " << streams.size() - MAX_LISTED_STREAMS << " more streams\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool quiet = false;
+    size_t partitions = 0;
+    size_t threads = 0;
+    std::string trace_file;
+    std::string json_file;
+    std::string prometheus_file;
+    std::string log_file;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-q" || arg == "--quiet") {
+            quiet = true;
+        } else if ((arg == "--json" || arg == "--prometheus" || arg == "--log") && i + 1 < argc) {
+            (arg == "--json" ? json_file : arg == "--log" ? log_file : prometheus_file) = argv[++i];
+        } else if ((arg == "--partitions" || arg == "--threads") && i + 1 < argc) {
+            (arg == "--partitions" ? partitions : threads) = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            trace_file = arg;
+        }
+    }
+    if (trace_file.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-q|--quiet] [--partitions N] [--threads N]"
+                  << " [--log <file|->] [--json <file|->] [--prometheus <file|->]"
+                  << " <trace_file.csv|trace_file.bin>\n";
+        return 1;
+    }
+    // --threads alone also sets the partition count; --partitions alone uses up to one
+    // thread per partition
+    if (partitions == 0) partitions = threads > 0 ? threads : 1;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::ofstream log_stream;
+    std::unique_ptr<ReplayLog> log;
+    if (!log_file.empty()) {
+        if (log_file != "-") {
+            log_stream.open(log_file);
+            if (!log_stream.is_open()) {
+                std::cerr << "Error: Could not write " << log_file << "\n";
+                return 1;
+            }
+        }
+        log = std::make_unique<ReplayLog>(log_file == "-" ? std::cout : log_stream);
+    }
+
+    TraceReplayer replayer(partitions, threads, !json_file.empty() || !prometheus_file.empty(),
+                           log.get());
+    bool binary = is_binary_trace(trace_file);
+
+    std::cout << "Starting SMMU Trace Runner with " << trace_file
+              << (binary ? " (binary)" : " (csv)") << "\n";
+    std::cout << "================================================\n";
+
+    auto start = std::chrono::steady_clock::now();
+    if (binary) {
+        MappedTrace mapped;
+        std::string error;
+        if (!mapped.open(trace_file, error)) {
+            std::cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        const trace::TraceRecord* records = mapped.records();
+        for (uint64_t i = 0; i < mapped.record_count(); i++) {
+            replayer.handle(records[i]);
+        }
+    } else {
+        std::ifstream file(trace_file);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open file " << trace_file << "\n";
+            return 1;
+        }
+        trace::CsvTraceReader reader(file);
+        trace::TraceRecord record;
+        auto on_error = [](size_t line, const char* message) {
+            std::cerr << "Error: line " << line << ": " << message << "\n";
+        };
+        while (reader.next(record, on_error)) {
+            replayer.handle(record);
+        }
+    }
+    replayer.finish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    print_summary(replayer, seconds, quiet);
+
+    if (!json_file.empty() &&
+        !write_output(json_file, [&](std::ostream& os) { write_json_report(os, replayer, seconds); })) {
+        return 1;
+    }
+    if (!prometheus_file.empty() &&
+        !write_output(prometheus_file, [&](std::ostream& os) {
+            replayer.instrumentation().write_prometheus(os);
+        })) {
+        return 1;
+    }
 
     return 0;
 }